@@ -0,0 +1,446 @@
+/*
+ * Microbenchmarks for the doseright_core paths the firmware runs every
+ * second (clock label, minute of day) or on every sync (time parsing, list
+ * ingest, cache persistence, list rendering), on the linux port. The
+ * *_sscanf cases are the sscanf time parsers dr_time.c had before, as a
+ * baseline.
+ *
+ *   bench_core [--json] [--filter <substring>] [--min-ms <ms>]
+ *
+ * Each case runs in batches until --min-ms (default 200) have passed and
+ * reports ns/op, heap allocations per op and the peak heap one op reached.
+ * Allocations are counted with the linker's --wrap on malloc and friends,
+ * so only calls made from DoseRight code are seen (not libc internals such
+ * as stdio buffers). --json prints one JSON object per line.
+ */
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dr_time.h"
+#include "med_cache.h"
+#include "med_json.h"
+
+#define BENCH_CHUNK 512
+#define BENCH_BATCH 64
+
+/* Heap accounting */
+
+typedef struct {
+    size_t allocs;
+    long long current;
+    long long peak;
+} heap_stats_t;
+
+static heap_stats_t heap;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_add(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    heap.allocs++;
+    heap.current += (long long)malloc_usable_size(ptr);
+    if (heap.current > heap.peak) {
+        heap.peak = heap.current;
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *ptr = __real_calloc(n, size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (ptr) {
+        heap.current -= (long long)malloc_usable_size(ptr);
+    }
+    void *out = __real_realloc(ptr, size);
+    heap_add(out ? out : ptr);
+    return out;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr) {
+        heap.current -= (long long)malloc_usable_size(ptr);
+    }
+    __real_free(ptr);
+}
+
+/* Harness */
+
+typedef void (*bench_fn_t)(void *ctx);
+
+typedef struct {
+    bool json;
+    const char *filter;
+    double min_ms;
+} bench_opts_t;
+
+static bench_opts_t opts = {.min_ms = 200};
+static volatile int bench_sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_run(const char *name, const char *variant, bench_fn_t fn, void *ctx)
+{
+    char full[96];
+    snprintf(full, sizeof(full), "%s/%s", name, variant);
+    if (opts.filter && !strstr(full, opts.filter)) {
+        return;
+    }
+
+    /* One op on its own for the heap figures, then timed batches */
+    memset(&heap, 0, sizeof(heap));
+    fn(ctx);
+    long long peak = heap.peak;
+
+    size_t before = heap.allocs;
+    long long ops = 0;
+    double start = now_ns();
+    double elapsed = 0;
+    do {
+        for (int i = 0; i < BENCH_BATCH; ++i) {
+            fn(ctx);
+        }
+        ops += BENCH_BATCH;
+        elapsed = now_ns() - start;
+    } while (elapsed < opts.min_ms * 1e6);
+    double allocs = (double)(heap.allocs - before) / (double)ops;
+
+    if (opts.json) {
+        printf("{\"bench\":\"%s\",\"variant\":\"%s\",\"ops\":%lld,\"ns_per_op\":%.1f,"
+               "\"allocs_per_op\":%.2f,\"peak_heap_bytes\":%lld}\n",
+               name, variant, ops, elapsed / (double)ops, allocs, peak);
+    } else {
+        printf("%-18s %-14s %10lld %12.1f %10.2f %12lld\n",
+               name, variant, ops, elapsed / (double)ops, allocs, peak);
+    }
+    fflush(stdout);
+}
+
+/* Clock */
+
+static dr_rtc_t bench_rtc;
+static int64_t bench_clock_now_ms;
+static int64_t bench_clock_raw_ms;
+
+static void bench_clock_text(void *ctx)
+{
+    (void)ctx;
+    /* update_clock_text() without the LVGL label */
+    char buf[16];
+    int minute = 0;
+    bench_clock_now_ms += 1000;
+    bench_clock_raw_ms += 1000;
+    if (dr_rtc_local_minute(dr_rtc_now_ms(&bench_rtc, bench_clock_raw_ms), bench_clock_now_ms, &minute, NULL)) {
+        dr_time_minutes_12h(minute, buf, sizeof(buf));
+        bench_sink += buf[0];
+    }
+}
+
+static void bench_local_minute(void *ctx)
+{
+    (void)ctx;
+    int minute = 0;
+    int64_t start_ms = 0;
+    bench_clock_now_ms += 1000;
+    bench_clock_raw_ms += 1000;
+    dr_rtc_local_minute(dr_rtc_now_ms(&bench_rtc, bench_clock_raw_ms), bench_clock_now_ms, &minute, &start_ms);
+    bench_sink += minute;
+}
+
+/* Time strings */
+
+static void bench_time_to_minutes(void *ctx)
+{
+    bench_sink += dr_time_to_minutes((const char *)ctx);
+}
+
+static void bench_format_12h(void *ctx)
+{
+    char buf[16];
+    dr_time_format_12h((const char *)ctx, buf, sizeof(buf));
+    bench_sink += buf[0];
+}
+
+/* The sscanf parsers dr_time.c used before, kept as the baseline */
+
+static int sscanf_from_12h(int hour, int minute, const char *ampm)
+{
+    if (minute < 0 || minute > 59 || hour < 1 || hour > 12) {
+        return -1;
+    }
+    int hour24 = hour % 12;
+    if (ampm[0] == 'P' || ampm[0] == 'p') {
+        hour24 += 12;
+    }
+    return hour24 * 60 + minute;
+}
+
+static int sscanf_to_minutes(const char *src)
+{
+    if (!src || src[0] == '\0') {
+        return -1;
+    }
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    char ampm[3] = {0};
+    if (sscanf(src, "%d:%d:%d %2s", &hour, &minute, &second, ampm) == 4) {
+        return sscanf_from_12h(hour, minute, ampm);
+    }
+    if (sscanf(src, "%d:%d %2s", &hour, &minute, ampm) == 3) {
+        return sscanf_from_12h(hour, minute, ampm);
+    }
+    if (sscanf(src, "%d:%d:%d", &hour, &minute, &second) == 3 ||
+        sscanf(src, "%d:%d", &hour, &minute) == 2) {
+        if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+            return -1;
+        }
+        return hour * 60 + minute;
+    }
+    return -1;
+}
+
+static void bench_time_to_minutes_sscanf(void *ctx)
+{
+    bench_sink += sscanf_to_minutes((const char *)ctx);
+}
+
+static void bench_format_12h_sscanf(void *ctx)
+{
+    char buf[16];
+    int hour = -1;
+    int minute = -1;
+    int second = 0;
+    const char *src = ctx;
+    if ((sscanf(src, "%d:%d:%d", &hour, &minute, &second) == 3 ||
+         sscanf(src, "%d:%d", &hour, &minute) == 2) &&
+        hour >= 0 && hour <= 23 && minute >= 0 && minute <= 59) {
+        dr_time_minutes_12h(hour * 60 + minute, buf, sizeof(buf));
+    } else {
+        snprintf(buf, sizeof(buf), "%s", src);
+    }
+    bench_sink += buf[0];
+}
+
+/* dose_schedule_reload(): minute of day for every cached dose */
+
+static void bench_schedule_minutes(void *ctx)
+{
+    const med_cache_t *cache = ctx;
+    for (size_t i = 0; i < cache->count; ++i) {
+        bench_sink += cache->items[i].minute;
+    }
+}
+
+static void bench_schedule_minutes_sscanf(void *ctx)
+{
+    const med_cache_t *cache = ctx;
+    for (size_t i = 0; i < cache->count; ++i) {
+        bench_sink += sscanf_to_minutes(cache->items[i].time_str);
+    }
+}
+
+/* Med lists */
+
+typedef struct {
+    char *payload;
+    size_t len;
+    med_cache_t cache;
+} ingest_ctx_t;
+
+static const char *const bench_names[] = {
+    "Metformin", "Lisinopril", "Atorvastatin", "Levothyroxine", "Amlodipine",
+    "Omeprazole", "Metoprolol Succinate ER", "Gabapentin", "Sertraline", "Vitamin D3",
+};
+
+static char *make_payload(int items, size_t *out_len)
+{
+    size_t cap = 64 + (size_t)items * 256;
+    char *buf = (char *)malloc(cap);
+    size_t len = (size_t)snprintf(buf, cap, "{\"success\":true,\"data\":[");
+    for (int i = 0; i < items; ++i) {
+        len += (size_t)snprintf(buf + len, cap - len,
+                                "%s{\"doseId\":\"65f1c0de%016x\",\"medicineName\":\"%s\","
+                                "\"dosage\":\"%d mg x 1\",\"scheduledTime\":\"%02d:%02d\","
+                                "\"status\":\"pending\",\"slot\":%d}",
+                                i ? "," : "", i, bench_names[i % 10], 250 + i % 4 * 250,
+                                (7 + i * 3) % 24, (i % 4) * 15, i % 5 + 1);
+    }
+    len += (size_t)snprintf(buf + len, cap - len, "]}");
+    *out_len = len;
+    return buf;
+}
+
+static void bench_ingest(void *ctx)
+{
+    ingest_ctx_t *in = ctx;
+    static med_json_ingest_t ing;
+    med_json_begin(&ing, &in->cache);
+    for (size_t off = 0; off < in->len; off += BENCH_CHUNK) {
+        size_t n = in->len - off < BENCH_CHUNK ? in->len - off : BENCH_CHUNK;
+        med_json_feed(&ing, in->payload + off, n);
+    }
+    bench_sink += med_json_end(&ing);
+}
+
+static void bench_cache_save(void *ctx)
+{
+    bench_sink += med_cache_save("bench_cache", (const med_cache_t *)ctx);
+}
+
+/* Flips the "Last update" text so every save has to write */
+static void bench_cache_save_changed(void *ctx)
+{
+    med_cache_t *cache = ctx;
+    cache->updated[4] = cache->updated[4] == '1' ? '2' : '1';
+    bench_sink += med_cache_save("bench_cache", cache);
+}
+
+static void bench_cache_load(void *ctx)
+{
+    (void)ctx;
+    static med_cache_t cache;
+    bench_sink += med_cache_load("bench_cache", &cache);
+}
+
+static void bench_render_line(const char *line, void *ctx)
+{
+    /* lv_list_add_text copies the text */
+    char *dst = ctx;
+    snprintf(dst, 128, "%s", line);
+}
+
+static void bench_render(void *ctx)
+{
+    char line[128];
+    med_cache_render((const med_cache_t *)ctx, false, bench_render_line, line);
+    bench_sink += line[0];
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--json] [--filter <substring>] [--min-ms <ms>]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            opts.json = true;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            opts.min_ms = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    /* Cache writes go to a scratch directory unless the caller chose one */
+    char storage[] = "/tmp/bench_core_XXXXXX";
+    bool own_storage = !getenv("DOSERIGHT_STORAGE_DIR");
+    if (own_storage) {
+        if (!mkdtemp(storage)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        setenv("DOSERIGHT_STORAGE_DIR", storage, 1);
+    }
+
+    if (!opts.json) {
+        printf("%-18s %-14s %10s %12s %10s %12s\n",
+               "bench", "variant", "ops", "ns/op", "allocs/op", "peak heap B");
+    }
+
+    /* Synced once, with drift learned, in a zone with DST rules */
+    setenv("TZ", "EST5EDT,M3.2.0/2,M11.1.0/2", 1);
+    tzset();
+    dr_rtc_init(&bench_rtc);
+    bench_rtc.set_epoch_ms = 1760000000000LL;
+    bench_rtc.drift_ppb = 12000;
+    bench_clock_now_ms = 1000;
+    bench_clock_raw_ms = bench_rtc.set_epoch_ms;
+    bench_run("clock_text", "synced", bench_clock_text, NULL);
+    bench_run("local_minute", "synced", bench_local_minute, NULL);
+
+    static const struct {
+        const char *variant;
+        const char *src;
+    } times[] = {
+        {"hh:mm_ampm", "8:30 PM"},
+        {"hh:mm:ss_ampm", "08:30:00 AM"},
+        {"hh:mm", "20:30"},
+        {"hh:mm:ss", "20:30:00"},
+        {"invalid", "--:--"},
+    };
+    for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); ++i) {
+        bench_run("time_to_minutes", times[i].variant, bench_time_to_minutes, (void *)times[i].src);
+        bench_run("time_to_min_sscanf", times[i].variant, bench_time_to_minutes_sscanf,
+                  (void *)times[i].src);
+    }
+    bench_run("format_12h", "hh:mm", bench_format_12h, "20:30");
+    bench_run("format_12h", "hh:mm:ss", bench_format_12h, "20:30:00");
+    bench_run("format_12h_sscanf", "hh:mm", bench_format_12h_sscanf, "20:30");
+    bench_run("format_12h_sscanf", "hh:mm:ss", bench_format_12h_sscanf, "20:30:00");
+
+    static ingest_ctx_t ingest[2];
+    const int ingest_items[] = {MED_CACHE_MAX, 100};
+    for (size_t i = 0; i < 2; ++i) {
+        char variant[16];
+        snprintf(variant, sizeof(variant), "%d_items", ingest_items[i]);
+        ingest[i].payload = make_payload(ingest_items[i], &ingest[i].len);
+        bench_run("json_ingest", variant, bench_ingest, &ingest[i]);
+    }
+
+    /* The cache benches use the 10-item ingest result, also when it was filtered out */
+    bench_ingest(&ingest[0]);
+    med_cache_t *full = &ingest[0].cache;
+    full->valid = true;
+    snprintf(full->updated, sizeof(full->updated), "08:41 AM");
+    bench_run("med_cache_save", "10_unchanged", bench_cache_save, full);
+    bench_run("med_cache_save", "10_changed", bench_cache_save_changed, full);
+    bench_run("med_cache_load", "10_items", bench_cache_load, NULL);
+    bench_run("render_med_cache", "10_items", bench_render, full);
+    bench_run("schedule_minutes", "10_items", bench_schedule_minutes, full);
+    bench_run("schedule_min_sscanf", "10_items", bench_schedule_minutes_sscanf, full);
+
+    for (size_t i = 0; i < 2; ++i) {
+        free(ingest[i].payload);
+    }
+    if (own_storage) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s/bench_cache", storage);
+        unlink(path);
+        rmdir(storage);
+    }
+    return 0;
+}
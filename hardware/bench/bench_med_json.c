@@ -0,0 +1,306 @@
+/*
+ * Compares the streaming med list ingestion (json_stream + med_json) with the
+ * previous path: buffer the whole body in a doubling heap buffer, cJSON_Parse
+ * it and copy fields out of the DOM. Payloads mimic /api/hardware/upcoming
+ * with 10, 100 and 1000 items and are fed in 512-byte chunks, the size
+ * backend_conn reads from the socket.
+ *
+ * "wire" decodes the same items in the binary med list format (med_wire)
+ * that the backend sends for "Accept: application/vnd.doseright.medlist";
+ * the bytes column compares the two on the wire.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "med_json.h"
+#include "med_wire.h"
+
+#ifdef BENCH_HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#define BENCH_CHUNK 512
+#define BENCH_INITIAL_BUFFER 2048
+
+typedef struct {
+    size_t current;
+    size_t peak;
+    size_t allocs;
+} heap_stats_t;
+
+static heap_stats_t heap;
+
+static void heap_reset(void)
+{
+    memset(&heap, 0, sizeof(heap));
+}
+
+#ifdef BENCH_HAVE_CJSON
+/* Size-prefixed allocator so frees can be accounted. */
+static void *counting_malloc(size_t size)
+{
+    size_t *p = (size_t *)malloc(size + sizeof(size_t));
+    if (!p) {
+        return NULL;
+    }
+    *p = size;
+    heap.allocs++;
+    heap.current += size;
+    if (heap.current > heap.peak) {
+        heap.peak = heap.current;
+    }
+    return p + 1;
+}
+
+static void counting_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    size_t *p = (size_t *)ptr - 1;
+    heap.current -= *p;
+    free(p);
+}
+
+static void *counting_realloc(void *ptr, size_t size)
+{
+    void *out = counting_malloc(size);
+    if (out && ptr) {
+        size_t old = *((size_t *)ptr - 1);
+        memcpy(out, ptr, old < size ? old : size);
+        counting_free(ptr);
+    }
+    return out;
+}
+#endif
+
+static char *make_payload(int items, size_t *out_len)
+{
+    size_t cap = 64 + (size_t)items * 256;
+    char *buf = (char *)malloc(cap);
+    size_t len = (size_t)snprintf(buf, cap, "{\"success\":true,\"data\":[");
+    for (int i = 0; i < items; ++i) {
+        len += (size_t)snprintf(buf + len, cap - len,
+                                "%s{\"doseId\":\"65f1c0de%016x\",\"medicineName\":\"Medication %d\","
+                                "\"dosage\":\"%d mg x 1\",\"scheduledTime\":\"%02d:%02d\","
+                                "\"status\":\"pending\",\"slot\":%d}",
+                                i ? "," : "", i, i, 250 + i % 4 * 250, (i / 4) % 24, (i % 4) * 15, i % 5 + 1);
+    }
+    len += (size_t)snprintf(buf + len, cap - len, "]}");
+    *out_len = len;
+    return buf;
+}
+
+typedef struct {
+    char text[256][48];
+    int count;
+} wire_strings_t;
+
+static int wire_intern(wire_strings_t *t, const char *text)
+{
+    for (int i = 0; i < t->count; ++i) {
+        if (strcmp(t->text[i], text) == 0) {
+            return i;
+        }
+    }
+    if (t->count == 256) {
+        return -1;
+    }
+    snprintf(t->text[t->count], sizeof(t->text[0]), "%s", text);
+    return t->count++;
+}
+
+/* make_payload()'s items as utils/medListWire.ts encodes them; NULL past 255 strings */
+static char *make_wire_payload(int items, size_t *out_len)
+{
+    static wire_strings_t strings;
+    strings.count = 0;
+    uint8_t *records = (uint8_t *)malloc((size_t)items * 19);
+    size_t rec_len = 0;
+    for (int i = 0; i < items; ++i) {
+        char name[48], dosage[32];
+        snprintf(name, sizeof(name), "Medication %d", i);
+        snprintf(dosage, sizeof(dosage), "%d mg x 1", 250 + i % 4 * 250);
+        int refs[3] = {wire_intern(&strings, name), wire_intern(&strings, dosage),
+                       wire_intern(&strings, "pending")};
+        if (refs[0] < 0 || refs[1] < 0 || refs[2] < 0 || strings.count > 255) {
+            free(records);
+            return NULL;
+        }
+        uint8_t *r = records + rec_len;
+        r[0] = 0x01;
+        static const uint8_t prefix[4] = {0x65, 0xf1, 0xc0, 0xde};
+        memcpy(r + 1, prefix, 4);
+        for (int b = 0; b < 8; ++b) {
+            r[5 + b] = (uint8_t)((uint64_t)(unsigned)i >> (8 * (7 - b)));
+        }
+        unsigned minute = (unsigned)((i / 4) % 24 * 60 + (i % 4) * 15);
+        r[13] = (uint8_t)minute;
+        r[14] = (uint8_t)(minute >> 8);
+        r[15] = (uint8_t)refs[0];
+        r[16] = (uint8_t)refs[1];
+        r[17] = (uint8_t)refs[2];
+        r[18] = (uint8_t)(i % 5 + 1);
+        rec_len += 19;
+    }
+
+    uint8_t *buf = (uint8_t *)malloc(7 + (size_t)strings.count * 49 + rec_len);
+    size_t len = 0;
+    const uint8_t header[7] = {'D', 'R', 'M', 1, (uint8_t)items, (uint8_t)(items >> 8),
+                               (uint8_t)strings.count};
+    memcpy(buf, header, sizeof(header));
+    len += sizeof(header);
+    for (int i = 0; i < strings.count; ++i) {
+        size_t n = strlen(strings.text[i]);
+        buf[len++] = (uint8_t)n;
+        memcpy(buf + len, strings.text[i], n);
+        len += n;
+    }
+    memcpy(buf + len, records, rec_len);
+    len += rec_len;
+    free(records);
+    *out_len = len;
+    return (char *)buf;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool run_stream(const char *payload, size_t len, med_cache_t *out)
+{
+    static med_json_ingest_t ing;
+    med_json_begin(&ing, out);
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+        size_t n = len - off < BENCH_CHUNK ? len - off : BENCH_CHUNK;
+        if (!med_json_feed(&ing, payload + off, n)) {
+            return false;
+        }
+    }
+    return med_json_end(&ing) && ing.saw_data;
+}
+
+static bool run_wire(const char *payload, size_t len, med_cache_t *out)
+{
+    static med_wire_ingest_t ing;
+    med_wire_begin(&ing, out);
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+        size_t n = len - off < BENCH_CHUNK ? len - off : BENCH_CHUNK;
+        if (!med_wire_feed(&ing, payload + off, n)) {
+            return false;
+        }
+    }
+    return med_wire_end(&ing);
+}
+
+#ifdef BENCH_HAVE_CJSON
+static void copy_str(char *dst, size_t dst_size, const cJSON *item, const char *key)
+{
+    const char *v = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, key));
+    snprintf(dst, dst_size, "%s", v ? v : "");
+}
+
+static bool run_cjson(const char *payload, size_t len, med_cache_t *out)
+{
+    size_t cap = BENCH_INITIAL_BUFFER;
+    size_t total = 0;
+    char *buf = (char *)counting_malloc(cap);
+    for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+        size_t n = len - off < BENCH_CHUNK ? len - off : BENCH_CHUNK;
+        while (total + n + 1 > cap) {
+            cap *= 2;
+            buf = (char *)counting_realloc(buf, cap);
+        }
+        memcpy(buf + total, payload + off, n);
+        total += n;
+    }
+    buf[total] = '\0';
+
+    cJSON *root = cJSON_Parse(buf);
+    counting_free(buf);
+    if (!root) {
+        return false;
+    }
+    memset(out, 0, sizeof(*out));
+    cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
+    int count = cJSON_GetArraySize(data);
+    if (count > MED_CACHE_MAX) {
+        count = MED_CACHE_MAX;
+    }
+    for (int i = 0; i < count; ++i) {
+        cJSON *item = cJSON_GetArrayItem(data, i);
+        med_cache_item_t *dst = &out->items[i];
+        copy_str(dst->name, sizeof(dst->name), item, "medicineName");
+        copy_str(dst->dose, sizeof(dst->dose), item, "dosage");
+        copy_str(dst->time_str, sizeof(dst->time_str), item, "scheduledTime");
+        copy_str(dst->status, sizeof(dst->status), item, "status");
+        copy_str(dst->dose_id, sizeof(dst->dose_id), item, "doseId");
+        cJSON *slot = cJSON_GetObjectItemCaseSensitive(item, "slot");
+        dst->slot = cJSON_IsNumber(slot) ? slot->valueint : 0;
+        out->count++;
+    }
+    cJSON_Delete(root);
+    return true;
+}
+#endif
+
+typedef bool (*bench_fn_t)(const char *payload, size_t len, med_cache_t *out);
+
+static void bench(const char *name, bench_fn_t fn, int items, const char *payload, size_t len)
+{
+    static med_cache_t out;
+    int iterations = items >= 1000 ? 200 : items >= 100 ? 2000 : 20000;
+
+    heap_reset();
+    if (!fn(payload, len, &out) || out.count == 0) {
+        printf("%-8s %6d  FAILED\n", name, items);
+        return;
+    }
+    heap_stats_t one = heap;
+
+    double start = now_us();
+    for (int i = 0; i < iterations; ++i) {
+        fn(payload, len, &out);
+    }
+    double per_parse = (now_us() - start) / iterations;
+
+    printf("%-8s %6d %9zu %10.2f %12zu %8zu\n", name, items, len, per_parse, one.peak, one.allocs);
+}
+
+int main(void)
+{
+#ifdef BENCH_HAVE_CJSON
+    cJSON_Hooks hooks = {.malloc_fn = counting_malloc, .free_fn = counting_free};
+    cJSON_InitHooks(&hooks);
+#endif
+
+    printf("streaming footprint: %zu bytes state + %zu bytes cache + %d bytes read chunk, 0 heap allocations\n",
+           sizeof(med_json_ingest_t), sizeof(med_cache_t), BENCH_CHUNK);
+    printf("wire footprint: %zu bytes state, 0 heap allocations\n\n", sizeof(med_wire_ingest_t));
+    printf("%-8s %6s %9s %10s %12s %8s\n", "path", "items", "bytes", "us/parse", "peak heap B", "allocs");
+
+    const int sizes[] = {10, 100, 1000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t len = 0;
+        char *payload = make_payload(sizes[i], &len);
+        bench("stream", run_stream, sizes[i], payload, len);
+#ifdef BENCH_HAVE_CJSON
+        bench("cjson", run_cjson, sizes[i], payload, len);
+#endif
+        free(payload);
+        payload = make_wire_payload(sizes[i], &len);
+        if (payload) {
+            bench("wire", run_wire, sizes[i], payload, len);
+            free(payload);
+        } else {
+            printf("%-8s %6d  n/a: more than 255 strings, the server sends JSON\n", "wire", sizes[i]);
+        }
+    }
+    return 0;
+}
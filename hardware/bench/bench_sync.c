@@ -0,0 +1,209 @@
+/*
+ * Sync-cycle latency through doseright_core on the linux port, against a
+ * backend such as tools/mock_backend.
+ *
+ *   bench_sync [--url http://127.0.0.1:3900] [--secret mock-secret]
+ *              [--device mock-1] [--cycles 100] [--interval-ms 0] [--json]
+ *
+ * Each cycle is what backend_sync() does on the device: POST
+ * /api/hardware/sync with the ETags from the last good cycle, stream the
+ * body into device_sync, and keep the new ETags. A cycle is "ok", "http"
+ * (non-200), "transport" (no or cut-off response) or "parse". Latency is
+ * measured for every cycle, failed ones included.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device_sync.h"
+#include "dr_hal.h"
+#include "dr_hal_linux.h"
+
+#define BENCH_SYNC_PATH "/api/hardware/sync"
+#define BENCH_SYNC_BODY_MAX 1024
+
+typedef enum {
+    CYCLE_OK,
+    CYCLE_HTTP,
+    CYCLE_TRANSPORT,
+    CYCLE_PARSE,
+    CYCLE_OUTCOMES,
+} cycle_outcome_t;
+
+static const char *const outcome_names[CYCLE_OUTCOMES] = {"ok", "http", "transport", "parse"};
+static const char *const list_names[DEVICE_SYNC_LIST_COUNT] = {"upcoming", "taken", "missed"};
+
+static char etags[DEVICE_SYNC_LIST_COUNT][64];
+static char profile_etag[64];
+static device_sync_parser_t parser;
+static device_sync_result_t result;
+
+static bool sync_on_body(const char *data, size_t len, void *ctx)
+{
+    return device_sync_feed((device_sync_parser_t *)ctx, data, len);
+}
+
+static void build_body(const char *device_id, char *body, size_t size)
+{
+    int len = snprintf(body, size, "{\"deviceId\":\"%s\",\"heartbeat\":{\"batteryLevel\":87,"
+                       "\"wifiConnected\":true,\"firmwareVersion\":\"bench\"},\"etags\":{",
+                       device_id);
+    const char *sep = "";
+    for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+        if (etags[i][0]) {
+            len += snprintf(body + len, size - (size_t)len, "%s\"%s\":\"%s\"", sep, list_names[i],
+                            etags[i]);
+            sep = ",";
+        }
+    }
+    if (profile_etag[0]) {
+        len += snprintf(body + len, size - (size_t)len, "%s\"profile\":\"%s\"", sep, profile_etag);
+    }
+    snprintf(body + len, size - (size_t)len, "}}");
+}
+
+/* JSON strings: ETags are quoted, so escape the quotes */
+static void copy_etag(char *dst, size_t size, const char *etag)
+{
+    size_t n = 0;
+    for (; *etag && n + 2 < size; ++etag) {
+        if (*etag == '"' || *etag == '\\') {
+            dst[n++] = '\\';
+        }
+        dst[n++] = *etag;
+    }
+    dst[n] = '\0';
+}
+
+static cycle_outcome_t run_cycle(const char *device_id, int *status, int updated[DEVICE_SYNC_LIST_COUNT])
+{
+    char body[BENCH_SYNC_BODY_MAX];
+    build_body(device_id, body, sizeof(body));
+    device_sync_begin(&parser, &result);
+    const dr_hal_http_request_t req = {
+        .post = true,
+        .path = BENCH_SYNC_PATH,
+        .body = body,
+        .on_body = sync_on_body,
+        .ctx = &parser,
+    };
+    *status = dr_hal_http_perform(&req, NULL, 0);
+    cycle_outcome_t outcome = CYCLE_OK;
+    if (*status < 0) {
+        outcome = CYCLE_TRANSPORT;
+    } else if (*status != 200) {
+        outcome = CYCLE_HTTP;
+    } else if (!device_sync_end(&parser)) {
+        outcome = CYCLE_PARSE;
+    }
+    if (outcome == CYCLE_OK) {
+        for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+            device_sync_list_result_t *list = &result.lists[i];
+            if (list->state == DEVICE_SYNC_UPDATED) {
+                copy_etag(etags[i], sizeof(etags[i]), list->cache.etag);
+                updated[i]++;
+            }
+        }
+        if (result.profile_state == DEVICE_SYNC_UPDATED) {
+            copy_etag(profile_etag, sizeof(profile_etag), result.profile_etag);
+        }
+    }
+    device_sync_result_free(&result);
+    return outcome;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, int n, double p)
+{
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+int main(int argc, char **argv)
+{
+    const char *url = "http://127.0.0.1:3900";
+    const char *secret = "mock-secret";
+    const char *device_id = "mock-1";
+    int cycles = 100;
+    int interval_ms = 0;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--url") == 0 && has_value) {
+            url = argv[++i];
+        } else if (strcmp(argv[i], "--secret") == 0 && has_value) {
+            secret = argv[++i];
+        } else if (strcmp(argv[i], "--device") == 0 && has_value) {
+            device_id = argv[++i];
+        } else if (strcmp(argv[i], "--cycles") == 0 && has_value) {
+            cycles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--interval-ms") == 0 && has_value) {
+            interval_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            fprintf(stderr, "usage: %s [--url U] [--secret S] [--device ID] [--cycles N] "
+                    "[--interval-ms MS] [--json]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (cycles <= 0) {
+        return 2;
+    }
+    dr_hal_linux_set_backend(url, secret);
+
+    double *latency = calloc((size_t)cycles, sizeof(double));
+    int outcomes[CYCLE_OUTCOMES] = {0};
+    int updated[DEVICE_SYNC_LIST_COUNT] = {0};
+    for (int c = 0; c < cycles; ++c) {
+        int status = 0;
+        int64_t start = dr_hal_now_us();
+        cycle_outcome_t outcome = run_cycle(device_id, &status, updated);
+        latency[c] = (double)(dr_hal_now_us() - start) / 1000.0;
+        outcomes[outcome]++;
+        if (!json) {
+            printf("cycle %4d  %-9s status %4d  %9.1f ms\n", c, outcome_names[outcome], status,
+                   latency[c]);
+        }
+        if (interval_ms > 0) {
+            struct timespec ts = {interval_ms / 1000, (long)(interval_ms % 1000) * 1000000};
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    double total = 0;
+    for (int c = 0; c < cycles; ++c) {
+        total += latency[c];
+    }
+    qsort(latency, (size_t)cycles, sizeof(double), cmp_double);
+    double p50 = percentile(latency, cycles, 0.50);
+    double p90 = percentile(latency, cycles, 0.90);
+    double p99 = percentile(latency, cycles, 0.99);
+    double max = latency[cycles - 1];
+
+    if (json) {
+        printf("{\"cycles\":%d,\"ok\":%d,\"http\":%d,\"transport\":%d,\"parse\":%d,"
+               "\"mean_ms\":%.1f,\"p50_ms\":%.1f,\"p90_ms\":%.1f,\"p99_ms\":%.1f,\"max_ms\":%.1f,"
+               "\"updated\":{\"upcoming\":%d,\"taken\":%d,\"missed\":%d}}\n",
+               cycles, outcomes[CYCLE_OK], outcomes[CYCLE_HTTP], outcomes[CYCLE_TRANSPORT],
+               outcomes[CYCLE_PARSE], total / cycles, p50, p90, p99, max,
+               updated[DEVICE_SYNC_UPCOMING], updated[DEVICE_SYNC_TAKEN], updated[DEVICE_SYNC_MISSED]);
+    } else {
+        printf("\n%d cycles: ok %d, http %d, transport %d, parse %d\n", cycles, outcomes[CYCLE_OK],
+               outcomes[CYCLE_HTTP], outcomes[CYCLE_TRANSPORT], outcomes[CYCLE_PARSE]);
+        printf("latency ms: mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+               total / cycles, p50, p90, p99, max);
+        printf("lists updated: upcoming %d, taken %d, missed %d\n", updated[DEVICE_SYNC_UPCOMING],
+               updated[DEVICE_SYNC_TAKEN], updated[DEVICE_SYNC_MISSED]);
+    }
+    free(latency);
+    return 0;
+}
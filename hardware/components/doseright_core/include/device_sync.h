@@ -0,0 +1,94 @@
+#ifndef DEVICE_SYNC_H
+#define DEVICE_SYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dr_time.h"
+#include "json_stream.h"
+#include "med_cache.h"
+#include "med_json.h"
+#include "med_plan.h"
+
+/*
+ * Streaming parser for the POST /api/hardware/sync response:
+ *
+ *   {"time":{...}, "upcoming":{"etag":..,"data":[..]}, "taken":{..},
+ *    "missed":{..}, "plans":{"etag":..,"data":[..]}, "profile":{"etag":..,"body":{..}}}
+ *
+ * Any list, plans or profile section may instead be {"etag":..,"notModified":true}.
+ * Lists are decoded into the med caches of the result, plans into its plan set. The profile body is
+ * copied verbatim, so profile_screen can keep it as its cached JSON.
+ */
+
+#define DEVICE_SYNC_PROFILE_MAX 8192
+
+typedef enum {
+    DEVICE_SYNC_ABSENT,
+    DEVICE_SYNC_NOT_MODIFIED,
+    DEVICE_SYNC_UPDATED,
+} device_sync_state_t;
+
+typedef enum {
+    DEVICE_SYNC_UPCOMING,
+    DEVICE_SYNC_TAKEN,
+    DEVICE_SYNC_MISSED,
+    DEVICE_SYNC_LIST_COUNT,
+} device_sync_list_t;
+
+typedef struct {
+    device_sync_state_t state;
+    med_cache_t cache;              /* items and etag when UPDATED */
+    size_t items_seen;
+} device_sync_list_result_t;
+
+typedef struct {
+    bool have_time;
+    char local_time12[16];
+    char local_time24[8];
+    int64_t epoch_ms;
+    int64_t processing_ms;
+    char posix_tz[DR_RTC_TZ_MAX];
+    int64_t time_recv_ms;           /* dr_hal_now_us() / 1000 when the time section ended */
+
+    device_sync_list_result_t lists[DEVICE_SYNC_LIST_COUNT];
+
+    device_sync_state_t plans_state;
+    med_plan_set_t plans;           /* plans and etag when UPDATED */
+    size_t plans_seen;
+
+    device_sync_state_t profile_state;
+    char profile_etag[64];
+    char *profile_json;             /* malloc'd, NUL-terminated when UPDATED */
+    size_t profile_len;
+} device_sync_result_t;
+
+typedef struct {
+    json_stream_t stream;
+    device_sync_result_t *out;
+    int section;
+    char key[16];
+    bool not_modified;
+    med_json_ingest_t list;
+    med_plan_ingest_t plans;
+    size_t profile_cap;
+    size_t capture_from;
+    size_t capture_to;
+    bool overflow;
+} device_sync_parser_t;
+
+void device_sync_begin(device_sync_parser_t *p, device_sync_result_t *out);
+bool device_sync_feed(device_sync_parser_t *p, const char *data, size_t len);
+bool device_sync_end(device_sync_parser_t *p);
+void device_sync_result_free(device_sync_result_t *result);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef DISPENSE_H
+#define DISPENSE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dispense_plan.h"
+
+/*
+ * Dispense state machine.
+ *
+ *   IDLE -> POSITIONING -> OPENING -> AWAITING_DROP -> CLOSING -> REPORTING -> IDLE
+ *
+ * A dose session starts with dispense_add_dose() at the alert. Doses that
+ * come due while the session runs are added to it. Each distinct slot is
+ * one stop. The carousel turns to the nearest stop first, and the lid opens
+ * once pick has been pressed and the carousel is within half a slot of the
+ * stop (dispense_approaching(), sent while it decelerates) or there. The
+ * alert sound stops and the pill detector is armed as the lid starts to
+ * move. The stop is served once both the lid and the carousel are in place.
+ * The first pill starts a DISPENSE_SETTLE_MS countdown, so later pills are
+ * still counted. If no pill drops within DISPENSE_DROP_TIMEOUT_MS the stop
+ * ends anyway.
+ *
+ * After each stop the remaining stops are planned again with
+ * dispense_plan_order(), and the carousel moves to the first of them the
+ * shorter way round. The lid stays open for that move when every slot it
+ * passes over was already emptied in this session. Otherwise it closes,
+ * the carousel moves, and the lid reopens. After the last stop the lid
+ * closes, and every dose whose stop saw a pill is reported. A refill is a
+ * one-stop session that opens without a pick and reports nothing.
+ *
+ * The hardware is driven through dispense_ops_t. The ops report back by
+ * calling the dispense_*() event functions. The module does no locking:
+ * callers serialize every event function (this firmware holds the LVGL
+ * lock), and the ops run inside them. Events that do not apply to the
+ * current state are ignored.
+ *
+ * Every transition is timestamped. Latencies are kept as histograms: alert
+ * to lid open, stop reached to first drop, first drop to report, and pick
+ * to lid open. The stats getters are safe from any task.
+ *
+ * dispense_preposition() turns the carousel to a slot ahead of an alert,
+ * only while idle. At the next dose alert it is counted as valid (carousel
+ * still at that slot, zero travel), stale (moved away since, e.g. by a
+ * refill, or prepared for another slot) or missed (nothing prepared).
+ */
+
+#define DISPENSE_SETTLE_MS 2000
+#define DISPENSE_DROP_TIMEOUT_MS 60000
+#define DISPENSE_HIST_BUCKETS 16
+#define DISPENSE_MAX_DOSES 8
+#define DISPENSE_MAX_STOPS DISPENSE_PLAN_MAX
+
+typedef enum {
+    DISPENSE_IDLE,
+    DISPENSE_POSITIONING,
+    DISPENSE_OPENING,
+    DISPENSE_AWAITING_DROP,
+    DISPENSE_CLOSING,
+    DISPENSE_REPORTING,
+    DISPENSE_STATE_COUNT,
+} dispense_state_t;
+
+typedef enum {
+    DISPENSE_LAT_ALERT_TO_OPEN,
+    DISPENSE_LAT_OPEN_TO_DROP,
+    DISPENSE_LAT_DROP_TO_REPORT,
+    DISPENSE_LAT_PICK_TO_OPEN,
+    DISPENSE_LAT_COUNT,
+} dispense_latency_t;
+
+/* Bucket i counts latencies below 128 << i ms; the last bucket is open-ended. */
+typedef struct {
+    uint32_t count;
+    uint32_t max_ms;
+    uint64_t sum_ms;
+    uint32_t buckets[DISPENSE_HIST_BUCKETS];
+} dispense_hist_t;
+
+typedef struct {
+    uint32_t moves;
+    uint32_t valid;
+    uint32_t stale;
+    uint32_t missed;
+} dispense_preposition_stats_t;
+
+typedef struct {
+    int slots;                              /* slot n sits at (n - 1) * steps_per_slot */
+    int32_t steps_per_slot;
+    int32_t steps_per_rev;
+} dispense_carousel_t;
+
+typedef struct {
+    int (*current_slot)(void);
+    /* shorter way round: dispense_approaching() near the end, then dispense_positioned() */
+    void (*position)(int slot);
+    void (*open_lid)(void);                 /* then dispense_lid_opened() */
+    void (*silence_alert)(void);
+    void (*close_lid)(void);                /* then dispense_lid_closed() */
+    void (*arm_detector)(bool armed);       /* dispense_dropped() per pill while armed */
+    void (*start_timer)(uint32_t ms);       /* one-shot dispense_timeout(); 0 stops it */
+    void (*report)(int dose, uint32_t pills);
+} dispense_ops_t;
+
+void dispense_init(const dispense_ops_t *ops, const dispense_carousel_t *carousel);
+
+/* Adds a dose to the running session, or starts one. Returns the dose index, or -1. */
+int dispense_add_dose(int slot);
+void dispense_refill(int slot);
+/* False unless idle */
+bool dispense_preposition(int slot);
+void dispense_pick(void);
+void dispense_cancel(void);
+void dispense_approaching(int32_t steps_left);
+void dispense_positioned(void);
+void dispense_lid_opened(void);
+/* pills: count since the detector was armed */
+void dispense_dropped(uint32_t pills);
+void dispense_timeout(void);
+void dispense_lid_closed(void);
+
+dispense_state_t dispense_state(void);
+const char *dispense_state_name(dispense_state_t state);
+/* Doses in the current (or last) session */
+int dispense_dose_count(void);
+/* Pills seen so far at the stop of a dose in the current session; lets a cancel report what was taken */
+uint32_t dispense_dose_pills(int dose);
+void dispense_stats_get(dispense_latency_t latency, dispense_hist_t *out);
+void dispense_preposition_stats_get(dispense_preposition_stats_t *out);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
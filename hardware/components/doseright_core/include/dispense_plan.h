@@ -0,0 +1,34 @@
+#ifndef DISPENSE_PLAN_H
+#define DISPENSE_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Visit order for a multi-slot dispense on the circular carousel.
+ *
+ * Positions are in motor steps, modulo one revolution. Between two
+ * positions the carousel always takes the shorter way round, so the cost of
+ * a leg is min(forward, backward) steps. dispense_plan_order() returns the
+ * order of targets that minimizes the total travel from the start position
+ * (an open path, no return). It is an exhaustive search with pruning: fine
+ * for the handful of slots a carousel has, bounded by DISPENSE_PLAN_MAX.
+ */
+
+#define DISPENSE_PLAN_MAX 8
+
+/* Signed shortest move from one position to another: > 0 forward, < 0 backward. */
+int32_t dispense_plan_delta(int32_t from, int32_t to, int32_t revolution);
+/* Writes the visit order (indices into targets) to order; returns total steps, or -1. */
+int32_t dispense_plan_order(int32_t from, const int32_t *targets, size_t count,
+                            int32_t revolution, uint8_t *order);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
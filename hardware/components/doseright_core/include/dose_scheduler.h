@@ -0,0 +1,70 @@
+#ifndef DOSE_SCHEDULER_H
+#define DOSE_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "med_cache.h"
+
+/*
+ * Dose alarm scheduler.
+ *
+ * Holds every upcoming dose in a min-heap keyed by its due time on the
+ * monotonic dr_hal_now_us() clock (ms), and keeps one one-shot HAL timer
+ * armed for the root.
+ * When it fires, every dose due by then is popped. Doses at most
+ * DOSE_SCHEDULER_GRACE_MS late are handed to the fire callback, so a
+ * stalled task, a late timer or a reboot just after the due time does not
+ * lose a dose. Older ones are dropped and logged.
+ *
+ * A dose fires once: the ids of doses the fire callback accepted are
+ * remembered, and dose_scheduler_load() skips them when the same list is
+ * loaded again. A dose the callback refuses (returns false) stays in the
+ * heap and is offered again after DOSE_SCHEDULER_FIRE_RETRY_MS, until it
+ * is accepted or falls out of the grace window.
+ *
+ * With dose_scheduler_set_prepare(), the next dose is also handed to a
+ * prepare callback lead_ms before it is due (or at once, if it is closer),
+ * e.g. to turn the carousel ahead of the alert. Only the earliest pending
+ * dose is prepared, and each dose only once. A callback that returns false
+ * (busy) is retried after DOSE_SCHEDULER_PREPARE_RETRY_MS. A callback that
+ * hands the work to another task can return true and call
+ * dose_scheduler_prepare_declined() from there, with the same effect.
+ *
+ * The callbacks run on the HAL timer task, or on the caller of
+ * dose_scheduler_load() for doses that are already due.
+ */
+
+#define DOSE_SCHEDULER_MAX MED_CACHE_MAX
+#define DOSE_SCHEDULER_GRACE_MS (15 * 60 * 1000)
+#define DOSE_SCHEDULER_PREPARE_RETRY_MS (30 * 1000)
+#define DOSE_SCHEDULER_FIRE_RETRY_MS (5 * 1000)
+
+typedef struct {
+    int64_t due_ms;                 /* dr_hal_now_us() / 1000 */
+    med_cache_item_t item;
+} dose_scheduler_entry_t;
+
+typedef bool (*dose_scheduler_fire_fn)(const med_cache_item_t *item, int64_t late_ms, void *ctx);
+typedef bool (*dose_scheduler_prepare_fn)(const med_cache_item_t *item, int64_t due_in_ms, void *ctx);
+
+bool dose_scheduler_init(dose_scheduler_fire_fn fire, void *ctx);
+void dose_scheduler_set_prepare(int64_t lead_ms, dose_scheduler_prepare_fn prepare, void *ctx);
+void dose_scheduler_prepare_declined(void);
+/* Replaces the schedule with entries[0..count) */
+void dose_scheduler_load(const dose_scheduler_entry_t *entries, size_t count);
+void dose_scheduler_clear(void);
+size_t dose_scheduler_count(void);
+/* Due time of the next dose, or -1 if none */
+int64_t dose_scheduler_next_due_ms(void);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef DR_HAL_H
+#define DR_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hardware abstraction for doseright_core.
+ *
+ * The core (med caches, time parsing, dose scheduling, sync parsing and the
+ * dispense state machine) only reaches the platform through these calls.
+ * port/esp32s3 implements them with esp_timer, FreeRTOS, NVS and the
+ * backend_conn HTTP session. port/linux uses POSIX clocks, pthreads, files
+ * and plain HTTP sockets, for the ESP-IDF linux target and host builds.
+ *
+ * Actuators are not called from here: the dispense state machine drives
+ * them through the dispense_ops_t the application passes to dispense_init().
+ */
+
+/* Clock: monotonic, since boot */
+int64_t dr_hal_now_us(void);
+
+/* Blocking mutex for task-level sections */
+typedef struct dr_hal_mutex *dr_hal_mutex_t;
+dr_hal_mutex_t dr_hal_mutex_create(void);
+void dr_hal_mutex_lock(dr_hal_mutex_t mutex);
+void dr_hal_mutex_unlock(dr_hal_mutex_t mutex);
+
+/* One short critical section shared by the core; never block inside */
+void dr_hal_critical_enter(void);
+void dr_hal_critical_exit(void);
+
+/* One-shot timer; the callback runs on the platform's timer task */
+typedef struct dr_hal_timer *dr_hal_timer_t;
+typedef void (*dr_hal_timer_fn)(void *arg);
+dr_hal_timer_t dr_hal_timer_create(const char *name, dr_hal_timer_fn fn, void *arg);
+/* Restarts the timer if it is already armed */
+void dr_hal_timer_start_once(dr_hal_timer_t timer, uint64_t delay_us);
+void dr_hal_timer_stop(dr_hal_timer_t timer);
+
+/* Storage: blobs under short keys. get: *len is the buffer size in, the stored size out. */
+bool dr_hal_storage_get(const char *key, void *buf, size_t *len);
+bool dr_hal_storage_set(const char *key, const void *buf, size_t len);
+
+/* Network: one request to the backend, relative to its base URL */
+typedef bool (*dr_hal_body_fn)(const char *data, size_t len, void *ctx);
+
+typedef struct {
+    bool post;
+    bool patch;                     /* PATCH with the body; wins over post */
+    const char *path;
+    const char *body;               /* optional JSON request body */
+    const char *if_none_match;      /* optional */
+    const char *accept;             /* optional Accept header */
+    dr_hal_body_fn on_body;         /* response body sink; return false to abort */
+    void *ctx;
+} dr_hal_http_request_t;
+
+/* HTTP status, or -1 if there was no response. etag (may be NULL) gets the ETag header. */
+int dr_hal_http_perform(const dr_hal_http_request_t *req, char *etag, size_t etag_size);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef DR_LOG_H
+#define DR_LOG_H
+
+/* ESP_LOG under ESP-IDF (including the linux target), stderr in plain host builds. */
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#define DR_LOGE ESP_LOGE
+#define DR_LOGW ESP_LOGW
+#define DR_LOGI ESP_LOGI
+#else
+#include <stdio.h>
+#define DR_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define DR_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define DR_LOGI(tag, fmt, ...) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#endif
+
+#endif
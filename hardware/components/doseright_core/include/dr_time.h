@@ -0,0 +1,76 @@
+#ifndef DR_TIME_H
+#define DR_TIME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Wall-clock helpers shared by the UI and the dose scheduler.
+ *
+ * Dose times arrive as "HH:MM", "HH:MM:SS", "h:MM AM" or "h:MM:SS PM".
+ *
+ * dr_rtc_t disciplines the platform's epoch clock (settimeofday) against
+ * the server: each time sync is corrected for the network delay, the rate
+ * at which the local oscillator drifts is learned from successive syncs and
+ * taken out of readings, and the resync interval doubles while the clock
+ * holds within DR_RTC_MAX_ERROR_MS. Local time comes from the POSIX TZ the
+ * server sends, so the clock is right straight after a reset as long as
+ * the platform kept its epoch time.
+ */
+
+/* Minute of day for any of the accepted formats, or -1. No sscanf, no allocation. */
+int dr_time_to_minutes(const char *src);
+/* Any accepted format to "hh:MM AM"; anything else is copied, empty gives "--:--" */
+void dr_time_format_12h(const char *src, char *dst, size_t dst_size);
+/* Minute of day to "hh:MM AM" */
+void dr_time_minutes_12h(int minute_of_day, char *dst, size_t dst_size);
+
+#define DR_RTC_MIN_EPOCH_MS 1704067200000LL     /* 2024-01-01: earlier readings were never set */
+#define DR_RTC_INTERVAL_MIN_MS (10 * 60 * 1000)
+#define DR_RTC_INTERVAL_MAX_MS (6 * 60 * 60 * 1000)
+#define DR_RTC_MAX_ERROR_MS 2000
+#define DR_RTC_TZ_MAX 64
+
+typedef struct {
+    int64_t set_epoch_ms;           /* server time the platform clock was last set to; 0 if never */
+    int32_t drift_ppb;              /* local clock rate error, positive when it runs fast */
+    int32_t last_error_ms;          /* corrected reading minus server time at the last sync */
+    int64_t interval_ms;            /* time until the next resync */
+    char tz[DR_RTC_TZ_MAX];         /* POSIX TZ, empty until the first sync */
+} dr_rtc_t;
+
+/* A server time reading. Monotonic ms for sent/recv, server ms for the rest. */
+typedef struct {
+    int64_t epoch_ms;               /* server's Unix ms */
+    int64_t processing_ms;          /* server time between request arrival and epoch_ms; 0 if unknown */
+    int64_t sent_ms;                /* request sent */
+    int64_t recv_ms;                /* epoch_ms received */
+} dr_rtc_sample_t;
+
+void dr_rtc_init(dr_rtc_t *rtc);
+/* Unix ms for a raw platform reading, drift corrected; 0 if never set or the platform lost it */
+int64_t dr_rtc_now_ms(const dr_rtc_t *rtc, int64_t raw_epoch_ms);
+/*
+ * Takes a server reading at now_ms, when the platform clock read
+ * raw_epoch_ms. Updates drift and interval, and sets set_epoch_ms to the
+ * server time at now_ms, which the caller then sets the platform clock to.
+ * False if the sample is too uncertain to beat a clock that is still valid.
+ */
+bool dr_rtc_sync(dr_rtc_t *rtc, const dr_rtc_sample_t *sample, int64_t raw_epoch_ms, int64_t now_ms);
+/* Network round trip of a sample: the request's time minus the server's share */
+int64_t dr_rtc_sample_rtt_ms(const dr_rtc_sample_t *sample);
+/* Local minute of day at epoch_ms under the current TZ, and the monotonic ms (at now_ms) it began */
+bool dr_rtc_local_minute(int64_t epoch_ms, int64_t now_ms, int *minute_of_day, int64_t *minute_start_ms);
+/* Fixed-offset TZ for servers that send no TZ: local minute of day at epoch_ms, offset rounded to 15 min */
+bool dr_rtc_tz_from_local(int local_minute, int64_t epoch_ms, char *dst, size_t dst_size);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
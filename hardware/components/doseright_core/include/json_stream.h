@@ -0,0 +1,68 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Incremental (SAX-style) JSON tokenizer with fixed memory.
+ *
+ * Input may be fed in arbitrary chunks; events are reported through the
+ * callback as soon as each token completes. Strings and numbers longer than
+ * JSON_STREAM_TOKEN_MAX - 1 bytes are truncated. Containers report the depth
+ * of the container itself; keys and values report the depth of their
+ * members (root members are depth 1). During a callback, `offset` is the
+ * input position of the byte that completed the token (the brace or bracket
+ * for container events), counted from the first byte ever fed.
+ */
+
+#define JSON_STREAM_MAX_DEPTH 32
+#define JSON_STREAM_TOKEN_MAX 96
+
+typedef enum {
+    JSON_STREAM_OBJECT_START,
+    JSON_STREAM_OBJECT_END,
+    JSON_STREAM_ARRAY_START,
+    JSON_STREAM_ARRAY_END,
+    JSON_STREAM_KEY,
+    JSON_STREAM_STRING,
+    JSON_STREAM_NUMBER,
+    JSON_STREAM_TRUE,
+    JSON_STREAM_FALSE,
+    JSON_STREAM_NULL,
+} json_stream_event_t;
+
+/* Return false to abort parsing. */
+typedef bool (*json_stream_cb_t)(void *ctx, json_stream_event_t event, const char *text, size_t len, int depth);
+
+typedef struct {
+    json_stream_cb_t cb;
+    void *ctx;
+    uint8_t state;
+    uint8_t depth;
+    uint32_t object_bits;
+    bool failed;
+    char token[JSON_STREAM_TOKEN_MAX];
+    size_t token_len;
+    uint32_t unicode;
+    uint8_t unicode_digits;
+    uint16_t high_surrogate;
+    bool string_is_key;
+    bool after_comma;
+    size_t offset;
+} json_stream_t;
+
+void json_stream_init(json_stream_t *js, json_stream_cb_t cb, void *ctx);
+bool json_stream_feed(json_stream_t *js, const char *data, size_t len);
+bool json_stream_finish(json_stream_t *js);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef MED_CACHE_H
+#define MED_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MED_CACHE_MAX 10
+
+typedef struct {
+    char name[48];
+    char dose[32];
+    char time_str[8];
+    int minute;                     /* time_str as minute of day, -1 if unknown; set at ingest */
+    char status[16];
+    char dose_id[40];
+    int slot;
+} med_cache_item_t;
+
+typedef struct {
+    med_cache_item_t items[MED_CACHE_MAX];
+    size_t count;
+    char updated[16];
+    bool valid;
+    char etag[48];  /* validator for the cached response */
+} med_cache_t;
+
+/*
+ * Persist through dr_hal storage in a compact versioned encoding (interned
+ * strings, binary dose ids). save skips the write when storage already holds
+ * the same bytes; load rejects blobs of another version (refetched on the
+ * next sync).
+ */
+bool med_cache_save(const char *key, const med_cache_t *cache);
+bool med_cache_load(const char *key, med_cache_t *cache);
+
+/* Text lines of the cached-list screen, in display order */
+typedef void (*med_cache_line_fn)(const char *line, void *ctx);
+void med_cache_render(const med_cache_t *cache, bool offline, med_cache_line_fn emit, void *ctx);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MED_JSON_H
+#define MED_JSON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "json_stream.h"
+#include "med_cache.h"
+
+/*
+ * Streams a backend list response ({"data":[{...}, ...]}) straight into a
+ * med_cache_t without building a DOM. Feed the body in whatever chunks the
+ * HTTP client hands out; items past MED_CACHE_MAX are counted but dropped.
+ *
+ * med_json_begin_nested() reuses the same mapping for a list object embedded
+ * in a larger document: the owner runs its own json_stream and forwards the
+ * events of that object to med_json_on_event(), with base_depth being the
+ * depth of the object's members minus one.
+ */
+
+typedef struct {
+    json_stream_t stream;
+    med_cache_t *out;
+    med_cache_item_t *item;
+    char key[16];
+    int base_depth;
+    bool in_data;
+    bool saw_data;
+    size_t items_seen;
+} med_json_ingest_t;
+
+void med_json_begin(med_json_ingest_t *ing, med_cache_t *out);
+bool med_json_feed(med_json_ingest_t *ing, const char *data, size_t len);
+bool med_json_end(med_json_ingest_t *ing);
+void med_json_begin_nested(med_json_ingest_t *ing, med_cache_t *out, int base_depth);
+bool med_json_on_event(void *ctx, json_stream_event_t event, const char *text, size_t len, int depth);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
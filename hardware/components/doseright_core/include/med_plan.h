@@ -0,0 +1,94 @@
+#ifndef MED_PLAN_H
+#define MED_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json_stream.h"
+#include "med_cache.h"
+
+/*
+ * Medication plan rules (GET /api/hardware/plans, or the "plans" section of
+ * /sync), from which the device expands dose occurrences itself for as far
+ * ahead as it needs, e.g. while offline past the 24 h upcoming list:
+ *
+ *   {"data":[{"planId":"65f0..","medicineName":..,"dosage":..,"slot":1,
+ *             "times":[480,1200],"daysOfWeek":[1,2,3,4,5,6,7],
+ *             "startMs":..,"endMs":null}]}
+ *
+ * times are minutes of day in local time (TZ), daysOfWeek 1 = Monday.
+ * Occurrences get the dose id "<planId>@<epoch minute>", which the backend
+ * maps onto its dose log when a taken/skipped event for it arrives.
+ *
+ * Ingest follows med_json: med_plan_begin_nested() for a plan list embedded
+ * in a larger document, plans past MED_PLAN_MAX counted but dropped.
+ */
+#define MED_PLAN_MAX 16
+#define MED_PLAN_TIMES_MAX 8
+#define MED_PLAN_ID_MAX 25
+
+typedef struct {
+    char plan_id[MED_PLAN_ID_MAX];
+    char name[48];
+    char dose[32];
+    int8_t slot;
+    uint8_t days;                   /* bit 0 Monday .. bit 6 Sunday */
+    uint8_t time_count;
+    uint16_t times[MED_PLAN_TIMES_MAX]; /* minutes of day, ascending */
+    int64_t start_ms;               /* Unix ms, 0 if open */
+    int64_t end_ms;                 /* Unix ms, 0 if open */
+} med_plan_t;
+
+typedef struct {
+    med_plan_t plans[MED_PLAN_MAX];
+    size_t count;
+    bool valid;
+    char etag[48];
+} med_plan_set_t;
+
+typedef struct {
+    json_stream_t stream;
+    med_plan_set_t *out;
+    med_plan_t *plan;
+    char key[16];
+    int base_depth;
+    bool in_data;
+    bool saw_data;
+    size_t plans_seen;
+} med_plan_ingest_t;
+
+void med_plan_begin(med_plan_ingest_t *ing, med_plan_set_t *out);
+bool med_plan_feed(med_plan_ingest_t *ing, const char *data, size_t len);
+bool med_plan_end(med_plan_ingest_t *ing);
+void med_plan_begin_nested(med_plan_ingest_t *ing, med_plan_set_t *out, int base_depth);
+bool med_plan_on_event(void *ctx, json_stream_event_t event, const char *text, size_t len, int depth);
+
+/* Persist through dr_hal storage in a versioned encoding, like med_cache */
+bool med_plan_save(const char *key, const med_plan_set_t *set);
+bool med_plan_load(const char *key, med_plan_set_t *set);
+
+typedef struct {
+    int64_t due_epoch_ms;
+    med_cache_item_t item;          /* status "pending", dose_id "<planId>@<epoch minute>" */
+} med_plan_occurrence_t;
+
+/*
+ * The earliest occurrences due in [from_ms, to_ms) (Unix ms), ascending, at
+ * most max of them; returns how many. Days and times follow the local time
+ * of TZ, so occurrences stay at their wall-clock time across DST changes.
+ * Scans at most MED_PLAN_SCAN_DAYS days.
+ */
+#define MED_PLAN_SCAN_DAYS 62
+size_t med_plan_expand(const med_plan_set_t *set, int64_t from_ms, int64_t to_ms,
+                       med_plan_occurrence_t *out, size_t max);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef MED_WIRE_H
+#define MED_WIRE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "med_cache.h"
+
+/*
+ * Streaming decoder for the binary med list the backend sends to
+ * "Accept: application/vnd.doseright.medlist" (format described in
+ * software/backend/src/utils/medListWire.ts). Same contract as med_json:
+ * feed the body in any chunks, items past MED_CACHE_MAX are counted but
+ * dropped. Times arrive as minutes of day and are stored as they are, plus
+ * "HH:MM" for display.
+ *
+ * Only the strings the first items can reference are kept: the table is in
+ * first-use order, so MED_CACHE_MAX items need at most 4 per item.
+ */
+#define MED_WIRE_CONTENT_TYPE "application/vnd.doseright.medlist"
+#define MED_WIRE_ACCEPT MED_WIRE_CONTENT_TYPE ", application/json;q=0.5"
+#define MED_WIRE_STRINGS_MAX (MED_CACHE_MAX * 4)
+
+typedef struct {
+    med_cache_t *out;
+    uint8_t phase;
+    uint8_t flags;
+    uint16_t need;
+    uint16_t have;
+    uint8_t buf[256];
+    uint16_t item_total;
+    uint8_t string_total;
+    uint8_t string_count;
+    char strings[MED_WIRE_STRINGS_MAX][48];
+    size_t items_seen;
+} med_wire_ingest_t;
+
+void med_wire_begin(med_wire_ingest_t *ing, med_cache_t *out);
+bool med_wire_feed(med_wire_ingest_t *ing, const char *data, size_t len);
+bool med_wire_end(med_wire_ingest_t *ing);
+
+/* True when a body starts like this format (JSON never starts with 'D') */
+bool med_wire_sniff(const char *data, size_t len);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,323 @@
+#include "backend_conn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_crt_bundle.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#define BACKEND_CONN_TIMEOUT_MS 5000
+#define BACKEND_CONN_INITIAL_BUFFER 2048
+#define BACKEND_CONN_MAX_BODY (64 * 1024)
+#define BACKEND_CONN_READ_CHUNK 512
+
+static const char *TAG = "backend_conn";
+
+static SemaphoreHandle_t conn_lock = NULL;
+static esp_http_client_handle_t conn_client = NULL;
+static char conn_base_url[128] = {0};
+static char conn_auth_header[128] = {0};
+static char conn_url[256] = {0};
+static bool conn_connected = false;
+static volatile bool conn_drop_pending = false;
+static char *conn_rx_buf = NULL;
+static int conn_rx_cap = 0;
+static backend_conn_stats_t conn_stats = {0};
+static backend_conn_response_t *conn_active_resp = NULL;
+
+static esp_err_t backend_conn_event_handler(esp_http_client_event_t *evt)
+{
+    switch (evt->event_id) {
+        case HTTP_EVENT_ON_CONNECTED:
+            conn_connected = true;
+            conn_stats.handshakes++;
+            break;
+        case HTTP_EVENT_DISCONNECTED:
+            conn_connected = false;
+            break;
+        case HTTP_EVENT_ON_HEADER:
+            if (conn_active_resp && evt->header_key && evt->header_value &&
+                strcasecmp(evt->header_key, "ETag") == 0) {
+                snprintf(conn_active_resp->etag, sizeof(conn_active_resp->etag), "%s", evt->header_value);
+            }
+            break;
+        default:
+            break;
+    }
+    return ESP_OK;
+}
+
+static bool backend_conn_ensure_client(void)
+{
+    if (conn_client) {
+        return true;
+    }
+    if (conn_base_url[0] == '\0') {
+        ESP_LOGE(TAG, "Backend base URL not configured");
+        return false;
+    }
+
+    esp_http_client_config_t config = {
+        .url = conn_base_url,
+        .timeout_ms = BACKEND_CONN_TIMEOUT_MS,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .event_handler = backend_conn_event_handler,
+        .keep_alive_enable = true,
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        .save_client_session = true,
+#endif
+    };
+    conn_client = esp_http_client_init(&config);
+    if (!conn_client) {
+        ESP_LOGE(TAG, "HTTP client init failed");
+        return false;
+    }
+    esp_http_client_set_header(conn_client, "Authorization", conn_auth_header);
+    esp_http_client_set_header(conn_client, "User-Agent", "DoseRight-ESP32");
+    return true;
+}
+
+static bool backend_conn_reserve(int needed)
+{
+    if (needed <= conn_rx_cap) {
+        return true;
+    }
+    if (needed > BACKEND_CONN_MAX_BODY + 1) {
+        return false;
+    }
+    int new_cap = conn_rx_cap > 0 ? conn_rx_cap : BACKEND_CONN_INITIAL_BUFFER;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    if (new_cap > BACKEND_CONN_MAX_BODY + 1) {
+        new_cap = BACKEND_CONN_MAX_BODY + 1;
+    }
+    char *new_buf = (char *)realloc(conn_rx_buf, new_cap);
+    if (!new_buf) {
+        return false;
+    }
+    conn_rx_buf = new_buf;
+    conn_rx_cap = new_cap;
+    conn_stats.buffer_grows++;
+    return true;
+}
+
+static void backend_conn_close(void)
+{
+    if (conn_client) {
+        esp_http_client_close(conn_client);
+    }
+    conn_connected = false;
+}
+
+static esp_err_t backend_conn_read_body(const backend_conn_request_t *req, backend_conn_response_t *resp,
+                                        int64_t content_length)
+{
+    int total = 0;
+    int read_len = 0;
+
+    /* Error bodies are small and buffered, so callers can tell them apart (backend_conn_route_missing) */
+    if (req->on_body && resp->status >= 200 && resp->status < 300) {
+        char chunk[BACKEND_CONN_READ_CHUNK];
+        while ((read_len = esp_http_client_read(conn_client, chunk, sizeof(chunk))) > 0) {
+            total += read_len;
+            if (!req->on_body(chunk, read_len, req->ctx)) {
+                resp->body_len = total;
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+        }
+    } else {
+        int wanted = (content_length > 0 && content_length <= BACKEND_CONN_MAX_BODY)
+            ? (int)content_length + 1
+            : BACKEND_CONN_INITIAL_BUFFER;
+        if (!backend_conn_reserve(wanted)) {
+            return ESP_ERR_NO_MEM;
+        }
+        while (true) {
+            if (total + 1 >= conn_rx_cap && !backend_conn_reserve(conn_rx_cap * 2)) {
+                return ESP_ERR_NO_MEM;
+            }
+            read_len = esp_http_client_read(conn_client, conn_rx_buf + total, conn_rx_cap - 1 - total);
+            if (read_len <= 0) {
+                break;
+            }
+            total += read_len;
+        }
+        conn_rx_buf[total] = '\0';
+        resp->body = conn_rx_buf;
+    }
+
+    resp->body_len = total;
+    conn_stats.body_bytes_received += (uint64_t)total;
+    return read_len < 0 ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t backend_conn_attempt(const backend_conn_request_t *req, backend_conn_response_t *resp,
+                                      bool *stale)
+{
+    bool reused = conn_connected;
+    *stale = false;
+    resp->status = 0;
+    resp->body = NULL;
+    resp->body_len = 0;
+    resp->etag[0] = '\0';
+
+    esp_http_client_set_url(conn_client, conn_url);
+    esp_http_client_set_method(conn_client, req->method);
+    int body_len = req->body ? (int)strlen(req->body) : 0;
+    if (body_len > 0) {
+        esp_http_client_set_header(conn_client, "Content-Type", "application/json");
+    } else {
+        esp_http_client_delete_header(conn_client, "Content-Type");
+    }
+    if (req->if_none_match && req->if_none_match[0] != '\0') {
+        esp_http_client_set_header(conn_client, "If-None-Match", req->if_none_match);
+    } else {
+        esp_http_client_delete_header(conn_client, "If-None-Match");
+    }
+    if (req->accept && req->accept[0] != '\0') {
+        esp_http_client_set_header(conn_client, "Accept", req->accept);
+    } else {
+        esp_http_client_delete_header(conn_client, "Accept");
+    }
+
+    esp_err_t err = esp_http_client_open(conn_client, body_len);
+    if (err != ESP_OK) {
+        backend_conn_close();
+        *stale = reused;
+        return err;
+    }
+
+    if (body_len > 0) {
+        int wrote = esp_http_client_write(conn_client, req->body, body_len);
+        if (wrote != body_len) {
+            backend_conn_close();
+            *stale = reused;
+            return ESP_FAIL;
+        }
+        conn_stats.body_bytes_sent += (uint64_t)body_len;
+    }
+
+    int64_t content_length = esp_http_client_fetch_headers(conn_client);
+    if (content_length < 0) {
+        backend_conn_close();
+        *stale = reused;
+        return ESP_FAIL;
+    }
+    resp->status = esp_http_client_get_status_code(conn_client);
+    if (resp->status == 304) {
+        conn_stats.not_modified++;
+    }
+
+    err = backend_conn_read_body(req, resp, content_length);
+    if (err != ESP_OK || !esp_http_client_is_complete_data_received(conn_client)) {
+        backend_conn_close();
+    }
+    return err;
+}
+
+void backend_conn_init(const char *base_url, const char *secret)
+{
+    if (!conn_lock) {
+        conn_lock = xSemaphoreCreateMutex();
+    }
+    snprintf(conn_base_url, sizeof(conn_base_url), "%s", base_url ? base_url : "");
+    snprintf(conn_auth_header, sizeof(conn_auth_header), "Bearer %s", secret ? secret : "");
+}
+
+esp_err_t backend_conn_perform(const backend_conn_request_t *req, backend_conn_response_t *resp)
+{
+    if (resp) {
+        memset(resp, 0, sizeof(*resp));
+    }
+    /* Before init there is no lock, and backend_conn_release() does nothing */
+    if (!conn_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* Taken on every path, so the caller's backend_conn_release() always balances it */
+    xSemaphoreTake(conn_lock, portMAX_DELAY);
+    if (!req || !req->path || !resp) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!backend_conn_ensure_client()) {
+        conn_stats.failures++;
+        return ESP_ERR_INVALID_STATE;
+    }
+    snprintf(conn_url, sizeof(conn_url), "%s%s", conn_base_url, req->path);
+
+    int64_t start_us = esp_timer_get_time();
+    conn_stats.requests++;
+    bool stale = false;
+    conn_active_resp = resp;
+    esp_err_t err = backend_conn_attempt(req, resp, &stale);
+    if (err != ESP_OK && stale) {
+        ESP_LOGI(TAG, "Keep-alive connection dropped by peer; reconnecting");
+        conn_stats.reconnects++;
+        err = backend_conn_attempt(req, resp, &stale);
+    }
+    conn_active_resp = NULL;
+    if (err != ESP_OK) {
+        conn_stats.failures++;
+        ESP_LOGE(TAG, "%s failed: %s", conn_url, esp_err_to_name(err));
+    }
+    conn_stats.busy_us += esp_timer_get_time() - start_us;
+    return err;
+}
+
+bool backend_conn_route_missing(const backend_conn_response_t *resp)
+{
+    if (!resp || resp->status != 404) {
+        return false;
+    }
+    /* The backend's catch-all sends {"message":"Route not found"}; other 404s name the device or record */
+    if (!resp->body || resp->body[0] != '{') {
+        return true;
+    }
+    return strstr(resp->body, "\"Route not found\"") != NULL;
+}
+
+void backend_conn_release(void)
+{
+    if (!conn_lock) {
+        return;
+    }
+    if (conn_drop_pending) {
+        conn_drop_pending = false;
+        backend_conn_close();
+    }
+    xSemaphoreGive(conn_lock);
+}
+
+void backend_conn_drop(void)
+{
+    if (!conn_lock) {
+        return;
+    }
+    if (xSemaphoreTake(conn_lock, 0) != pdTRUE) {
+        conn_drop_pending = true;
+        return;
+    }
+    backend_conn_close();
+    xSemaphoreGive(conn_lock);
+}
+
+void backend_conn_get_stats(backend_conn_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    if (conn_lock) {
+        xSemaphoreTake(conn_lock, portMAX_DELAY);
+    }
+    *out = conn_stats;
+    if (conn_lock) {
+        xSemaphoreGive(conn_lock);
+    }
+}
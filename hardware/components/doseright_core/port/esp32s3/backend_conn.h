@@ -0,0 +1,76 @@
+#ifndef BACKEND_CONN_H
+#define BACKEND_CONN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+/*
+ * Shared keep-alive HTTP(S) session to the backend.
+ *
+ * Every backend call goes through one esp_http_client that stays connected
+ * between requests. A request that fails on a reused socket (server closed
+ * the idle connection) is retried once on a fresh connection, and TLS
+ * sessions are resumed from the saved ticket when the session has to
+ * reconnect.
+ *
+ * backend_conn_perform() takes the session lock; callers must always call
+ * backend_conn_release() afterwards, also on error. resp is zeroed on every
+ * path, so resp->status reads 0 when there was no response. Do not take the
+ * LVGL lock while holding the session.
+ */
+
+typedef bool (*backend_conn_body_cb_t)(const char *data, int len, void *ctx);
+
+typedef struct {
+    esp_http_client_method_t method;
+    const char *path;                /* appended to the base URL, may carry a query string */
+    const char *body;                /* optional JSON request body */
+    backend_conn_body_cb_t on_body;  /* optional streaming sink for 2xx bodies; NULL buffers */
+    void *ctx;
+    const char *if_none_match;       /* optional validator from a previous ETag */
+    const char *accept;              /* optional Accept header */
+} backend_conn_request_t;
+
+typedef struct {
+    int status;
+    const char *body;                /* NUL-terminated when buffered, valid until release */
+    int body_len;
+    char etag[64];                   /* ETag response header, empty if absent */
+} backend_conn_response_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t handshakes;             /* TCP (+TLS) connects */
+    uint32_t reconnects;             /* retries after a stale keep-alive socket */
+    uint32_t failures;
+    uint32_t buffer_grows;
+    uint32_t not_modified;           /* 304 responses */
+    uint64_t body_bytes_sent;
+    uint64_t body_bytes_received;
+    int64_t busy_us;                 /* time with a request in flight */
+} backend_conn_stats_t;
+
+void backend_conn_init(const char *base_url, const char *secret);
+esp_err_t backend_conn_perform(const backend_conn_request_t *req, backend_conn_response_t *resp);
+void backend_conn_release(void);
+/*
+ * True for a 404 because the backend has no such route (an older server),
+ * false for a 404 about the device, patient or dose. Non-2xx bodies are
+ * buffered in resp->body even when the request streams to on_body.
+ */
+bool backend_conn_route_missing(const backend_conn_response_t *resp);
+void backend_conn_drop(void);
+void backend_conn_get_stats(backend_conn_stats_t *out);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
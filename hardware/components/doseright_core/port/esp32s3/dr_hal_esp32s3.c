@@ -0,0 +1,107 @@
+#include "dr_hal.h"
+
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "backend_conn.h"
+#include "nvs_store.h"
+
+static portMUX_TYPE dr_hal_mux = portMUX_INITIALIZER_UNLOCKED;
+
+int64_t dr_hal_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+dr_hal_mutex_t dr_hal_mutex_create(void)
+{
+    return (dr_hal_mutex_t)xSemaphoreCreateMutex();
+}
+
+void dr_hal_mutex_lock(dr_hal_mutex_t mutex)
+{
+    xSemaphoreTake((SemaphoreHandle_t)mutex, portMAX_DELAY);
+}
+
+void dr_hal_mutex_unlock(dr_hal_mutex_t mutex)
+{
+    xSemaphoreGive((SemaphoreHandle_t)mutex);
+}
+
+void dr_hal_critical_enter(void)
+{
+    portENTER_CRITICAL(&dr_hal_mux);
+}
+
+void dr_hal_critical_exit(void)
+{
+    portEXIT_CRITICAL(&dr_hal_mux);
+}
+
+dr_hal_timer_t dr_hal_timer_create(const char *name, dr_hal_timer_fn fn, void *arg)
+{
+    const esp_timer_create_args_t args = {
+        .callback = fn,
+        .arg = arg,
+        .name = name,
+    };
+    esp_timer_handle_t timer = NULL;
+    if (esp_timer_create(&args, &timer) != ESP_OK) {
+        return NULL;
+    }
+    return (dr_hal_timer_t)timer;
+}
+
+void dr_hal_timer_start_once(dr_hal_timer_t timer, uint64_t delay_us)
+{
+    esp_timer_handle_t handle = (esp_timer_handle_t)timer;
+    esp_timer_stop(handle);
+    esp_timer_start_once(handle, delay_us);
+}
+
+void dr_hal_timer_stop(dr_hal_timer_t timer)
+{
+    esp_timer_stop((esp_timer_handle_t)timer);
+}
+
+/* Through nvs_store: saves are written in the next batch, not on the caller's task */
+bool dr_hal_storage_get(const char *key, void *buf, size_t *len)
+{
+    return nvs_store_get_blob(key, buf, len);
+}
+
+bool dr_hal_storage_set(const char *key, const void *buf, size_t len)
+{
+    return nvs_store_set_blob(key, buf, len, NVS_STORE_DELAY_MS);
+}
+
+static bool dr_hal_body_forward(const char *data, int len, void *ctx)
+{
+    const dr_hal_http_request_t *req = ctx;
+    return req->on_body(data, (size_t)len, req->ctx);
+}
+
+int dr_hal_http_perform(const dr_hal_http_request_t *req, char *etag, size_t etag_size)
+{
+    const backend_conn_request_t conn_req = {
+        .method = req->patch ? HTTP_METHOD_PATCH : req->post ? HTTP_METHOD_POST : HTTP_METHOD_GET,
+        .path = req->path,
+        .body = req->body,
+        .on_body = req->on_body ? dr_hal_body_forward : NULL,
+        .ctx = (void *)req,
+        .if_none_match = req->if_none_match,
+        .accept = req->accept,
+    };
+    backend_conn_response_t resp;
+    int status = -1;
+    if (backend_conn_perform(&conn_req, &resp) == ESP_OK) {
+        status = resp.status;
+        if (etag && etag_size > 0) {
+            snprintf(etag, etag_size, "%s", resp.etag);
+        }
+    }
+    backend_conn_release();
+    return status;
+}
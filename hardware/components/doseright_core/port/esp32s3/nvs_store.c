@@ -0,0 +1,390 @@
+#include "nvs_store.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#define NVS_STORE_KEYS_MAX 64          /* includes the 34 dose outbox keys */
+#define NVS_STORE_RETRY_MS 30000
+#define NVS_STORE_TASK_STACK 4096
+#define NVS_STORE_TASK_PRIORITY 2
+
+static const char *TAG = "nvs_store";
+
+typedef enum {
+    NVS_STORE_BLOB,
+    NVS_STORE_STR,
+    NVS_STORE_I32,
+    NVS_STORE_I64,
+    NVS_STORE_ERASED,
+} nvs_store_type_t;
+
+typedef struct {
+    nvs_store_type_t type;
+    void *data;                      /* heap copy, NULL when erased */
+    size_t len;
+} nvs_store_value_t;
+
+typedef struct {
+    char key[16];
+    bool dirty;
+    nvs_store_value_t pending;       /* valid while dirty */
+    bool in_flight;
+    nvs_store_value_t flushing;      /* being written by the flush, valid while in_flight */
+    int64_t due_us;
+    uint32_t sets;
+    uint32_t writes;
+} nvs_store_entry_t;
+
+static nvs_store_entry_t store_entries[NVS_STORE_KEYS_MAX];
+static size_t store_count = 0;
+static nvs_store_stats_t store_stats = {0};
+static SemaphoreHandle_t store_lock = NULL;
+static SemaphoreHandle_t flush_lock = NULL;
+static TaskHandle_t store_task = NULL;
+static nvs_handle_t store_handle;
+static bool store_open = false;
+
+static nvs_store_entry_t *nvs_store_find(const char *key, bool add)
+{
+    for (size_t i = 0; i < store_count; ++i) {
+        if (strcmp(store_entries[i].key, key) == 0) {
+            return &store_entries[i];
+        }
+    }
+    if (!add || store_count >= NVS_STORE_KEYS_MAX || strlen(key) >= sizeof(store_entries[0].key)) {
+        return NULL;
+    }
+    nvs_store_entry_t *entry = &store_entries[store_count++];
+    memset(entry, 0, sizeof(*entry));
+    strcpy(entry->key, key);
+    return entry;
+}
+
+static bool nvs_store_put(const char *key, nvs_store_type_t type, const void *data, size_t len,
+                          uint32_t delay_ms)
+{
+    if (!store_open || !key) {
+        return false;
+    }
+    void *copy = NULL;
+    if (len > 0) {
+        copy = malloc(len);
+        if (!copy) {
+            return false;
+        }
+        memcpy(copy, data, len);
+    }
+
+    int64_t due_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    nvs_store_entry_t *entry = nvs_store_find(key, true);
+    if (!entry) {
+        xSemaphoreGive(store_lock);
+        free(copy);
+        ESP_LOGE(TAG, "No room for key %s", key);
+        return false;
+    }
+    entry->sets++;
+    store_stats.sets++;
+    if (entry->dirty) {
+        free(entry->pending.data);
+        /* Keep the earlier deadline, so repeated sets cannot postpone the write */
+        if (due_us > entry->due_us) {
+            due_us = entry->due_us;
+        }
+    }
+    entry->pending = (nvs_store_value_t){type, copy, len};
+    entry->due_us = due_us;
+    entry->dirty = true;
+    xSemaphoreGive(store_lock);
+
+    xTaskNotifyGive(store_task);
+    return true;
+}
+
+/* 1: value copied (or sized), 0: pending erase or too small a buffer, -1: not pending, read NVS */
+static int nvs_store_peek(const char *key, nvs_store_type_t type, void *buf, size_t *len)
+{
+    int found = -1;
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    nvs_store_entry_t *entry = nvs_store_find(key, false);
+    const nvs_store_value_t *value = NULL;
+    if (entry && entry->dirty) {
+        value = &entry->pending;
+    } else if (entry && entry->in_flight) {
+        value = &entry->flushing;
+    }
+    if (value) {
+        found = 0;
+        if (value->type == type) {
+            if (!buf) {
+                *len = value->len;
+                found = 1;
+            } else if (*len >= value->len) {
+                memcpy(buf, value->data, value->len);
+                *len = value->len;
+                found = 1;
+            }
+        }
+    }
+    xSemaphoreGive(store_lock);
+    return found;
+}
+
+static esp_err_t nvs_store_write(const char *key, const nvs_store_value_t *value)
+{
+    switch (value->type) {
+        case NVS_STORE_BLOB:
+            return nvs_set_blob(store_handle, key, value->data, value->len);
+        case NVS_STORE_STR:
+            return nvs_set_str(store_handle, key, value->data);
+        case NVS_STORE_I32:
+            return nvs_set_i32(store_handle, key, *(const int32_t *)value->data);
+        case NVS_STORE_I64:
+            return nvs_set_i64(store_handle, key, *(const int64_t *)value->data);
+        case NVS_STORE_ERASED: {
+            esp_err_t err = nvs_erase_key(store_handle, key);
+            return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+/* Puts a value that did not reach flash back as pending, unless a newer set replaced it */
+static void nvs_store_requeue(nvs_store_entry_t *entry)
+{
+    if (entry->dirty) {
+        free(entry->flushing.data);
+    } else {
+        entry->pending = entry->flushing;
+        entry->dirty = true;
+        entry->due_us = esp_timer_get_time() + (int64_t)NVS_STORE_RETRY_MS * 1000;
+    }
+    entry->flushing = (nvs_store_value_t){0};
+    entry->in_flight = false;
+}
+
+/*
+ * Writes every dirty key and commits once. store_lock is dropped around each
+ * write, so sets and gets never wait for flash. A value counts as saved only
+ * once the commit succeeds; until then it stays in flight, and a failed
+ * write or commit puts it back as pending for a retry.
+ */
+void nvs_store_flush(void)
+{
+    if (!store_open) {
+        return;
+    }
+    xSemaphoreTake(flush_lock, portMAX_DELAY);
+    bool written[NVS_STORE_KEYS_MAX] = {0};
+    size_t count = 0;
+    for (size_t i = 0; i < NVS_STORE_KEYS_MAX; ++i) {
+        xSemaphoreTake(store_lock, portMAX_DELAY);
+        nvs_store_entry_t *entry = &store_entries[i];
+        if (i >= store_count || !entry->dirty) {
+            xSemaphoreGive(store_lock);
+            continue;
+        }
+        entry->flushing = entry->pending;
+        entry->in_flight = true;
+        entry->dirty = false;
+        xSemaphoreGive(store_lock);
+
+        esp_err_t err = nvs_store_write(entry->key, &entry->flushing);
+
+        xSemaphoreTake(store_lock, portMAX_DELAY);
+        if (err == ESP_OK) {
+            written[i] = true;
+            count++;
+        } else {
+            store_stats.failures++;
+            nvs_store_requeue(entry);
+        }
+        xSemaphoreGive(store_lock);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Write %s failed: %s", entry->key, esp_err_to_name(err));
+        }
+    }
+    if (count > 0) {
+        esp_err_t err = nvs_commit(store_handle);
+        xSemaphoreTake(store_lock, portMAX_DELAY);
+        store_stats.flushes++;
+        if (err != ESP_OK) {
+            store_stats.failures++;
+        }
+        for (size_t i = 0; i < NVS_STORE_KEYS_MAX; ++i) {
+            if (!written[i]) {
+                continue;
+            }
+            nvs_store_entry_t *entry = &store_entries[i];
+            if (err != ESP_OK) {
+                nvs_store_requeue(entry);
+                continue;
+            }
+            entry->writes++;
+            store_stats.writes++;
+            free(entry->flushing.data);
+            entry->flushing = (nvs_store_value_t){0};
+            entry->in_flight = false;
+        }
+        xSemaphoreGive(store_lock);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Commit of %u keys failed: %s", (unsigned)count, esp_err_to_name(err));
+        } else {
+            ESP_LOGD(TAG, "Flushed %u keys", (unsigned)count);
+        }
+    }
+    xSemaphoreGive(flush_lock);
+}
+
+static void nvs_store_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        /* Sleep until the earliest deadline; a set wakes the task to recompute it */
+        int64_t due_us = INT64_MAX;
+        xSemaphoreTake(store_lock, portMAX_DELAY);
+        for (size_t i = 0; i < store_count; ++i) {
+            if (store_entries[i].dirty && store_entries[i].due_us < due_us) {
+                due_us = store_entries[i].due_us;
+            }
+        }
+        xSemaphoreGive(store_lock);
+
+        if (due_us == INT64_MAX) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        int64_t wait_ms = (due_us - esp_timer_get_time() + 999) / 1000;
+        if (wait_ms > 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+            continue;
+        }
+        nvs_store_flush();
+    }
+}
+
+esp_err_t nvs_store_init(void)
+{
+    if (store_open) {
+        return ESP_OK;
+    }
+    store_lock = xSemaphoreCreateMutex();
+    flush_lock = xSemaphoreCreateMutex();
+    if (!store_lock || !flush_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = nvs_open(NVS_STORE_NAMESPACE, NVS_READWRITE, &store_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (xTaskCreate(nvs_store_task, "nvs_store", NVS_STORE_TASK_STACK, NULL, NVS_STORE_TASK_PRIORITY,
+                    &store_task) != pdPASS) {
+        nvs_close(store_handle);
+        return ESP_ERR_NO_MEM;
+    }
+    store_open = true;
+    return esp_register_shutdown_handler(nvs_store_flush);
+}
+
+bool nvs_store_set_blob(const char *key, const void *data, size_t len, uint32_t delay_ms)
+{
+    return nvs_store_put(key, NVS_STORE_BLOB, data, len, delay_ms);
+}
+
+bool nvs_store_set_str(const char *key, const char *value, uint32_t delay_ms)
+{
+    return value && nvs_store_put(key, NVS_STORE_STR, value, strlen(value) + 1, delay_ms);
+}
+
+bool nvs_store_set_i32(const char *key, int32_t value, uint32_t delay_ms)
+{
+    return nvs_store_put(key, NVS_STORE_I32, &value, sizeof(value), delay_ms);
+}
+
+bool nvs_store_set_i64(const char *key, int64_t value, uint32_t delay_ms)
+{
+    return nvs_store_put(key, NVS_STORE_I64, &value, sizeof(value), delay_ms);
+}
+
+bool nvs_store_erase(const char *key, uint32_t delay_ms)
+{
+    return nvs_store_put(key, NVS_STORE_ERASED, NULL, 0, delay_ms);
+}
+
+bool nvs_store_get_blob(const char *key, void *buf, size_t *len)
+{
+    if (!store_open || !key || !len) {
+        return false;
+    }
+    int found = nvs_store_peek(key, NVS_STORE_BLOB, buf, len);
+    if (found >= 0) {
+        return found == 1;
+    }
+    return nvs_get_blob(store_handle, key, buf, len) == ESP_OK;
+}
+
+bool nvs_store_get_str(const char *key, char *buf, size_t *len)
+{
+    if (!store_open || !key || !len) {
+        return false;
+    }
+    int found = nvs_store_peek(key, NVS_STORE_STR, buf, len);
+    if (found >= 0) {
+        return found == 1;
+    }
+    return nvs_get_str(store_handle, key, buf, len) == ESP_OK;
+}
+
+bool nvs_store_get_i32(const char *key, int32_t *out)
+{
+    if (!store_open || !key || !out) {
+        return false;
+    }
+    size_t len = sizeof(*out);
+    int found = nvs_store_peek(key, NVS_STORE_I32, out, &len);
+    if (found >= 0) {
+        return found == 1;
+    }
+    return nvs_get_i32(store_handle, key, out) == ESP_OK;
+}
+
+bool nvs_store_get_i64(const char *key, int64_t *out)
+{
+    if (!store_open || !key || !out) {
+        return false;
+    }
+    size_t len = sizeof(*out);
+    int found = nvs_store_peek(key, NVS_STORE_I64, out, &len);
+    if (found >= 0) {
+        return found == 1;
+    }
+    return nvs_get_i64(store_handle, key, out) == ESP_OK;
+}
+
+size_t nvs_store_get_stats(nvs_store_stats_t *totals, nvs_store_key_stats_t *keys, size_t max)
+{
+    if (!store_lock) {
+        return 0;
+    }
+    xSemaphoreTake(store_lock, portMAX_DELAY);
+    if (totals) {
+        *totals = store_stats;
+    }
+    size_t n = store_count < max ? store_count : max;
+    for (size_t i = 0; keys && i < n; ++i) {
+        memcpy(keys[i].key, store_entries[i].key, sizeof(keys[i].key));
+        keys[i].sets = store_entries[i].sets;
+        keys[i].writes = store_entries[i].writes;
+    }
+    xSemaphoreGive(store_lock);
+    return keys ? n : 0;
+}
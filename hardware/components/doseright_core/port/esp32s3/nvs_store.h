@@ -0,0 +1,71 @@
+#ifndef NVS_STORE_H
+#define NVS_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/*
+ * Write-coalescing persistence for the "doseright" NVS namespace.
+ *
+ * One handle stays open. A set copies the value into RAM, marks the key
+ * dirty and returns; the nvs_store task writes all dirty keys in one batch
+ * with a single commit once the earliest deadline of a pending key passes.
+ * Setting a key again before it is written replaces the pending value and
+ * keeps the earlier deadline, so a burst of sets costs one flash write.
+ * Gets see pending values first, so callers never read stale data.
+ *
+ * nvs_store_flush() writes everything now; it also runs from the esp_restart
+ * shutdown hook. A brown-out or power cut resets without running any code,
+ * so pending values younger than their delay are lost; keep the delay short
+ * for keys that matter after a power cut.
+ *
+ * Call nvs_store_init() after nvs_flash_init(). Gets before that fail, sets
+ * are refused.
+ */
+#define NVS_STORE_NAMESPACE "doseright"
+#define NVS_STORE_DELAY_MS 10000    /* default time a set may wait for its flush */
+
+esp_err_t nvs_store_init(void);
+void nvs_store_flush(void);
+
+/* Copies the value; delay_ms bounds how long it may stay unwritten */
+bool nvs_store_set_blob(const char *key, const void *data, size_t len, uint32_t delay_ms);
+bool nvs_store_set_str(const char *key, const char *value, uint32_t delay_ms);
+bool nvs_store_set_i32(const char *key, int32_t value, uint32_t delay_ms);
+bool nvs_store_set_i64(const char *key, int64_t value, uint32_t delay_ms);
+bool nvs_store_erase(const char *key, uint32_t delay_ms);
+
+/* Like nvs_get_*: *len is the buffer size in, the stored size out; buf NULL only asks for the size */
+bool nvs_store_get_blob(const char *key, void *buf, size_t *len);
+bool nvs_store_get_str(const char *key, char *buf, size_t *len);
+bool nvs_store_get_i32(const char *key, int32_t *out);
+bool nvs_store_get_i64(const char *key, int64_t *out);
+
+typedef struct {
+    char key[16];
+    uint32_t sets;                   /* set calls */
+    uint32_t writes;                 /* values written to flash */
+} nvs_store_key_stats_t;
+
+typedef struct {
+    uint32_t sets;
+    uint32_t writes;
+    uint32_t flushes;                /* batches, one commit each */
+    uint32_t failures;
+} nvs_store_stats_t;
+
+/* Fills up to max per-key entries and returns how many; totals may be NULL */
+size_t nvs_store_get_stats(nvs_store_stats_t *totals, nvs_store_key_stats_t *keys, size_t max);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,429 @@
+#define _GNU_SOURCE
+
+#include "dr_hal.h"
+#include "dr_hal_linux.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DR_HAL_HEADER_MAX 4096
+#define DR_HAL_HTTP_TIMEOUT_MS 5000     /* same as backend_conn */
+
+struct dr_hal_mutex {
+    pthread_mutex_t mutex;
+};
+
+struct dr_hal_timer {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    dr_hal_timer_fn fn;
+    void *arg;
+    bool armed;
+    int64_t due_us;
+};
+
+static pthread_mutex_t dr_hal_critical = PTHREAD_MUTEX_INITIALIZER;
+static char dr_hal_host[128] = "127.0.0.1";
+static char dr_hal_port[8] = "80";
+static char dr_hal_base_path[128] = "";
+static char dr_hal_auth[160] = "";
+
+int64_t dr_hal_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+dr_hal_mutex_t dr_hal_mutex_create(void)
+{
+    dr_hal_mutex_t mutex = calloc(1, sizeof(*mutex));
+    if (mutex) {
+        pthread_mutex_init(&mutex->mutex, NULL);
+    }
+    return mutex;
+}
+
+void dr_hal_mutex_lock(dr_hal_mutex_t mutex)
+{
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void dr_hal_mutex_unlock(dr_hal_mutex_t mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+void dr_hal_critical_enter(void)
+{
+    pthread_mutex_lock(&dr_hal_critical);
+}
+
+void dr_hal_critical_exit(void)
+{
+    pthread_mutex_unlock(&dr_hal_critical);
+}
+
+/* Like esp_timer, each callback runs on a timer thread with the timer unlocked. */
+static void *dr_hal_timer_thread(void *arg)
+{
+    dr_hal_timer_t timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    for (;;) {
+        if (!timer->armed) {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+        int64_t wait_us = timer->due_us - dr_hal_now_us();
+        if (wait_us > 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            int64_t ns = (int64_t)ts.tv_nsec + (wait_us % 1000000) * 1000;
+            ts.tv_sec += (time_t)(wait_us / 1000000 + ns / 1000000000);
+            ts.tv_nsec = (long)(ns % 1000000000);
+            pthread_cond_timedwait(&timer->cond, &timer->lock, &ts);
+            continue;
+        }
+        timer->armed = false;
+        pthread_mutex_unlock(&timer->lock);
+        timer->fn(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+    return NULL;
+}
+
+dr_hal_timer_t dr_hal_timer_create(const char *name, dr_hal_timer_fn fn, void *arg)
+{
+    (void)name;
+    dr_hal_timer_t timer = calloc(1, sizeof(*timer));
+    if (!timer) {
+        return NULL;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&timer->lock, NULL);
+    timer->fn = fn;
+    timer->arg = arg;
+    if (pthread_create(&timer->thread, NULL, dr_hal_timer_thread, timer) != 0) {
+        free(timer);
+        return NULL;
+    }
+    pthread_detach(timer->thread);
+    return timer;
+}
+
+void dr_hal_timer_start_once(dr_hal_timer_t timer, uint64_t delay_us)
+{
+    pthread_mutex_lock(&timer->lock);
+    timer->armed = true;
+    timer->due_us = dr_hal_now_us() + (int64_t)delay_us;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+}
+
+void dr_hal_timer_stop(dr_hal_timer_t timer)
+{
+    pthread_mutex_lock(&timer->lock);
+    timer->armed = false;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+}
+
+static void dr_hal_storage_path(const char *key, char *path, size_t size)
+{
+    const char *dir = getenv("DOSERIGHT_STORAGE_DIR");
+    if (!dir || dir[0] == '\0') {
+        dir = "/tmp/doseright";
+    }
+    mkdir(dir, 0700);
+    snprintf(path, size, "%s/%s", dir, key);
+}
+
+bool dr_hal_storage_get(const char *key, void *buf, size_t *len)
+{
+    char path[256];
+    dr_hal_storage_path(key, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    /* Same contract as nvs_get_blob: fail if the stored blob does not fit */
+    fseek(f, 0, SEEK_END);
+    long stored = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bool ok = stored >= 0 && (size_t)stored <= *len &&
+        fread(buf, 1, (size_t)stored, f) == (size_t)stored;
+    if (ok) {
+        *len = (size_t)stored;
+    }
+    fclose(f);
+    return ok;
+}
+
+bool dr_hal_storage_set(const char *key, const void *buf, size_t len)
+{
+    char path[256];
+    char tmp[264];
+    dr_hal_storage_path(key, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(buf, 1, len, f) == len;
+    ok = fclose(f) == 0 && ok;
+    return ok && rename(tmp, path) == 0;
+}
+
+void dr_hal_linux_set_backend(const char *base_url, const char *secret)
+{
+    const char *rest = base_url;
+    if (strncmp(rest, "http://", 7) == 0) {
+        rest += 7;
+    }
+    size_t host_len = strcspn(rest, ":/");
+    snprintf(dr_hal_host, sizeof(dr_hal_host), "%.*s", (int)host_len, rest);
+    rest += host_len;
+    snprintf(dr_hal_port, sizeof(dr_hal_port), "80");
+    if (*rest == ':') {
+        size_t port_len = strcspn(++rest, "/");
+        snprintf(dr_hal_port, sizeof(dr_hal_port), "%.*s", (int)port_len, rest);
+        rest += port_len;
+    }
+    snprintf(dr_hal_base_path, sizeof(dr_hal_base_path), "%s", rest);
+    size_t n = strlen(dr_hal_base_path);
+    if (n > 0 && dr_hal_base_path[n - 1] == '/') {
+        dr_hal_base_path[n - 1] = '\0';
+    }
+    dr_hal_auth[0] = '\0';
+    if (secret && secret[0]) {
+        snprintf(dr_hal_auth, sizeof(dr_hal_auth), "Authorization: Bearer %s\r\n", secret);
+    }
+}
+
+static int dr_hal_connect(void)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(dr_hal_host, dr_hal_port, &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        /* Bounds connect, each send and each recv */
+        struct timeval tv = {
+            .tv_sec = DR_HAL_HTTP_TIMEOUT_MS / 1000,
+            .tv_usec = (DR_HAL_HTTP_TIMEOUT_MS % 1000) * 1000,
+        };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool dr_hal_send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+typedef struct {
+    int fd;
+    char buf[DR_HAL_HEADER_MAX];
+    size_t pos;
+    size_t len;
+} dr_hal_reader_t;
+
+static bool dr_hal_fill(dr_hal_reader_t *r)
+{
+    if (r->pos < r->len) {
+        return true;
+    }
+    ssize_t n;
+    do {
+        n = recv(r->fd, r->buf, sizeof(r->buf), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+    r->pos = 0;
+    r->len = (size_t)n;
+    return true;
+}
+
+/* One header or chunk-size line without the CRLF; false on EOF or overflow */
+static bool dr_hal_read_line(dr_hal_reader_t *r, char *line, size_t size)
+{
+    size_t n = 0;
+    for (;;) {
+        if (!dr_hal_fill(r)) {
+            return false;
+        }
+        char c = r->buf[r->pos++];
+        if (c == '\n') {
+            if (n > 0 && line[n - 1] == '\r') {
+                n--;
+            }
+            line[n] = '\0';
+            return true;
+        }
+        if (n + 1 >= size) {
+            return false;
+        }
+        line[n++] = c;
+    }
+}
+
+/* Streams up to len bytes (or to EOF when len is -1) into the sink */
+static bool dr_hal_read_body(dr_hal_reader_t *r, long long len, const dr_hal_http_request_t *req)
+{
+    while (len != 0) {
+        if (!dr_hal_fill(r)) {
+            return len < 0;
+        }
+        size_t avail = r->len - r->pos;
+        if (len > 0 && (long long)avail > len) {
+            avail = (size_t)len;
+        }
+        if (req->on_body && !req->on_body(r->buf + r->pos, avail, req->ctx)) {
+            return false;
+        }
+        r->pos += avail;
+        if (len > 0) {
+            len -= (long long)avail;
+        }
+    }
+    return true;
+}
+
+static int dr_hal_read_response(dr_hal_reader_t *r, const dr_hal_http_request_t *req,
+                                char *etag, size_t etag_size)
+{
+    char line[512];
+    int status = -1;
+    long long content_length = -1;
+    bool chunked = false;
+    if (!dr_hal_read_line(r, line, sizeof(line)) ||
+        sscanf(line, "HTTP/%*d.%*d %d", &status) != 1) {
+        return -1;
+    }
+    while (dr_hal_read_line(r, line, sizeof(line)) && line[0] != '\0') {
+        char *value = strchr(line, ':');
+        if (!value) {
+            continue;
+        }
+        *value++ = '\0';
+        value += strspn(value, " \t");
+        if (strcasecmp(line, "Content-Length") == 0) {
+            content_length = strtoll(value, NULL, 10);
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+            chunked = strstr(value, "chunked") != NULL;
+        } else if (strcasecmp(line, "ETag") == 0 && etag && etag_size > 0) {
+            snprintf(etag, etag_size, "%s", value);
+        }
+    }
+
+    if (status == 204 || status == 304) {
+        return status;
+    }
+    if (!chunked) {
+        return dr_hal_read_body(r, content_length, req) ? status : -1;
+    }
+    for (;;) {
+        if (!dr_hal_read_line(r, line, sizeof(line))) {
+            return -1;
+        }
+        long long size = strtoll(line, NULL, 16);
+        if (size <= 0) {
+            return status;
+        }
+        if (!dr_hal_read_body(r, size, req) || !dr_hal_read_line(r, line, sizeof(line))) {
+            return -1;
+        }
+    }
+}
+
+int dr_hal_http_perform(const dr_hal_http_request_t *req, char *etag, size_t etag_size)
+{
+    if (etag && etag_size > 0) {
+        etag[0] = '\0';
+    }
+    int fd = dr_hal_connect();
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t body_len = req->body ? strlen(req->body) : 0;
+    char head[1024];
+    int head_len = snprintf(head, sizeof(head),
+        "%s %s%s HTTP/1.1\r\nHost: %s:%s\r\nConnection: close\r\n%s",
+        req->patch ? "PATCH" : req->post ? "POST" : "GET", dr_hal_base_path, req->path, dr_hal_host, dr_hal_port,
+        dr_hal_auth);
+    if (req->if_none_match && req->if_none_match[0] && head_len < (int)sizeof(head)) {
+        head_len += snprintf(head + head_len, sizeof(head) - (size_t)head_len,
+                             "If-None-Match: %s\r\n", req->if_none_match);
+    }
+    if (req->accept && req->accept[0] && head_len < (int)sizeof(head)) {
+        head_len += snprintf(head + head_len, sizeof(head) - (size_t)head_len, "Accept: %s\r\n",
+                             req->accept);
+    }
+    if ((req->post || req->patch) && head_len < (int)sizeof(head)) {
+        head_len += snprintf(head + head_len, sizeof(head) - (size_t)head_len,
+                             "Content-Type: application/json\r\nContent-Length: %zu\r\n",
+                             body_len);
+    }
+    if (head_len < (int)sizeof(head)) {
+        head_len += snprintf(head + head_len, sizeof(head) - (size_t)head_len, "\r\n");
+    }
+    if (head_len >= (int)sizeof(head) || !dr_hal_send_all(fd, head, (size_t)head_len) ||
+        (body_len > 0 && !dr_hal_send_all(fd, req->body, body_len))) {
+        close(fd);
+        return -1;
+    }
+
+    dr_hal_reader_t *r = malloc(sizeof(*r));
+    int status = -1;
+    if (r) {
+        r->fd = fd;
+        r->pos = 0;
+        r->len = 0;
+        status = dr_hal_read_response(r, req, etag, etag_size);
+        free(r);
+    }
+    close(fd);
+    return status;
+}
@@ -0,0 +1,23 @@
+#ifndef DR_HAL_LINUX_H
+#define DR_HAL_LINUX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Linux port of dr_hal.h.
+ *
+ * Storage keys are files under $DOSERIGHT_STORAGE_DIR (default
+ * /tmp/doseright). HTTP is plain http:// only, one connection per request,
+ * with the same 5 s socket timeout as backend_conn.
+ */
+
+/* base_url like "http://127.0.0.1:3000/api"; secret (may be NULL) is sent as a Bearer token */
+void dr_hal_linux_set_backend(const char *base_url, const char *secret);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,257 @@
+#include "device_sync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dr_hal.h"
+
+enum {
+    SECTION_NONE,
+    SECTION_TIME,
+    SECTION_UPCOMING,
+    SECTION_TAKEN,
+    SECTION_MISSED,
+    SECTION_PLANS,
+    SECTION_PROFILE,
+};
+
+#define NO_CAPTURE ((size_t)-1)
+
+static int device_sync_section_for(const char *key)
+{
+    if (strcmp(key, "time") == 0) {
+        return SECTION_TIME;
+    }
+    if (strcmp(key, "upcoming") == 0) {
+        return SECTION_UPCOMING;
+    }
+    if (strcmp(key, "taken") == 0) {
+        return SECTION_TAKEN;
+    }
+    if (strcmp(key, "missed") == 0) {
+        return SECTION_MISSED;
+    }
+    if (strcmp(key, "plans") == 0) {
+        return SECTION_PLANS;
+    }
+    if (strcmp(key, "profile") == 0) {
+        return SECTION_PROFILE;
+    }
+    return SECTION_NONE;
+}
+
+static device_sync_list_result_t *device_sync_list(device_sync_parser_t *p)
+{
+    switch (p->section) {
+        case SECTION_UPCOMING:
+            return &p->out->lists[DEVICE_SYNC_UPCOMING];
+        case SECTION_TAKEN:
+            return &p->out->lists[DEVICE_SYNC_TAKEN];
+        case SECTION_MISSED:
+            return &p->out->lists[DEVICE_SYNC_MISSED];
+        default:
+            return NULL;
+    }
+}
+
+static void device_sync_section_start(device_sync_parser_t *p)
+{
+    p->not_modified = false;
+    p->key[0] = '\0';
+    device_sync_list_result_t *list = device_sync_list(p);
+    if (list) {
+        med_json_begin_nested(&p->list, &list->cache, 1);
+    } else if (p->section == SECTION_PLANS) {
+        med_plan_begin_nested(&p->plans, &p->out->plans, 1);
+    }
+}
+
+static void device_sync_section_end(device_sync_parser_t *p)
+{
+    device_sync_result_t *out = p->out;
+    device_sync_list_result_t *list = device_sync_list(p);
+    if (list) {
+        if (p->not_modified) {
+            list->state = DEVICE_SYNC_NOT_MODIFIED;
+        } else if (p->list.saw_data) {
+            list->state = DEVICE_SYNC_UPDATED;
+            list->items_seen = p->list.items_seen;
+        }
+    } else if (p->section == SECTION_PLANS) {
+        if (p->not_modified) {
+            out->plans_state = DEVICE_SYNC_NOT_MODIFIED;
+        } else if (p->plans.saw_data) {
+            out->plans_state = DEVICE_SYNC_UPDATED;
+            out->plans_seen = p->plans.plans_seen;
+        }
+    } else if (p->section == SECTION_PROFILE) {
+        if (p->not_modified) {
+            out->profile_state = DEVICE_SYNC_NOT_MODIFIED;
+        } else if (p->capture_from != NO_CAPTURE && p->capture_to != NO_CAPTURE && !p->overflow) {
+            out->profile_state = DEVICE_SYNC_UPDATED;
+        }
+    } else if (p->section == SECTION_TIME) {
+        out->have_time = out->local_time12[0] != '\0' || out->local_time24[0] != '\0' || out->epoch_ms > 0;
+        out->time_recv_ms = dr_hal_now_us() / 1000;
+    }
+    p->section = SECTION_NONE;
+}
+
+static void device_sync_member(device_sync_parser_t *p, json_stream_event_t event, const char *text)
+{
+    device_sync_result_t *out = p->out;
+    if (event == JSON_STREAM_TRUE && strcmp(p->key, "notModified") == 0) {
+        p->not_modified = true;
+        return;
+    }
+    if (event == JSON_STREAM_STRING && strcmp(p->key, "etag") == 0) {
+        device_sync_list_result_t *list = device_sync_list(p);
+        if (list) {
+            snprintf(list->cache.etag, sizeof(list->cache.etag), "%s", text);
+        } else if (p->section == SECTION_PLANS) {
+            snprintf(out->plans.etag, sizeof(out->plans.etag), "%s", text);
+        } else if (p->section == SECTION_PROFILE) {
+            snprintf(out->profile_etag, sizeof(out->profile_etag), "%s", text);
+        }
+        return;
+    }
+    if (p->section != SECTION_TIME) {
+        return;
+    }
+    if (event == JSON_STREAM_STRING && strcmp(p->key, "localTime12") == 0) {
+        snprintf(out->local_time12, sizeof(out->local_time12), "%s", text);
+    } else if (event == JSON_STREAM_STRING && strcmp(p->key, "localTime24") == 0) {
+        snprintf(out->local_time24, sizeof(out->local_time24), "%s", text);
+    } else if (event == JSON_STREAM_NUMBER && strcmp(p->key, "epochMs") == 0) {
+        out->epoch_ms = strtoll(text, NULL, 10);
+    } else if (event == JSON_STREAM_NUMBER && strcmp(p->key, "processingMs") == 0) {
+        out->processing_ms = strtoll(text, NULL, 10);
+    } else if (event == JSON_STREAM_STRING && strcmp(p->key, "posixTz") == 0) {
+        snprintf(out->posix_tz, sizeof(out->posix_tz), "%s", text);
+    }
+}
+
+static bool device_sync_event(void *ctx, json_stream_event_t event, const char *text, size_t len, int depth)
+{
+    device_sync_parser_t *p = (device_sync_parser_t *)ctx;
+
+    if (depth == 1) {
+        if (event == JSON_STREAM_KEY) {
+            p->section = device_sync_section_for(text);
+        } else if (event == JSON_STREAM_OBJECT_START) {
+            device_sync_section_start(p);
+        } else if (event == JSON_STREAM_OBJECT_END) {
+            device_sync_section_end(p);
+        } else {
+            p->section = SECTION_NONE;
+        }
+        return true;
+    }
+    if (depth < 2 || p->section == SECTION_NONE) {
+        return true;
+    }
+
+    if (device_sync_list(p)) {
+        med_json_on_event(&p->list, event, text, len, depth);
+    } else if (p->section == SECTION_PLANS) {
+        med_plan_on_event(&p->plans, event, text, len, depth);
+    }
+
+    if (p->section == SECTION_PROFILE && strcmp(p->key, "body") == 0) {
+        if (depth == 2 && event == JSON_STREAM_OBJECT_START) {
+            p->capture_from = p->stream.offset;
+            p->capture_to = NO_CAPTURE;
+            p->out->profile_len = 0;
+        } else if (depth == 2 && event == JSON_STREAM_OBJECT_END && p->capture_from != NO_CAPTURE) {
+            p->capture_to = p->stream.offset + 1;
+        }
+    }
+
+    if (depth != 2) {
+        return true;
+    }
+    if (event == JSON_STREAM_KEY) {
+        snprintf(p->key, sizeof(p->key), "%s", text);
+        return true;
+    }
+    device_sync_member(p, event, text);
+    return true;
+}
+
+static void device_sync_capture(device_sync_parser_t *p, const char *data, size_t base, size_t len)
+{
+    if (p->capture_from == NO_CAPTURE || p->overflow) {
+        return;
+    }
+    size_t from = p->capture_from > base ? p->capture_from : base;
+    size_t to = (p->capture_to != NO_CAPTURE && p->capture_to < base + len) ? p->capture_to : base + len;
+    if (to <= from) {
+        return;
+    }
+
+    device_sync_result_t *out = p->out;
+    size_t n = to - from;
+    size_t needed = out->profile_len + n + 1;
+    if (needed > DEVICE_SYNC_PROFILE_MAX) {
+        p->overflow = true;
+        return;
+    }
+    if (needed > p->profile_cap) {
+        size_t cap = p->profile_cap ? p->profile_cap : 1024;
+        while (cap < needed) {
+            cap *= 2;
+        }
+        if (cap > DEVICE_SYNC_PROFILE_MAX) {
+            cap = DEVICE_SYNC_PROFILE_MAX;
+        }
+        char *buf = (char *)realloc(out->profile_json, cap);
+        if (!buf) {
+            p->overflow = true;
+            return;
+        }
+        out->profile_json = buf;
+        p->profile_cap = cap;
+    }
+    memcpy(out->profile_json + out->profile_len, data + (from - base), n);
+    out->profile_len += n;
+    out->profile_json[out->profile_len] = '\0';
+}
+
+void device_sync_begin(device_sync_parser_t *p, device_sync_result_t *out)
+{
+    memset(p, 0, sizeof(*p));
+    memset(out, 0, sizeof(*out));
+    p->out = out;
+    p->capture_from = NO_CAPTURE;
+    p->capture_to = NO_CAPTURE;
+    json_stream_init(&p->stream, device_sync_event, p);
+}
+
+bool device_sync_feed(device_sync_parser_t *p, const char *data, size_t len)
+{
+    size_t base = p->stream.offset;
+    bool ok = json_stream_feed(&p->stream, data, len);
+    device_sync_capture(p, data, base, len);
+    return ok;
+}
+
+bool device_sync_end(device_sync_parser_t *p)
+{
+    if (!json_stream_finish(&p->stream)) {
+        return false;
+    }
+    if (p->out->profile_state == DEVICE_SYNC_UPDATED && (!p->out->profile_json || p->overflow)) {
+        p->out->profile_state = DEVICE_SYNC_ABSENT;
+    }
+    return true;
+}
+
+void device_sync_result_free(device_sync_result_t *result)
+{
+    if (result && result->profile_json) {
+        free(result->profile_json);
+        result->profile_json = NULL;
+        result->profile_len = 0;
+    }
+}
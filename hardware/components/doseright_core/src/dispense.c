@@ -0,0 +1,528 @@
+#include "dispense.h"
+
+#include <stddef.h>
+
+#include "dr_hal.h"
+#include "dr_log.h"
+
+static const char *TAG = "dispense";
+
+static const char *const STATE_NAMES[DISPENSE_STATE_COUNT] = {
+    "idle", "positioning", "opening", "awaiting_drop", "closing", "reporting",
+};
+
+typedef struct {
+    int slot;
+    uint32_t doses;                 /* bit per dose index */
+    bool done;
+    uint32_t pills;
+    int64_t drop_us;                /* first pill, 0 if none */
+} ds_stop_t;
+
+static const dispense_ops_t *ds_ops = NULL;
+static dispense_carousel_t ds_carousel;
+static dispense_state_t ds_state = DISPENSE_IDLE;
+static int64_t ds_entered_us[DISPENSE_STATE_COUNT];
+static int ds_prepositioned_slot = 0;          /* 0 none, -1 moved away since */
+
+/* Current session */
+static ds_stop_t ds_stops[DISPENSE_MAX_STOPS];
+static size_t ds_stop_count = 0;
+static int ds_dose_count = 0;
+static int ds_stop = -1;                        /* stop being approached or served */
+static bool ds_refill = false;
+static bool ds_picked = false;
+static bool ds_positioned = false;
+static bool ds_approached = false;              /* within half a slot of the stop */
+static bool ds_lid_open = false;                /* from the open command to the close command */
+static bool ds_lid_ready = false;               /* lid fully open */
+static bool ds_opened_once = false;
+static uint32_t ds_count = 0;                   /* detector count since armed */
+static uint32_t ds_count_base = 0;              /* ds_count when the current stop began */
+static int64_t ds_session_us = 0;
+static int64_t ds_picked_us = 0;
+static int64_t ds_arrived_us = 0;
+
+static dispense_hist_t ds_hist[DISPENSE_LAT_COUNT];
+static dispense_preposition_stats_t ds_prepos;
+
+static void ds_record(dispense_latency_t latency, int64_t from_us, int64_t to_us)
+{
+    if (ds_refill || from_us <= 0 || to_us < from_us) {
+        return;
+    }
+    uint32_t ms = (uint32_t)((to_us - from_us) / 1000);
+    size_t bucket = 0;
+    while (bucket < DISPENSE_HIST_BUCKETS - 1 && ms >= (128u << bucket)) {
+        bucket++;
+    }
+    dr_hal_critical_enter();
+    dispense_hist_t *hist = &ds_hist[latency];
+    hist->count++;
+    hist->sum_ms += ms;
+    if (ms > hist->max_ms) {
+        hist->max_ms = ms;
+    }
+    hist->buckets[bucket]++;
+    dr_hal_critical_exit();
+}
+
+static void ds_enter(dispense_state_t next)
+{
+    int64_t now_us = dr_hal_now_us();
+    int64_t since_us = ds_state == DISPENSE_IDLE ? 0 : now_us - ds_entered_us[ds_state];
+    DR_LOGI(TAG, "%s -> %s (+%lld ms)", STATE_NAMES[ds_state], STATE_NAMES[next],
+             (long long)(since_us / 1000));
+    ds_state = next;
+    ds_entered_us[next] = now_us;
+}
+
+static int32_t ds_slot_pos(int slot)
+{
+    return (int32_t)(slot - 1) * ds_carousel.steps_per_slot;
+}
+
+static void ds_reset_session(bool refill)
+{
+    ds_stop_count = 0;
+    ds_dose_count = 0;
+    ds_stop = -1;
+    ds_refill = refill;
+    ds_picked = refill;
+    ds_positioned = false;
+    ds_approached = false;
+    ds_lid_open = false;
+    ds_lid_ready = false;
+    ds_opened_once = false;
+    ds_count = 0;
+    ds_count_base = 0;
+    ds_session_us = dr_hal_now_us();
+    ds_picked_us = refill ? ds_session_us : 0;
+}
+
+/* The pending stop that starts the shortest remaining route, or -1. */
+static int ds_next_stop(void)
+{
+    int32_t targets[DISPENSE_MAX_STOPS];
+    int index[DISPENSE_MAX_STOPS];
+    size_t n = 0;
+    for (size_t i = 0; i < ds_stop_count; ++i) {
+        if (!ds_stops[i].done) {
+            targets[n] = ds_slot_pos(ds_stops[i].slot);
+            index[n++] = (int)i;
+        }
+    }
+    if (n == 0) {
+        return -1;
+    }
+    int from_slot = ds_stop >= 0 ? ds_stops[ds_stop].slot : ds_ops->current_slot();
+    uint8_t order[DISPENSE_MAX_STOPS];
+    int32_t steps = dispense_plan_order(ds_slot_pos(from_slot), targets, n,
+                                        ds_carousel.steps_per_rev, order);
+    DR_LOGI(TAG, "%u stop(s) left, %ld steps; next slot %d", (unsigned)n, (long)steps,
+             ds_stops[index[order[0]]].slot);
+    return index[order[0]];
+}
+
+static bool ds_slot_emptied(int slot)
+{
+    for (size_t i = 0; i < ds_stop_count; ++i) {
+        if (ds_stops[i].slot == slot && ds_stops[i].done) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* True if the shorter way from one slot to another only passes emptied slots. */
+static bool ds_path_clear(int from_slot, int to_slot)
+{
+    if (from_slot == to_slot) {
+        return true;
+    }
+    int32_t delta = dispense_plan_delta(ds_slot_pos(from_slot), ds_slot_pos(to_slot),
+                                        ds_carousel.steps_per_rev);
+    int dir = delta >= 0 ? 1 : -1;
+    for (int slot = from_slot;;) {
+        slot = (slot - 1 + dir + ds_carousel.slots) % ds_carousel.slots + 1;
+        if (slot == to_slot) {
+            return true;
+        }
+        if (!ds_slot_emptied(slot)) {
+            return false;
+        }
+    }
+}
+
+/*
+ * Interlocks. Actuators overlap only where these hold:
+ *  - The lid opens over a moving carousel only within half a slot of the
+ *    stop, so the trapdoor only ever sees the stop's own compartment.
+ *  - The carousel moves under an open lid only across emptied slots
+ *    (ds_path_clear), and only from AWAITING_DROP, never while the lid moves.
+ *  - The detector is armed from the open command to the close command, so
+ *    pills that fall while the lid or the carousel still moves count for
+ *    the stop.
+ *  - The alert sound is stopped before the lid moves.
+ */
+static bool ds_may_open_early(int32_t steps_left)
+{
+    return steps_left <= ds_carousel.steps_per_slot / 2;
+}
+
+static void ds_travel(int stop)
+{
+    ds_stop = stop;
+    ds_positioned = false;
+    ds_approached = false;
+    ds_count_base = ds_count;
+    ds_enter(DISPENSE_POSITIONING);
+    ds_ops->position(ds_stops[stop].slot);
+}
+
+static void ds_open(void)
+{
+    ds_lid_open = true;
+    ds_lid_ready = false;
+    ds_count = 0;
+    ds_count_base = 0;
+    ds_ops->silence_alert();
+    ds_ops->arm_detector(true);
+    ds_enter(DISPENSE_OPENING);
+    ds_ops->open_lid();
+}
+
+static void ds_close(void)
+{
+    ds_ops->start_timer(0);
+    ds_ops->arm_detector(false);
+    ds_lid_open = false;
+    ds_enter(DISPENSE_CLOSING);
+    ds_ops->close_lid();
+}
+
+/* At a stop with the lid open: wait for pills (some may have dropped on the way in). */
+static void ds_serve(void)
+{
+    ds_stop_t *stop = &ds_stops[ds_stop];
+    ds_arrived_us = dr_hal_now_us();
+    ds_enter(DISPENSE_AWAITING_DROP);
+    if (ds_count > ds_count_base) {
+        /* Dropped while the lid opened on the way in: a 0 ms sample, so fast drops are not left out */
+        stop->drop_us = ds_arrived_us;
+        ds_record(DISPENSE_LAT_OPEN_TO_DROP, ds_arrived_us, stop->drop_us);
+        ds_ops->start_timer(DISPENSE_SETTLE_MS);
+    } else {
+        ds_ops->start_timer(DISPENSE_DROP_TIMEOUT_MS);
+    }
+}
+
+static void ds_leave(void)
+{
+    ds_stop_t *stop = &ds_stops[ds_stop];
+    stop->pills = ds_count - ds_count_base;
+    stop->done = true;
+    if (stop->pills == 0) {
+        DR_LOGW(TAG, "No pill detected at slot %d", stop->slot);
+    }
+    int next = ds_next_stop();
+    if (next >= 0 && ds_path_clear(stop->slot, ds_stops[next].slot)) {
+        ds_ops->start_timer(0);
+        ds_travel(next);
+    } else {
+        ds_close();
+    }
+}
+
+static void ds_report(void)
+{
+    ds_enter(DISPENSE_REPORTING);
+    int64_t now_us = dr_hal_now_us();
+    uint32_t total = 0;
+    for (size_t i = 0; i < ds_stop_count; ++i) {
+        const ds_stop_t *stop = &ds_stops[i];
+        total += stop->pills;
+        if (ds_refill || stop->pills == 0) {
+            continue;
+        }
+        for (int dose = 0; dose < ds_dose_count; ++dose) {
+            if (stop->doses & (1u << dose)) {
+                ds_ops->report(dose, stop->pills);
+            }
+        }
+        ds_record(DISPENSE_LAT_DROP_TO_REPORT, stop->drop_us, now_us);
+    }
+    DR_LOGI(TAG, "%s done: %d dose(s), %u stop(s), %lu pill(s)", ds_refill ? "Refill" : "Session",
+             ds_dose_count, (unsigned)ds_stop_count, (unsigned long)total);
+    ds_enter(DISPENSE_IDLE);
+}
+
+/* Drops the current session; closes the lid if it may be open. */
+static void ds_abort(void)
+{
+    dispense_state_t state = ds_state;
+    if (state == DISPENSE_IDLE) {
+        return;
+    }
+    bool close = ds_lid_open || state == DISPENSE_CLOSING;
+    ds_ops->silence_alert();
+    ds_ops->start_timer(0);
+    ds_ops->arm_detector(false);
+    ds_lid_open = false;
+    ds_enter(DISPENSE_IDLE);
+    if (close) {
+        ds_ops->close_lid();
+    }
+}
+
+void dispense_init(const dispense_ops_t *ops, const dispense_carousel_t *carousel)
+{
+    ds_ops = ops;
+    ds_carousel = *carousel;
+    ds_state = DISPENSE_IDLE;
+}
+
+int dispense_add_dose(int slot)
+{
+    if (!ds_ops || slot < 1 || slot > ds_carousel.slots) {
+        return -1;
+    }
+    if (ds_state != DISPENSE_IDLE && ds_refill) {
+        DR_LOGW(TAG, "Dose due during refill; aborting the refill");
+        ds_abort();
+    }
+    bool start = ds_state == DISPENSE_IDLE;
+    if (start) {
+        dr_hal_critical_enter();
+        if (ds_prepositioned_slot == slot) {
+            ds_prepos.valid++;
+        } else if (ds_prepositioned_slot != 0) {
+            ds_prepos.stale++;
+        } else {
+            ds_prepos.missed++;
+        }
+        ds_prepositioned_slot = 0;
+        dr_hal_critical_exit();
+        ds_reset_session(false);
+    }
+    if (ds_dose_count >= DISPENSE_MAX_DOSES) {
+        return -1;
+    }
+
+    size_t stop = 0;
+    while (stop < ds_stop_count && (ds_stops[stop].done || ds_stops[stop].slot != slot)) {
+        stop++;
+    }
+    if (stop == ds_stop_count) {
+        if (ds_stop_count >= DISPENSE_MAX_STOPS) {
+            return -1;
+        }
+        ds_stops[stop] = (ds_stop_t){.slot = slot};
+        ds_stop_count++;
+    }
+    int dose = ds_dose_count++;
+    ds_stops[stop].doses |= 1u << dose;
+    DR_LOGI(TAG, "Dose %d at slot %d (%u stop(s))", dose, slot, (unsigned)ds_stop_count);
+
+    if (start) {
+        ds_travel(ds_next_stop());
+    }
+    return dose;
+}
+
+void dispense_refill(int slot)
+{
+    if (!ds_ops || slot < 1 || slot > ds_carousel.slots) {
+        return;
+    }
+    if (ds_state != DISPENSE_IDLE) {
+        DR_LOGW(TAG, "Refill while %s; aborting it", STATE_NAMES[ds_state]);
+        ds_abort();
+    }
+    dr_hal_critical_enter();
+    if (ds_prepositioned_slot != 0) {
+        ds_prepositioned_slot = -1;
+    }
+    dr_hal_critical_exit();
+    ds_reset_session(true);
+    ds_stops[0] = (ds_stop_t){.slot = slot};
+    ds_stop_count = 1;
+    ds_travel(0);
+}
+
+bool dispense_preposition(int slot)
+{
+    if (!ds_ops || ds_state != DISPENSE_IDLE) {
+        return false;
+    }
+    DR_LOGI(TAG, "Pre-positioning carousel to slot %d", slot);
+    dr_hal_critical_enter();
+    ds_prepositioned_slot = slot;
+    ds_prepos.moves++;
+    dr_hal_critical_exit();
+    ds_ops->position(slot);
+    return true;
+}
+
+void dispense_pick(void)
+{
+    if (!ds_ops || ds_state == DISPENSE_IDLE) {
+        return;
+    }
+    if (!ds_picked) {
+        ds_picked = true;
+        ds_picked_us = dr_hal_now_us();
+    }
+    if (ds_state == DISPENSE_POSITIONING && (ds_positioned || ds_approached) && !ds_lid_open) {
+        ds_open();
+    }
+}
+
+void dispense_cancel(void)
+{
+    if (ds_ops) {
+        ds_abort();
+    }
+}
+
+void dispense_approaching(int32_t steps_left)
+{
+    if (ds_state != DISPENSE_POSITIONING || ds_positioned || !ds_may_open_early(steps_left)) {
+        return;
+    }
+    ds_approached = true;
+    if (ds_picked && !ds_lid_open) {
+        DR_LOGI(TAG, "Opening with %ld steps to go", (long)steps_left);
+        ds_open();
+    }
+}
+
+void dispense_positioned(void)
+{
+    if (ds_state == DISPENSE_OPENING) {
+        ds_positioned = true;
+        if (ds_lid_ready) {
+            ds_serve();
+        }
+        return;
+    }
+    if (ds_state != DISPENSE_POSITIONING) {
+        return;
+    }
+    ds_positioned = true;
+    if (ds_lid_open) {
+        ds_serve();
+    } else if (ds_picked) {
+        ds_open();
+    }
+}
+
+void dispense_lid_opened(void)
+{
+    if (ds_state != DISPENSE_OPENING) {
+        return;
+    }
+    ds_lid_ready = true;
+    if (!ds_opened_once) {
+        int64_t now_us = dr_hal_now_us();
+        ds_opened_once = true;
+        ds_record(DISPENSE_LAT_ALERT_TO_OPEN, ds_session_us, now_us);
+        ds_record(DISPENSE_LAT_PICK_TO_OPEN, ds_picked_us, now_us);
+    }
+    if (ds_positioned) {
+        ds_serve();
+    }
+}
+
+void dispense_dropped(uint32_t pills)
+{
+    if (!ds_lid_open) {
+        return;
+    }
+    ds_count = pills;
+    if (ds_state != DISPENSE_AWAITING_DROP) {
+        return;
+    }
+    ds_stop_t *stop = &ds_stops[ds_stop];
+    if (stop->drop_us == 0 && ds_count > ds_count_base) {
+        stop->drop_us = dr_hal_now_us();
+        ds_record(DISPENSE_LAT_OPEN_TO_DROP, ds_arrived_us, stop->drop_us);
+        ds_ops->start_timer(DISPENSE_SETTLE_MS);
+    }
+}
+
+void dispense_timeout(void)
+{
+    if (ds_state == DISPENSE_AWAITING_DROP) {
+        ds_leave();
+    }
+}
+
+void dispense_lid_closed(void)
+{
+    if (ds_state != DISPENSE_CLOSING) {
+        return;
+    }
+    int next = ds_next_stop();
+    if (next >= 0) {
+        ds_travel(next);
+    } else {
+        ds_report();
+    }
+}
+
+dispense_state_t dispense_state(void)
+{
+    return ds_state;
+}
+
+const char *dispense_state_name(dispense_state_t state)
+{
+    return state < DISPENSE_STATE_COUNT ? STATE_NAMES[state] : "unknown";
+}
+
+int dispense_dose_count(void)
+{
+    return ds_dose_count;
+}
+
+uint32_t dispense_dose_pills(int dose)
+{
+    if (dose < 0 || dose >= ds_dose_count) {
+        return 0;
+    }
+    for (size_t i = 0; i < ds_stop_count; ++i) {
+        const ds_stop_t *stop = &ds_stops[i];
+        if (!(stop->doses & (1u << dose))) {
+            continue;
+        }
+        if (stop->done) {
+            return stop->pills;
+        }
+        if (ds_state == DISPENSE_AWAITING_DROP && ds_stop == (int)i) {
+            return ds_count - ds_count_base;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+void dispense_stats_get(dispense_latency_t latency, dispense_hist_t *out)
+{
+    if (!out || latency >= DISPENSE_LAT_COUNT) {
+        return;
+    }
+    dr_hal_critical_enter();
+    *out = ds_hist[latency];
+    dr_hal_critical_exit();
+}
+
+void dispense_preposition_stats_get(dispense_preposition_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    dr_hal_critical_enter();
+    *out = ds_prepos;
+    dr_hal_critical_exit();
+}
@@ -0,0 +1,66 @@
+#include "dispense_plan.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct {
+    const int32_t *targets;
+    size_t count;
+    int32_t revolution;
+    uint8_t path[DISPENSE_PLAN_MAX];
+    uint8_t best[DISPENSE_PLAN_MAX];
+    int32_t best_cost;
+    bool used[DISPENSE_PLAN_MAX];
+} plan_search_t;
+
+int32_t dispense_plan_delta(int32_t from, int32_t to, int32_t revolution)
+{
+    if (revolution <= 0) {
+        return to - from;
+    }
+    int32_t forward = ((to - from) % revolution + revolution) % revolution;
+    return forward <= revolution - forward ? forward : forward - revolution;
+}
+
+static void plan_search(plan_search_t *s, size_t depth, int32_t at, int32_t cost)
+{
+    if (cost >= s->best_cost) {
+        return;
+    }
+    if (depth == s->count) {
+        s->best_cost = cost;
+        for (size_t i = 0; i < s->count; ++i) {
+            s->best[i] = s->path[i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < s->count; ++i) {
+        if (s->used[i]) {
+            continue;
+        }
+        s->used[i] = true;
+        s->path[depth] = (uint8_t)i;
+        int32_t leg = abs(dispense_plan_delta(at, s->targets[i], s->revolution));
+        plan_search(s, depth + 1, s->targets[i], cost + leg);
+        s->used[i] = false;
+    }
+}
+
+int32_t dispense_plan_order(int32_t from, const int32_t *targets, size_t count,
+                            int32_t revolution, uint8_t *order)
+{
+    if (!targets || !order || count > DISPENSE_PLAN_MAX) {
+        return -1;
+    }
+    plan_search_t s = {
+        .targets = targets,
+        .count = count,
+        .revolution = revolution,
+        .best_cost = INT32_MAX,
+    };
+    plan_search(&s, 0, from, 0);
+    for (size_t i = 0; i < count; ++i) {
+        order[i] = s.best[i];
+    }
+    return count == 0 ? 0 : s.best_cost;
+}
@@ -0,0 +1,296 @@
+#include "dose_scheduler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dr_hal.h"
+#include "dr_log.h"
+
+#define SCHED_FIRED_MAX 16
+#define SCHED_NEVER INT64_MAX
+
+static const char *TAG = "dose_scheduler";
+
+static dr_hal_mutex_t sched_lock = NULL;
+static dr_hal_timer_t sched_timer = NULL;
+static dose_scheduler_fire_fn sched_fire = NULL;
+static void *sched_ctx = NULL;
+static dose_scheduler_entry_t sched_heap[DOSE_SCHEDULER_MAX];
+static size_t sched_size = 0;
+static char sched_fired[SCHED_FIRED_MAX][48];
+static size_t sched_fired_next = 0;
+static dose_scheduler_prepare_fn sched_prepare = NULL;
+static void *sched_prepare_ctx = NULL;
+static int64_t sched_lead_ms = 0;
+static char sched_prepared[48];
+static int64_t sched_prepare_not_before_ms = 0;
+static int64_t sched_fire_not_before_ms = 0;
+static char sched_firing[48];       /* handed to the fire callback, not yet accepted */
+
+static int64_t sched_now_ms(void)
+{
+    return dr_hal_now_us() / 1000;
+}
+
+static void sched_key(const med_cache_item_t *item, char *key, size_t size)
+{
+    if (item->dose_id[0]) {
+        snprintf(key, size, "%s", item->dose_id);
+    } else {
+        snprintf(key, size, "%.30s@%s", item->name, item->time_str);
+    }
+}
+
+static bool sched_was_fired(const char *key)
+{
+    if (strcmp(sched_firing, key) == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < SCHED_FIRED_MAX; ++i) {
+        if (sched_fired[i][0] && strcmp(sched_fired[i], key) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void sched_mark_fired(const char *key)
+{
+    snprintf(sched_fired[sched_fired_next], sizeof(sched_fired[0]), "%s", key);
+    sched_fired_next = (sched_fired_next + 1) % SCHED_FIRED_MAX;
+}
+
+static void sched_swap(size_t a, size_t b)
+{
+    dose_scheduler_entry_t tmp = sched_heap[a];
+    sched_heap[a] = sched_heap[b];
+    sched_heap[b] = tmp;
+}
+
+static void sched_push(const dose_scheduler_entry_t *entry)
+{
+    if (sched_size >= DOSE_SCHEDULER_MAX) {
+        return;
+    }
+    size_t i = sched_size++;
+    sched_heap[i] = *entry;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (sched_heap[parent].due_ms <= sched_heap[i].due_ms) {
+            break;
+        }
+        sched_swap(parent, i);
+        i = parent;
+    }
+}
+
+static dose_scheduler_entry_t sched_pop(void)
+{
+    dose_scheduler_entry_t top = sched_heap[0];
+    sched_heap[0] = sched_heap[--sched_size];
+    size_t i = 0;
+    for (;;) {
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        size_t smallest = i;
+        if (left < sched_size && sched_heap[left].due_ms < sched_heap[smallest].due_ms) {
+            smallest = left;
+        }
+        if (right < sched_size && sched_heap[right].due_ms < sched_heap[smallest].due_ms) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        sched_swap(i, smallest);
+        i = smallest;
+    }
+    return top;
+}
+
+/*
+ * Pops and fires everything due, then hands the new root to the prepare
+ * callback once it is within the lead time, and re-arms the timer for
+ * whichever comes first.
+ */
+static void sched_run_due(void)
+{
+    for (;;) {
+        dr_hal_mutex_lock(sched_lock);
+        int64_t now_ms = sched_now_ms();
+        if (sched_size == 0 || sched_heap[0].due_ms > now_ms || sched_fire_not_before_ms > now_ms) {
+            int64_t wake_ms = SCHED_NEVER;
+            if (sched_size > 0) {
+                wake_ms = sched_heap[0].due_ms;
+                if (wake_ms < sched_fire_not_before_ms) {
+                    wake_ms = sched_fire_not_before_ms;
+                }
+            }
+            dose_scheduler_entry_t next = {0};
+            bool prepare = false;
+            if (sched_prepare && sched_size > 0) {
+                next = sched_heap[0];
+                char key[48];
+                sched_key(&next.item, key, sizeof(key));
+                if (strcmp(key, sched_prepared) != 0) {
+                    int64_t at_ms = next.due_ms - sched_lead_ms;
+                    if (at_ms < sched_prepare_not_before_ms) {
+                        at_ms = sched_prepare_not_before_ms;
+                    }
+                    if (at_ms <= now_ms) {
+                        prepare = true;
+                        snprintf(sched_prepared, sizeof(sched_prepared), "%s", key);
+                    } else if (at_ms < wake_ms) {
+                        wake_ms = at_ms;
+                    }
+                }
+            }
+            dr_hal_timer_stop(sched_timer);
+            if (wake_ms != SCHED_NEVER) {
+                dr_hal_timer_start_once(sched_timer, (uint64_t)(wake_ms - now_ms) * 1000);
+            }
+            dr_hal_mutex_unlock(sched_lock);
+
+            if (!prepare || sched_prepare(&next.item, next.due_ms - now_ms, sched_prepare_ctx)) {
+                return;
+            }
+            /* Declined (dispenser busy): try again later. */
+            dr_hal_mutex_lock(sched_lock);
+            sched_prepared[0] = '\0';
+            sched_prepare_not_before_ms = now_ms + DOSE_SCHEDULER_PREPARE_RETRY_MS;
+            dr_hal_mutex_unlock(sched_lock);
+            continue;
+        }
+
+        dose_scheduler_entry_t entry = sched_pop();
+        int64_t late_ms = now_ms - entry.due_ms;
+        char key[48];
+        sched_key(&entry.item, key, sizeof(key));
+        bool fire = late_ms <= DOSE_SCHEDULER_GRACE_MS && !sched_was_fired(key);
+        if (fire) {
+            snprintf(sched_firing, sizeof(sched_firing), "%s", key);
+        }
+        dr_hal_mutex_unlock(sched_lock);
+
+        if (fire) {
+            DR_LOGI(TAG, "Dose %s due (%lld ms late)", key, (long long)late_ms);
+            bool accepted = sched_fire(&entry.item, late_ms, sched_ctx);
+            dr_hal_mutex_lock(sched_lock);
+            sched_firing[0] = '\0';
+            if (accepted) {
+                sched_mark_fired(key);
+            } else {
+                /* Refused (alert queue full): keep it and try again shortly */
+                sched_push(&entry);
+                sched_fire_not_before_ms = now_ms + DOSE_SCHEDULER_FIRE_RETRY_MS;
+            }
+            dr_hal_mutex_unlock(sched_lock);
+        } else if (late_ms > DOSE_SCHEDULER_GRACE_MS) {
+            DR_LOGW(TAG, "Dose %s dropped, %lld min past due", key, (long long)(late_ms / 60000));
+        }
+    }
+}
+
+static void sched_timer_cb(void *arg)
+{
+    (void)arg;
+    sched_run_due();
+}
+
+bool dose_scheduler_init(dose_scheduler_fire_fn fire, void *ctx)
+{
+    if (!fire) {
+        return false;
+    }
+    if (sched_lock) {
+        return true;
+    }
+    sched_timer = dr_hal_timer_create("dose_sched", sched_timer_cb, NULL);
+    if (!sched_timer) {
+        return false;
+    }
+    sched_lock = dr_hal_mutex_create();
+    if (!sched_lock) {
+        return false;
+    }
+    sched_fire = fire;
+    sched_ctx = ctx;
+    return true;
+}
+
+void dose_scheduler_set_prepare(int64_t lead_ms, dose_scheduler_prepare_fn prepare, void *ctx)
+{
+    if (!sched_lock) {
+        return;
+    }
+    dr_hal_mutex_lock(sched_lock);
+    sched_prepare = prepare;
+    sched_prepare_ctx = ctx;
+    sched_lead_ms = lead_ms > 0 ? lead_ms : 0;
+    sched_prepared[0] = '\0';
+    dr_hal_mutex_unlock(sched_lock);
+    sched_run_due();
+}
+
+void dose_scheduler_prepare_declined(void)
+{
+    if (!sched_lock) {
+        return;
+    }
+    dr_hal_mutex_lock(sched_lock);
+    sched_prepared[0] = '\0';
+    sched_prepare_not_before_ms = sched_now_ms() + DOSE_SCHEDULER_PREPARE_RETRY_MS;
+    dr_hal_mutex_unlock(sched_lock);
+    sched_run_due();
+}
+
+void dose_scheduler_load(const dose_scheduler_entry_t *entries, size_t count)
+{
+    if (!sched_lock) {
+        return;
+    }
+    dr_hal_mutex_lock(sched_lock);
+    sched_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        char key[48];
+        sched_key(&entries[i].item, key, sizeof(key));
+        if (!sched_was_fired(key)) {
+            sched_push(&entries[i]);
+        }
+    }
+    dr_hal_mutex_unlock(sched_lock);
+    sched_run_due();
+}
+
+void dose_scheduler_clear(void)
+{
+    if (!sched_lock) {
+        return;
+    }
+    dr_hal_mutex_lock(sched_lock);
+    sched_size = 0;
+    dr_hal_timer_stop(sched_timer);
+    dr_hal_mutex_unlock(sched_lock);
+}
+
+size_t dose_scheduler_count(void)
+{
+    if (!sched_lock) {
+        return 0;
+    }
+    dr_hal_mutex_lock(sched_lock);
+    size_t count = sched_size;
+    dr_hal_mutex_unlock(sched_lock);
+    return count;
+}
+
+int64_t dose_scheduler_next_due_ms(void)
+{
+    if (!sched_lock) {
+        return -1;
+    }
+    dr_hal_mutex_lock(sched_lock);
+    int64_t due = sched_size > 0 ? sched_heap[0].due_ms : -1;
+    dr_hal_mutex_unlock(sched_lock);
+    return due;
+}
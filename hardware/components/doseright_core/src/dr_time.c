@@ -0,0 +1,223 @@
+#include "dr_time.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define DR_MINUTES_PER_DAY (24 * 60)
+#define DR_RTC_DRIFT_MIN_SPAN_MS (30 * 60 * 1000)
+#define DR_RTC_DRIFT_NOISE_PPB 100000       /* 100 ppm */
+#define DR_RTC_DRIFT_MAX_PPB 500000
+
+/* Up to two digits; returns the value or -1, advancing *p */
+static int dr_time_digits(const char **p)
+{
+    const char *s = *p;
+    if (*s < '0' || *s > '9') {
+        return -1;
+    }
+    int value = *s++ - '0';
+    if (*s >= '0' && *s <= '9') {
+        value = value * 10 + (*s++ - '0');
+    }
+    *p = s;
+    return value;
+}
+
+int dr_time_to_minutes(const char *src)
+{
+    if (!src) {
+        return -1;
+    }
+    const char *p = src;
+    while (*p == ' ') {
+        ++p;
+    }
+    int hour = dr_time_digits(&p);
+    if (hour < 0 || *p++ != ':') {
+        return -1;
+    }
+    int minute = dr_time_digits(&p);
+    if (minute < 0 || minute > 59) {
+        return -1;
+    }
+    if (*p == ':') {
+        ++p;
+        if (dr_time_digits(&p) < 0) {
+            return -1;
+        }
+    }
+    while (*p == ' ') {
+        ++p;
+    }
+    if (*p == '\0') {
+        return hour <= 23 ? hour * 60 + minute : -1;
+    }
+
+    /* 12 h suffix: AM/PM in any case, the M optional */
+    bool is_pm;
+    if (*p == 'A' || *p == 'a') {
+        is_pm = false;
+    } else if (*p == 'P' || *p == 'p') {
+        is_pm = true;
+    } else {
+        return -1;
+    }
+    ++p;
+    if (*p == 'M' || *p == 'm') {
+        ++p;
+    }
+    if (*p != '\0' || hour < 1 || hour > 12) {
+        return -1;
+    }
+    return (hour % 12 + (is_pm ? 12 : 0)) * 60 + minute;
+}
+
+void dr_time_minutes_12h(int minute_of_day, char *dst, size_t dst_size)
+{
+    if (!dst || dst_size == 0) {
+        return;
+    }
+    if (minute_of_day < 0 || minute_of_day >= DR_MINUTES_PER_DAY) {
+        snprintf(dst, dst_size, "--:--");
+        return;
+    }
+    int hour24 = minute_of_day / 60;
+    const char *ampm = (hour24 >= 12) ? "PM" : "AM";
+    int hour12 = hour24 % 12;
+    if (hour12 == 0) {
+        hour12 = 12;
+    }
+    snprintf(dst, dst_size, "%02d:%02d %s", hour12, minute_of_day % 60, ampm);
+}
+
+void dr_time_format_12h(const char *src, char *dst, size_t dst_size)
+{
+    if (!dst || dst_size == 0) {
+        return;
+    }
+    if (!src || src[0] == '\0') {
+        snprintf(dst, dst_size, "--:--");
+        return;
+    }
+    int minute_of_day = dr_time_to_minutes(src);
+    if (minute_of_day < 0) {
+        snprintf(dst, dst_size, "%s", src);
+        return;
+    }
+    dr_time_minutes_12h(minute_of_day, dst, dst_size);
+}
+
+void dr_rtc_init(dr_rtc_t *rtc)
+{
+    memset(rtc, 0, sizeof(*rtc));
+    rtc->interval_ms = DR_RTC_INTERVAL_MIN_MS;
+}
+
+int64_t dr_rtc_now_ms(const dr_rtc_t *rtc, int64_t raw_epoch_ms)
+{
+    if (rtc->set_epoch_ms <= 0 || raw_epoch_ms < DR_RTC_MIN_EPOCH_MS ||
+        raw_epoch_ms < rtc->set_epoch_ms - DR_RTC_MAX_ERROR_MS) {
+        return 0;
+    }
+    int64_t elapsed_ms = raw_epoch_ms - rtc->set_epoch_ms;
+    return raw_epoch_ms - elapsed_ms * rtc->drift_ppb / 1000000000;
+}
+
+int64_t dr_rtc_sample_rtt_ms(const dr_rtc_sample_t *sample)
+{
+    int64_t rtt_ms = sample->recv_ms - sample->sent_ms - sample->processing_ms;
+    return rtt_ms > 0 ? rtt_ms : 0;
+}
+
+bool dr_rtc_sync(dr_rtc_t *rtc, const dr_rtc_sample_t *sample, int64_t raw_epoch_ms, int64_t now_ms)
+{
+    if (sample->epoch_ms < DR_RTC_MIN_EPOCH_MS) {
+        return false;
+    }
+    int64_t rtt_ms = dr_rtc_sample_rtt_ms(sample);
+    /* The server stamped epoch_ms about halfway through the network round trip */
+    int64_t server_ms = sample->epoch_ms + rtt_ms / 2 + (now_ms - sample->recv_ms);
+    int64_t local_ms = dr_rtc_now_ms(rtc, raw_epoch_ms);
+
+    if (local_ms == 0) {
+        rtc->last_error_ms = 0;
+        rtc->interval_ms = DR_RTC_INTERVAL_MIN_MS;
+    } else {
+        if (rtt_ms > 2 * DR_RTC_MAX_ERROR_MS) {
+            return false;
+        }
+        int64_t error_ms = local_ms - server_ms;
+        int64_t span_ms = server_ms - rtc->set_epoch_ms;
+        /* Half the round trip bounds the sample's error; drift is only learned over spans that dwarf it */
+        if (span_ms >= DR_RTC_DRIFT_MIN_SPAN_MS && rtt_ms / 2 * 1000000000 / span_ms <= DR_RTC_DRIFT_NOISE_PPB) {
+            int64_t drift_ppb = rtc->drift_ppb + error_ms * 1000000000 / span_ms / 2;
+            if (drift_ppb > DR_RTC_DRIFT_MAX_PPB) {
+                drift_ppb = DR_RTC_DRIFT_MAX_PPB;
+            } else if (drift_ppb < -DR_RTC_DRIFT_MAX_PPB) {
+                drift_ppb = -DR_RTC_DRIFT_MAX_PPB;
+            }
+            rtc->drift_ppb = (int32_t)drift_ppb;
+        }
+
+        if (error_ms > INT32_MAX) {
+            error_ms = INT32_MAX;
+        } else if (error_ms < -INT32_MAX) {
+            error_ms = -INT32_MAX;
+        }
+        rtc->last_error_ms = (int32_t)error_ms;
+        int64_t abs_error_ms = error_ms < 0 ? -error_ms : error_ms;
+        if (abs_error_ms > DR_RTC_MAX_ERROR_MS) {
+            rtc->interval_ms = DR_RTC_INTERVAL_MIN_MS;
+        } else if (abs_error_ms <= DR_RTC_MAX_ERROR_MS / 2) {
+            rtc->interval_ms = rtc->interval_ms * 2 < DR_RTC_INTERVAL_MAX_MS ? rtc->interval_ms * 2
+                                                                             : DR_RTC_INTERVAL_MAX_MS;
+        }
+    }
+    rtc->set_epoch_ms = server_ms;
+    return true;
+}
+
+bool dr_rtc_local_minute(int64_t epoch_ms, int64_t now_ms, int *minute_of_day, int64_t *minute_start_ms)
+{
+    if (epoch_ms <= 0) {
+        return false;
+    }
+    time_t seconds = (time_t)(epoch_ms / 1000);
+    struct tm local;
+    if (!localtime_r(&seconds, &local)) {
+        return false;
+    }
+    if (minute_of_day) {
+        *minute_of_day = local.tm_hour * 60 + local.tm_min;
+    }
+    if (minute_start_ms) {
+        *minute_start_ms = now_ms - (local.tm_sec * 1000 + epoch_ms % 1000);
+    }
+    return true;
+}
+
+bool dr_rtc_tz_from_local(int local_minute, int64_t epoch_ms, char *dst, size_t dst_size)
+{
+    if (local_minute < 0 || local_minute >= DR_MINUTES_PER_DAY || epoch_ms <= 0 || !dst || dst_size == 0) {
+        return false;
+    }
+    int utc_minute = (int)(epoch_ms / 60000 % DR_MINUTES_PER_DAY);
+    int east = ((local_minute - utc_minute) % DR_MINUTES_PER_DAY + DR_MINUTES_PER_DAY) % DR_MINUTES_PER_DAY;
+    if (east > 14 * 60) {
+        east -= DR_MINUTES_PER_DAY;     /* zones run from UTC-12 to UTC+14 */
+    }
+    east = (east >= 0 ? east + 7 : east - 7) / 15 * 15;
+
+    /* Same shape as the server's: "<+0530>-5:30", "<-03>3" */
+    int abs_east = east < 0 ? -east : east;
+    char name[16];
+    if (abs_east % 60) {
+        snprintf(name, sizeof(name), "%c%02d%02d", east < 0 ? '-' : '+', abs_east / 60, abs_east % 60);
+        snprintf(dst, dst_size, "<%s>%s%d:%02d", name, east > 0 ? "-" : "", abs_east / 60, abs_east % 60);
+    } else {
+        snprintf(name, sizeof(name), "%c%02d", east < 0 ? '-' : '+', abs_east / 60);
+        snprintf(dst, dst_size, "<%s>%s%d", name, east > 0 ? "-" : "", abs_east / 60);
+    }
+    return true;
+}
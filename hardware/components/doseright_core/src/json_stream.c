@@ -0,0 +1,391 @@
+#include "json_stream.h"
+
+#include <string.h>
+
+enum {
+    JS_VALUE,
+    JS_KEY,
+    JS_COLON,
+    JS_AFTER_VALUE,
+    JS_STRING,
+    JS_ESCAPE,
+    JS_UNICODE,
+    JS_NUMBER,
+    JS_LITERAL,
+    JS_DONE,
+};
+
+static bool js_fail(json_stream_t *js)
+{
+    js->failed = true;
+    return false;
+}
+
+static bool js_emit(json_stream_t *js, json_stream_event_t event, int depth)
+{
+    js->token[js->token_len] = '\0';
+    if (!js->cb(js->ctx, event, js->token, js->token_len, depth)) {
+        return js_fail(js);
+    }
+    return true;
+}
+
+static void js_append(json_stream_t *js, char c)
+{
+    if (js->token_len < JSON_STREAM_TOKEN_MAX - 1) {
+        js->token[js->token_len++] = c;
+    }
+}
+
+static void js_append_utf8(json_stream_t *js, uint32_t cp)
+{
+    if (cp < 0x80) {
+        js_append(js, (char)cp);
+    } else if (cp < 0x800) {
+        js_append(js, (char)(0xC0 | (cp >> 6)));
+        js_append(js, (char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        js_append(js, (char)(0xE0 | (cp >> 12)));
+        js_append(js, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        js_append(js, (char)(0x80 | (cp & 0x3F)));
+    } else {
+        js_append(js, (char)(0xF0 | (cp >> 18)));
+        js_append(js, (char)(0x80 | ((cp >> 12) & 0x3F)));
+        js_append(js, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        js_append(js, (char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+static bool js_in_object(const json_stream_t *js)
+{
+    return js->depth > 0 && (js->object_bits & (1u << (js->depth - 1))) != 0;
+}
+
+static void js_value_done(json_stream_t *js)
+{
+    js->state = (js->depth == 0) ? JS_DONE : JS_AFTER_VALUE;
+}
+
+static bool js_open(json_stream_t *js, bool is_object)
+{
+    if (js->depth >= JSON_STREAM_MAX_DEPTH) {
+        return js_fail(js);
+    }
+    js->token_len = 0;
+    if (!js_emit(js, is_object ? JSON_STREAM_OBJECT_START : JSON_STREAM_ARRAY_START, js->depth)) {
+        return false;
+    }
+    if (is_object) {
+        js->object_bits |= (1u << js->depth);
+    } else {
+        js->object_bits &= ~(1u << js->depth);
+    }
+    js->depth++;
+    js->state = is_object ? JS_KEY : JS_VALUE;
+    return true;
+}
+
+static bool js_close(json_stream_t *js, bool is_object)
+{
+    if (js->depth == 0 || js_in_object(js) != is_object) {
+        return js_fail(js);
+    }
+    js->depth--;
+    js->token_len = 0;
+    if (!js_emit(js, is_object ? JSON_STREAM_OBJECT_END : JSON_STREAM_ARRAY_END, js->depth)) {
+        return false;
+    }
+    js_value_done(js);
+    return true;
+}
+
+static bool js_finish_literal(json_stream_t *js)
+{
+    js->token[js->token_len] = '\0';
+    json_stream_event_t event;
+    if (strcmp(js->token, "true") == 0) {
+        event = JSON_STREAM_TRUE;
+    } else if (strcmp(js->token, "false") == 0) {
+        event = JSON_STREAM_FALSE;
+    } else if (strcmp(js->token, "null") == 0) {
+        event = JSON_STREAM_NULL;
+    } else {
+        return js_fail(js);
+    }
+    if (!js_emit(js, event, js->depth)) {
+        return false;
+    }
+    js_value_done(js);
+    return true;
+}
+
+static bool js_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int js_hex(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool js_begin_value(json_stream_t *js, char c)
+{
+    js->token_len = 0;
+    if (c == '{') {
+        return js_open(js, true);
+    }
+    if (c == '[') {
+        return js_open(js, false);
+    }
+    if (c == ']' && js->depth > 0 && !js_in_object(js) && !js->after_comma) {
+        return js_close(js, false);
+    }
+    if (c == '"') {
+        js->string_is_key = false;
+        js->high_surrogate = 0;
+        js->state = JS_STRING;
+        return true;
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        js_append(js, c);
+        js->state = JS_NUMBER;
+        return true;
+    }
+    if (c == 't' || c == 'f' || c == 'n') {
+        js_append(js, c);
+        js->state = JS_LITERAL;
+        return true;
+    }
+    return js_fail(js);
+}
+
+static bool js_string_char(json_stream_t *js, char c)
+{
+    if (c == '\\') {
+        js->state = JS_ESCAPE;
+        return true;
+    }
+    if (js->high_surrogate) {
+        js_append(js, '?');
+        js->high_surrogate = 0;
+    }
+    if (c != '"') {
+        js_append(js, c);
+        return true;
+    }
+    if (js->string_is_key) {
+        if (!js_emit(js, JSON_STREAM_KEY, js->depth)) {
+            return false;
+        }
+        js->state = JS_COLON;
+        return true;
+    }
+    if (!js_emit(js, JSON_STREAM_STRING, js->depth)) {
+        return false;
+    }
+    js_value_done(js);
+    return true;
+}
+
+static bool js_escape_char(json_stream_t *js, char c)
+{
+    char out;
+    switch (c) {
+        case '"': out = '"'; break;
+        case '\\': out = '\\'; break;
+        case '/': out = '/'; break;
+        case 'b': out = '\b'; break;
+        case 'f': out = '\f'; break;
+        case 'n': out = '\n'; break;
+        case 'r': out = '\r'; break;
+        case 't': out = '\t'; break;
+        case 'u':
+            js->unicode = 0;
+            js->unicode_digits = 0;
+            js->state = JS_UNICODE;
+            return true;
+        default:
+            return js_fail(js);
+    }
+    if (js->high_surrogate) {
+        js_append(js, '?');
+        js->high_surrogate = 0;
+    }
+    js_append(js, out);
+    js->state = JS_STRING;
+    return true;
+}
+
+static bool js_unicode_char(json_stream_t *js, char c)
+{
+    int digit = js_hex(c);
+    if (digit < 0) {
+        return js_fail(js);
+    }
+    js->unicode = (js->unicode << 4) | (uint32_t)digit;
+    if (++js->unicode_digits < 4) {
+        return true;
+    }
+
+    uint32_t cp = js->unicode;
+    js->state = JS_STRING;
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        if (js->high_surrogate) {
+            js_append(js, '?');
+        }
+        js->high_surrogate = (uint16_t)cp;
+        return true;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (!js->high_surrogate) {
+            js_append(js, '?');
+            return true;
+        }
+        cp = 0x10000 + (((uint32_t)js->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+        js->high_surrogate = 0;
+    } else if (js->high_surrogate) {
+        js_append(js, '?');
+        js->high_surrogate = 0;
+    }
+    js_append_utf8(js, cp);
+    return true;
+}
+
+static bool js_structural_char(json_stream_t *js, char c)
+{
+    switch (js->state) {
+        case JS_VALUE:
+            if (!js_begin_value(js, c)) {
+                return false;
+            }
+            js->after_comma = false;
+            return true;
+        case JS_KEY:
+            if (c == '"') {
+                js->after_comma = false;
+                js->token_len = 0;
+                js->string_is_key = true;
+                js->high_surrogate = 0;
+                js->state = JS_STRING;
+                return true;
+            }
+            if (c == '}' && !js->after_comma) {
+                return js_close(js, true);
+            }
+            return js_fail(js);
+        case JS_COLON:
+            if (c != ':') {
+                return js_fail(js);
+            }
+            js->state = JS_VALUE;
+            return true;
+        case JS_AFTER_VALUE:
+            if (c == ',') {
+                js->after_comma = true;
+                js->state = js_in_object(js) ? JS_KEY : JS_VALUE;
+                return true;
+            }
+            if (c == '}' || c == ']') {
+                return js_close(js, c == '}');
+            }
+            return js_fail(js);
+        default:
+            return js_fail(js);
+    }
+}
+
+void json_stream_init(json_stream_t *js, json_stream_cb_t cb, void *ctx)
+{
+    memset(js, 0, sizeof(*js));
+    js->cb = cb;
+    js->ctx = ctx;
+    js->state = JS_VALUE;
+}
+
+bool json_stream_feed(json_stream_t *js, const char *data, size_t len)
+{
+    if (!js || js->failed) {
+        return false;
+    }
+    size_t i = 0;
+    while (i < len) {
+        char c = data[i];
+        switch (js->state) {
+            case JS_STRING:
+                if (!js_string_char(js, c)) {
+                    return false;
+                }
+                break;
+            case JS_ESCAPE:
+                if (!js_escape_char(js, c)) {
+                    return false;
+                }
+                break;
+            case JS_UNICODE:
+                if (!js_unicode_char(js, c)) {
+                    return false;
+                }
+                break;
+            case JS_NUMBER:
+                if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                    js_append(js, c);
+                    break;
+                }
+                if (!js_emit(js, JSON_STREAM_NUMBER, js->depth)) {
+                    return false;
+                }
+                js_value_done(js);
+                continue;
+            case JS_LITERAL:
+                if (c >= 'a' && c <= 'z') {
+                    js_append(js, c);
+                    break;
+                }
+                if (!js_finish_literal(js)) {
+                    return false;
+                }
+                continue;
+            case JS_DONE:
+                if (!js_is_space(c)) {
+                    return js_fail(js);
+                }
+                break;
+            default:
+                if (!js_is_space(c) && !js_structural_char(js, c)) {
+                    return false;
+                }
+                break;
+        }
+        i++;
+        js->offset++;
+    }
+    return true;
+}
+
+bool json_stream_finish(json_stream_t *js)
+{
+    if (!js || js->failed) {
+        return false;
+    }
+    if (js->state == JS_NUMBER && js->depth == 0) {
+        if (!js_emit(js, JSON_STREAM_NUMBER, 0)) {
+            return false;
+        }
+        js->state = JS_DONE;
+    } else if (js->state == JS_LITERAL && js->depth == 0) {
+        if (!js_finish_literal(js)) {
+            return false;
+        }
+    }
+    return js->state == JS_DONE;
+}
@@ -0,0 +1,134 @@
+#include "med_blob.h"
+
+#include <string.h>
+
+#include "dr_hal.h"
+
+void med_blob_put(med_blob_writer_t *w, const void *data, size_t n)
+{
+    if (w->bad || n > w->size - w->len) {
+        w->bad = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+}
+
+void med_blob_put_u8(med_blob_writer_t *w, uint8_t v)
+{
+    med_blob_put(w, &v, 1);
+}
+
+void med_blob_put_u16(med_blob_writer_t *w, uint16_t v)
+{
+    const uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+    med_blob_put(w, b, sizeof(b));
+}
+
+void med_blob_put_u32(med_blob_writer_t *w, uint32_t v)
+{
+    med_blob_put_u16(w, (uint16_t)v);
+    med_blob_put_u16(w, (uint16_t)(v >> 16));
+}
+
+void med_blob_put_i64(med_blob_writer_t *w, int64_t v)
+{
+    med_blob_put_u32(w, (uint32_t)(uint64_t)v);
+    med_blob_put_u32(w, (uint32_t)((uint64_t)v >> 32));
+}
+
+void med_blob_put_str(med_blob_writer_t *w, const char *s)
+{
+    size_t n = strlen(s);
+    if (n > 255) {
+        w->bad = true;
+        return;
+    }
+    med_blob_put_u8(w, (uint8_t)n);
+    med_blob_put(w, s, n);
+}
+
+const uint8_t *med_blob_get(med_blob_reader_t *r, size_t n)
+{
+    if (r->bad || n > r->len - r->pos) {
+        r->bad = true;
+        return NULL;
+    }
+    const uint8_t *p = r->buf + r->pos;
+    r->pos += n;
+    return p;
+}
+
+uint8_t med_blob_get_u8(med_blob_reader_t *r)
+{
+    const uint8_t *p = med_blob_get(r, 1);
+    return p ? p[0] : 0;
+}
+
+uint16_t med_blob_get_u16(med_blob_reader_t *r)
+{
+    const uint8_t *p = med_blob_get(r, 2);
+    return p ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+}
+
+uint32_t med_blob_get_u32(med_blob_reader_t *r)
+{
+    uint32_t lo = med_blob_get_u16(r);
+    return lo | ((uint32_t)med_blob_get_u16(r) << 16);
+}
+
+int64_t med_blob_get_i64(med_blob_reader_t *r)
+{
+    uint64_t lo = med_blob_get_u32(r);
+    return (int64_t)(lo | ((uint64_t)med_blob_get_u32(r) << 32));
+}
+
+void med_blob_get_str(med_blob_reader_t *r, char *dst, size_t dst_size)
+{
+    uint8_t n = med_blob_get_u8(r);
+    const uint8_t *p = med_blob_get(r, n);
+    size_t copy = p ? (n < dst_size ? n : dst_size - 1) : 0;
+    if (copy > 0) {
+        memcpy(dst, p, copy);
+    }
+    dst[copy] = '\0';
+}
+
+bool med_blob_object_id(const char *hex, uint8_t out[MED_BLOB_OBJECT_ID_LEN])
+{
+    for (int i = 0; i < MED_BLOB_OBJECT_ID_LEN * 2; ++i) {
+        char c = hex[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (v < 0) {
+            return false;
+        }
+        if (i % 2 == 0) {
+            out[i / 2] = (uint8_t)(v << 4);
+        } else {
+            out[i / 2] |= (uint8_t)v;
+        }
+    }
+    return true;
+}
+
+void med_blob_object_id_hex(const uint8_t *id, char *out)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < MED_BLOB_OBJECT_ID_LEN; ++i) {
+        out[i * 2] = hex[id[i] >> 4];
+        out[i * 2 + 1] = hex[id[i] & 0x0f];
+    }
+    out[MED_BLOB_OBJECT_ID_LEN * 2] = '\0';
+}
+
+bool med_blob_store(const char *key, const med_blob_writer_t *w, uint8_t *scratch)
+{
+    if (w->bad) {
+        return false;
+    }
+    size_t stored = w->size;
+    if (dr_hal_storage_get(key, scratch, &stored) && stored == w->len && memcmp(scratch, w->buf, w->len) == 0) {
+        return true;
+    }
+    return dr_hal_storage_set(key, w->buf, w->len);
+}
@@ -0,0 +1,64 @@
+#ifndef MED_BLOB_H
+#define MED_BLOB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Byte writer/reader for the storage encodings of med_cache.c and
+ * med_plan.c (private to doseright_core). Little-endian integers, strings
+ * as a length byte plus the bytes without NUL. A writer that runs out of
+ * room or a reader that runs past the end sets `bad` and ignores the rest.
+ */
+#define MED_BLOB_OBJECT_ID_LEN 12
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool bad;
+} med_blob_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    bool bad;
+} med_blob_reader_t;
+
+void med_blob_put(med_blob_writer_t *w, const void *data, size_t n);
+void med_blob_put_u8(med_blob_writer_t *w, uint8_t v);
+void med_blob_put_u16(med_blob_writer_t *w, uint16_t v);
+void med_blob_put_u32(med_blob_writer_t *w, uint32_t v);
+void med_blob_put_i64(med_blob_writer_t *w, int64_t v);
+void med_blob_put_str(med_blob_writer_t *w, const char *s);
+
+const uint8_t *med_blob_get(med_blob_reader_t *r, size_t n);
+uint8_t med_blob_get_u8(med_blob_reader_t *r);
+uint16_t med_blob_get_u16(med_blob_reader_t *r);
+uint32_t med_blob_get_u32(med_blob_reader_t *r);
+int64_t med_blob_get_i64(med_blob_reader_t *r);
+/* Copies into dst, truncated to dst_size - 1 */
+void med_blob_get_str(med_blob_reader_t *r, char *dst, size_t dst_size);
+
+/* 24 lowercase hex digits (a Mongo ObjectId) to 12 bytes and back (out holds 25 chars) */
+bool med_blob_object_id(const char *hex, uint8_t out[MED_BLOB_OBJECT_ID_LEN]);
+void med_blob_object_id_hex(const uint8_t *id, char *out);
+
+/*
+ * Stores the writer's bytes under key unless storage already holds exactly
+ * them, so an unchanged cache costs a read instead of a flash write.
+ * scratch must have room for w->size bytes.
+ */
+bool med_blob_store(const char *key, const med_blob_writer_t *w, uint8_t *scratch);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,284 @@
+#include "med_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dr_hal.h"
+#include "dr_time.h"
+#include "med_blob.h"
+
+/*
+ * Storage layout, version MED_CACHE_BLOB_VERSION:
+ *   'M' 'C' version  etag  updated  u8 n strings[n]  u8 count  item[count]
+ *   item: u8 flags  u16 minute (0xffff unknown)  u8 name  u8 dose  u8 status
+ *         u16 slot  [u8 time_str]  [dose id]
+ * Strings are length-prefixed; name, dose, status and an irregular time_str
+ * are indexes into the interned strings[]. The dose id is 12 bytes for an
+ * ObjectId, 12 bytes + u32 epoch minute for a plan occurrence, or a string.
+ */
+#define MED_CACHE_BLOB_VERSION 1
+#define MED_CACHE_BLOB_MAX (sizeof(med_cache_t) + 64)
+#define MED_CACHE_STRINGS_MAX (MED_CACHE_MAX * 4)
+
+#define MED_CACHE_ID_OBJECT 0x01
+#define MED_CACHE_ID_PLAN 0x02
+#define MED_CACHE_ID_TEXT 0x04
+#define MED_CACHE_TIME_TEXT 0x08
+
+typedef struct {
+    const char *strings[MED_CACHE_STRINGS_MAX];
+    size_t count;
+} med_cache_strings_t;
+
+static uint8_t med_cache_intern(med_cache_strings_t *table, const char *s)
+{
+    for (size_t i = 0; i < table->count; ++i) {
+        if (strcmp(table->strings[i], s) == 0) {
+            return (uint8_t)i;
+        }
+    }
+    table->strings[table->count] = s;
+    return (uint8_t)table->count++;
+}
+
+/* time_str is implied by minute unless the backend sent something else */
+static bool med_cache_time_regular(const med_cache_item_t *item)
+{
+    char expect[sizeof(item->time_str)];
+    if (item->minute < 0) {
+        return item->time_str[0] == '\0';
+    }
+    snprintf(expect, sizeof(expect), "%02u:%02u", (unsigned)item->minute / 60 % 24,
+             (unsigned)item->minute % 60);
+    return strcmp(expect, item->time_str) == 0;
+}
+
+/* Plan occurrence ids are "<planId>@<epoch minute>" (med_plan_expand) */
+static bool med_cache_plan_minute(const char *dose_id, uint32_t *minute)
+{
+    const char *digits = dose_id + MED_BLOB_OBJECT_ID_LEN * 2;
+    if (strlen(dose_id) <= MED_BLOB_OBJECT_ID_LEN * 2 + 1 || digits[0] != '@') {
+        return false;
+    }
+    char *end = NULL;
+    unsigned long long value = strtoull(digits + 1, &end, 10);
+    if (*end != '\0' || value > UINT32_MAX) {
+        return false;
+    }
+    /* Only ids that print back identically, so decoding restores them exactly */
+    char check[16];
+    snprintf(check, sizeof(check), "%llu", value);
+    *minute = (uint32_t)value;
+    return strcmp(check, digits + 1) == 0;
+}
+
+static uint8_t med_cache_put_dose_id(med_blob_writer_t *w, const char *dose_id)
+{
+    uint8_t id[MED_BLOB_OBJECT_ID_LEN];
+    uint32_t minute = 0;
+    if (strlen(dose_id) == MED_BLOB_OBJECT_ID_LEN * 2 && med_blob_object_id(dose_id, id)) {
+        med_blob_put(w, id, sizeof(id));
+        return MED_CACHE_ID_OBJECT;
+    }
+    if (med_cache_plan_minute(dose_id, &minute) && med_blob_object_id(dose_id, id)) {
+        med_blob_put(w, id, sizeof(id));
+        med_blob_put_u32(w, minute);
+        return MED_CACHE_ID_PLAN;
+    }
+    if (dose_id[0] == '\0') {
+        return 0;
+    }
+    med_blob_put_str(w, dose_id);
+    return MED_CACHE_ID_TEXT;
+}
+
+static void med_cache_encode(const med_cache_t *cache, med_blob_writer_t *w)
+{
+    med_cache_strings_t table = {0};
+    uint8_t refs[MED_CACHE_MAX][4];
+    size_t count = cache->count < MED_CACHE_MAX ? cache->count : MED_CACHE_MAX;
+    for (size_t i = 0; i < count; ++i) {
+        const med_cache_item_t *item = &cache->items[i];
+        refs[i][0] = med_cache_intern(&table, item->name);
+        refs[i][1] = med_cache_intern(&table, item->dose);
+        refs[i][2] = med_cache_intern(&table, item->status);
+        refs[i][3] = med_cache_time_regular(item) ? 0 : med_cache_intern(&table, item->time_str);
+    }
+
+    const uint8_t magic[] = {'M', 'C', MED_CACHE_BLOB_VERSION};
+    med_blob_put(w, magic, sizeof(magic));
+    med_blob_put_str(w, cache->etag);
+    med_blob_put_str(w, cache->updated);
+    med_blob_put_u8(w, (uint8_t)table.count);
+    for (size_t i = 0; i < table.count; ++i) {
+        med_blob_put_str(w, table.strings[i]);
+    }
+    med_blob_put_u8(w, (uint8_t)count);
+    for (size_t i = 0; i < count; ++i) {
+        const med_cache_item_t *item = &cache->items[i];
+        size_t flags_at = w->len;
+        med_blob_put_u8(w, 0);
+        med_blob_put_u16(w, item->minute >= 0 ? (uint16_t)item->minute : 0xffff);
+        med_blob_put(w, refs[i], 3);
+        med_blob_put_u16(w, (uint16_t)(int16_t)item->slot);
+        uint8_t flags = 0;
+        if (!med_cache_time_regular(item)) {
+            flags |= MED_CACHE_TIME_TEXT;
+            med_blob_put_u8(w, refs[i][3]);
+        }
+        flags |= med_cache_put_dose_id(w, item->dose_id);
+        if (!w->bad) {
+            w->buf[flags_at] = flags;
+        }
+    }
+}
+
+static bool med_cache_decode(med_blob_reader_t *r, med_cache_t *cache)
+{
+    const uint8_t *magic = med_blob_get(r, 3);
+    if (!magic || magic[0] != 'M' || magic[1] != 'C' || magic[2] != MED_CACHE_BLOB_VERSION) {
+        return false;
+    }
+    med_blob_get_str(r, cache->etag, sizeof(cache->etag));
+    med_blob_get_str(r, cache->updated, sizeof(cache->updated));
+
+    /* Interned strings stay in the blob; indexes are resolved while copying */
+    size_t string_at[MED_CACHE_STRINGS_MAX];
+    size_t string_count = med_blob_get_u8(r);
+    if (string_count > MED_CACHE_STRINGS_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < string_count; ++i) {
+        string_at[i] = r->pos;
+        med_blob_get(r, med_blob_get_u8(r));
+    }
+
+    cache->count = med_blob_get_u8(r);
+    if (cache->count > MED_CACHE_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < cache->count && !r->bad; ++i) {
+        med_cache_item_t *item = &cache->items[i];
+        uint8_t flags = med_blob_get_u8(r);
+        uint16_t minute = med_blob_get_u16(r);
+        item->minute = minute == 0xffff ? -1 : minute;
+        const uint8_t *ref = med_blob_get(r, 3);
+        if (!ref) {
+            return false;
+        }
+        item->slot = (int16_t)med_blob_get_u16(r);
+        bool time_text = (flags & MED_CACHE_TIME_TEXT) != 0;
+        const uint8_t refs[] = {ref[0], ref[1], ref[2], time_text ? med_blob_get_u8(r) : 0};
+        char *const fields[] = {item->name, item->dose, item->status, item->time_str};
+        const size_t sizes[] = {sizeof(item->name), sizeof(item->dose), sizeof(item->status),
+                                sizeof(item->time_str)};
+        for (int f = 0; f < (time_text ? 4 : 3); ++f) {
+            if (refs[f] >= string_count) {
+                return false;
+            }
+            med_blob_reader_t s = {r->buf, r->len, string_at[refs[f]], false};
+            med_blob_get_str(&s, fields[f], sizes[f]);
+        }
+        if (!time_text && item->minute >= 0) {
+            snprintf(item->time_str, sizeof(item->time_str), "%02u:%02u", minute / 60 % 24, minute % 60);
+        }
+
+        if (flags & (MED_CACHE_ID_OBJECT | MED_CACHE_ID_PLAN)) {
+            const uint8_t *id = med_blob_get(r, MED_BLOB_OBJECT_ID_LEN);
+            if (!id) {
+                return false;
+            }
+            med_blob_object_id_hex(id, item->dose_id);
+            if (flags & MED_CACHE_ID_PLAN) {
+                size_t at = MED_BLOB_OBJECT_ID_LEN * 2;
+                snprintf(item->dose_id + at, sizeof(item->dose_id) - at, "@%lu",
+                         (unsigned long)med_blob_get_u32(r));
+            }
+        } else if (flags & MED_CACHE_ID_TEXT) {
+            med_blob_get_str(r, item->dose_id, sizeof(item->dose_id));
+        }
+    }
+    return !r->bad;
+}
+
+bool med_cache_save(const char *key, const med_cache_t *cache)
+{
+    if (!key || !cache) {
+        return false;
+    }
+    uint8_t *buf = malloc(MED_CACHE_BLOB_MAX * 2);
+    if (!buf) {
+        return false;
+    }
+    med_blob_writer_t w = {buf, MED_CACHE_BLOB_MAX, 0, false};
+    med_cache_encode(cache, &w);
+    bool ok = med_blob_store(key, &w, buf + MED_CACHE_BLOB_MAX);
+    free(buf);
+    return ok;
+}
+
+bool med_cache_load(const char *key, med_cache_t *cache)
+{
+    if (!key || !cache) {
+        return false;
+    }
+    uint8_t *buf = malloc(MED_CACHE_BLOB_MAX);
+    if (!buf) {
+        return false;
+    }
+    size_t size = MED_CACHE_BLOB_MAX;
+    bool ok = dr_hal_storage_get(key, buf, &size);
+    if (ok) {
+        /* Another version or a damaged blob leaves the cache empty until the next sync */
+        med_blob_reader_t r = {buf, size, 0, false};
+        memset(cache, 0, sizeof(*cache));
+        ok = med_cache_decode(&r, cache);
+        if (!ok) {
+            memset(cache, 0, sizeof(*cache));
+        }
+        cache->valid = ok;
+    }
+    free(buf);
+    return ok;
+}
+
+void med_cache_render(const med_cache_t *cache, bool offline, med_cache_line_fn emit, void *ctx)
+{
+    if (!cache || !cache->valid) {
+        emit("No cached data", ctx);
+        return;
+    }
+
+    if (offline) {
+        emit("Offline - showing last data", ctx);
+    }
+    if (cache->updated[0] != '\0') {
+        char line[48];
+        snprintf(line, sizeof(line), "Last update: %s", cache->updated);
+        emit(line, ctx);
+    }
+
+    if (cache->count == 0) {
+        emit("No records found", ctx);
+        return;
+    }
+
+    for (size_t i = 0; i < cache->count; ++i) {
+        const med_cache_item_t *item = &cache->items[i];
+        char line[128];
+        char time_buf[16];
+        if (item->minute >= 0) {
+            dr_time_minutes_12h(item->minute, time_buf, sizeof(time_buf));
+        } else {
+            snprintf(time_buf, sizeof(time_buf), "%s", item->time_str);
+        }
+        snprintf(line, sizeof(line), "%s  |  %s", item->name[0] ? item->name : "--",
+                 time_buf[0] ? time_buf : "--:--");
+        emit(line, ctx);
+
+        snprintf(line, sizeof(line), "Dose: %s  Slot: %d", item->dose[0] ? item->dose : "--", item->slot);
+        emit(line, ctx);
+        emit(" ", ctx);
+    }
+}
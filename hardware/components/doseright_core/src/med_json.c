@@ -0,0 +1,115 @@
+#include "med_json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dr_time.h"
+
+static void med_json_copy(char *dst, size_t dst_size, const char *src)
+{
+    snprintf(dst, dst_size, "%s", src);
+}
+
+static void med_json_set_field(med_cache_item_t *item, const char *key, json_stream_event_t event,
+                               const char *text)
+{
+    if (event == JSON_STREAM_NUMBER) {
+        if (strcmp(key, "slot") == 0) {
+            item->slot = atoi(text);
+        }
+        return;
+    }
+    if (event != JSON_STREAM_STRING) {
+        return;
+    }
+    if (strcmp(key, "medicineName") == 0) {
+        med_json_copy(item->name, sizeof(item->name), text);
+    } else if (strcmp(key, "dosage") == 0) {
+        med_json_copy(item->dose, sizeof(item->dose), text);
+    } else if (strcmp(key, "scheduledTime") == 0) {
+        med_json_copy(item->time_str, sizeof(item->time_str), text);
+        item->minute = dr_time_to_minutes(text);
+    } else if (strcmp(key, "status") == 0) {
+        med_json_copy(item->status, sizeof(item->status), text);
+    } else if (strcmp(key, "doseId") == 0) {
+        med_json_copy(item->dose_id, sizeof(item->dose_id), text);
+    } else if (strcmp(key, "id") == 0 && item->dose_id[0] == '\0') {
+        med_json_copy(item->dose_id, sizeof(item->dose_id), text);
+    }
+}
+
+bool med_json_on_event(void *ctx, json_stream_event_t event, const char *text, size_t len, int depth)
+{
+    (void)len;
+    med_json_ingest_t *ing = (med_json_ingest_t *)ctx;
+    depth -= ing->base_depth;
+
+    if (event == JSON_STREAM_KEY) {
+        if (depth == 1) {
+            ing->in_data = false;
+        }
+        med_json_copy(ing->key, sizeof(ing->key), text);
+        return true;
+    }
+
+    /* {"data": [ {item}, ... ]} -> root members at depth 1, items at 2, fields at 3 */
+    if (depth == 1 && event == JSON_STREAM_ARRAY_START && strcmp(ing->key, "data") == 0) {
+        ing->in_data = true;
+        ing->saw_data = true;
+        return true;
+    }
+    if (!ing->in_data) {
+        return true;
+    }
+
+    if (depth == 2 && event == JSON_STREAM_OBJECT_START) {
+        ing->items_seen++;
+        ing->item = NULL;
+        if (ing->out->count < MED_CACHE_MAX) {
+            ing->item = &ing->out->items[ing->out->count];
+            memset(ing->item, 0, sizeof(*ing->item));
+            ing->item->minute = -1;
+        }
+        return true;
+    }
+    if (depth == 2 && event == JSON_STREAM_OBJECT_END) {
+        if (ing->item) {
+            ing->out->count++;
+            ing->item = NULL;
+        }
+        return true;
+    }
+    if (depth == 1 && event == JSON_STREAM_ARRAY_END) {
+        ing->in_data = false;
+        return true;
+    }
+    if (depth == 3 && ing->item) {
+        med_json_set_field(ing->item, ing->key, event, text);
+    }
+    return true;
+}
+
+void med_json_begin(med_json_ingest_t *ing, med_cache_t *out)
+{
+    memset(ing, 0, sizeof(*ing));
+    memset(out, 0, sizeof(*out));
+    ing->out = out;
+    json_stream_init(&ing->stream, med_json_on_event, ing);
+}
+
+void med_json_begin_nested(med_json_ingest_t *ing, med_cache_t *out, int base_depth)
+{
+    med_json_begin(ing, out);
+    ing->base_depth = base_depth;
+}
+
+bool med_json_feed(med_json_ingest_t *ing, const char *data, size_t len)
+{
+    return json_stream_feed(&ing->stream, data, len);
+}
+
+bool med_json_end(med_json_ingest_t *ing)
+{
+    return json_stream_finish(&ing->stream);
+}
@@ -0,0 +1,340 @@
+#include "med_plan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dr_hal.h"
+#include "med_blob.h"
+
+#define MED_PLAN_MINUTES_PER_DAY 1440
+
+static void med_plan_set_field(med_plan_t *plan, const char *key, json_stream_event_t event,
+                               const char *text)
+{
+    if (event == JSON_STREAM_NUMBER) {
+        if (strcmp(key, "slot") == 0) {
+            plan->slot = (int8_t)atoi(text);
+        } else if (strcmp(key, "startMs") == 0) {
+            plan->start_ms = strtoll(text, NULL, 10);
+        } else if (strcmp(key, "endMs") == 0) {
+            plan->end_ms = strtoll(text, NULL, 10);
+        }
+        return;
+    }
+    if (event != JSON_STREAM_STRING) {
+        return;
+    }
+    if (strcmp(key, "planId") == 0) {
+        snprintf(plan->plan_id, sizeof(plan->plan_id), "%s", text);
+    } else if (strcmp(key, "medicineName") == 0) {
+        snprintf(plan->name, sizeof(plan->name), "%s", text);
+    } else if (strcmp(key, "dosage") == 0) {
+        snprintf(plan->dose, sizeof(plan->dose), "%s", text);
+    }
+}
+
+/* Elements of the "times" and "daysOfWeek" arrays */
+static void med_plan_set_element(med_plan_t *plan, const char *key, const char *text)
+{
+    long value = strtol(text, NULL, 10);
+    if (strcmp(key, "times") == 0) {
+        if (value >= 0 && value < MED_PLAN_MINUTES_PER_DAY && plan->time_count < MED_PLAN_TIMES_MAX) {
+            plan->times[plan->time_count++] = (uint16_t)value;
+        }
+    } else if (strcmp(key, "daysOfWeek") == 0) {
+        if (value >= 1 && value <= 7) {
+            plan->days |= (uint8_t)(1u << (value - 1));
+        }
+    }
+}
+
+bool med_plan_on_event(void *ctx, json_stream_event_t event, const char *text, size_t len, int depth)
+{
+    (void)len;
+    med_plan_ingest_t *ing = (med_plan_ingest_t *)ctx;
+    depth -= ing->base_depth;
+
+    if (event == JSON_STREAM_KEY) {
+        if (depth == 1) {
+            ing->in_data = false;
+        }
+        snprintf(ing->key, sizeof(ing->key), "%s", text);
+        return true;
+    }
+
+    /* {"data": [ {plan}, ... ]} -> plans at depth 2, fields at 3, array elements at 4 */
+    if (depth == 1 && event == JSON_STREAM_ARRAY_START && strcmp(ing->key, "data") == 0) {
+        ing->in_data = true;
+        ing->saw_data = true;
+        return true;
+    }
+    if (!ing->in_data) {
+        return true;
+    }
+
+    if (depth == 2 && event == JSON_STREAM_OBJECT_START) {
+        ing->plans_seen++;
+        ing->plan = NULL;
+        if (ing->out->count < MED_PLAN_MAX) {
+            ing->plan = &ing->out->plans[ing->out->count];
+            memset(ing->plan, 0, sizeof(*ing->plan));
+        }
+        return true;
+    }
+    if (depth == 2 && event == JSON_STREAM_OBJECT_END) {
+        if (ing->plan) {
+            ing->out->count++;
+            ing->plan = NULL;
+        }
+        return true;
+    }
+    if (depth == 1 && event == JSON_STREAM_ARRAY_END) {
+        ing->in_data = false;
+        return true;
+    }
+    if (!ing->plan) {
+        return true;
+    }
+    if (depth == 3) {
+        med_plan_set_field(ing->plan, ing->key, event, text);
+    } else if (depth == 4 && event == JSON_STREAM_NUMBER) {
+        med_plan_set_element(ing->plan, ing->key, text);
+    }
+    return true;
+}
+
+void med_plan_begin(med_plan_ingest_t *ing, med_plan_set_t *out)
+{
+    memset(ing, 0, sizeof(*ing));
+    memset(out, 0, sizeof(*out));
+    ing->out = out;
+    json_stream_init(&ing->stream, med_plan_on_event, ing);
+}
+
+void med_plan_begin_nested(med_plan_ingest_t *ing, med_plan_set_t *out, int base_depth)
+{
+    med_plan_begin(ing, out);
+    ing->base_depth = base_depth;
+}
+
+bool med_plan_feed(med_plan_ingest_t *ing, const char *data, size_t len)
+{
+    return json_stream_feed(&ing->stream, data, len);
+}
+
+bool med_plan_end(med_plan_ingest_t *ing)
+{
+    return json_stream_finish(&ing->stream);
+}
+
+/*
+ * Storage layout, version MED_PLAN_BLOB_VERSION:
+ *   'M' 'P' version  etag  u8 count  plan[count]
+ *   plan: u8 id kind (1 = 12-byte ObjectId, 0 = string)  id  name  dose
+ *         u8 slot  u8 days  u8 n  u16 times[n]  i64 start_ms  i64 end_ms
+ */
+#define MED_PLAN_BLOB_VERSION 1
+#define MED_PLAN_BLOB_MAX (sizeof(med_plan_set_t) + 64)
+
+static void med_plan_encode(const med_plan_set_t *set, med_blob_writer_t *w)
+{
+    size_t count = set->count < MED_PLAN_MAX ? set->count : MED_PLAN_MAX;
+    const uint8_t magic[] = {'M', 'P', MED_PLAN_BLOB_VERSION};
+    med_blob_put(w, magic, sizeof(magic));
+    med_blob_put_str(w, set->etag);
+    med_blob_put_u8(w, (uint8_t)count);
+    for (size_t i = 0; i < count; ++i) {
+        const med_plan_t *plan = &set->plans[i];
+        uint8_t id[MED_BLOB_OBJECT_ID_LEN];
+        if (strlen(plan->plan_id) == MED_BLOB_OBJECT_ID_LEN * 2 && med_blob_object_id(plan->plan_id, id)) {
+            med_blob_put_u8(w, 1);
+            med_blob_put(w, id, sizeof(id));
+        } else {
+            med_blob_put_u8(w, 0);
+            med_blob_put_str(w, plan->plan_id);
+        }
+        med_blob_put_str(w, plan->name);
+        med_blob_put_str(w, plan->dose);
+        med_blob_put_u8(w, (uint8_t)plan->slot);
+        med_blob_put_u8(w, plan->days);
+        uint8_t n = plan->time_count < MED_PLAN_TIMES_MAX ? plan->time_count : MED_PLAN_TIMES_MAX;
+        med_blob_put_u8(w, n);
+        for (uint8_t t = 0; t < n; ++t) {
+            med_blob_put_u16(w, plan->times[t]);
+        }
+        med_blob_put_i64(w, plan->start_ms);
+        med_blob_put_i64(w, plan->end_ms);
+    }
+}
+
+static bool med_plan_decode(med_blob_reader_t *r, med_plan_set_t *set)
+{
+    const uint8_t *magic = med_blob_get(r, 3);
+    if (!magic || magic[0] != 'M' || magic[1] != 'P' || magic[2] != MED_PLAN_BLOB_VERSION) {
+        return false;
+    }
+    med_blob_get_str(r, set->etag, sizeof(set->etag));
+    set->count = med_blob_get_u8(r);
+    if (set->count > MED_PLAN_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < set->count && !r->bad; ++i) {
+        med_plan_t *plan = &set->plans[i];
+        if (med_blob_get_u8(r) == 1) {
+            const uint8_t *id = med_blob_get(r, MED_BLOB_OBJECT_ID_LEN);
+            if (!id) {
+                return false;
+            }
+            med_blob_object_id_hex(id, plan->plan_id);
+        } else {
+            med_blob_get_str(r, plan->plan_id, sizeof(plan->plan_id));
+        }
+        med_blob_get_str(r, plan->name, sizeof(plan->name));
+        med_blob_get_str(r, plan->dose, sizeof(plan->dose));
+        plan->slot = (int8_t)med_blob_get_u8(r);
+        plan->days = med_blob_get_u8(r);
+        plan->time_count = med_blob_get_u8(r);
+        if (plan->time_count > MED_PLAN_TIMES_MAX) {
+            return false;
+        }
+        for (uint8_t t = 0; t < plan->time_count; ++t) {
+            plan->times[t] = med_blob_get_u16(r);
+        }
+        plan->start_ms = med_blob_get_i64(r);
+        plan->end_ms = med_blob_get_i64(r);
+    }
+    return !r->bad;
+}
+
+bool med_plan_save(const char *key, const med_plan_set_t *set)
+{
+    if (!key || !set) {
+        return false;
+    }
+    uint8_t *buf = malloc(MED_PLAN_BLOB_MAX * 2);
+    if (!buf) {
+        return false;
+    }
+    med_blob_writer_t w = {buf, MED_PLAN_BLOB_MAX, 0, false};
+    med_plan_encode(set, &w);
+    bool ok = med_blob_store(key, &w, buf + MED_PLAN_BLOB_MAX);
+    free(buf);
+    return ok;
+}
+
+bool med_plan_load(const char *key, med_plan_set_t *set)
+{
+    if (!key || !set) {
+        return false;
+    }
+    uint8_t *buf = malloc(MED_PLAN_BLOB_MAX);
+    if (!buf) {
+        return false;
+    }
+    size_t size = MED_PLAN_BLOB_MAX;
+    bool ok = dr_hal_storage_get(key, buf, &size);
+    if (ok) {
+        med_blob_reader_t r = {buf, size, 0, false};
+        memset(set, 0, sizeof(*set));
+        ok = med_plan_decode(&r, set);
+        if (!ok) {
+            memset(set, 0, sizeof(*set));
+        }
+        set->valid = ok;
+    }
+    free(buf);
+    return ok;
+}
+
+/* Keeps out[] ascending and at most max long; later ties stay after earlier ones */
+static void med_plan_insert(med_plan_occurrence_t *out, size_t *count, size_t max,
+                            const med_plan_t *plan, int64_t due_ms, unsigned minute)
+{
+    size_t at = *count;
+    while (at > 0 && out[at - 1].due_epoch_ms > due_ms) {
+        at--;
+    }
+    if (at >= max) {
+        return;
+    }
+    size_t n = *count < max ? *count : max - 1;
+    memmove(&out[at + 1], &out[at], (n - at) * sizeof(out[0]));
+    if (*count < max) {
+        (*count)++;
+    }
+
+    med_plan_occurrence_t *occ = &out[at];
+    memset(occ, 0, sizeof(*occ));
+    occ->due_epoch_ms = due_ms;
+    med_cache_item_t *item = &occ->item;
+    snprintf(item->name, sizeof(item->name), "%s", plan->name);
+    snprintf(item->dose, sizeof(item->dose), "%s", plan->dose);
+    snprintf(item->time_str, sizeof(item->time_str), "%02u:%02u", minute / 60 % 24, minute % 60);
+    item->minute = (int)minute;
+    snprintf(item->status, sizeof(item->status), "pending");
+    snprintf(item->dose_id, sizeof(item->dose_id), "%s@%lld", plan->plan_id,
+             (long long)(due_ms / 60000));
+    item->slot = plan->slot;
+}
+
+size_t med_plan_expand(const med_plan_set_t *set, int64_t from_ms, int64_t to_ms,
+                       med_plan_occurrence_t *out, size_t max)
+{
+    if (!set || !set->valid || !out || max == 0 || from_ms >= to_ms) {
+        return 0;
+    }
+
+    time_t from = (time_t)(from_ms / 1000);
+    struct tm first;
+    if (!localtime_r(&from, &first)) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (int d = 0; d < MED_PLAN_SCAN_DAYS; ++d) {
+        struct tm day = first;
+        day.tm_mday += d;
+        day.tm_hour = 0;
+        day.tm_min = 0;
+        day.tm_sec = 0;
+        day.tm_isdst = -1;
+        time_t midnight = mktime(&day);     /* also normalizes the date and sets tm_wday */
+        if (midnight == (time_t)-1 || (int64_t)midnight * 1000 >= to_ms) {
+            break;
+        }
+        if (count == max && (int64_t)midnight * 1000 > out[max - 1].due_epoch_ms) {
+            break;
+        }
+
+        uint8_t day_bit = (uint8_t)(1u << (day.tm_wday == 0 ? 6 : day.tm_wday - 1));
+        for (size_t p = 0; p < set->count; ++p) {
+            const med_plan_t *plan = &set->plans[p];
+            if (!(plan->days & day_bit)) {
+                continue;
+            }
+            for (uint8_t t = 0; t < plan->time_count && t < MED_PLAN_TIMES_MAX; ++t) {
+                struct tm at = day;
+                at.tm_hour = plan->times[t] / 60;
+                at.tm_min = plan->times[t] % 60;
+                at.tm_sec = 0;
+                at.tm_isdst = -1;
+                time_t when = mktime(&at);
+                if (when == (time_t)-1) {
+                    continue;
+                }
+                int64_t due_ms = (int64_t)when * 1000;
+                if (due_ms < from_ms || due_ms >= to_ms) {
+                    continue;
+                }
+                if ((plan->start_ms > 0 && due_ms < plan->start_ms) || (plan->end_ms > 0 && due_ms >= plan->end_ms)) {
+                    continue;
+                }
+                /* A time skipped by a DST change was moved forward by mktime */
+                med_plan_insert(out, &count, max, plan, due_ms, (unsigned)(at.tm_hour * 60 + at.tm_min));
+            }
+        }
+    }
+    return count;
+}
@@ -0,0 +1,191 @@
+#include "med_wire.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MED_WIRE_VERSION 1
+#define MED_WIRE_HEADER_LEN 7
+#define MED_WIRE_FLAG_OBJECT_ID 0x01
+#define MED_WIRE_FLAG_STRING_ID 0x02
+#define MED_WIRE_OBJECT_ID_LEN 12
+#define MED_WIRE_ITEM_FIXED 6
+#define MED_WIRE_MINUTES_PER_DAY 1440
+
+enum {
+    MED_WIRE_HEADER,
+    MED_WIRE_STRING_LEN,
+    MED_WIRE_STRING,
+    MED_WIRE_ITEM_FLAGS,
+    MED_WIRE_ITEM,
+    MED_WIRE_DONE,
+    MED_WIRE_ERROR,
+};
+
+static const char *med_wire_string(const med_wire_ingest_t *ing, uint8_t index)
+{
+    return index < ing->string_count && index < MED_WIRE_STRINGS_MAX ? ing->strings[index] : "";
+}
+
+static void med_wire_expect(med_wire_ingest_t *ing, uint8_t phase, uint16_t need)
+{
+    ing->phase = phase;
+    ing->need = need;
+    ing->have = 0;
+}
+
+/* After the string table, or a finished item: the next item or the end */
+static void med_wire_next_item(med_wire_ingest_t *ing)
+{
+    if (ing->items_seen >= ing->item_total) {
+        med_wire_expect(ing, MED_WIRE_DONE, 0);
+    } else {
+        med_wire_expect(ing, MED_WIRE_ITEM_FLAGS, 1);
+    }
+}
+
+static void med_wire_next_string(med_wire_ingest_t *ing)
+{
+    if (ing->string_count >= ing->string_total) {
+        med_wire_next_item(ing);
+    } else {
+        med_wire_expect(ing, MED_WIRE_STRING_LEN, 1);
+    }
+}
+
+static void med_wire_item(med_wire_ingest_t *ing)
+{
+    ing->items_seen++;
+    med_cache_t *out = ing->out;
+    if (out->count >= MED_CACHE_MAX) {
+        return;
+    }
+    med_cache_item_t *item = &out->items[out->count++];
+    memset(item, 0, sizeof(*item));
+
+    const uint8_t *p = ing->buf;
+    if (ing->flags & MED_WIRE_FLAG_OBJECT_ID) {
+        static const char hex[] = "0123456789abcdef";
+        for (int i = 0; i < MED_WIRE_OBJECT_ID_LEN; ++i) {
+            item->dose_id[i * 2] = hex[p[i] >> 4];
+            item->dose_id[i * 2 + 1] = hex[p[i] & 0x0f];
+        }
+        p += MED_WIRE_OBJECT_ID_LEN;
+    } else if (ing->flags & MED_WIRE_FLAG_STRING_ID) {
+        snprintf(item->dose_id, sizeof(item->dose_id), "%s", med_wire_string(ing, *p++));
+    }
+
+    unsigned minute = (unsigned)p[0] | ((unsigned)p[1] << 8);
+    item->minute = -1;
+    if (minute < MED_WIRE_MINUTES_PER_DAY) {
+        item->minute = (int)minute;
+        snprintf(item->time_str, sizeof(item->time_str), "%02u:%02u", minute / 60, minute % 60);
+    }
+    snprintf(item->name, sizeof(item->name), "%s", med_wire_string(ing, p[2]));
+    snprintf(item->dose, sizeof(item->dose), "%s", med_wire_string(ing, p[3]));
+    snprintf(item->status, sizeof(item->status), "%s", med_wire_string(ing, p[4]));
+    item->slot = (int8_t)p[5];
+}
+
+/* One complete field is in buf */
+static void med_wire_step(med_wire_ingest_t *ing)
+{
+    const uint8_t *b = ing->buf;
+    switch (ing->phase) {
+        case MED_WIRE_HEADER:
+            if (b[0] != 'D' || b[1] != 'R' || b[2] != 'M' || b[3] != MED_WIRE_VERSION) {
+                ing->phase = MED_WIRE_ERROR;
+                return;
+            }
+            ing->item_total = (uint16_t)(b[4] | (b[5] << 8));
+            ing->string_total = b[6];
+            med_wire_next_string(ing);
+            return;
+        case MED_WIRE_STRING_LEN:
+            if (b[0] > 0) {
+                med_wire_expect(ing, MED_WIRE_STRING, b[0]);
+                return;
+            }
+            if (ing->string_count < MED_WIRE_STRINGS_MAX) {
+                ing->strings[ing->string_count][0] = '\0';
+            }
+            ing->string_count++;
+            med_wire_next_string(ing);
+            return;
+        case MED_WIRE_STRING:
+            if (ing->string_count < MED_WIRE_STRINGS_MAX) {
+                size_t n = ing->have < sizeof(ing->strings[0]) ? ing->have : sizeof(ing->strings[0]) - 1;
+                memcpy(ing->strings[ing->string_count], b, n);
+                ing->strings[ing->string_count][n] = '\0';
+            }
+            ing->string_count++;
+            med_wire_next_string(ing);
+            return;
+        case MED_WIRE_ITEM_FLAGS: {
+            uint8_t flags = b[0];
+            if ((flags & ~(MED_WIRE_FLAG_OBJECT_ID | MED_WIRE_FLAG_STRING_ID)) ||
+                flags == (MED_WIRE_FLAG_OBJECT_ID | MED_WIRE_FLAG_STRING_ID)) {
+                ing->phase = MED_WIRE_ERROR;
+                return;
+            }
+            ing->flags = flags;
+            uint16_t id_len = 0;
+            if (flags & MED_WIRE_FLAG_OBJECT_ID) {
+                id_len = MED_WIRE_OBJECT_ID_LEN;
+            } else if (flags & MED_WIRE_FLAG_STRING_ID) {
+                id_len = 1;
+            }
+            med_wire_expect(ing, MED_WIRE_ITEM, (uint16_t)(id_len + MED_WIRE_ITEM_FIXED));
+            return;
+        }
+        case MED_WIRE_ITEM:
+            med_wire_item(ing);
+            med_wire_next_item(ing);
+            return;
+        default:
+            ing->phase = MED_WIRE_ERROR;
+            return;
+    }
+}
+
+void med_wire_begin(med_wire_ingest_t *ing, med_cache_t *out)
+{
+    memset(ing, 0, sizeof(*ing));
+    memset(out, 0, sizeof(*out));
+    ing->out = out;
+    med_wire_expect(ing, MED_WIRE_HEADER, MED_WIRE_HEADER_LEN);
+}
+
+bool med_wire_feed(med_wire_ingest_t *ing, const char *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (len > 0) {
+        if (ing->phase == MED_WIRE_DONE) {
+            ing->phase = MED_WIRE_ERROR;     /* trailing bytes */
+        }
+        if (ing->phase == MED_WIRE_ERROR) {
+            return false;
+        }
+        size_t take = (size_t)(ing->need - ing->have);
+        if (take > len) {
+            take = len;
+        }
+        memcpy(ing->buf + ing->have, p, take);
+        ing->have = (uint16_t)(ing->have + take);
+        p += take;
+        len -= take;
+        if (ing->have == ing->need) {
+            med_wire_step(ing);
+        }
+    }
+    return ing->phase != MED_WIRE_ERROR;
+}
+
+bool med_wire_end(med_wire_ingest_t *ing)
+{
+    return ing->phase == MED_WIRE_DONE;
+}
+
+bool med_wire_sniff(const char *data, size_t len)
+{
+    return len > 0 && data[0] == 'D';
+}
@@ -0,0 +1,265 @@
+#include "dose_outbox.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_store.h"
+
+#define OUTBOX_LEGACY_NAMESPACE "dose_outbox"      /* own namespace and handle before nvs_store */
+#define OUTBOX_VERSION 1
+
+static const char *TAG = "dose_outbox";
+
+typedef struct {
+    uint32_t version;
+    uint32_t salt;                  /* random per outbox, keeps keys unique after an NVS erase */
+    uint32_t next_seq;
+    uint16_t head;
+    uint16_t count;
+} outbox_meta_t;
+
+static SemaphoreHandle_t outbox_lock = NULL;
+static dose_outbox_config_t outbox_config;
+static outbox_meta_t outbox_meta;
+static dose_outbox_event_t outbox_events[DOSE_OUTBOX_CAPACITY];
+static uint32_t outbox_boot = 0;
+
+static void outbox_slot_key(uint16_t slot, char *key, size_t size)
+{
+    snprintf(key, size, "ob_e%02u", (unsigned)slot);
+}
+
+/* Queued with nvs_store, written by its task right away: callers never wait for flash */
+static bool outbox_save_meta(void)
+{
+    return nvs_store_set_blob("ob_meta", &outbox_meta, sizeof(outbox_meta), 0);
+}
+
+static bool outbox_save_event(uint16_t slot)
+{
+    char key[8];
+    outbox_slot_key(slot, key, sizeof(key));
+    return nvs_store_set_blob(key, &outbox_events[slot], sizeof(outbox_events[slot]), 0);
+}
+
+static bool outbox_meta_valid(size_t len)
+{
+    return len == sizeof(outbox_meta) && outbox_meta.version == OUTBOX_VERSION &&
+           outbox_meta.head < DOSE_OUTBOX_CAPACITY && outbox_meta.count <= DOSE_OUTBOX_CAPACITY;
+}
+
+/*
+ * Moves a ring left in the old dose_outbox namespace into nvs_store, so an
+ * update does not lose events that were still pending.
+ */
+static bool outbox_load_legacy(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(OUTBOX_LEGACY_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(outbox_meta);
+    bool found = nvs_get_blob(handle, "meta", &outbox_meta, &len) == ESP_OK && outbox_meta_valid(len);
+    uint16_t loaded = 0;
+    for (uint16_t i = 0; found && i < outbox_meta.count; ++i) {
+        uint16_t slot = (outbox_meta.head + i) % DOSE_OUTBOX_CAPACITY;
+        char key[8];
+        snprintf(key, sizeof(key), "e%02u", (unsigned)slot);
+        len = sizeof(outbox_events[slot]);
+        if (nvs_get_blob(handle, key, &outbox_events[slot], &len) != ESP_OK || len != sizeof(outbox_events[slot])) {
+            break;
+        }
+        outbox_save_event(slot);
+        loaded++;
+    }
+    uint32_t boot = 0;
+    if (nvs_get_u32(handle, "boot", &boot) == ESP_OK) {
+        outbox_boot = boot;
+    }
+    if (found) {
+        outbox_meta.count = loaded;
+        outbox_save_meta();
+        ESP_LOGI(TAG, "Moved %u event(s) from the %s namespace", (unsigned)loaded, OUTBOX_LEGACY_NAMESPACE);
+    }
+    nvs_erase_all(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+    return found;
+}
+
+static void outbox_load(void)
+{
+    memset(&outbox_meta, 0, sizeof(outbox_meta));
+    int32_t boot = 0;
+    if (nvs_store_get_i32("ob_boot", &boot)) {
+        outbox_boot = (uint32_t)boot;
+    }
+
+    size_t len = sizeof(outbox_meta);
+    if (!nvs_store_get_blob("ob_meta", &outbox_meta, &len) || !outbox_meta_valid(len)) {
+        memset(&outbox_meta, 0, sizeof(outbox_meta));
+        if (!outbox_load_legacy()) {
+            memset(&outbox_meta, 0, sizeof(outbox_meta));
+            outbox_meta.version = OUTBOX_VERSION;
+            outbox_meta.salt = esp_random();
+            outbox_meta.next_seq = 1;
+            outbox_save_meta();
+        }
+    } else {
+        uint16_t loaded = 0;
+        for (uint16_t i = 0; i < outbox_meta.count; ++i) {
+            uint16_t slot = (outbox_meta.head + i) % DOSE_OUTBOX_CAPACITY;
+            char key[8];
+            outbox_slot_key(slot, key, sizeof(key));
+            len = sizeof(outbox_events[slot]);
+            if (!nvs_store_get_blob(key, &outbox_events[slot], &len) || len != sizeof(outbox_events[slot])) {
+                break;
+            }
+            loaded++;
+        }
+        if (loaded != outbox_meta.count) {
+            ESP_LOGW(TAG, "Outbox truncated to %u of %u events", (unsigned)loaded, (unsigned)outbox_meta.count);
+            outbox_meta.count = loaded;
+            outbox_save_meta();
+        }
+    }
+
+    outbox_boot++;
+    nvs_store_set_i32("ob_boot", (int32_t)outbox_boot, 0);
+
+    if (outbox_meta.count > 0) {
+        ESP_LOGI(TAG, "Replaying %u dose event(s) from flash", (unsigned)outbox_meta.count);
+    }
+}
+
+/* Drops events up to and including last_seq. Called with outbox_lock held. */
+static void outbox_remove_through(uint32_t last_seq)
+{
+    uint16_t removed = 0;
+    while (outbox_meta.count > 0 && outbox_events[outbox_meta.head].seq <= last_seq) {
+        outbox_meta.head = (outbox_meta.head + 1) % DOSE_OUTBOX_CAPACITY;
+        outbox_meta.count--;
+        removed++;
+    }
+    if (removed > 0) {
+        outbox_save_meta();
+    }
+}
+
+esp_err_t dose_outbox_init(const dose_outbox_config_t *config)
+{
+    if (!config || !config->send) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (outbox_lock) {
+        return ESP_OK;
+    }
+    outbox_lock = xSemaphoreCreateMutex();
+    if (!outbox_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    outbox_config = *config;
+    outbox_load();
+    if (outbox_meta.count > 0 && outbox_config.on_pending) {
+        outbox_config.on_pending();
+    }
+    return ESP_OK;
+}
+
+int dose_outbox_drain(void)
+{
+    if (!outbox_lock) {
+        return 0;
+    }
+    dose_outbox_event_t batch[DOSE_OUTBOX_BATCH_MAX];
+    size_t count = 0;
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    while (count < DOSE_OUTBOX_BATCH_MAX && count < outbox_meta.count) {
+        batch[count] = outbox_events[(outbox_meta.head + count) % DOSE_OUTBOX_CAPACITY];
+        count++;
+    }
+    xSemaphoreGive(outbox_lock);
+    if (count == 0) {
+        return 0;
+    }
+
+    int sent = outbox_config.send(batch, count, outbox_config.ctx);
+    if (sent > (int)count) {
+        sent = (int)count;
+    }
+    if (sent <= 0) {
+        ESP_LOGW(TAG, "Upload failed, %u pending", (unsigned)dose_outbox_pending());
+        return -1;
+    }
+
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    outbox_remove_through(batch[sent - 1].seq);
+    xSemaphoreGive(outbox_lock);
+    ESP_LOGI(TAG, "Uploaded %d dose event(s), %u pending", sent, (unsigned)dose_outbox_pending());
+    return sent;
+}
+
+bool dose_outbox_push(const char *dose_id, dose_outbox_action_t action)
+{
+    if (!outbox_lock || !dose_id || dose_id[0] == '\0') {
+        return false;
+    }
+
+    dose_outbox_event_t event = {0};
+    event.boot = outbox_boot;
+    event.uptime_ms = esp_timer_get_time() / 1000;
+    event.epoch_ms = outbox_config.epoch_ms ? outbox_config.epoch_ms() : 0;
+    snprintf(event.dose_id, sizeof(event.dose_id), "%s", dose_id);
+    event.action = (uint8_t)action;
+
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    if (outbox_meta.count == DOSE_OUTBOX_CAPACITY) {
+        ESP_LOGW(TAG, "Outbox full, dropping event %lu", (unsigned long)outbox_events[outbox_meta.head].seq);
+        outbox_meta.head = (outbox_meta.head + 1) % DOSE_OUTBOX_CAPACITY;
+        outbox_meta.count--;
+    }
+    event.seq = outbox_meta.next_seq++;
+    uint16_t slot = (outbox_meta.head + outbox_meta.count) % DOSE_OUTBOX_CAPACITY;
+    outbox_events[slot] = event;
+    outbox_meta.count++;
+
+    bool persisted = outbox_save_event(slot) && outbox_save_meta();
+    xSemaphoreGive(outbox_lock);
+
+    if (!persisted) {
+        ESP_LOGW(TAG, "Event %lu kept in RAM only", (unsigned long)event.seq);
+    }
+    ESP_LOGI(TAG, "Queued %s for dose %s (seq %lu)", action == DOSE_OUTBOX_TAKEN ? "taken" : "skipped",
+             event.dose_id, (unsigned long)event.seq);
+    if (outbox_config.on_pending) {
+        outbox_config.on_pending();
+    }
+    return true;
+}
+
+size_t dose_outbox_pending(void)
+{
+    if (!outbox_lock) {
+        return 0;
+    }
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    size_t count = outbox_meta.count;
+    xSemaphoreGive(outbox_lock);
+    return count;
+}
+
+uint32_t dose_outbox_boot(void)
+{
+    return outbox_boot;
+}
+
+void dose_outbox_key(const dose_outbox_event_t *event, char *buf, size_t size)
+{
+    snprintf(buf, size, "%08lx-%lu", (unsigned long)outbox_meta.salt, (unsigned long)event->seq);
+}
@@ -0,0 +1,77 @@
+#ifndef DOSE_OUTBOX_H
+#define DOSE_OUTBOX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/*
+ * Durable outbox for dose events.
+ *
+ * dose_outbox_push() appends the event to a ring kept in NVS, so a pick or
+ * skip is never lost to a WiFi outage or a reboot, and calls on_pending.
+ * The ring goes through nvs_store (keys "ob_*") with no delay: a push only
+ * copies the event into RAM, which is safe on the LVGL task, and the
+ * nvs_store task writes and commits it on the shared handle right after.
+ * A power cut in those few milliseconds loses the event. Call
+ * dose_outbox_init() after nvs_store_init().
+ *
+ * The owner calls dose_outbox_drain() from its network task: each call
+ * hands the oldest batch to the send callback and removes what the backend
+ * accepted. Retry timing is up to the caller. When the ring is full the
+ * oldest event is dropped.
+ *
+ * Each event carries an idempotency key (dose_outbox_key()), so the backend
+ * can ignore an event that is replayed after a lost response.
+ */
+
+#define DOSE_OUTBOX_CAPACITY 32
+#define DOSE_OUTBOX_BATCH_MAX 8
+
+typedef enum {
+    DOSE_OUTBOX_TAKEN,
+    DOSE_OUTBOX_SKIPPED,
+} dose_outbox_action_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t boot;                  /* boot counter at the time of the event */
+    int64_t uptime_ms;              /* esp_timer time within that boot */
+    int64_t epoch_ms;               /* wall clock, 0 if unknown */
+    char dose_id[40];
+    uint8_t action;                 /* dose_outbox_action_t */
+} dose_outbox_event_t;
+
+/*
+ * Uploads events[0..count). Returns how many leading events the backend has
+ * processed; they are removed from the outbox. Returns -1 on a transient
+ * failure.
+ */
+typedef int (*dose_outbox_send_fn)(const dose_outbox_event_t *events, size_t count, void *ctx);
+
+typedef struct {
+    dose_outbox_send_fn send;
+    void (*on_pending)(void);       /* events waiting: push, or replay found at init */
+    int64_t (*epoch_ms)(void);      /* optional: wall clock for new events, 0 if unknown */
+    void *ctx;
+} dose_outbox_config_t;
+
+esp_err_t dose_outbox_init(const dose_outbox_config_t *config);
+bool dose_outbox_push(const char *dose_id, dose_outbox_action_t action);
+/* Uploads one batch. Returns the number of events removed, or -1 if the send failed. */
+int dose_outbox_drain(void);
+size_t dose_outbox_pending(void);
+uint32_t dose_outbox_boot(void);
+void dose_outbox_key(const dose_outbox_event_t *event, char *buf, size_t size);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
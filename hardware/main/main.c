@@ -10,7 +10,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "nvs.h"
+#include "freertos/queue.h"
 #include "nvs_flash.h"
 #include "esp_err.h"
 #include "esp_event.h"
@@ -19,11 +19,10 @@
 #include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_http_client.h"
-#include "esp_crt_bundle.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
-#include "esp_rom_sys.h"
 #include "iot_button.h"
 
 #include "lvgl.h"
@@ -36,6 +35,21 @@
 #include "ui/custom/settings_screen.h"
 #include "ui/custom/profile_screen.h"
 #include "ui/custom/alert_screen.h"
+#include "backend_conn.h"
+#include "nvs_store.h"
+#include "med_cache.h"
+#include "dr_time.h"
+#include "med_json.h"
+#include "med_plan.h"
+#include "med_wire.h"
+#include "device_sync.h"
+#include "dose_outbox.h"
+#include "net_service.h"
+#include "dose_scheduler.h"
+#include "stepper_motion.h"
+#include "servo_motion.h"
+#include "pill_detector.h"
+#include "dispense.h"
 
 static const char *TAG = "DoseRight";
 
@@ -46,6 +60,8 @@ static const char *DEVICE_ID = "";
 static const char *DEVICE_SECRET = "";
 static const char *FIRMWARE_VERSION = "1.2.3";
 static const char *TIME_API_PATH = "/api/hardware/time";
+static const char *SYNC_API_PATH = "/api/hardware/sync";
+static const char *PLANS_API_PATH = "/api/hardware/plans";
 
 #define STEPPER_TOTAL_SLOTS 5
 #define STEPPER_STEPS_PER_REV 2048
@@ -57,6 +73,9 @@ static const float DEMO_TEMPERATURE_C = 36.8f;
 
 static const int64_t BACKEND_FETCH_INTERVAL_MS = 60000;
 static const int64_t HEARTBEAT_INTERVAL_MS = 60000;
+/* The upcoming list covers the server's next 24 h; past it plan rules are expanded up to PLAN_HORIZON_MS ahead */
+static const int64_t UPCOMING_WINDOW_MS = 24LL * 60 * 60 * 1000;
+static const int64_t PLAN_HORIZON_MS = (int64_t)MED_PLAN_SCAN_DAYS * 24 * 60 * 60 * 1000;
 
 static lv_obj_t *clock_label = NULL;
 static lv_obj_t *wifi_status_label = NULL;
@@ -76,9 +95,7 @@ static lv_obj_t *servo_screen = NULL;
 static lv_obj_t *servo_slider = NULL;
 static lv_obj_t *servo_value_label = NULL;
 static lv_obj_t *servo_status_label = NULL;
-static lv_timer_t *servo_move_timer = NULL;
 static int servo_target_deg = 90;
-static int servo_current_deg = 90;
 static int calibrate_move_dir = 0;
 static lv_timer_t *boot_progress_timer = NULL;
 static int boot_progress_value = 0;
@@ -107,20 +124,19 @@ static bool wifi_ready = false;
 static bool wifi_auto_connecting = false;
 static int wifi_auto_index = -1;
 static button_handle_t main_button = NULL;
-static volatile bool backend_fetch_requested = false;
 static char backend_last_error[64] = "Fetch failed";
-static volatile bool time_sync_requested = false;
+static bool main_data_stale = false;  /* main card shows an error instead of cache_upcoming */
+/* net_service jobs, in priority order for equal deadlines */
+static int net_job_sync = -1;
+static int net_job_time = -1;
+static int net_job_heartbeat = -1;
+static int net_job_outbox = -1;
+static int net_job_info = -1;
 static bool time_synced = false;
-static int64_t time_base_epoch_seconds = 0;
-static int32_t time_base_offset_min = 0;
-static int64_t time_base_ms = 0;
+static dr_rtc_t wall_rtc;
 static char time_display[16] = "--:--";
 static bool time_display_valid = false;
-static int64_t last_time_sync_ms = 0;
-static int time_base_hour24 = -1;
-static int time_base_minute = -1;
 
-static const int64_t TIME_RESYNC_INTERVAL_MS = 10 * 60 * 1000;
 static const uint32_t BOOT_PROGRESS_INTERVAL_MS = 50;
 
 static void log_http_response(const char *context, const char *url, int status, const char *body, int body_len)
@@ -154,29 +170,34 @@ static void log_http_response(const char *context, const char *url, int status,
 #define MOTOR_IN2_GPIO 10
 #define MOTOR_IN3_GPIO 42
 #define MOTOR_IN4_GPIO 13
+#define MOTOR_START_SPS 400
+#define MOTOR_MAX_SPS 900
+#define MOTOR_ACCEL_SPS2 3000
 
 #define SERVO_GPIO 21
 #define SERVO_MIN_US 1000
 #define SERVO_MAX_US 2000
-#define SERVO_PERIOD_US 20000
 #define SERVO_LEDC_MODE LEDC_LOW_SPEED_MODE
 #define SERVO_LEDC_TIMER LEDC_TIMER_0
 #define SERVO_LEDC_CHANNEL LEDC_CHANNEL_0
-#define SERVO_LEDC_RESOLUTION LEDC_TIMER_14_BIT
 #define SERVO_DEG_MAX 180
-#define SERVO_SWEEP_MAX_DEG 90
-#define SERVO_STEP_DEG 1
-#define SERVO_STEP_INTERVAL_US 20000
+#define SERVO_SETTLE_MS 150
+#define SERVO_LID_OPEN_DEG 80
+#define SERVO_LID_CLOSED_DEG 180
+#define SERVO_OPEN_DPS 120
+#define SERVO_OPEN_RAMP_MS 250
+#define SERVO_CLOSE_DPS 80
+#define SERVO_CLOSE_RAMP_MS 300
+#define SERVO_MANUAL_DPS 50
 
 #define IR_SENSOR_GPIO 12
-#define IR_POLL_INTERVAL_US 500000
+#define IR_MIN_BREAK_US 300
+#define IR_MIN_GAP_US 5000
 
 #define CALIBRATE_STEP_COUNT 20
-#define CALIBRATE_STEP_DELAY_US 2000
 #define CALIBRATE_CONT_STEP 1
 #define CALIBRATE_CONT_INTERVAL_MS 50
 
-#define MED_CACHE_MAX 10
 #define WIFI_CRED_MAX 3
 
 typedef struct {
@@ -189,120 +210,75 @@ typedef struct {
     wifi_cred_t creds[WIFI_CRED_MAX];
 } wifi_cred_store_t;
 
-typedef struct {
-    char name[48];
-    char dose[32];
-    char time_str[8];
-    char status[16];
-    char dose_id[40];
-    int slot;
-} med_cache_item_t;
-
-typedef struct {
-    med_cache_item_t items[MED_CACHE_MAX];
-    size_t count;
-    char updated[16];
-    bool valid;
-} med_cache_t;
-
 static med_cache_t cache_taken = {0};
 static med_cache_t cache_upcoming = {0};
 static med_cache_t cache_missed = {0};
+static med_plan_set_t cache_plans = {0};
+/* Unix ms up to which cache_upcoming holds every dose; plan occurrences are used after it */
+static int64_t upcoming_covered_until_ms = 0;
 static wifi_cred_t wifi_creds[WIFI_CRED_MAX] = {0};
 static size_t wifi_creds_count = 0;
 
-static int motor_step_index = 0;
-static int stepper_current_steps = 0;
 static int stepper_current_slot = 1;
-static esp_timer_handle_t servo_timer = NULL;
-static bool servo_left = false;
-static int servo_deg = 0;
-static esp_timer_handle_t ir_timer = NULL;
-static esp_timer_handle_t ir_close_timer = NULL;
-static int last_ir_state = -1;
-static bool ir_enabled = false;
-static bool servo_enable_ir_on_complete = false;
-static bool ir_close_pending = false;
-static bool ir_detected_once = false;
-static bool pending_mark_taken = false;
+static lv_timer_t *dispense_timer = NULL;
 static char current_alert_dose_id[40] = {0};
 
-static void med_cache_save_nvs(const char *key, const med_cache_t *cache)
+static void med_cache_load_all(void)
 {
-    if (!key || !cache) {
-        return;
-    }
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READWRITE, &handle) != ESP_OK) {
-        return;
-    }
-    nvs_set_blob(handle, key, cache, sizeof(*cache));
-    nvs_commit(handle);
-    nvs_close(handle);
+    med_cache_load("med_taken", &cache_taken);
+    med_cache_load("med_upcoming", &cache_upcoming);
+    med_cache_load("med_missed", &cache_missed);
+    med_plan_load("med_plans", &cache_plans);
+
+    nvs_store_get_i64("upcoming_until", &upcoming_covered_until_ms);
 }
 
-static void med_cache_load_nvs(const char *key, med_cache_t *cache)
+static int64_t wall_raw_ms(void)
 {
-    if (!key || !cache) {
-        return;
-    }
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READONLY, &handle) != ESP_OK) {
-        return;
-    }
-    size_t size = sizeof(*cache);
-    if (nvs_get_blob(handle, key, cache, &size) == ESP_OK) {
-        cache->valid = true;
-    }
-    nvs_close(handle);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
-static void med_cache_load_all(void)
+/* Drift-corrected Unix ms, or 0 while the clock is unset */
+static int64_t wall_now_ms(void)
 {
-    med_cache_load_nvs("med_taken", &cache_taken);
-    med_cache_load_nvs("med_upcoming", &cache_upcoming);
-    med_cache_load_nvs("med_missed", &cache_missed);
+    return dr_rtc_now_ms(&wall_rtc, wall_raw_ms());
 }
 
-static void time_cache_save_nvs(const char *time_str)
+/* The platform keeps the epoch itself; NVS keeps the TZ, drift and resync interval that go with it. */
+static void time_cache_save_nvs(void)
 {
-    if (!time_str || time_str[0] == '\0') {
-        return;
-    }
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READWRITE, &handle) != ESP_OK) {
-        return;
-    }
-    nvs_set_str(handle, "time_display", time_str);
-    nvs_commit(handle);
-    nvs_close(handle);
+    nvs_store_set_blob("clock", &wall_rtc, sizeof(wall_rtc), NVS_STORE_DELAY_MS);
 }
 
 static void time_cache_load_nvs(void)
 {
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READONLY, &handle) != ESP_OK) {
+    dr_rtc_init(&wall_rtc);
+    dr_rtc_t saved;
+    size_t len = sizeof(saved);
+    if (nvs_store_get_blob("clock", &saved, &len) && len == sizeof(saved)) {
+        saved.tz[sizeof(saved.tz) - 1] = '\0';
+        wall_rtc = saved;
+    }
+    if (wall_rtc.tz[0] == '\0') {
         return;
     }
-    char buf[16] = {0};
-    size_t len = sizeof(buf);
-    if (nvs_get_str(handle, "time_display", buf, &len) == ESP_OK && len > 1) {
-        snprintf(time_display, sizeof(time_display), "%s", buf);
-        time_display_valid = true;
+    setenv("TZ", wall_rtc.tz, 1);
+    tzset();
+    /* The epoch survives software resets; after a power cycle it starts over and reads as unset. */
+    if (wall_now_ms() > 0) {
+        time_synced = true;
+        ESP_LOGI(TAG, "Clock kept across reset (TZ %s)", wall_rtc.tz);
     }
-    nvs_close(handle);
 }
 
 static void wifi_creds_load(void)
 {
     wifi_creds_count = 0;
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READONLY, &handle) != ESP_OK) {
-        return;
-    }
     wifi_cred_store_t store = {0};
     size_t size = sizeof(store);
-    if (nvs_get_blob(handle, "wifi_creds", &store, &size) == ESP_OK) {
+    if (nvs_store_get_blob("wifi_creds", &store, &size)) {
         if (store.count > WIFI_CRED_MAX) {
             store.count = WIFI_CRED_MAX;
         }
@@ -311,23 +287,17 @@ static void wifi_creds_load(void)
             wifi_creds[i] = store.creds[i];
         }
     }
-    nvs_close(handle);
 }
 
+/* Written right away (still off the caller's task): credentials are not worth losing to a power cut */
 static void wifi_creds_save(void)
 {
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READWRITE, &handle) != ESP_OK) {
-        return;
-    }
     wifi_cred_store_t store = {0};
     store.count = (uint8_t)wifi_creds_count;
     for (size_t i = 0; i < wifi_creds_count; ++i) {
         store.creds[i] = wifi_creds[i];
     }
-    nvs_set_blob(handle, "wifi_creds", &store, sizeof(store));
-    nvs_commit(handle);
-    nvs_close(handle);
+    nvs_store_set_blob("wifi_creds", &store, sizeof(store), 0);
 }
 
 static void wifi_creds_add_or_update(const char *ssid, const char *password)
@@ -434,13 +404,12 @@ static void ensure_med_cache_loaded(const char *path, med_cache_t *cache)
     }
     const char *key = get_cache_key_for_path(path);
     if (key) {
-        med_cache_load_nvs(key, cache);
+        med_cache_load(key, cache);
     }
 }
 
 static void wifi_start_scan(void);
-static void backend_fetch_task(void *arg);
-static void time_sync_task(void *arg);
+static void net_jobs_init(void);
 static void on_wifi_logo_clicked(lv_event_t *e);
 static void on_main_menu_selected(main_menu_item_t item);
 static void on_info_back_clicked(lv_event_t *e);
@@ -475,13 +444,11 @@ static void on_servo_back_clicked(lv_event_t *e);
 static void on_servo_slider_changed(lv_event_t *e);
 static void on_servo_move_clicked(lv_event_t *e);
 static void motor_init(void);
-static void motor_move_steps(int steps);
-static void stepper_move_to_slot(int slot);
+static void stepper_move_to_slot(int slot, lv_async_cb_t on_arrived);
 static void stepper_slot_load(void);
 static void stepper_slot_save(int slot);
 static void on_calibrate_move_event(lv_event_t *e);
 static void on_calibrate_move_timer(lv_timer_t *timer);
-static void servo_move_timer_cb(lv_timer_t *timer);
 static void boot_progress_timer_cb(lv_timer_t *timer);
 static void wifi_creds_load(void);
 static void wifi_creds_save(void);
@@ -491,31 +458,18 @@ static bool wifi_auto_connect_next(void);
 static void wifi_connect_start(const char *ssid, const char *password, bool auto_attempt);
 static void init_main_button(void);
 static void on_main_button_click(void *btn, void *arg);
-static void format_time_12h(const char *src, char *dst, size_t dst_size);
-static int time_12h_to_minutes(const char *src);
-static int time_any_to_minutes(const char *src);
-static int get_current_time_minutes(void);
-static void check_medicine_alert(void);
-static bool backend_fetch_cache(const char *path, med_cache_t *cache, const char *cache_key);
-static void servo_init(void);
-static void servo_set_pulse_us(uint32_t pulse_us);
-static void servo_set_degree(int degree);
-static void servo_test_timer_cb(void *arg);
-static void servo_test_start(void);
-static void servo_test_stop(void);
-static void servo_start_move(int target_deg, bool enable_ir_on_complete);
-static void ir_sensor_init(void);
-static void ir_sensor_timer_cb(void *arg);
+static bool local_minute_now(int *minute_of_day, int64_t *minute_start_ms);
+static void dose_schedule_reload(void);
+static int backend_fetch_cache(const char *path, med_cache_t *cache, const char *cache_key);
+static void servo_start(void);
+static bool servo_start_move(int target_deg);
 static void ir_sensor_start(void);
-static void ir_sensor_set_enabled(bool enabled);
-static void ir_close_timer_cb(void *arg);
-static void heartbeat_task(void *arg);
+static void dispense_setup(void);
 static bool send_heartbeat(void);
 static int get_wifi_strength(void);
 static int get_battery_level(void);
-static void send_dose_event_async(bool taken);
-static bool send_dose_event(const char *dose_id, bool taken);
-static void dose_event_task(void *arg);
+static void dose_event_record(const char *dose_id, bool taken);
+static void dispense_report(int dose, uint32_t pills);
 static void log_wifi_status(const char *context);
 
 static void update_clock_text(void)
@@ -529,218 +483,291 @@ static void update_clock_text(void)
         return;
     }
 
-    if (time_base_ms == 0 || time_base_hour24 < 0 || time_base_minute < 0) {
+    int minute_of_day = 0;
+    if (!dr_rtc_local_minute(wall_now_ms(), esp_timer_get_time() / 1000, &minute_of_day, NULL)) {
         lv_label_set_text(clock_label, time_display);
         return;
     }
 
-    int64_t now_ms = esp_timer_get_time() / 1000;
-    int64_t elapsed_minutes = (now_ms - time_base_ms) / 60000;
-    int total_minutes = (time_base_hour24 * 60 + time_base_minute + (int)elapsed_minutes) % (24 * 60);
-    if (total_minutes < 0) {
-        total_minutes += 24 * 60;
-    }
-
-    int hour24 = total_minutes / 60;
-    int minute = total_minutes % 60;
-    const char *ampm = (hour24 >= 12) ? "PM" : "AM";
-    int hour12 = hour24 % 12;
-    if (hour12 == 0) {
-        hour12 = 12;
-    }
-
     char buf[16];
-    snprintf(buf, sizeof(buf), "%02d:%02d %s", hour12, minute, ampm);
+    dr_time_minutes_12h(minute_of_day, buf, sizeof(buf));
     lv_label_set_text(clock_label, buf);
     snprintf(time_display, sizeof(time_display), "%s", buf);
     time_display_valid = true;
 }
 
-static void format_time_12h(const char *src, char *dst, size_t dst_size)
+/* Current local minute of day and the esp_timer ms at which it began. False until the clock is synced. */
+static bool local_minute_now(int *minute_of_day, int64_t *minute_start_ms)
 {
-    if (!dst || dst_size == 0) {
-        return;
+    if (!time_synced) {
+        return false;
     }
-    if (!src || src[0] == '\0') {
-        snprintf(dst, dst_size, "--:--");
-        return;
+    return dr_rtc_local_minute(wall_now_ms(), esp_timer_get_time() / 1000, minute_of_day, minute_start_ms);
+}
+
+/* esp_timer ms at which a list item is due: inside the grace window behind us it is today, the rest is ahead. */
+static int64_t upcoming_due_ms(int med_minutes, int now_minutes, int64_t minute_start_ms)
+{
+    int delta = ((med_minutes - now_minutes) % (24 * 60) + 24 * 60) % (24 * 60);
+    if ((int64_t)delta * 60000 > 24LL * 60 * 60000 - DOSE_SCHEDULER_GRACE_MS) {
+        delta -= 24 * 60;
     }
+    return minute_start_ms + (int64_t)delta * 60000;
+}
 
-    int hour = -1;
-    int minute = -1;
-    int second = 0;
-    if (sscanf(src, "%d:%d:%d", &hour, &minute, &second) == 3) {
-        if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
-            snprintf(dst, dst_size, "%s", src);
-            return;
-        }
-        const char *ampm = (hour >= 12) ? "PM" : "AM";
-        int hour12 = hour % 12;
-        if (hour12 == 0) {
-            hour12 = 12;
-        }
-        snprintf(dst, dst_size, "%02d:%02d %s", hour12, minute, ampm);
+/*
+ * The server just confirmed cache_upcoming, so it holds every dose of the
+ * next 24 h; a full list may have been cut short, so then only up to its last
+ * item. Persisted only when the list itself changed.
+ */
+static void upcoming_coverage_update(bool persist)
+{
+    int now_minutes = 0;
+    int64_t minute_start_ms = 0;
+    if (!local_minute_now(&now_minutes, &minute_start_ms)) {
         return;
     }
-
-    if (sscanf(src, "%d:%d", &hour, &minute) == 2) {
-        if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
-            snprintf(dst, dst_size, "%s", src);
-            return;
-        }
-        const char *ampm = (hour >= 12) ? "PM" : "AM";
-        int hour12 = hour % 12;
-        if (hour12 == 0) {
-            hour12 = 12;
+    int64_t wall_ms = wall_now_ms();
+    int64_t until_ms = wall_ms + UPCOMING_WINDOW_MS;
+    if (cache_upcoming.count >= MED_CACHE_MAX) {
+        const med_cache_item_t *last = &cache_upcoming.items[cache_upcoming.count - 1];
+        until_ms = wall_ms;
+        if (last->minute >= 0) {
+            until_ms += upcoming_due_ms(last->minute, now_minutes, minute_start_ms) + 60000 -
+                        esp_timer_get_time() / 1000;
         }
-        snprintf(dst, dst_size, "%02d:%02d %s", hour12, minute, ampm);
+    }
+    upcoming_covered_until_ms = until_ms;
+    if (!persist) {
         return;
     }
+    nvs_store_set_i64("upcoming_until", upcoming_covered_until_ms, NVS_STORE_DELAY_MS);
+}
+
+/*
+ * Occurrences (slot, epoch minute) that already alerted, whatever their dose
+ * id: a plan occurrence fired offline must not fire again once the server
+ * lists it under its own id. Kept in NVS, so a reset inside the grace
+ * window does not alert (and dispense) the same dose twice. Guarded by the
+ * LVGL lock.
+ */
+#define DOSE_FIRED_MAX 16
+static struct {
+    int64_t minute;
+    int slot;
+} dose_fired[DOSE_FIRED_MAX];
+static size_t dose_fired_next = 0;
+
+/*
+ * Alerts and pre-positions handed from the esp_timer task to the LVGL task.
+ * The timer task only posts to the queues; dose_alert_timer_cb() drains them
+ * on the LVGL task, so the scheduler never waits for the LVGL lock.
+ */
+#define DOSE_ALERT_QUEUE_LEN DOSE_SCHEDULER_MAX
+#define DOSE_ALERT_POLL_MS 200
+#define DOSE_PREPOSITION_LEAD_MS (5 * 60 * 1000)
+typedef struct {
+    med_cache_item_t item;
+    int64_t due_epoch_ms;
+} dose_alert_t;
+static QueueHandle_t dose_alert_queue = NULL;
+static QueueHandle_t dose_prepare_queue = NULL;     /* latest pre-position request only */
+
+/* doseIds of the running dispense session, by dispense dose index. */
+static char dispense_dose_ids[DISPENSE_MAX_DOSES][40];
+static char dispense_alert_name[48];
 
-    snprintf(dst, dst_size, "%s", src);
+static int64_t dose_minute(int64_t due_epoch_ms)
+{
+    return (due_epoch_ms + 30000) / 60000;
 }
 
-static int time_12h_to_minutes(const char *src)
+static void dose_mark_fired(int slot, int64_t due_epoch_ms)
 {
-    if (!src || src[0] == '\0') {
-        return -1;
+    dose_fired[dose_fired_next].minute = dose_minute(due_epoch_ms);
+    dose_fired[dose_fired_next].slot = slot;
+    dose_fired_next = (dose_fired_next + 1) % DOSE_FIRED_MAX;
+    nvs_store_set_blob("dose_fired", dose_fired, sizeof(dose_fired), 0);
+}
+
+static void dose_fired_load(void)
+{
+    size_t len = sizeof(dose_fired);
+    if (!nvs_store_get_blob("dose_fired", dose_fired, &len) || len != sizeof(dose_fired)) {
+        memset(dose_fired, 0, sizeof(dose_fired));
+        return;
     }
-    int hour = 0;
-    int minute = 0;
-    int second = 0;
-    char ampm[3] = {0};
-    if (sscanf(src, "%d:%d:%d %2s", &hour, &minute, &second, ampm) == 4) {
-        if (minute < 0 || minute > 59 || hour < 1 || hour > 12) {
-            return -1;
-        }
-        bool is_pm = (ampm[0] == 'P' || ampm[0] == 'p');
-        int hour24 = hour % 12;
-        if (is_pm) {
-            hour24 += 12;
+    /* Overwrite the oldest entry next */
+    dose_fired_next = 0;
+    for (size_t i = 1; i < DOSE_FIRED_MAX; ++i) {
+        if (dose_fired[i].minute < dose_fired[dose_fired_next].minute) {
+            dose_fired_next = i;
         }
-        return hour24 * 60 + minute;
     }
+}
 
-    if (sscanf(src, "%d:%d %2s", &hour, &minute, ampm) != 3) {
-        return -1;
-    }
-    if (minute < 0 || minute > 59 || hour < 1 || hour > 12) {
-        return -1;
-    }
-    bool is_pm = (ampm[0] == 'P' || ampm[0] == 'p');
-    int hour24 = hour % 12;
-    if (is_pm) {
-        hour24 += 12;
+static bool dose_fired_recently(int slot, int64_t due_epoch_ms)
+{
+    int64_t minute = dose_minute(due_epoch_ms);
+    for (size_t i = 0; i < DOSE_FIRED_MAX; ++i) {
+        if (dose_fired[i].minute == minute && dose_fired[i].slot == slot) {
+            return true;
+        }
     }
-    return hour24 * 60 + minute;
+    return false;
 }
 
-static int time_any_to_minutes(const char *src)
+/* LVGL task: adds every queued alert to the dispense session; returns how many were taken */
+static size_t dose_alert_take_queued(void)
 {
-    if (!src || src[0] == '\0') {
-        return -1;
-    }
-    int hour = 0;
-    int minute = 0;
-    int second = 0;
-    char ampm[3] = {0};
+    size_t taken = 0;
+    dose_alert_t alert;
+    while (dose_alert_queue && xQueueReceive(dose_alert_queue, &alert, 0) == pdTRUE) {
+        const med_cache_item_t *item = &alert.item;
+        taken++;
+        dose_mark_fired(item->slot, alert.due_epoch_ms);
 
-    if (sscanf(src, "%d:%d:%d %2s", &hour, &minute, &second, ampm) == 4) {
-        if (minute < 0 || minute > 59 || hour < 1 || hour > 12) {
-            return -1;
-        }
-        bool is_pm = (ampm[0] == 'P' || ampm[0] == 'p');
-        int hour24 = hour % 12;
-        if (is_pm) {
-            hour24 += 12;
+        if (item->dose_id[0] == '\0') {
+            ESP_LOGW(TAG, "Upcoming dose missing doseId; cannot mark taken/skip (slot=%d)", item->slot);
         }
-        return hour24 * 60 + minute;
-    }
-
-    if (sscanf(src, "%d:%d %2s", &hour, &minute, ampm) == 3) {
-        if (minute < 0 || minute > 59 || hour < 1 || hour > 12) {
-            return -1;
+        int dose = dispense_add_dose(item->slot);
+        if (dose < 0) {
+            /* Session full or bad slot: report it rather than lose it */
+            ESP_LOGW(TAG, "Cannot dispense %s (slot=%d); recording it as skipped", item->name, item->slot);
+            dose_event_record(item->dose_id, false);
+            continue;
         }
-        bool is_pm = (ampm[0] == 'P' || ampm[0] == 'p');
-        int hour24 = hour % 12;
-        if (is_pm) {
-            hour24 += 12;
+        snprintf(dispense_dose_ids[dose], sizeof(dispense_dose_ids[dose]), "%s", item->dose_id);
+        if (dose == 0) {
+            snprintf(current_alert_dose_id, sizeof(current_alert_dose_id), "%s", item->dose_id);
+            snprintf(dispense_alert_name, sizeof(dispense_alert_name), "%s", item->name);
+            alert_screen_show(item->name, item->time_str, item->dose);
+        } else {
+            char name[64];
+            snprintf(name, sizeof(name), "%s +%d more", dispense_alert_name, dose);
+            alert_screen_update(name, item->time_str, item->dose);
         }
-        return hour24 * 60 + minute;
     }
+    return taken;
+}
 
-    if (sscanf(src, "%d:%d:%d", &hour, &minute, &second) == 3) {
-        if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
-            return -1;
-        }
-        return hour * 60 + minute;
-    }
+/* Scratch for dose_schedule_reload(), guarded by the LVGL lock */
+static dose_scheduler_entry_t dose_schedule_entries[DOSE_SCHEDULER_MAX];
+static med_plan_occurrence_t dose_schedule_occurrences[DOSE_SCHEDULER_MAX];
 
-    if (sscanf(src, "%d:%d", &hour, &minute) == 2) {
-        if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
-            return -1;
-        }
-        return hour * 60 + minute;
+/*
+ * Rebuilds the dose scheduler against the current clock: cache_upcoming
+ * first, then plan occurrences from where the list stops covering, so the
+ * device keeps alerting however long it stays offline.
+ */
+static void dose_schedule_reload(void)
+{
+    int now_minutes = 0;
+    int64_t minute_start_ms = 0;
+    if (!local_minute_now(&now_minutes, &minute_start_ms)) {
+        return;
     }
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    int64_t wall_ms = wall_now_ms();
 
-    return -1;
-}
-
-static int get_current_time_minutes(void)
-{
-    if (time_synced && time_base_ms != 0 && time_base_hour24 >= 0 && time_base_minute >= 0) {
-        int64_t now_ms = esp_timer_get_time() / 1000;
-        int64_t elapsed_minutes = (now_ms - time_base_ms) / 60000;
-        int total_minutes = (time_base_hour24 * 60 + time_base_minute + (int)elapsed_minutes) % (24 * 60);
-        if (total_minutes < 0) {
-            total_minutes += 24 * 60;
+    lvgl_port_lock(0);
+    dose_alert_take_queued();       /* fired but not yet handled: mark them before the dedup */
+    dose_scheduler_entry_t *entries = dose_schedule_entries;
+    size_t count = 0;
+    for (size_t i = 0; i < cache_upcoming.count && count < DOSE_SCHEDULER_MAX; ++i) {
+        const med_cache_item_t *item = &cache_upcoming.items[i];
+        if (item->minute < 0) {
+            continue;
+        }
+        int64_t due_ms = upcoming_due_ms(item->minute, now_minutes, minute_start_ms);
+        if (dose_fired_recently(item->slot, wall_ms + due_ms - now_ms)) {
+            continue;
+        }
+        entries[count].due_ms = due_ms;
+        entries[count].item = *item;
+        count++;
+    }
+
+    int64_t from_ms = wall_ms - DOSE_SCHEDULER_GRACE_MS;
+    if (from_ms < upcoming_covered_until_ms) {
+        from_ms = upcoming_covered_until_ms;
+    }
+    size_t expanded = med_plan_expand(&cache_plans, from_ms, wall_ms + PLAN_HORIZON_MS,
+                                      dose_schedule_occurrences, DOSE_SCHEDULER_MAX - count);
+    size_t listed = count;
+    for (size_t i = 0; i < expanded; ++i) {
+        const med_plan_occurrence_t *occ = &dose_schedule_occurrences[i];
+        int64_t due_ms = now_ms + (occ->due_epoch_ms - wall_ms);
+        bool duplicate = dose_fired_recently(occ->item.slot, occ->due_epoch_ms);
+        for (size_t j = 0; j < listed && !duplicate; ++j) {
+            duplicate = entries[j].item.slot == occ->item.slot && llabs(entries[j].due_ms - due_ms) < 30000;
+        }
+        if (!duplicate) {
+            entries[count].due_ms = due_ms;
+            entries[count].item = occ->item;
+            count++;
         }
-        return total_minutes;
     }
-    if (time_display_valid) {
-        return time_12h_to_minutes(time_display);
+    if (count > listed) {
+        ESP_LOGI(TAG, "Scheduled %d listed and %d plan doses", (int)listed, (int)(count - listed));
     }
-    return -1;
+    dose_scheduler_load(entries, count);
+    lvgl_port_unlock();
 }
 
-static void check_medicine_alert(void)
+/*
+ * dose_scheduler callback (esp_timer task): hand the alert to the LVGL task.
+ * A full queue refuses the dose, so the scheduler offers it again.
+ */
+static bool dose_alert_fire(const med_cache_item_t *item, int64_t late_ms, void *ctx)
 {
-    static int last_alert_minute = -1;
-    static char last_alert_name[48] = {0};
-
-    if (!time_display_valid || !cache_upcoming.valid || cache_upcoming.count == 0) {
-        return;
-    }
-    const med_cache_item_t *item = &cache_upcoming.items[0];
-    if (!item->time_str[0]) {
-        return;
+    (void)ctx;
+    if (late_ms > 60000) {
+        ESP_LOGW(TAG, "Dose alert for %s is %lld s late", item->name, (long long)(late_ms / 1000));
     }
+    dose_alert_t alert = {.item = *item, .due_epoch_ms = wall_now_ms() - late_ms};
+    return dose_alert_queue && xQueueSend(dose_alert_queue, &alert, 0) == pdTRUE;
+}
 
-    int now_minutes = get_current_time_minutes();
-    int med_minutes = time_any_to_minutes(item->time_str);
-    if (now_minutes < 0 || med_minutes < 0) {
-        return;
+/*
+ * dose_scheduler prepare callback (esp_timer task): turn the carousel early
+ * while idle. The LVGL task makes the move, and declines it there if the
+ * dispenser has become busy.
+ */
+static bool dose_alert_prepare(const med_cache_item_t *item, int64_t due_in_ms, void *ctx)
+{
+    (void)ctx;
+    if (stepper_motion_busy() || !dose_prepare_queue) {
+        return false;
     }
+    dose_alert_t prepare = {.item = *item, .due_epoch_ms = wall_now_ms() + due_in_ms};
+    xQueueOverwrite(dose_prepare_queue, &prepare);
+    return true;
+}
 
-    if (now_minutes == med_minutes) {
-        if (last_alert_minute != now_minutes || strcmp(last_alert_name, item->name) != 0) {
-            snprintf(last_alert_name, sizeof(last_alert_name), "%s", item->name);
-            last_alert_minute = now_minutes;
-            snprintf(current_alert_dose_id, sizeof(current_alert_dose_id), "%s", item->dose_id);
-            if (current_alert_dose_id[0] == '\0') {
-                ESP_LOGW(TAG, "Upcoming dose missing doseId; cannot mark taken/skip (slot=%d)", item->slot);
-            }
-            stepper_move_to_slot(item->slot);
-            alert_screen_show(item->name, item->time_str, item->dose);
+/* LVGL timer: runs what the scheduler handed over since the last tick. */
+static void dose_alert_timer_cb(lv_timer_t *timer)
+{
+    (void)timer;
+    dose_alert_t prepare;
+    if (dose_prepare_queue && xQueueReceive(dose_prepare_queue, &prepare, 0) == pdTRUE) {
+        if (dispense_preposition(prepare.item.slot)) {
+            ESP_LOGI(TAG, "Dose %s due in %lld s; pre-positioning slot %d", prepare.item.name,
+                     (long long)((prepare.due_epoch_ms - wall_now_ms()) / 1000), prepare.item.slot);
+        } else {
+            dose_scheduler_prepare_declined();
         }
     }
+    if (dose_alert_take_queued() > 0) {
+        /* Refill the scheduler: past the listed doses it only holds the next DOSE_SCHEDULER_MAX occurrences */
+        dose_schedule_reload();
+    }
 }
 
 static void clock_timer_cb(lv_timer_t *timer)
 {
     (void)timer;
     update_clock_text();
-    check_medicine_alert();
 }
 
 static void ensure_clock_label(void)
@@ -1047,53 +1074,52 @@ static void route_to_info_screen(const char *title)
 
 static void motor_init(void)
 {
-    gpio_config_t cfg = {
-        .pin_bit_mask = (1ULL << MOTOR_IN1_GPIO) | (1ULL << MOTOR_IN2_GPIO) |
-                        (1ULL << MOTOR_IN3_GPIO) | (1ULL << MOTOR_IN4_GPIO),
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE
+    const stepper_motion_config_t cfg = {
+        .gpio = {MOTOR_IN1_GPIO, MOTOR_IN2_GPIO, MOTOR_IN3_GPIO, MOTOR_IN4_GPIO},
+        .start_sps = MOTOR_START_SPS,
+        .max_sps = MOTOR_MAX_SPS,
+        .accel_sps2 = MOTOR_ACCEL_SPS2,
+        .approach_steps = STEPPER_STEPS_PER_SLOT / 2,
     };
-    gpio_config(&cfg);
+    ESP_ERROR_CHECK(stepper_motion_init(&cfg));
+}
 
-    gpio_set_level(MOTOR_IN1_GPIO, 0);
-    gpio_set_level(MOTOR_IN2_GPIO, 0);
-    gpio_set_level(MOTOR_IN3_GPIO, 0);
-    gpio_set_level(MOTOR_IN4_GPIO, 0);
-    motor_step_index = 0;
+/* stepper_motion callback (motion task): queue the slot for NVS, then resume the caller on the LVGL task. */
+static void stepper_slot_reached(int32_t position, bool completed, void *ctx)
+{
+    if (!completed) {
+        return;
+    }
+    int32_t wrapped = (position % STEPPER_STEPS_PER_REV + STEPPER_STEPS_PER_REV) % STEPPER_STEPS_PER_REV;
+    int slot = (int)((wrapped + STEPPER_STEPS_PER_SLOT / 2) / STEPPER_STEPS_PER_SLOT) % STEPPER_TOTAL_SLOTS + 1;
+    stepper_current_slot = slot;
+    stepper_slot_save(slot);
+    lv_async_cb_t on_arrived = (lv_async_cb_t)ctx;
+    if (on_arrived) {
+        lvgl_port_lock(0);
+        lv_async_call(on_arrived, NULL);
+        lvgl_port_unlock();
+    }
 }
 
-static void motor_set_phase(int index)
+static void stepper_approaching_async(void *arg)
 {
-    static const uint8_t phase[4][4] = {
-        {1, 0, 0, 0},
-        {0, 0, 1, 0},
-        {0, 1, 0, 0},
-        {0, 0, 0, 1}
-    };
-    int idx = index & 0x03;
-    gpio_set_level(MOTOR_IN1_GPIO, phase[idx][0]);
-    gpio_set_level(MOTOR_IN3_GPIO, phase[idx][1]);
-    gpio_set_level(MOTOR_IN2_GPIO, phase[idx][2]);
-    gpio_set_level(MOTOR_IN4_GPIO, phase[idx][3]);
+    dispense_approaching((int32_t)(intptr_t)arg);
 }
 
-static void motor_move_steps(int steps)
+/* stepper_motion approach callback (motion task): the carousel is decelerating into the slot. */
+static void stepper_slot_approaching(int32_t steps_left, void *ctx)
 {
-    if (steps == 0) {
+    if (!ctx) {
         return;
     }
-    int dir = (steps > 0) ? 1 : -1;
-    int count = steps > 0 ? steps : -steps;
-    for (int i = 0; i < count; ++i) {
-        motor_step_index = (motor_step_index + dir + 4) % 4;
-        motor_set_phase(motor_step_index);
-        esp_rom_delay_us(CALIBRATE_STEP_DELAY_US);
-    }
+    lvgl_port_lock(0);
+    lv_async_call(stepper_approaching_async, (void *)(intptr_t)steps_left);
+    lvgl_port_unlock();
 }
 
-static void stepper_move_to_slot(int slot)
+/* Queues a carousel move; on_arrived (may be NULL) then runs on the LVGL task. */
+static void stepper_move_to_slot(int slot, lv_async_cb_t on_arrived)
 {
     if (slot < 1) {
         ESP_LOGW(TAG, "Stepper slot too low (%d); using slot 1", slot);
@@ -1103,197 +1129,58 @@ static void stepper_move_to_slot(int slot)
         slot = STEPPER_TOTAL_SLOTS;
     }
 
-    int target_steps = STEPPER_STEPS_PER_SLOT * (slot - 1);
-    int delta = target_steps - stepper_current_steps;
-    if (delta == 0) {
-        return;
+    int32_t target_steps = STEPPER_STEPS_PER_SLOT * (slot - 1);
+    ESP_LOGI(TAG, "Stepper moving to slot %d (from %ld)", slot, (long)stepper_motion_position());
+    if (!stepper_motion_move_to_circular(target_steps, STEPPER_STEPS_PER_REV,
+                                         stepper_slot_approaching, stepper_slot_reached,
+                                         (void *)on_arrived) &&
+        on_arrived) {
+        on_arrived(NULL);
     }
-
-    ESP_LOGI(TAG, "Stepper moving to slot %d (delta=%d)", slot, delta);
-    motor_move_steps(delta);
-    stepper_current_steps = target_steps;
-    stepper_current_slot = slot;
-    stepper_slot_save(slot);
 }
 
 static void stepper_slot_load(void)
 {
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READONLY, &handle) != ESP_OK) {
-        return;
-    }
     int32_t stored_slot = 0;
-    if (nvs_get_i32(handle, "stepper_slot", &stored_slot) == ESP_OK) {
+    if (nvs_store_get_i32("stepper_slot", &stored_slot)) {
         if (stored_slot >= 1 && stored_slot <= STEPPER_TOTAL_SLOTS) {
             stepper_current_slot = (int)stored_slot;
-            stepper_current_steps = STEPPER_STEPS_PER_SLOT * (stepper_current_slot - 1);
+            stepper_motion_set_position(STEPPER_STEPS_PER_SLOT * (stepper_current_slot - 1));
         }
     }
-    nvs_close(handle);
 }
 
+/* Runs on the motion task after every move; written at once, a power cut mid-session must not lose it */
 static void stepper_slot_save(int slot)
 {
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READWRITE, &handle) != ESP_OK) {
-        return;
-    }
-    nvs_set_i32(handle, "stepper_slot", (int32_t)slot);
-    nvs_commit(handle);
-    nvs_close(handle);
+    nvs_store_set_i32("stepper_slot", (int32_t)slot, 0);
 }
 
-static void servo_init(void)
+static void servo_start(void)
 {
-    ledc_timer_config_t timer_cfg = {
-        .speed_mode = SERVO_LEDC_MODE,
-        .duty_resolution = SERVO_LEDC_RESOLUTION,
-        .timer_num = SERVO_LEDC_TIMER,
-        .freq_hz = 50,
-        .clk_cfg = LEDC_AUTO_CLK
-    };
-    ledc_timer_config(&timer_cfg);
-
-    ledc_channel_config_t ch_cfg = {
-        .gpio_num = SERVO_GPIO,
+    const servo_motion_config_t cfg = {
+        .gpio = SERVO_GPIO,
         .speed_mode = SERVO_LEDC_MODE,
+        .timer = SERVO_LEDC_TIMER,
         .channel = SERVO_LEDC_CHANNEL,
-        .timer_sel = SERVO_LEDC_TIMER,
-        .duty = 0,
-        .hpoint = 0
-    };
-    ledc_channel_config(&ch_cfg);
-}
-
-static void servo_set_pulse_us(uint32_t pulse_us)
-{
-    const uint32_t max_duty = (1u << SERVO_LEDC_RESOLUTION) - 1u;
-    uint32_t duty = (pulse_us * max_duty) / SERVO_PERIOD_US;
-    ledc_set_duty(SERVO_LEDC_MODE, SERVO_LEDC_CHANNEL, duty);
-    ledc_update_duty(SERVO_LEDC_MODE, SERVO_LEDC_CHANNEL);
-}
-
-static void servo_set_degree(int degree)
-{
-    if (degree < 0) {
-        degree = 0;
-    }
-    if (degree > SERVO_DEG_MAX) {
-        degree = SERVO_DEG_MAX;
-    }
-    uint32_t pulse = SERVO_MIN_US +
-        (uint32_t)((SERVO_MAX_US - SERVO_MIN_US) * degree / SERVO_DEG_MAX);
-    servo_set_pulse_us(pulse);
-}
-
-static void servo_test_timer_cb(void *arg)
-{
-    (void)arg;
-    if (servo_deg > SERVO_SWEEP_MAX_DEG) {
-        servo_deg = SERVO_SWEEP_MAX_DEG;
-    }
-    if (servo_deg < 0) {
-        servo_deg = 0;
-    }
-    servo_set_degree(servo_deg);
-    servo_deg += SERVO_STEP_DEG;
-    if (servo_deg > SERVO_SWEEP_MAX_DEG) {
-        servo_deg = 0;
-    }
-}
-
-static void servo_test_start(void)
-{
-    if (servo_timer) {
-        return;
-    }
-    servo_init();
-    servo_left = true;
-    servo_deg = 0;
-    servo_set_degree(0);
-
-    const esp_timer_create_args_t args = {
-        .callback = &servo_test_timer_cb,
-        .name = "servo_test"
-    };
-    if (esp_timer_create(&args, &servo_timer) == ESP_OK) {
-        esp_timer_start_periodic(servo_timer, SERVO_STEP_INTERVAL_US);
-    }
-}
-
-static void servo_test_stop(void)
-{
-    if (servo_timer) {
-        esp_timer_stop(servo_timer);
-    }
-    servo_current_deg = servo_deg;
-    if (servo_current_deg < 0) {
-        servo_current_deg = 0;
-    }
-    if (servo_current_deg > SERVO_DEG_MAX) {
-        servo_current_deg = SERVO_DEG_MAX;
-    }
-}
-
-static void ir_sensor_init(void)
-{
-    gpio_config_t cfg = {
-        .pin_bit_mask = (1ULL << IR_SENSOR_GPIO),
-        .mode = GPIO_MODE_INPUT,
-        .pull_up_en = GPIO_PULLUP_ENABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE
+        .min_us = SERVO_MIN_US,
+        .max_us = SERVO_MAX_US,
+        .deg_max = SERVO_DEG_MAX,
+        .initial_deg = SERVO_LID_CLOSED_DEG,
+        .settle_ms = SERVO_SETTLE_MS,
     };
-    gpio_config(&cfg);
-}
-
-static void ir_sensor_timer_cb(void *arg)
-{
-    (void)arg;
-    if (!ir_enabled) {
-        return;
-    }
-    int state = gpio_get_level(IR_SENSOR_GPIO);
-    if (state == last_ir_state) {
-        return;
-    }
-    last_ir_state = state;
-    if (state == 0) {
-        ESP_LOGI(TAG, "IR: object detected");
-        ir_detected_once = true;
-    } else {
-        ESP_LOGI(TAG, "IR: object not detected");
-        if (ir_detected_once && !ir_close_pending) {
-            ir_close_pending = true;
-            ir_sensor_set_enabled(false);
-            if (!ir_close_timer) {
-                const esp_timer_create_args_t args = {
-                    .callback = &ir_close_timer_cb,
-                    .name = "ir_close"
-                };
-                if (esp_timer_create(&args, &ir_close_timer) != ESP_OK) {
-                    return;
-                }
-            }
-            esp_timer_start_once(ir_close_timer, 2000000);
-        }
-    }
-}
-
-static void ir_sensor_set_enabled(bool enabled)
-{
-    ir_enabled = enabled;
-    last_ir_state = -1;
-    if (enabled) {
-        ir_close_pending = false;
-        ir_detected_once = false;
-    }
+    ESP_ERROR_CHECK(servo_motion_init(&cfg));
 }
 
-static void ir_close_timer_cb(void *arg)
+/* pill_detector callback (detector task) */
+static void ir_pill_dropped(const pill_drop_t *drop, uint32_t count, void *ctx)
 {
-    (void)arg;
-    servo_start_move(180, false);
+    (void)ctx;
+    ESP_LOGI(TAG, "IR: pill %lu dropped (beam broken %lld us)", (unsigned long)count,
+             (long long)(drop->clear_us - drop->break_us));
+    lvgl_port_lock(0);
+    dispense_dropped(count);
+    lvgl_port_unlock();
 }
 
 static int get_wifi_strength(void)
@@ -1343,20 +1230,42 @@ static void log_wifi_status(const char *context)
     ESP_LOGW(TAG, "%s wifi status: rssi=%d, ip=" IPSTR, context ? context : "wifi", rssi, IP2STR(&ip_info.ip));
 }
 
-static bool send_heartbeat(void)
+/* Non-empty dispense latency histograms, trailing empty buckets trimmed. */
+static void heartbeat_add_dispense_latency(cJSON *root)
 {
-    if (!wifi_is_connected()) {
-        return false;
+    static const char *const names[DISPENSE_LAT_COUNT] = {
+        "alertToOpen", "openToDrop", "dropToReport", "pickToOpen",
+    };
+    cJSON *latency = NULL;
+    for (int i = 0; i < DISPENSE_LAT_COUNT; ++i) {
+        dispense_hist_t hist;
+        dispense_stats_get((dispense_latency_t)i, &hist);
+        if (hist.count == 0) {
+            continue;
+        }
+        if (!latency && !(latency = cJSON_AddObjectToObject(root, "dispenseLatency"))) {
+            return;
+        }
+        cJSON *item = cJSON_AddObjectToObject(latency, names[i]);
+        if (!item) {
+            continue;
+        }
+        cJSON_AddNumberToObject(item, "count", hist.count);
+        cJSON_AddNumberToObject(item, "sumMs", (double)hist.sum_ms);
+        cJSON_AddNumberToObject(item, "maxMs", hist.max_ms);
+        size_t used = DISPENSE_HIST_BUCKETS;
+        while (used > 0 && hist.buckets[used - 1] == 0) {
+            used--;
+        }
+        cJSON *buckets = cJSON_AddArrayToObject(item, "buckets");
+        for (size_t b = 0; buckets && b < used; ++b) {
+            cJSON_AddItemToArray(buckets, cJSON_CreateNumber(hist.buckets[b]));
+        }
     }
+}
 
-    char url[256];
-    snprintf(url, sizeof(url), "%s/api/hardware/heartbeat", BACKEND_BASE_URL);
-    ESP_LOGI(TAG, "HTTP POST %s", url);
-
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        return false;
-    }
+static void heartbeat_add_fields(cJSON *root)
+{
     cJSON_AddStringToObject(root, "deviceId", DEVICE_ID);
     cJSON_AddNumberToObject(root, "batteryLevel", get_battery_level());
     cJSON_AddNumberToObject(root, "wifiStrength", get_wifi_strength());
@@ -1367,168 +1276,395 @@ static bool send_heartbeat(void)
     cJSON_AddNumberToObject(root, "temperatureC", get_temperature_c());
     cJSON_AddNullToObject(root, "lastError");
     cJSON_AddNumberToObject(root, "slotCount", STEPPER_TOTAL_SLOTS);
+    cJSON_AddNumberToObject(root, "pendingDoseEvents", (double)dose_outbox_pending());
+    heartbeat_add_dispense_latency(root);
 
-    char *body = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    if (!body) {
+    dispense_preposition_stats_t prepos;
+    dispense_preposition_stats_get(&prepos);
+    cJSON *prepos_json = cJSON_AddObjectToObject(root, "preposition");
+    if (prepos_json) {
+        cJSON_AddNumberToObject(prepos_json, "moves", prepos.moves);
+        cJSON_AddNumberToObject(prepos_json, "valid", prepos.valid);
+        cJSON_AddNumberToObject(prepos_json, "stale", prepos.stale);
+        cJSON_AddNumberToObject(prepos_json, "missed", prepos.missed);
+    }
+}
+
+static bool send_heartbeat(void)
+{
+    if (!wifi_is_connected()) {
         return false;
     }
 
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        free(body);
+    cJSON *root = cJSON_CreateObject();
+    if (!root) {
         return false;
     }
+    heartbeat_add_fields(root);
 
-    char auth_header[128];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", DEVICE_SECRET);
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Authorization", auth_header);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, body, (int)strlen(body));
+    char *body = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!body) {
+        return false;
+    }
 
-    esp_err_t err = esp_http_client_perform(client);
+    ESP_LOGI(TAG, "HTTP POST /api/hardware/heartbeat");
+    const backend_conn_request_t req = {
+        .method = HTTP_METHOD_POST,
+        .path = "/api/hardware/heartbeat",
+        .body = body,
+    };
+    backend_conn_response_t resp;
+    esp_err_t err = backend_conn_perform(&req, &resp);
+    backend_conn_release();
+    free(body);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Heartbeat perform failed: %s", esp_err_to_name(err));
         log_wifi_status("heartbeat");
-        esp_http_client_cleanup(client);
-        free(body);
         return false;
     }
 
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-    free(body);
-    ESP_LOGI(TAG, "Heartbeat status: %d", status);
-    return status >= 200 && status < 300;
-}
-
-static void heartbeat_task(void *arg)
-{
-    (void)arg;
-    while (true) {
-        send_heartbeat();
-        vTaskDelay(pdMS_TO_TICKS(HEARTBEAT_INTERVAL_MS));
-    }
+    ESP_LOGI(TAG, "Heartbeat status: %d", resp.status);
+    return resp.status >= 200 && resp.status < 300;
 }
 
-typedef struct {
-    char dose_id[40];
-    bool taken;
-} dose_event_t;
+static bool dose_batch_supported = true;
 
-static bool send_dose_event(const char *dose_id, bool taken)
+/*
+ * Legacy per-dose PATCH. Returns 1 once the event is settled: applied, or
+ * refused for the dose itself ("Dose not found", "Invalid doseId"), which a
+ * retry cannot change. 0 for any other answer (device unknown, server
+ * error), -1 when no response was received; both keep the event queued.
+ */
+static int send_dose_event(const char *dose_id, bool taken)
 {
-    if (!dose_id || dose_id[0] == '\0') {
-        ESP_LOGE(TAG, "Dose event failed: missing doseId");
-        return false;
-    }
-    if (!wifi_is_connected()) {
-        ESP_LOGE(TAG, "Dose event failed: WiFi not connected");
-        return false;
-    }
-
-    char url[256];
+    char path[128];
     const char *action = taken ? "mark-taken" : "mark-skipped";
-    snprintf(url, sizeof(url), "%s/api/hardware/doses/%s/%s", BACKEND_BASE_URL, dose_id,
-             action);
-    ESP_LOGI(TAG, "HTTP PATCH %s", url);
+    snprintf(path, sizeof(path), "/api/hardware/doses/%s/%s", dose_id, action);
+    ESP_LOGI(TAG, "HTTP PATCH %s", path);
 
     cJSON *root = cJSON_CreateObject();
     if (!root) {
-        return false;
+        return -1;
     }
     cJSON_AddStringToObject(root, "deviceId", DEVICE_ID);
     char *body = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
     if (!body) {
-        return false;
+        return -1;
     }
 
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
+    const backend_conn_request_t req = {
+        .method = HTTP_METHOD_PATCH,
+        .path = path,
+        .body = body,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        free(body);
-        return false;
-    }
-
-    char auth_header[128];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", DEVICE_SECRET);
-    esp_http_client_set_method(client, HTTP_METHOD_PATCH);
-    esp_http_client_set_header(client, "Authorization", auth_header);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, body, (int)strlen(body));
-
-    esp_err_t err = esp_http_client_perform(client);
+    backend_conn_response_t resp;
+    esp_err_t err = backend_conn_perform(&req, &resp);
+    bool dose_refused = (resp.status == 404 || resp.status == 400) && resp.body &&
+                        (strstr(resp.body, "\"Dose not found\"") || strstr(resp.body, "\"Invalid doseId\""));
+    backend_conn_release();
+    free(body);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Dose event perform failed: %s", esp_err_to_name(err));
         log_wifi_status("dose_event");
-        esp_http_client_cleanup(client);
+        return -1;
+    }
+
+    if (resp.status >= 200 && resp.status < 300) {
+        ESP_LOGI(TAG, "Dose event %s success (status=%d)", action, resp.status);
+        return 1;
+    }
+    if (dose_refused) {
+        ESP_LOGW(TAG, "Dose event %s for %s refused (status=%d), dropping it", action, dose_id, resp.status);
+        return 1;
+    }
+    ESP_LOGE(TAG, "Dose event %s failed (status=%d)", action, resp.status);
+    return 0;
+}
+
+static char *dose_batch_build_body(const dose_outbox_event_t *events, size_t count)
+{
+    cJSON *root = cJSON_CreateObject();
+    if (!root) {
+        return NULL;
+    }
+    cJSON_AddStringToObject(root, "deviceId", DEVICE_ID);
+    cJSON *list = cJSON_AddArrayToObject(root, "events");
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    for (size_t i = 0; list && i < count; ++i) {
+        const dose_outbox_event_t *ev = &events[i];
+        cJSON *item = cJSON_CreateObject();
+        if (!item) {
+            break;
+        }
+        char key[24];
+        dose_outbox_key(ev, key, sizeof(key));
+        cJSON_AddStringToObject(item, "id", key);
+        cJSON_AddStringToObject(item, "doseId", ev->dose_id);
+        cJSON_AddStringToObject(item, "action", ev->action == DOSE_OUTBOX_TAKEN ? "taken" : "skipped");
+        /* Same boot: the monotonic age is exact. Older boots fall back to the wall clock if we had one. */
+        if (ev->boot == dose_outbox_boot()) {
+            cJSON_AddNumberToObject(item, "ageMs", (double)(now_ms - ev->uptime_ms));
+        } else if (ev->epoch_ms > 0) {
+            cJSON_AddNumberToObject(item, "at", (double)ev->epoch_ms);
+        }
+        cJSON_AddItemToArray(list, item);
+    }
+    char *body = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return body;
+}
+
+/*
+ * Leading events the batch response settles, in order: each needs a result
+ * with its id. applied and duplicate are done; not_found and invalid are
+ * final answers about that event, so it is dropped with a warning.
+ */
+static int dose_batch_settled(const char *body, const dose_outbox_event_t *events, size_t count)
+{
+    cJSON *root = body ? cJSON_Parse(body) : NULL;
+    const cJSON *results = cJSON_GetObjectItemCaseSensitive(root, "results");
+    size_t settled = 0;
+    while (settled < count) {
+        const cJSON *entry = cJSON_GetArrayItem(results, (int)settled);
+        const cJSON *id = cJSON_GetObjectItemCaseSensitive(entry, "id");
+        const cJSON *result = cJSON_GetObjectItemCaseSensitive(entry, "result");
+        char key[24];
+        dose_outbox_key(&events[settled], key, sizeof(key));
+        if (!cJSON_IsString(id) || strcmp(id->valuestring, key) != 0 || !cJSON_IsString(result)) {
+            break;
+        }
+        if (strcmp(result->valuestring, "not_found") == 0 || strcmp(result->valuestring, "invalid") == 0) {
+            ESP_LOGW(TAG, "Dose event %s for %s: %s, dropping it", key, events[settled].dose_id,
+                     result->valuestring);
+        } else if (strcmp(result->valuestring, "applied") != 0 && strcmp(result->valuestring, "duplicate") != 0) {
+            break;
+        }
+        settled++;
+    }
+    cJSON_Delete(root);
+    return (int)settled;
+}
+
+/*
+ * Uploader callback for dose_outbox: one batch POST, or per-dose PATCHes on
+ * backends without the batch route. Events only leave the outbox on an
+ * answer about the event itself, never on a device-level error.
+ */
+static int dose_outbox_send(const dose_outbox_event_t *events, size_t count, void *ctx)
+{
+    (void)ctx;
+    if (dose_batch_supported) {
+        char *body = dose_batch_build_body(events, count);
+        if (!body) {
+            return -1;
+        }
+        ESP_LOGI(TAG, "HTTP POST /api/hardware/doses/batch (%u events)", (unsigned)count);
+        const backend_conn_request_t req = {
+            .method = HTTP_METHOD_POST,
+            .path = "/api/hardware/doses/batch",
+            .body = body,
+        };
+        backend_conn_response_t resp;
+        esp_err_t err = backend_conn_perform(&req, &resp);
+        bool route_missing = backend_conn_route_missing(&resp);
+        int settled = err == ESP_OK && resp.status >= 200 && resp.status < 300
+                          ? dose_batch_settled(resp.body, events, count)
+                          : 0;
+        backend_conn_release();
         free(body);
-        return false;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Dose batch perform failed: %s", esp_err_to_name(err));
+            return -1;
+        }
+        if (resp.status >= 200 && resp.status < 300) {
+            if (settled < (int)count) {
+                ESP_LOGW(TAG, "Dose batch: %d of %u events settled", settled, (unsigned)count);
+            }
+            return settled > 0 ? settled : -1;
+        }
+        if (!route_missing) {
+            ESP_LOGE(TAG, "Dose batch failed (status=%d)", resp.status);
+            return -1;
+        }
+        ESP_LOGW(TAG, "Backend has no dose batch endpoint; using per-dose requests");
+        dose_batch_supported = false;
     }
 
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-    free(body);
-    bool ok = status >= 200 && status < 300;
-    if (ok) {
-        ESP_LOGI(TAG, "Dose event %s success (status=%d)", action, status);
-    } else {
-        ESP_LOGE(TAG, "Dose event %s failed (status=%d)", action, status);
+    for (size_t i = 0; i < count; ++i) {
+        if (send_dose_event(events[i].dose_id, events[i].action == DOSE_OUTBOX_TAKEN) != 1) {
+            return i > 0 ? (int)i : -1;
+        }
     }
-    return ok;
+    return (int)count;
 }
 
-static void send_dose_event_async(bool taken)
+static int64_t device_epoch_ms(void)
 {
-    if (current_alert_dose_id[0] == '\0') {
+    return wall_now_ms();
+}
+
+static void dose_outbox_on_pending(void)
+{
+    net_service_request(net_job_outbox);
+}
+
+static void dose_outbox_setup(void)
+{
+    const dose_outbox_config_t config = {
+        .send = dose_outbox_send,
+        .on_pending = dose_outbox_on_pending,
+        .epoch_ms = device_epoch_ms,
+    };
+    if (dose_outbox_init(&config) != ESP_OK) {
+        ESP_LOGE(TAG, "Dose outbox init failed");
+    }
+}
+
+static void dose_event_record(const char *dose_id, bool taken)
+{
+    if (!dose_id || dose_id[0] == '\0') {
         ESP_LOGW(TAG, "Dose event skipped: missing doseId");
         return;
     }
-    dose_event_t *evt = (dose_event_t *)calloc(1, sizeof(dose_event_t));
-    if (!evt) {
+    dose_outbox_push(dose_id, taken ? DOSE_OUTBOX_TAKEN : DOSE_OUTBOX_SKIPPED);
+}
+
+static void ir_sensor_start(void)
+{
+    const pill_detector_config_t cfg = {
+        .gpio = IR_SENSOR_GPIO,
+        .active_low = true,
+        .min_break_us = IR_MIN_BREAK_US,
+        .min_gap_us = IR_MIN_GAP_US,
+        .on_drop = ir_pill_dropped,
+    };
+    if (pill_detector_init(&cfg) != ESP_OK) {
+        ESP_LOGE(TAG, "IR detector init failed");
+    }
+}
+
+/* dispense ops. The FSM is driven only with the LVGL lock held. */
+static void dispense_positioned_async(void *arg)
+{
+    (void)arg;
+    dispense_positioned();
+}
+
+static int dispense_current_slot(void)
+{
+    return stepper_current_slot;
+}
+
+static void dispense_position(int slot)
+{
+    stepper_move_to_slot(slot, dispense_positioned_async);
+}
+
+/*
+ * A lid move that was not queued never reports back, which would leave the
+ * session waiting forever. End it instead: doses whose stop already dropped
+ * pills are reported taken, and the abort closes the lid again.
+ */
+static void dispense_lid_failed_async(void *arg)
+{
+    (void)arg;
+    if (dispense_state() == DISPENSE_IDLE) {
         return;
     }
-    snprintf(evt->dose_id, sizeof(evt->dose_id), "%s", current_alert_dose_id);
-    evt->taken = taken;
-    xTaskCreate(dose_event_task, "dose_event", 4096, evt, 5, NULL);
+    ESP_LOGW(TAG, "Lid move failed; ending the dispense session");
+    for (int i = 0; i < dispense_dose_count(); ++i) {
+        uint32_t pills = dispense_dose_pills(i);
+        if (pills > 0) {
+            dispense_report(i, pills);
+        }
+    }
+    dispense_cancel();
+    route_to_screen3();
 }
 
-static void dose_event_task(void *arg)
+static void dispense_open_lid(void)
 {
-    dose_event_t *data = (dose_event_t *)arg;
-    if (data) {
-        send_dose_event(data->dose_id, data->taken);
-        free(data);
+    if (servo_status_label) {
+        lv_label_set_text(servo_status_label, "Opening lid...");
+    }
+    if (!servo_start_move(SERVO_LID_OPEN_DEG)) {
+        lv_async_call(dispense_lid_failed_async, NULL);
     }
-    vTaskDelete(NULL);
 }
 
-static void ir_sensor_start(void)
+static void dispense_silence_alert(void)
+{
+    alert_screen_silence();
+}
+
+static void dispense_close_lid(void)
 {
-    if (ir_timer) {
+    if (!servo_start_move(SERVO_LID_CLOSED_DEG)) {
+        lv_async_call(dispense_lid_failed_async, NULL);
+    }
+}
+
+static void dispense_arm_detector(bool armed)
+{
+    if (armed) {
+        pill_detector_arm();
+    } else {
+        pill_detector_disarm();
+    }
+}
+
+/* One-shot on the LVGL task, which already serializes the dispense events; caller holds the LVGL lock. */
+static void dispense_start_timer(uint32_t ms)
+{
+    if (!dispense_timer) {
         return;
     }
-    ir_sensor_init();
-    last_ir_state = -1;
+    lv_timer_pause(dispense_timer);
+    if (ms > 0) {
+        lv_timer_set_period(dispense_timer, ms);
+        lv_timer_reset(dispense_timer);
+        lv_timer_resume(dispense_timer);
+    }
+}
 
-    const esp_timer_create_args_t args = {
-        .callback = &ir_sensor_timer_cb,
-        .name = "ir_sensor"
+static void dispense_report(int dose, uint32_t pills)
+{
+    ESP_LOGI(TAG, "Dose %d taken (%lu pill(s) detected)", dose, (unsigned long)pills);
+    dose_event_record(dispense_dose_ids[dose], true);
+}
+
+static void dispense_timer_cb(lv_timer_t *timer)
+{
+    lv_timer_pause(timer);
+    dispense_timeout();
+}
+
+static void dispense_setup(void)
+{
+    static const dispense_ops_t ops = {
+        .current_slot = dispense_current_slot,
+        .position = dispense_position,
+        .open_lid = dispense_open_lid,
+        .silence_alert = dispense_silence_alert,
+        .close_lid = dispense_close_lid,
+        .arm_detector = dispense_arm_detector,
+        .start_timer = dispense_start_timer,
+        .report = dispense_report,
     };
-    if (esp_timer_create(&args, &ir_timer) == ESP_OK) {
-        esp_timer_start_periodic(ir_timer, IR_POLL_INTERVAL_US);
+    dispense_timer = lv_timer_create(dispense_timer_cb, DISPENSE_DROP_TIMEOUT_MS, NULL);
+    if (!dispense_timer) {
+        ESP_LOGE(TAG, "Dispense timer create failed");
+    } else {
+        lv_timer_pause(dispense_timer);
     }
+    static const dispense_carousel_t carousel = {
+        .slots = STEPPER_TOTAL_SLOTS,
+        .steps_per_slot = STEPPER_STEPS_PER_SLOT,
+        .steps_per_rev = STEPPER_STEPS_PER_REV,
+    };
+    dispense_init(&ops, &carousel);
 }
 
 static void show_info_screen(const char *title)
@@ -1547,6 +1683,7 @@ static void queue_info_fetch(const char *path, const char *title)
     snprintf(pending_info_path, sizeof(pending_info_path), "%s", path);
     snprintf(pending_info_title, sizeof(pending_info_title), "%s", title);
     pending_info_fetch = true;
+    net_service_request(net_job_info);
 }
 
 static void add_info_line(const char *text)
@@ -1586,41 +1723,16 @@ static void med_cache_set_updated(med_cache_t *cache)
     }
 }
 
-static void render_med_cache(const char *title, const med_cache_t *cache, bool offline)
+static void add_info_line_cb(const char *line, void *ctx)
 {
-    show_info_screen(title);
-    if (!cache || !cache->valid) {
-        add_info_line("No cached data");
-        return;
-    }
-
-    if (offline) {
-        add_info_line("Offline - showing last data");
-    }
-    if (cache->updated[0] != '\0') {
-        char line[48];
-        snprintf(line, sizeof(line), "Last update: %s", cache->updated);
-        add_info_line(line);
-    }
-
-    if (cache->count == 0) {
-        add_info_line("No records found");
-        return;
-    }
-
-    for (size_t i = 0; i < cache->count; ++i) {
-        const med_cache_item_t *item = &cache->items[i];
-        char line[128];
-        char time_buf[16];
-        format_time_12h(item->time_str, time_buf, sizeof(time_buf));
-        snprintf(line, sizeof(line), "%s  |  %s", item->name[0] ? item->name : "--",
-             time_buf[0] ? time_buf : "--:--");
-        add_info_line(line);
+    (void)ctx;
+    add_info_line(line);
+}
 
-        snprintf(line, sizeof(line), "Dose: %s  Slot: %d", item->dose[0] ? item->dose : "--", item->slot);
-        add_info_line(line);
-        add_info_line(" ");
-    }
+static void render_med_cache(const char *title, const med_cache_t *cache, bool offline)
+{
+    show_info_screen(title);
+    med_cache_render(cache, offline, add_info_line_cb, NULL);
 }
 
 static bool apply_cached_upcoming_to_main(void)
@@ -1635,7 +1747,9 @@ static bool apply_cached_upcoming_to_main(void)
     }
 
     const med_cache_item_t *item = &cache_upcoming.items[0];
-    set_main_data(item->name, item->time_str, item->dose, item->status);
+    char time_buf[16];
+    dr_time_minutes_12h(item->minute, time_buf, sizeof(time_buf));
+    set_main_data(item->name, time_buf, item->dose, item->status);
     return true;
 }
 
@@ -1709,7 +1823,9 @@ static void on_calibrate_move_timer(lv_timer_t *timer)
     if (calibrate_move_dir == 0) {
         return;
     }
-    motor_move_steps(calibrate_move_dir * CALIBRATE_CONT_STEP);
+    if (!stepper_motion_busy()) {
+        stepper_motion_jog(calibrate_move_dir * CALIBRATE_CONT_STEP);
+    }
 }
 
 static void on_calibrate_move_event(lv_event_t *e)
@@ -1741,54 +1857,44 @@ static void on_calibrate_move_event(lv_event_t *e)
     }
 }
 
-static void servo_move_timer_cb(lv_timer_t *timer)
+static void servo_reached_async(void *arg)
 {
-    (void)timer;
-    if (servo_current_deg == servo_target_deg) {
-        if (servo_move_timer) {
-            lv_timer_del(servo_move_timer);
-            servo_move_timer = NULL;
-        }
-        if (pending_mark_taken && servo_target_deg == 180) {
-            pending_mark_taken = false;
-            send_dose_event_async(true);
-        }
-        if (servo_status_label) {
-            char buf[48];
-            snprintf(buf, sizeof(buf), "Reached %d deg", servo_target_deg);
-            lv_label_set_text(servo_status_label, buf);
-        }
-        if (servo_enable_ir_on_complete) {
-            servo_enable_ir_on_complete = false;
-            ir_sensor_set_enabled(true);
-        }
-        return;
+    int deg = (int)(intptr_t)arg;
+    if (servo_status_label) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "Reached %d deg", deg);
+        lv_label_set_text(servo_status_label, buf);
     }
-
-    if (servo_current_deg < servo_target_deg) {
-        servo_current_deg += SERVO_STEP_DEG;
-        if (servo_current_deg > servo_target_deg) {
-            servo_current_deg = servo_target_deg;
-        }
-    } else {
-        servo_current_deg -= SERVO_STEP_DEG;
-        if (servo_current_deg < servo_target_deg) {
-            servo_current_deg = servo_target_deg;
-        }
+    if (deg == SERVO_LID_OPEN_DEG) {
+        dispense_lid_opened();
+    } else if (deg == SERVO_LID_CLOSED_DEG) {
+        dispense_lid_closed();
     }
-    servo_set_degree(servo_current_deg);
 }
 
-static void servo_start_move(int target_deg, bool enable_ir_on_complete)
+/* servo_motion callback (servo task): resume on the LVGL task. */
+static void servo_move_done(int deg, void *ctx)
 {
-    servo_target_deg = target_deg;
-    servo_enable_ir_on_complete = enable_ir_on_complete;
+    (void)ctx;
+    lvgl_port_lock(0);
+    lv_async_call(servo_reached_async, (void *)(intptr_t)deg);
+    lvgl_port_unlock();
+}
 
-    if (servo_move_timer) {
-        lv_timer_del(servo_move_timer);
-        servo_move_timer = NULL;
+/* Queues a lid move; the lid positions get their own velocity profiles. False if it was not queued. */
+static bool servo_start_move(int target_deg)
+{
+    servo_motion_profile_t profile = {.max_dps = SERVO_MANUAL_DPS};
+    if (target_deg == SERVO_LID_OPEN_DEG) {
+        profile = (servo_motion_profile_t){.max_dps = SERVO_OPEN_DPS, .ramp_ms = SERVO_OPEN_RAMP_MS};
+    } else if (target_deg == SERVO_LID_CLOSED_DEG) {
+        profile = (servo_motion_profile_t){.max_dps = SERVO_CLOSE_DPS, .ramp_ms = SERVO_CLOSE_RAMP_MS};
+    }
+    if (!servo_motion_move_to(target_deg, &profile, servo_move_done, NULL)) {
+        ESP_LOGE(TAG, "Servo move to %d deg not queued", target_deg);
+        return false;
     }
-    servo_move_timer = lv_timer_create(servo_move_timer_cb, SERVO_STEP_INTERVAL_US / 1000, NULL);
+    return true;
 }
 
 static void ensure_calibrate_screen(void)
@@ -1911,13 +2017,14 @@ static void ensure_servo_calibrate_screen(void)
     lv_obj_set_size(servo_slider, 220, 14);
     lv_obj_align(servo_slider, LV_ALIGN_CENTER, 0, -10);
     lv_slider_set_range(servo_slider, 80, 180);
-    if (servo_current_deg < 80) {
-        servo_current_deg = 80;
+    servo_target_deg = servo_motion_position();
+    if (servo_target_deg < 80) {
+        servo_target_deg = 80;
     }
-    if (servo_current_deg > 180) {
-        servo_current_deg = 180;
+    if (servo_target_deg > 180) {
+        servo_target_deg = 180;
     }
-    lv_slider_set_value(servo_slider, servo_current_deg, LV_ANIM_OFF);
+    lv_slider_set_value(servo_slider, servo_target_deg, LV_ANIM_OFF);
     lv_obj_add_event_cb(servo_slider, on_servo_slider_changed, LV_EVENT_VALUE_CHANGED, NULL);
 
     servo_value_label = lv_label_create(servo_screen);
@@ -1925,7 +2032,7 @@ static void ensure_servo_calibrate_screen(void)
     lv_obj_set_style_text_font(servo_value_label, &lv_font_montserrat_16, LV_PART_MAIN | LV_STATE_DEFAULT);
     {
         char buf[32];
-        snprintf(buf, sizeof(buf), "Target: %d deg", servo_current_deg);
+        snprintf(buf, sizeof(buf), "Target: %d deg", servo_target_deg);
         lv_label_set_text(servo_value_label, buf);
     }
 
@@ -1945,17 +2052,16 @@ static void ensure_servo_calibrate_screen(void)
 
 static void show_servo_calibrate_screen(void)
 {
-    servo_test_stop();
-    servo_init();
     ensure_servo_calibrate_screen();
     if (servo_slider) {
-        if (servo_current_deg < 80) {
-            servo_current_deg = 80;
+        int deg = servo_motion_position();
+        if (deg < 80) {
+            deg = 80;
         }
-        if (servo_current_deg > 180) {
-            servo_current_deg = 180;
+        if (deg > 180) {
+            deg = 180;
         }
-        lv_slider_set_value(servo_slider, servo_current_deg, LV_ANIM_OFF);
+        lv_slider_set_value(servo_slider, deg, LV_ANIM_OFF);
     }
     lv_scr_load_anim(servo_screen, LV_SCR_LOAD_ANIM_FADE_ON, 200, 0, false);
 }
@@ -1965,10 +2071,6 @@ static void on_servo_back_clicked(lv_event_t *e)
     if (lv_event_get_code(e) != LV_EVENT_CLICKED) {
         return;
     }
-    if (servo_move_timer) {
-        lv_timer_del(servo_move_timer);
-        servo_move_timer = NULL;
-    }
     show_calibrate_menu_screen();
 }
 
@@ -1990,13 +2092,6 @@ static void on_servo_move_clicked(lv_event_t *e)
         return;
     }
     servo_target_deg = lv_slider_get_value(servo_slider);
-    if (servo_current_deg < 80) {
-        servo_current_deg = 80;
-    }
-    if (servo_current_deg > 180) {
-        servo_current_deg = 180;
-    }
-    servo_set_degree(servo_current_deg);
 
     if (servo_status_label) {
         char buf[48];
@@ -2004,7 +2099,7 @@ static void on_servo_move_clicked(lv_event_t *e)
         lv_label_set_text(servo_status_label, buf);
     }
 
-    servo_start_move(servo_target_deg, false);
+    servo_start_move(servo_target_deg);
 }
 
 static void show_calibrate_screen(void)
@@ -2085,18 +2180,7 @@ static void on_refill_slot_clicked(lv_event_t *e)
         lv_label_set_text(refill_status_label, buf);
     }
 
-    stepper_move_to_slot(slot);
-
-    servo_test_stop();
-    servo_init();
-    ir_sensor_set_enabled(false);
-    ir_close_pending = false;
-    ir_detected_once = false;
-    pending_mark_taken = false;
-
-    servo_current_deg = 180;
-    servo_set_degree(servo_current_deg);
-    servo_start_move(80, true);
+    dispense_refill(slot);
 }
 
 static void ensure_refill_screen(void)
@@ -2170,33 +2254,29 @@ static void on_submenu_back(void)
 
 static void on_alert_pick_action(void)
 {
-    servo_test_stop();
-    servo_init();
-    ir_sensor_set_enabled(false);
-    ir_close_pending = false;
-    ir_detected_once = false;
     if (current_alert_dose_id[0] == '\0') {
         ESP_LOGW(TAG, "Pick pressed but doseId is missing; mark-taken will be skipped");
-        pending_mark_taken = false;
-    } else {
-        pending_mark_taken = true;
-    }
-    if (ir_close_timer) {
-        esp_timer_stop(ir_close_timer);
-    }
-    servo_current_deg = 180;
-    servo_set_degree(servo_current_deg);
-    if (servo_status_label) {
-        lv_label_set_text(servo_status_label, "Opening lid...");
     }
-    servo_start_move(80, true);
+    dispense_pick();
     route_to_screen3();
 }
 
 static void on_alert_skip_action(void)
 {
-    pending_mark_taken = false;
-    send_dose_event_async(false);
+    if (dispense_state() == DISPENSE_IDLE) {
+        dose_event_record(current_alert_dose_id, false);
+    } else {
+        /* Stops already served keep their pills: report those doses taken */
+        for (int i = 0; i < dispense_dose_count(); ++i) {
+            uint32_t pills = dispense_dose_pills(i);
+            if (pills > 0) {
+                dispense_report(i, pills);
+            } else {
+                dose_event_record(dispense_dose_ids[i], false);
+            }
+        }
+    }
+    dispense_cancel();
     route_to_screen3();
 }
 
@@ -2302,469 +2382,660 @@ static bool wifi_is_connected(void)
     return esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK;
 }
 
-static bool backend_fetch_upcoming(void)
-{
-    char url[256];
-    snprintf(url, sizeof(url), "%s/api/hardware/upcoming?deviceId=%s", BACKEND_BASE_URL, DEVICE_ID);
-    ESP_LOGI(TAG, "Fetching: %s", url);
-
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        ESP_LOGE(TAG, "HTTP client init failed");
-        snprintf(backend_last_error, sizeof(backend_last_error), "HTTP init failed");
-        return false;
-    }
-
-    char auth_header[128];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", DEVICE_SECRET);
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_http_client_set_header(client, "Authorization", auth_header);
+static med_json_ingest_t med_ingest;
+static med_wire_ingest_t med_wire_ingest;
+static med_cache_t med_ingest_scratch;
+static bool med_ingest_started;
+static bool med_ingest_wire;
 
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "HTTP open failed: %s", esp_err_to_name(err));
-        snprintf(backend_last_error, sizeof(backend_last_error), "HTTP open: %s", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
-        return false;
+/* The first chunk tells the binary list from JSON; the server picks by Accept. */
+static bool med_ingest_on_body(const char *data, int len, void *ctx)
+{
+    (void)ctx;
+    if (!med_ingest_started) {
+        med_ingest_started = true;
+        med_ingest_wire = med_wire_sniff(data, (size_t)len);
+        if (med_ingest_wire) {
+            med_wire_begin(&med_wire_ingest, &med_ingest_scratch);
+        }
     }
-
-    int content_length = esp_http_client_fetch_headers(client);
-    int buffer_size = (content_length > 0) ? (content_length + 1) : 4096;
-    char *buffer = (char *)malloc(buffer_size);
-    if (!buffer) {
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
-        return false;
+    if (med_ingest_wire) {
+        return med_wire_feed(&med_wire_ingest, data, (size_t)len);
     }
+    return med_json_feed(&med_ingest, data, (size_t)len);
+}
 
-    int total_read = 0;
-    int read_len = 0;
-    while ((read_len = esp_http_client_read(client, buffer + total_read, buffer_size - 1 - total_read)) > 0) {
-        total_read += read_len;
-        if (total_read >= buffer_size - 1) {
-            buffer_size *= 2;
-            char *new_buf = (char *)realloc(buffer, buffer_size);
-            if (!new_buf) {
-                free(buffer);
-                esp_http_client_close(client);
-                esp_http_client_cleanup(client);
-                return false;
-            }
-            buffer = new_buf;
+/*
+ * Streams a med list into med_ingest_scratch, as the binary wire format when
+ * the backend has it and {"data":[...]} JSON otherwise. Sends the cached
+ * validator as If-None-Match; returns the HTTP status (200 or 304) or -1.
+ */
+static int backend_stream_med_list(const char *path, const char *etag)
+{
+    med_json_begin(&med_ingest, &med_ingest_scratch);
+    med_ingest_started = false;
+    med_ingest_wire = false;
+    const backend_conn_request_t req = {
+        .method = HTTP_METHOD_GET,
+        .path = path,
+        .on_body = med_ingest_on_body,
+        .if_none_match = etag,
+        .accept = MED_WIRE_ACCEPT,
+    };
+    backend_conn_response_t resp;
+    esp_err_t err = backend_conn_perform(&req, &resp);
+    backend_conn_release();
+
+    ESP_LOGI(TAG, "HTTP status: %d, bytes: %d%s", resp.status, resp.body_len,
+             med_ingest_wire ? " (binary)" : "");
+    if (resp.status == 304 && err == ESP_OK) {
+        return 304;
+    }
+    if (resp.status != 200) {
+        if (err != ESP_OK && resp.status == 0) {
+            snprintf(backend_last_error, sizeof(backend_last_error), "HTTP: %s", esp_err_to_name(err));
+        } else {
+            snprintf(backend_last_error, sizeof(backend_last_error), "HTTP %d", resp.status);
         }
+        return -1;
     }
-    buffer[total_read] = '\0';
-
-    int status = esp_http_client_get_status_code(client);
-    ESP_LOGI(TAG, "HTTP status: %d, bytes: %d", status, total_read);
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
-
-    log_http_response("upcoming", url, status, buffer, total_read);
-
-    if (status != 200 || total_read == 0) {
-        ESP_LOGE(TAG, "HTTP error status=%d, bytes=%d", status, total_read);
-        snprintf(backend_last_error, sizeof(backend_last_error), "HTTP %d", status);
-        free(buffer);
-        return false;
-    }
-
-    cJSON *root = cJSON_Parse(buffer);
-    free(buffer);
-    if (!root) {
-        ESP_LOGE(TAG, "JSON parse failed");
-        snprintf(backend_last_error, sizeof(backend_last_error), "JSON parse failed");
-        return false;
+    bool parsed = med_ingest_wire ? med_wire_end(&med_wire_ingest) : med_json_end(&med_ingest);
+    if (err != ESP_OK || resp.body_len == 0 || !parsed) {
+        const char *what = med_ingest_wire ? "List decode" : "JSON parse";
+        ESP_LOGE(TAG, "%s failed (%d bytes)", what, resp.body_len);
+        snprintf(backend_last_error, sizeof(backend_last_error), "%s failed", what);
+        return -1;
     }
-
-    cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
-    if (!cJSON_IsArray(data) || cJSON_GetArraySize(data) == 0) {
-        cJSON_Delete(root);
-        lvgl_port_lock(0);
-        set_main_data_error("No upcoming meds");
-        lvgl_port_unlock();
-        return true;
+    size_t items_seen = med_ingest_wire ? med_wire_ingest.items_seen : med_ingest.items_seen;
+    if (items_seen > MED_CACHE_MAX) {
+        ESP_LOGW(TAG, "%s: kept %d of %d items", path, MED_CACHE_MAX, (int)items_seen);
     }
+    snprintf(med_ingest_scratch.etag, sizeof(med_ingest_scratch.etag), "%s", resp.etag);
+    ESP_LOGI(TAG, "%s: %d items", path, (int)med_ingest_scratch.count);
+    return resp.status;
+}
 
-    cache_upcoming.count = 0;
-    int count = cJSON_GetArraySize(data);
-    if (count > MED_CACHE_MAX) {
-        count = MED_CACHE_MAX;
-    }
-    for (int i = 0; i < count; ++i) {
-        cJSON *item = cJSON_GetArrayItem(data, i);
-        const char *name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "medicineName"));
-        const char *dose = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "dosage"));
-        const char *time = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "scheduledTime"));
-        const char *status = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "status"));
-        const char *dose_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "doseId"));
-        if (!dose_id) {
-            dose_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "id"));
-        }
-        if (!dose_id) {
+/* Replaces cache_upcoming with a freshly parsed list and shows its first dose. */
+static void upcoming_apply(const med_cache_t *fresh)
+{
+    for (size_t i = 0; i < fresh->count; ++i) {
+        const med_cache_item_t *item = &fresh->items[i];
+        if (!item->dose_id[0]) {
             ESP_LOGW(TAG, "Upcoming item missing doseId (name=%s, time=%s)",
-                     name ? name : "?", time ? time : "?");
+                     item->name[0] ? item->name : "?", item->time_str[0] ? item->time_str : "?");
         }
-        int slot = cJSON_IsNumber(cJSON_GetObjectItemCaseSensitive(item, "slot"))
-            ? cJSON_GetObjectItemCaseSensitive(item, "slot")->valueint
-            : 0;
-
-        med_cache_item_t *dst = &cache_upcoming.items[i];
-        snprintf(dst->name, sizeof(dst->name), "%s", name ? name : "");
-        snprintf(dst->dose, sizeof(dst->dose), "%s", dose ? dose : "");
-        snprintf(dst->time_str, sizeof(dst->time_str), "%s", time ? time : "");
-        snprintf(dst->status, sizeof(dst->status), "%s", status ? status : "");
-        snprintf(dst->dose_id, sizeof(dst->dose_id), "%s", dose_id ? dose_id : "");
-        dst->slot = slot;
-        cache_upcoming.count++;
     }
+    memcpy(cache_upcoming.items, fresh->items, sizeof(cache_upcoming.items));
+    cache_upcoming.count = fresh->count;
+    snprintf(cache_upcoming.etag, sizeof(cache_upcoming.etag), "%s", fresh->etag);
     cache_upcoming.valid = true;
     med_cache_set_updated(&cache_upcoming);
-    med_cache_save_nvs("med_upcoming", &cache_upcoming);
+    med_cache_save("med_upcoming", &cache_upcoming);
+    upcoming_coverage_update(true);
+    dose_schedule_reload();
 
-    cJSON *item = cJSON_GetArrayItem(data, 0);
-    const char *name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "medicineName"));
-    const char *dose = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "dosage"));
-    const char *time = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "scheduledTime"));
-    const char *status_txt = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "status"));
-    const char *dose_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "doseId"));
-    if (!dose_id) {
-        dose_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "id"));
+    if (cache_upcoming.count == 0) {
+        lvgl_port_lock(0);
+        set_main_data_error("No upcoming meds");
+        lvgl_port_unlock();
+        return;
     }
 
+    const med_cache_item_t *first = &cache_upcoming.items[0];
     lvgl_port_lock(0);
     char time_buf[16];
-    format_time_12h(time, time_buf, sizeof(time_buf));
-    set_main_data(name, time_buf, dose, status_txt);
+    dr_time_minutes_12h(first->minute, time_buf, sizeof(time_buf));
+    set_main_data(first->name, time_buf, first->dose, first->status);
     lvgl_port_unlock();
 
-    snprintf(current_alert_dose_id, sizeof(current_alert_dose_id), "%s", dose_id ? dose_id : "");
+    snprintf(current_alert_dose_id, sizeof(current_alert_dose_id), "%s", first->dose_id);
+}
 
-    cJSON_Delete(root);
-    return true;
+/* Replaces a history cache (taken/missed) with a freshly parsed list. */
+static void med_cache_apply(med_cache_t *cache, const med_cache_t *fresh, const char *cache_key)
+{
+    memcpy(cache->items, fresh->items, sizeof(cache->items));
+    cache->count = fresh->count;
+    snprintf(cache->etag, sizeof(cache->etag), "%s", fresh->etag);
+
+    cache->valid = true;
+    med_cache_set_updated(cache);
+    med_cache_save(cache_key, cache);
 }
 
-static bool backend_fetch_cache(const char *path, med_cache_t *cache, const char *cache_key)
+/* Returns 1 when the cache was replaced, 0 when the server answered 304, -1 on error. */
+static int backend_fetch_upcoming(void)
 {
-    if (!path || !cache || !cache_key) {
-        return false;
+    char path[128];
+    snprintf(path, sizeof(path), "/api/hardware/upcoming?deviceId=%s", DEVICE_ID);
+    ESP_LOGI(TAG, "Fetching: %s", path);
+
+    int status = backend_stream_med_list(path, cache_upcoming.valid ? cache_upcoming.etag : NULL);
+    if (status < 0) {
+        return -1;
+    }
+    if (status == 304) {
+        ESP_LOGI(TAG, "Upcoming unchanged");
+        return 0;
     }
 
-    char url[256];
-    snprintf(url, sizeof(url), "%s%s?deviceId=%s", BACKEND_BASE_URL, path, DEVICE_ID);
-    ESP_LOGI(TAG, "HTTP GET %s", url);
+    upcoming_apply(&med_ingest_scratch);
+    return 1;
+}
 
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
+/* Replaces cache_plans and reschedules with the new rules. */
+static void plans_apply(const med_plan_set_t *fresh)
+{
+    cache_plans = *fresh;
+    cache_plans.valid = true;
+    med_plan_save("med_plans", &cache_plans);
+    ESP_LOGI(TAG, "Plans: %d", (int)cache_plans.count);
+    dose_schedule_reload();
+}
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        return false;
-    }
+static med_plan_ingest_t plan_ingest;
+static med_plan_set_t plan_ingest_scratch;
+static bool backend_plans_supported = true;
 
-    char auth_header[128];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", DEVICE_SECRET);
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_http_client_set_header(client, "Authorization", auth_header);
+static bool plan_ingest_on_body(const char *data, int len, void *ctx)
+{
+    return med_plan_feed((med_plan_ingest_t *)ctx, data, (size_t)len);
+}
 
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        esp_http_client_cleanup(client);
-        return false;
+/* Same return convention as backend_fetch_upcoming(); a backend without /plans is not asked again. */
+static int backend_fetch_plans(void)
+{
+    if (!backend_plans_supported) {
+        return 0;
     }
+    char path[128];
+    snprintf(path, sizeof(path), "%s?deviceId=%s", PLANS_API_PATH, DEVICE_ID);
+    ESP_LOGI(TAG, "HTTP GET %s", path);
+
+    med_plan_begin(&plan_ingest, &plan_ingest_scratch);
+    const backend_conn_request_t req = {
+        .method = HTTP_METHOD_GET,
+        .path = path,
+        .on_body = plan_ingest_on_body,
+        .ctx = &plan_ingest,
+        .if_none_match = cache_plans.valid ? cache_plans.etag : NULL,
+    };
+    backend_conn_response_t resp;
+    esp_err_t err = backend_conn_perform(&req, &resp);
+    bool route_missing = backend_conn_route_missing(&resp);
+    backend_conn_release();
 
-    int content_length = esp_http_client_fetch_headers(client);
-    int buffer_size = (content_length > 0) ? (content_length + 1) : 4096;
-    char *buffer = (char *)malloc(buffer_size);
-    if (!buffer) {
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
-        return false;
+    if (resp.status == 304 && err == ESP_OK) {
+        return 0;
     }
-
-    int total_read = 0;
-    int read_len = 0;
-    while ((read_len = esp_http_client_read(client, buffer + total_read, buffer_size - 1 - total_read)) > 0) {
-        total_read += read_len;
-        if (total_read >= buffer_size - 1) {
-            buffer_size *= 2;
-            char *new_buf = (char *)realloc(buffer, buffer_size);
-            if (!new_buf) {
-                free(buffer);
-                esp_http_client_close(client);
-                esp_http_client_cleanup(client);
-                return false;
-            }
-            buffer = new_buf;
-        }
+    if (route_missing) {
+        ESP_LOGW(TAG, "Backend has no %s; alerts only cover the upcoming list", PLANS_API_PATH);
+        backend_plans_supported = false;
+        return 0;
+    }
+    if (resp.status != 200 || err != ESP_OK || !med_plan_end(&plan_ingest)) {
+        ESP_LOGW(TAG, "Plans fetch failed (HTTP %d, %d bytes)", resp.status, resp.body_len);
+        return -1;
+    }
+    if (plan_ingest.plans_seen > MED_PLAN_MAX) {
+        ESP_LOGW(TAG, "Plans: kept %d of %d", MED_PLAN_MAX, (int)plan_ingest.plans_seen);
     }
-    buffer[total_read] = '\0';
+    snprintf(plan_ingest_scratch.etag, sizeof(plan_ingest_scratch.etag), "%s", resp.etag);
+    plans_apply(&plan_ingest_scratch);
+    return 1;
+}
 
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+/* Same return convention as backend_fetch_upcoming(). */
+static int backend_fetch_cache(const char *path, med_cache_t *cache, const char *cache_key)
+{
+    if (!path || !cache || !cache_key) {
+        return -1;
+    }
 
-    log_http_response("cache", url, status, buffer, total_read);
+    char req_path[128];
+    snprintf(req_path, sizeof(req_path), "%s?deviceId=%s", path, DEVICE_ID);
+    ESP_LOGI(TAG, "HTTP GET %s", req_path);
 
-    if (status != 200 || total_read == 0) {
-        free(buffer);
-        return false;
+    int status = backend_stream_med_list(req_path, cache->valid ? cache->etag : NULL);
+    if (status < 0) {
+        return -1;
     }
-
-    cJSON *root = cJSON_Parse(buffer);
-    free(buffer);
-    if (!root) {
-        return false;
+    if (status == 304) {
+        return 0;
     }
 
-    cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
-    cache->count = 0;
-    if (cJSON_IsArray(data) && cJSON_GetArraySize(data) > 0) {
-        int count = cJSON_GetArraySize(data);
-        if (count > MED_CACHE_MAX) {
-            count = MED_CACHE_MAX;
-        }
-        for (int i = 0; i < count; ++i) {
-            cJSON *item = cJSON_GetArrayItem(data, i);
-            const char *name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "medicineName"));
-            const char *dose = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "dosage"));
-            const char *time = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "scheduledTime"));
-            const char *status_txt = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "status"));
-            const char *dose_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "doseId"));
-            if (!dose_id) {
-                dose_id = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(item, "id"));
-            }
-            int slot = cJSON_IsNumber(cJSON_GetObjectItemCaseSensitive(item, "slot"))
-                ? cJSON_GetObjectItemCaseSensitive(item, "slot")->valueint
-                : 0;
-
-            med_cache_item_t *dst = &cache->items[i];
-            snprintf(dst->name, sizeof(dst->name), "%s", name ? name : "");
-            snprintf(dst->dose, sizeof(dst->dose), "%s", dose ? dose : "");
-            format_time_12h(time, dst->time_str, sizeof(dst->time_str));
-            snprintf(dst->status, sizeof(dst->status), "%s", status_txt ? status_txt : "");
-            snprintf(dst->dose_id, sizeof(dst->dose_id), "%s", dose_id ? dose_id : "");
-            dst->slot = slot;
-            cache->count++;
-        }
-    }
+    med_cache_apply(cache, &med_ingest_scratch, cache_key);
+    return 1;
+}
 
-    cache->valid = true;
-    med_cache_set_updated(cache);
-    med_cache_save_nvs(cache_key, cache);
+/*
+ * Sets the epoch clock and TZ from a server time reading. Servers that send
+ * no posixTz get a fixed offset from their localTime24 (either may be NULL).
+ */
+static bool time_apply_server_time(const dr_rtc_sample_t *sample, const char *posix_tz, const char *local_time_24)
+{
+    char tz[DR_RTC_TZ_MAX];
+    if (posix_tz && posix_tz[0]) {
+        snprintf(tz, sizeof(tz), "%s", posix_tz);
+    } else if (!dr_rtc_tz_from_local(local_time_24 ? dr_time_to_minutes(local_time_24) : -1, sample->epoch_ms, tz,
+                                     sizeof(tz))) {
+        snprintf(tz, sizeof(tz), "%s", wall_rtc.tz[0] ? wall_rtc.tz : "UTC0");
+    }
 
-    cJSON_Delete(root);
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    if (!dr_rtc_sync(&wall_rtc, sample, wall_raw_ms(), now_ms)) {
+        ESP_LOGW(TAG, "Time sample dropped (round trip %lld ms)", (long long)dr_rtc_sample_rtt_ms(sample));
+        return false;
+    }
+    const struct timeval tv = {
+        .tv_sec = (time_t)(wall_rtc.set_epoch_ms / 1000),
+        .tv_usec = (suseconds_t)(wall_rtc.set_epoch_ms % 1000 * 1000),
+    };
+    settimeofday(&tv, NULL);
+    if (strcmp(tz, wall_rtc.tz) != 0) {
+        snprintf(wall_rtc.tz, sizeof(wall_rtc.tz), "%s", tz);
+        setenv("TZ", wall_rtc.tz, 1);
+        tzset();
+    }
+    ESP_LOGI(TAG, "Clock set (TZ %s): off by %ld ms, drift %ld ppb, round trip %lld ms, next resync in %lld min",
+             wall_rtc.tz, (long)wall_rtc.last_error_ms, (long)wall_rtc.drift_ppb,
+             (long long)dr_rtc_sample_rtt_ms(sample), (long long)(wall_rtc.interval_ms / 60000));
+
+    int minute_of_day = -1;
+    dr_rtc_local_minute(wall_rtc.set_epoch_ms, now_ms, &minute_of_day, NULL);
+    dr_time_minutes_12h(minute_of_day, time_display, sizeof(time_display));
+    time_display_valid = minute_of_day >= 0;
+    time_cache_save_nvs();
     return true;
 }
 
 static bool time_sync_from_api(void)
 {
-    char url[256];
-    snprintf(url, sizeof(url), "%s%s", BACKEND_BASE_URL, TIME_API_PATH);
-    ESP_LOGI(TAG, "HTTP GET %s", url);
+    ESP_LOGI(TAG, "HTTP GET %s", TIME_API_PATH);
 
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
+    const backend_conn_request_t req = {
+        .method = HTTP_METHOD_GET,
+        .path = TIME_API_PATH,
     };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        ESP_LOGE(TAG, "Time API client init failed");
+    backend_conn_response_t resp;
+    int64_t sent_ms = esp_timer_get_time() / 1000;
+    esp_err_t err = backend_conn_perform(&req, &resp);
+    int64_t recv_ms = esp_timer_get_time() / 1000;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Time API request failed: %s", esp_err_to_name(err));
+        backend_conn_release();
         return false;
     }
 
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_http_client_set_header(client, "User-Agent", "DoseRight-ESP32");
-    {
-        char auth_header[128];
-        snprintf(auth_header, sizeof(auth_header), "Bearer %s", DEVICE_SECRET);
-        esp_http_client_set_header(client, "Authorization", auth_header);
-    }
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Time API open failed: %s", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
+    log_http_response("time", TIME_API_PATH, resp.status, resp.body, resp.body_len);
+
+    if (resp.status != 200 || resp.body_len == 0) {
+        backend_conn_release();
         return false;
     }
 
-    int content_length = esp_http_client_fetch_headers(client);
-    int buffer_size = (content_length > 0) ? (content_length + 1) : 2048;
-    char *buffer = (char *)malloc(buffer_size);
-    if (!buffer) {
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
+    cJSON *root = cJSON_Parse(resp.body);
+    backend_conn_release();
+    if (!root) {
         return false;
     }
 
-    int total_read = 0;
-    int read_len = 0;
-    while ((read_len = esp_http_client_read(client, buffer + total_read, buffer_size - 1 - total_read)) > 0) {
-        total_read += read_len;
-        if (total_read >= buffer_size - 1) {
-            buffer_size *= 2;
-            char *new_buf = (char *)realloc(buffer, buffer_size);
-            if (!new_buf) {
-                free(buffer);
-                esp_http_client_close(client);
-                esp_http_client_cleanup(client);
-                return false;
-            }
-            buffer = new_buf;
-        }
-    }
-    buffer[total_read] = '\0';
+    cJSON *epoch_ms = cJSON_GetObjectItemCaseSensitive(root, "epochMs");
+    cJSON *processing_ms = cJSON_GetObjectItemCaseSensitive(root, "processingMs");
+    const dr_rtc_sample_t sample = {
+        .epoch_ms = cJSON_IsNumber(epoch_ms) ? (int64_t)epoch_ms->valuedouble : 0,
+        .processing_ms = cJSON_IsNumber(processing_ms) ? (int64_t)processing_ms->valuedouble : 0,
+        .sent_ms = sent_ms,
+        .recv_ms = recv_ms,
+    };
+    bool applied = time_apply_server_time(&sample,
+                                          cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "posixTz")),
+                                          cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "localTime24")));
+    cJSON_Delete(root);
+    return applied;
+}
 
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+static device_sync_parser_t sync_parser;
+static device_sync_result_t sync_result;
+static bool backend_sync_supported = true;
+static med_cache_t *const sync_caches[DEVICE_SYNC_LIST_COUNT] = {&cache_upcoming, &cache_taken, &cache_missed};
+static const char *const sync_cache_keys[DEVICE_SYNC_LIST_COUNT] = {"med_upcoming", "med_taken", "med_missed"};
 
-    log_http_response("time", url, status, buffer, total_read);
+static bool sync_on_body(const char *data, int len, void *ctx)
+{
+    return device_sync_feed((device_sync_parser_t *)ctx, data, (size_t)len);
+}
 
-    if (status != 200 || total_read == 0) {
-        free(buffer);
-        return false;
+static const char *sync_state_name(device_sync_state_t state)
+{
+    switch (state) {
+        case DEVICE_SYNC_UPDATED:
+            return "updated";
+        case DEVICE_SYNC_NOT_MODIFIED:
+            return "unchanged";
+        default:
+            return "absent";
     }
+}
 
-    cJSON *root = cJSON_Parse(buffer);
-    free(buffer);
+static char *backend_sync_build_body(void)
+{
+    cJSON *root = cJSON_CreateObject();
     if (!root) {
-        return false;
+        return NULL;
+    }
+    cJSON_AddStringToObject(root, "deviceId", DEVICE_ID);
+    cJSON *heartbeat = cJSON_AddObjectToObject(root, "heartbeat");
+    if (heartbeat) {
+        heartbeat_add_fields(heartbeat);
+    }
+    cJSON *etags = cJSON_AddObjectToObject(root, "etags");
+    if (etags) {
+        static const char *const names[DEVICE_SYNC_LIST_COUNT] = {"upcoming", "taken", "missed"};
+        for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+            if (sync_caches[i]->valid && sync_caches[i]->etag[0] != '\0') {
+                cJSON_AddStringToObject(etags, names[i], sync_caches[i]->etag);
+            }
+        }
+        if (cache_plans.valid && cache_plans.etag[0] != '\0') {
+            cJSON_AddStringToObject(etags, "plans", cache_plans.etag);
+        }
+        const char *profile_etag = profile_screen_cached_etag();
+        if (profile_etag && profile_etag[0] != '\0') {
+            cJSON_AddStringToObject(etags, "profile", profile_etag);
+        }
     }
+    char *body = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return body;
+}
 
-    cJSON *local_time_24 = cJSON_GetObjectItemCaseSensitive(root, "localTime24");
-    cJSON *local_time_12 = cJSON_GetObjectItemCaseSensitive(root, "localTime12");
-    if (!cJSON_IsString(local_time_12) && !cJSON_IsString(local_time_24)) {
-        cJSON_Delete(root);
-        return false;
+/*
+ * One round-trip per cycle: sends the heartbeat and cached ETags, applies
+ * time, med lists, plans and profile from the response. Returns 1 on success, 0 when
+ * the backend has no /sync route (caller falls back to per-endpoint requests),
+ * -1 on error, including a 404 for an unknown device or patient. states[]
+ * reports what happened to each med list.
+ */
+static int backend_sync(device_sync_state_t states[DEVICE_SYNC_LIST_COUNT])
+{
+    for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+        states[i] = DEVICE_SYNC_ABSENT;
+    }
+    char *body = backend_sync_build_body();
+    if (!body) {
+        snprintf(backend_last_error, sizeof(backend_last_error), "No memory");
+        return -1;
     }
 
-    time_base_epoch_seconds = 0;
-    time_base_offset_min = 0;
-    time_base_ms = 0;
-    time_base_hour24 = -1;
-    time_base_minute = -1;
-
-    if (cJSON_IsString(local_time_12)) {
-        snprintf(time_display, sizeof(time_display), "%s", local_time_12->valuestring);
-    } else if (cJSON_IsString(local_time_24)) {
-        int hour = 0;
-        int minute = 0;
-        if (sscanf(local_time_24->valuestring, "%d:%d", &hour, &minute) == 2) {
-            const char *ampm = (hour >= 12) ? "PM" : "AM";
-            int hour12 = hour % 12;
-            if (hour12 == 0) {
-                hour12 = 12;
-            }
-            snprintf(time_display, sizeof(time_display), "%02d:%02d %s", hour12, minute, ampm);
+    ESP_LOGI(TAG, "HTTP POST %s", SYNC_API_PATH);
+    device_sync_begin(&sync_parser, &sync_result);
+    const backend_conn_request_t req = {
+        .method = HTTP_METHOD_POST,
+        .path = SYNC_API_PATH,
+        .body = body,
+        .on_body = sync_on_body,
+        .ctx = &sync_parser,
+    };
+    backend_conn_response_t resp;
+    int64_t sent_ms = esp_timer_get_time() / 1000;
+    esp_err_t err = backend_conn_perform(&req, &resp);
+    bool route_missing = backend_conn_route_missing(&resp);
+    backend_conn_release();
+    free(body);
+
+    ESP_LOGI(TAG, "Sync status: %d, bytes: %d", resp.status, resp.body_len);
+    if (route_missing) {
+        ESP_LOGW(TAG, "Backend has no %s; using per-endpoint requests", SYNC_API_PATH);
+        backend_sync_supported = false;
+        device_sync_result_free(&sync_result);
+        return 0;
+    }
+    if (resp.status != 200) {
+        if (err != ESP_OK && resp.status == 0) {
+            snprintf(backend_last_error, sizeof(backend_last_error), "HTTP: %s", esp_err_to_name(err));
         } else {
-            snprintf(time_display, sizeof(time_display), "--:--");
+            snprintf(backend_last_error, sizeof(backend_last_error), "HTTP %d", resp.status);
         }
-    } else {
-        snprintf(time_display, sizeof(time_display), "--:--");
+        device_sync_result_free(&sync_result);
+        return -1;
+    }
+    if (err != ESP_OK || !device_sync_end(&sync_parser)) {
+        ESP_LOGE(TAG, "Sync JSON parse failed (%d bytes)", resp.body_len);
+        snprintf(backend_last_error, sizeof(backend_last_error), "JSON parse failed");
+        device_sync_result_free(&sync_result);
+        return -1;
     }
-    time_display_valid = strcmp(time_display, "--:--") != 0;
-    if (time_display_valid) {
-        time_cache_save_nvs(time_display);
+
+    /* The sync carried the heartbeat; the standalone one only runs when syncs stall. */
+    net_service_schedule(net_job_heartbeat, HEARTBEAT_INTERVAL_MS);
+
+    /* The clock is only stepped when the time job is due, so drift is measured over the whole interval. */
+    const dr_rtc_sample_t sample = {
+        .epoch_ms = sync_result.epoch_ms,
+        .processing_ms = sync_result.processing_ms,
+        .sent_ms = sent_ms,
+        .recv_ms = sync_result.time_recv_ms,
+    };
+    bool time_due = net_service_due(net_job_time) || !time_synced;
+    if (time_due && sync_result.have_time &&
+        time_apply_server_time(&sample, sync_result.posix_tz,
+                               sync_result.local_time24[0] ? sync_result.local_time24 : NULL)) {
+        time_synced = true;
+        net_service_schedule(net_job_time, wall_rtc.interval_ms);
+        dose_schedule_reload();
+        lvgl_port_lock(0);
+        if (clock_label) {
+            lv_label_set_text(clock_label, time_display);
+        }
+        lvgl_port_unlock();
     }
 
-    if (cJSON_IsString(local_time_24)) {
-        int hour24 = 0;
-        int minute = 0;
-        if (sscanf(local_time_24->valuestring, "%d:%d", &hour24, &minute) == 2) {
-            time_base_hour24 = hour24 % 24;
-            time_base_minute = minute % 60;
-            time_base_ms = esp_timer_get_time() / 1000;
+    for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+        device_sync_list_result_t *list = &sync_result.lists[i];
+        states[i] = list->state;
+        if (list->state != DEVICE_SYNC_UPDATED) {
+            continue;
+        }
+        if (list->items_seen > MED_CACHE_MAX) {
+            ESP_LOGW(TAG, "%s: kept %d of %d items", sync_cache_keys[i], MED_CACHE_MAX, (int)list->items_seen);
+        }
+        if (i == DEVICE_SYNC_UPCOMING) {
+            upcoming_apply(&list->cache);
+        } else {
+            med_cache_apply(sync_caches[i], &list->cache, sync_cache_keys[i]);
+        }
+    }
+    if (sync_result.plans_state == DEVICE_SYNC_UPDATED) {
+        if (sync_result.plans_seen > MED_PLAN_MAX) {
+            ESP_LOGW(TAG, "Plans: kept %d of %d", MED_PLAN_MAX, (int)sync_result.plans_seen);
+        }
+        plans_apply(&sync_result.plans);
+    }
+    if (sync_result.profile_state == DEVICE_SYNC_UPDATED) {
+        profile_screen_apply_synced(sync_result.profile_json, sync_result.profile_etag);
+    }
+
+    ESP_LOGI(TAG, "Sync: upcoming=%s taken=%s missed=%s plans=%s profile=%s",
+             sync_state_name(states[DEVICE_SYNC_UPCOMING]), sync_state_name(states[DEVICE_SYNC_TAKEN]),
+             sync_state_name(states[DEVICE_SYNC_MISSED]), sync_state_name(sync_result.plans_state),
+             sync_state_name(sync_result.profile_state));
+    device_sync_result_free(&sync_result);
+    return 1;
+}
+
+static void log_sync_cycle_stats(const backend_conn_stats_t *before, size_t heap_before, int64_t start_us)
+{
+    backend_conn_stats_t after;
+    backend_conn_get_stats(&after);
+    size_t heap_after = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    ESP_LOGI(TAG,
+             "Sync cycle: %lld ms total, %lld ms on network, requests=%lu not_modified=%lu handshakes=%lu "
+             "reconnects=%lu rx=%llu tx=%llu buf_grows=%lu heap_free=%u (delta %d) heap_min=%u largest_block=%u",
+             (long long)((esp_timer_get_time() - start_us) / 1000),
+             (long long)((after.busy_us - before->busy_us) / 1000),
+             (unsigned long)(after.requests - before->requests),
+             (unsigned long)(after.not_modified - before->not_modified),
+             (unsigned long)(after.handshakes - before->handshakes),
+             (unsigned long)(after.reconnects - before->reconnects),
+             (unsigned long long)(after.body_bytes_received - before->body_bytes_received),
+             (unsigned long long)(after.body_bytes_sent - before->body_bytes_sent),
+             (unsigned long)(after.buffer_grows - before->buffer_grows),
+             (unsigned)heap_after, (int)heap_after - (int)heap_before,
+             (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+
+    nvs_store_stats_t nvs;
+    nvs_store_key_stats_t keys[16];
+    size_t key_count = nvs_store_get_stats(&nvs, keys, sizeof(keys) / sizeof(keys[0]));
+    char per_key[256] = "";
+    size_t len = 0;
+    for (size_t i = 0; i < key_count && len < sizeof(per_key); ++i) {
+        len += (size_t)snprintf(per_key + len, sizeof(per_key) - len, " %s=%lu/%lu", keys[i].key,
+                                (unsigned long)keys[i].writes, (unsigned long)keys[i].sets);
+    }
+    ESP_LOGI(TAG, "NVS: sets=%lu writes=%lu flushes=%lu failures=%lu, writes/sets per key:%s",
+             (unsigned long)nvs.sets, (unsigned long)nvs.writes, (unsigned long)nvs.flushes,
+             (unsigned long)nvs.failures, per_key);
+}
+
+/* Re-renders the info screen if its list changed. synced/states come from this cycle's backend_sync. */
+static void backend_refresh_pending_info(int synced, const device_sync_state_t *states)
+{
+    pending_info_fetch = false;
+    med_cache_t *cache = get_cache_for_path(pending_info_path);
+    const char *key = get_cache_key_for_path(pending_info_path);
+    bool refreshed = false;
+    if (synced > 0) {
+        for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+            refreshed |= sync_caches[i] == cache && states[i] == DEVICE_SYNC_UPDATED;
+        }
+    } else if (synced == 0) {
+        refreshed = cache && key && backend_fetch_cache(pending_info_path, cache, key) > 0;
+    }
+    if (refreshed) {
+        if (current_info_path[0] != '\0' && strcmp(current_info_path, pending_info_path) == 0) {
+            lvgl_port_lock(0);
+            render_med_cache(pending_info_title, cache, false);
+            lvgl_port_unlock();
         }
     }
-    cJSON_Delete(root);
-    return true;
 }
 
-static void time_sync_task(void *arg)
+/* Shows cache_upcoming on the main card while offline. Caller holds the LVGL lock. */
+static void main_data_show_cached(void)
 {
-    (void)arg;
-    while (true) {
-        int64_t now_ms = esp_timer_get_time() / 1000;
-        if (wifi_is_connected() && (time_sync_requested || (now_ms - last_time_sync_ms >= TIME_RESYNC_INTERVAL_MS))) {
-            time_sync_requested = false;
-            bool synced = false;
-            for (int attempt = 0; attempt < 3 && !synced; ++attempt) {
-                synced = time_sync_from_api();
-                if (!synced) {
-                    vTaskDelay(pdMS_TO_TICKS(1000));
-                }
-            }
+    main_data_stale = !apply_cached_upcoming_to_main();
+    if (main_data_stale) {
+        set_main_data_error("WiFi not connected");
+    }
+}
 
-            time_synced = synced;
-            if (synced) {
-                last_time_sync_ms = now_ms;
-                lvgl_port_lock(0);
-                if (clock_label) {
-                    lv_label_set_text(clock_label, time_display);
-                }
-                lvgl_port_unlock();
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(5000));
+static net_job_result_t sync_job(void *ctx)
+{
+    (void)ctx;
+    backend_conn_stats_t stats_before;
+    backend_conn_get_stats(&stats_before);
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    int64_t cycle_start_us = esp_timer_get_time();
+    if (!cache_upcoming.valid) {
+        lvgl_port_lock(0);
+        set_main_data_fetching();
+        lvgl_port_unlock();
+        main_data_stale = true;
+    }
+    device_sync_state_t sync_states[DEVICE_SYNC_LIST_COUNT];
+    int synced = backend_sync_supported ? backend_sync(sync_states) : 0;
+    int upcoming;
+    bool upcoming_confirmed = false;
+    if (synced > 0) {
+        upcoming = sync_states[DEVICE_SYNC_UPCOMING] == DEVICE_SYNC_UPDATED ? 1 : 0;
+        upcoming_confirmed = sync_states[DEVICE_SYNC_UPCOMING] == DEVICE_SYNC_NOT_MODIFIED;
+    } else if (synced < 0) {
+        upcoming = -1;
+    } else {
+        upcoming = backend_fetch_upcoming();
+        upcoming_confirmed = upcoming == 0;
+        backend_fetch_cache("/api/hardware/taken", &cache_taken, "med_taken");
+        backend_fetch_cache("/api/hardware/missed", &cache_missed, "med_missed");
+        backend_fetch_plans();
+        profile_screen_preload();
+    }
+    if (upcoming_confirmed) {
+        upcoming_coverage_update(false);
+    }
+    if (upcoming < 0) {
+        lvgl_port_lock(0);
+        set_main_data_error(backend_last_error);
+        lvgl_port_unlock();
+        main_data_stale = true;
+    } else if (upcoming == 0 && main_data_stale) {
+        lvgl_port_lock(0);
+        apply_cached_upcoming_to_main();
+        lvgl_port_unlock();
+        main_data_stale = false;
+    } else {
+        main_data_stale = false;
+    }
+    if (pending_info_fetch) {
+        backend_refresh_pending_info(synced, sync_states);
     }
+    log_sync_cycle_stats(&stats_before, heap_before, cycle_start_us);
+    return upcoming < 0 ? NET_JOB_RETRY : NET_JOB_DONE;
 }
 
-static void backend_fetch_task(void *arg)
+static net_job_result_t time_job(void *ctx)
 {
-    (void)arg;
-    int64_t last_fetch_ms = 0;
+    (void)ctx;
+    if (!time_sync_from_api()) {
+        return NET_JOB_RETRY;
+    }
+    time_synced = true;
+    /* Below the job's period, so it wins over the DONE reschedule */
+    net_service_schedule(net_job_time, wall_rtc.interval_ms);
+    dose_schedule_reload();
+    lvgl_port_lock(0);
+    if (clock_label) {
+        lv_label_set_text(clock_label, time_display);
+    }
+    lvgl_port_unlock();
+    return NET_JOB_DONE;
+}
 
-    while (true) {
-        int64_t now_ms = esp_timer_get_time() / 1000;
-        bool should_fetch = backend_fetch_requested || (now_ms - last_fetch_ms >= BACKEND_FETCH_INTERVAL_MS);
+static net_job_result_t heartbeat_job(void *ctx)
+{
+    (void)ctx;
+    return send_heartbeat() ? NET_JOB_DONE : NET_JOB_RETRY;
+}
 
-        if (should_fetch && wifi_is_connected()) {
-            backend_fetch_requested = false;
-            last_fetch_ms = now_ms;
-            lvgl_port_lock(0);
-            set_main_data_fetching();
-            lvgl_port_unlock();
-            if (!backend_fetch_upcoming()) {
-                lvgl_port_lock(0);
-                set_main_data_error(backend_last_error);
-                lvgl_port_unlock();
-            }
-            backend_fetch_cache("/api/hardware/taken", &cache_taken, "med_taken");
-            backend_fetch_cache("/api/hardware/missed", &cache_missed, "med_missed");
-            profile_screen_preload();
-            if (pending_info_fetch) {
-                pending_info_fetch = false;
-                med_cache_t *cache = get_cache_for_path(pending_info_path);
-                const char *key = get_cache_key_for_path(pending_info_path);
-                if (cache && key && backend_fetch_cache(pending_info_path, cache, key)) {
-                    if (current_info_path[0] != '\0' && strcmp(current_info_path, pending_info_path) == 0) {
-                        lvgl_port_lock(0);
-                        render_med_cache(pending_info_title, cache, false);
-                        lvgl_port_unlock();
-                    }
-                }
-            }
-        } else if (!wifi_is_connected()) {
-            lvgl_port_lock(0);
-            if (!apply_cached_upcoming_to_main()) {
-                set_main_data_error("WiFi not connected");
-            }
-            lvgl_port_unlock();
-        }
+static net_job_result_t outbox_job(void *ctx)
+{
+    (void)ctx;
+    if (dose_outbox_drain() < 0) {
+        return NET_JOB_RETRY;
+    }
+    return dose_outbox_pending() > 0 ? NET_JOB_MORE : NET_JOB_DONE;
+}
 
-        vTaskDelay(pdMS_TO_TICKS(5000));
+static net_job_result_t info_job(void *ctx)
+{
+    (void)ctx;
+    /* Info screen opened between syncs: fetch just that list (cheap with its ETag). */
+    if (pending_info_fetch) {
+        backend_refresh_pending_info(0, NULL);
     }
+    return NET_JOB_DONE;
+}
+
+/* All backend traffic runs as jobs on the single net_service task. */
+static void net_jobs_init(void)
+{
+    ESP_ERROR_CHECK(net_service_init(wifi_is_connected));
+    net_job_sync = net_service_add("sync", sync_job, NULL, BACKEND_FETCH_INTERVAL_MS);
+    net_job_time = net_service_add("time", time_job, NULL, DR_RTC_INTERVAL_MAX_MS);
+    net_job_heartbeat = net_service_add("heartbeat", heartbeat_job, NULL, HEARTBEAT_INTERVAL_MS);
+    net_job_outbox = net_service_add("outbox", outbox_job, NULL, 0);
+    net_job_info = net_service_add("info", info_job, NULL, 0);
 }
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
@@ -2805,9 +3076,11 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
     }
 
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        backend_conn_drop();
         lvgl_port_lock(0);
         wifi_list_screen_set_status_text("Disconnected");
         set_wifi_status_state(false, NULL);
+        main_data_show_cached();
         lvgl_port_unlock();
         if (wifi_auto_connecting && wifi_auto_connect_next()) {
             return;
@@ -2832,8 +3105,14 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
             set_wifi_status_state(true, NULL);
         }
         lvgl_port_unlock();
-        backend_fetch_requested = true;
-        time_sync_requested = true;
+        backend_sync_supported = true;
+        dose_batch_supported = true;
+        net_service_request(net_job_sync);
+        net_service_request(net_job_time);
+        net_service_request(net_job_heartbeat);
+        if (dose_outbox_pending() > 0) {
+            net_service_request(net_job_outbox);
+        }
         route_to_screen3();
     }
 }
@@ -2851,6 +3130,7 @@ static void wifi_init_sta(void)
     } else {
         ESP_ERROR_CHECK(ret);
     }
+    ESP_ERROR_CHECK(nvs_store_init());
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -2978,12 +3258,11 @@ void app_main(void)
     }
     ensure_main_data_labels();
     motor_init();
-    servo_init();
-    servo_current_deg = 180;
-    servo_set_degree(servo_current_deg);
-    ir_sensor_set_enabled(false);
+    servo_start();
     ir_sensor_start();
+    dispense_setup();
     lv_timer_create(clock_timer_cb, 1000, NULL);
+    lv_timer_create(dose_alert_timer_cb, DOSE_ALERT_POLL_MS, NULL);
 
     /* Auto-advance from loading screen SET SCREEN TIME BOOT SCREEN*/
     if (ui_Bar1) {
@@ -2994,6 +3273,13 @@ void app_main(void)
     lv_timer_create(loading_timer_cb, 3000, NULL);
     lvgl_port_unlock();
 
+    net_jobs_init();
+    dose_alert_queue = xQueueCreate(DOSE_ALERT_QUEUE_LEN, sizeof(dose_alert_t));
+    dose_prepare_queue = xQueueCreate(1, sizeof(dose_alert_t));
+    if (!dose_scheduler_init(dose_alert_fire, NULL)) {
+        ESP_LOGE(TAG, "Dose scheduler init failed");
+    }
+    dose_scheduler_set_prepare(DOSE_PREPOSITION_LEAD_MS, dose_alert_prepare, NULL);
     wifi_init_sta();
     wifi_creds_load();
     wifi_auto_connect_start();
@@ -3001,10 +3287,18 @@ void app_main(void)
     med_cache_load_all();
     time_cache_load_nvs();
     lvgl_port_lock(0);
-    apply_cached_upcoming_to_main();
+    dose_fired_load();
+    lvgl_port_unlock();
+    if (time_synced) {
+        dose_schedule_reload();     /* the clock survived the reset: alerts run before the first sync */
+    }
+    backend_conn_init(BACKEND_BASE_URL, DEVICE_SECRET);
+    dose_outbox_setup();
+    lvgl_port_lock(0);
+    main_data_show_cached();
     update_clock_text();
     lvgl_port_unlock();
-    xTaskCreate(backend_fetch_task, "backend_fetch", 8192, NULL, 5, NULL);
-    xTaskCreate(time_sync_task, "time_sync", 4096, NULL, 5, NULL);
-    xTaskCreate(heartbeat_task, "heartbeat", 4096, NULL, 4, NULL);
+    if (net_service_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Network service start failed");
+    }
 }
@@ -0,0 +1,200 @@
+#include "net_service.h"
+
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define NET_SERVICE_STACK 8192
+#define NET_SERVICE_PRIORITY 5
+#define NET_RETRY_MIN_MS 2000
+#define NET_RETRY_MAX_MS (5 * 60 * 1000)
+#define NET_NEVER INT64_MAX
+
+static const char *TAG = "net_service";
+
+typedef struct {
+    const char *name;
+    net_job_fn_t fn;
+    void *ctx;
+    int64_t period_ms;
+    int64_t deadline_ms;
+    uint32_t attempts;              /* consecutive NET_JOB_RETRY results */
+} net_job_t;
+
+static SemaphoreHandle_t net_lock = NULL;
+static TaskHandle_t net_task_handle = NULL;
+static bool (*net_ready)(void) = NULL;
+static net_job_t net_jobs[NET_SERVICE_MAX_JOBS];
+static int net_job_count = 0;
+
+static int64_t net_now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static int64_t net_retry_delay_ms(const net_job_t *job)
+{
+    int64_t delay = NET_RETRY_MIN_MS;
+    for (uint32_t i = 1; i < job->attempts && delay < NET_RETRY_MAX_MS; ++i) {
+        delay *= 2;
+    }
+    if (delay > NET_RETRY_MAX_MS) {
+        delay = NET_RETRY_MAX_MS;
+    }
+    if (job->period_ms > 0 && delay > job->period_ms) {
+        delay = job->period_ms;
+    }
+    return delay;
+}
+
+/* Earliest deadline wins; ties go to the job added first. */
+static int net_next_job(int64_t *deadline_ms)
+{
+    int next = -1;
+    *deadline_ms = NET_NEVER;
+    xSemaphoreTake(net_lock, portMAX_DELAY);
+    for (int i = 0; i < net_job_count; ++i) {
+        if (net_jobs[i].deadline_ms < *deadline_ms) {
+            *deadline_ms = net_jobs[i].deadline_ms;
+            next = i;
+        }
+    }
+    xSemaphoreGive(net_lock);
+    return next;
+}
+
+static void net_service_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        int64_t deadline_ms;
+        int id = net_next_job(&deadline_ms);
+        int64_t now_ms = net_now_ms();
+        if (id < 0 || (net_ready && !net_ready())) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (deadline_ms > now_ms) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(deadline_ms - now_ms));
+            continue;
+        }
+
+        net_job_t *job = &net_jobs[id];
+        xSemaphoreTake(net_lock, portMAX_DELAY);
+        job->deadline_ms = NET_NEVER;
+        xSemaphoreGive(net_lock);
+
+        net_job_result_t result = job->fn(job->ctx);
+
+        now_ms = net_now_ms();
+        int64_t next_ms = NET_NEVER;
+        xSemaphoreTake(net_lock, portMAX_DELAY);
+        if (result == NET_JOB_RETRY) {
+            job->attempts++;
+            next_ms = now_ms + net_retry_delay_ms(job);
+            ESP_LOGW(TAG, "%s failed (attempt %lu), retry in %lld ms", job->name, (unsigned long)job->attempts,
+                     (long long)(next_ms - now_ms));
+        } else {
+            job->attempts = 0;
+            if (result == NET_JOB_MORE) {
+                next_ms = now_ms;
+            } else if (job->period_ms > 0) {
+                next_ms = now_ms + job->period_ms;
+            }
+        }
+        /* A request or schedule that arrived while the job ran may be earlier. */
+        if (next_ms < job->deadline_ms) {
+            job->deadline_ms = next_ms;
+        }
+        xSemaphoreGive(net_lock);
+    }
+}
+
+esp_err_t net_service_init(bool (*ready)(void))
+{
+    if (net_lock) {
+        return ESP_OK;
+    }
+    net_lock = xSemaphoreCreateMutex();
+    if (!net_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    net_ready = ready;
+    return ESP_OK;
+}
+
+int net_service_add(const char *name, net_job_fn_t fn, void *ctx, int64_t period_ms)
+{
+    if (!net_lock || !fn || net_task_handle || net_job_count >= NET_SERVICE_MAX_JOBS) {
+        return -1;
+    }
+    net_job_t *job = &net_jobs[net_job_count];
+    job->name = name;
+    job->fn = fn;
+    job->ctx = ctx;
+    job->period_ms = period_ms;
+    job->deadline_ms = period_ms > 0 ? net_now_ms() + period_ms : NET_NEVER;
+    job->attempts = 0;
+    return net_job_count++;
+}
+
+esp_err_t net_service_start(void)
+{
+    if (!net_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (net_task_handle) {
+        return ESP_OK;
+    }
+    if (xTaskCreate(net_service_task, "net_service", NET_SERVICE_STACK, NULL, NET_SERVICE_PRIORITY,
+                    &net_task_handle) != pdPASS) {
+        net_task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void net_service_schedule(int job, int64_t delay_ms)
+{
+    if (!net_lock || job < 0 || job >= net_job_count) {
+        return;
+    }
+    xSemaphoreTake(net_lock, portMAX_DELAY);
+    net_jobs[job].deadline_ms = net_now_ms() + (delay_ms > 0 ? delay_ms : 0);
+    xSemaphoreGive(net_lock);
+    net_service_wake();
+}
+
+void net_service_request(int job)
+{
+    if (!net_lock || job < 0 || job >= net_job_count) {
+        return;
+    }
+    xSemaphoreTake(net_lock, portMAX_DELAY);
+    net_jobs[job].attempts = 0;
+    net_jobs[job].deadline_ms = net_now_ms();
+    xSemaphoreGive(net_lock);
+    net_service_wake();
+}
+
+bool net_service_due(int job)
+{
+    if (!net_lock || job < 0 || job >= net_job_count) {
+        return false;
+    }
+    xSemaphoreTake(net_lock, portMAX_DELAY);
+    bool due = net_jobs[job].deadline_ms <= net_now_ms();
+    xSemaphoreGive(net_lock);
+    return due;
+}
+
+void net_service_wake(void)
+{
+    if (net_task_handle) {
+        xTaskNotifyGive(net_task_handle);
+    }
+}
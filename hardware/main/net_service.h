@@ -0,0 +1,59 @@
+#ifndef NET_SERVICE_H
+#define NET_SERVICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/*
+ * One task for all backend traffic.
+ *
+ * Jobs (sync, time, heartbeat, outbox drain, on-demand fetches) are added
+ * once at boot. Each has a deadline, and the task always runs the job with
+ * the earliest one, so requests never compete for the session or the radio.
+ * The job table is small and fixed, so the next job is found by scanning the
+ * deadlines.
+ *
+ * A job tells the service what to do next:
+ *   NET_JOB_DONE   run again after its period (never, if the period is 0)
+ *   NET_JOB_MORE   run again right away (e.g. more outbox batches)
+ *   NET_JOB_RETRY  run again after the shared backoff: 2 s, 4 s, ... capped
+ *                  at 5 min and at the job's period
+ *
+ * Jobs run only while ready() returns true (WiFi up). net_service_request()
+ * makes a job due now, resets its backoff and wakes the task. It is safe to
+ * call from any task, including from a running job, and before
+ * net_service_start(): the request is kept until the task runs.
+ *
+ * Call net_service_init(), then net_service_add() for each job, then
+ * net_service_start().
+ */
+
+#define NET_SERVICE_MAX_JOBS 8
+
+typedef enum {
+    NET_JOB_DONE,
+    NET_JOB_MORE,
+    NET_JOB_RETRY,
+} net_job_result_t;
+
+typedef net_job_result_t (*net_job_fn_t)(void *ctx);
+
+esp_err_t net_service_init(bool (*ready)(void));
+int net_service_add(const char *name, net_job_fn_t fn, void *ctx, int64_t period_ms);
+esp_err_t net_service_start(void);
+void net_service_request(int job);
+void net_service_schedule(int job, int64_t delay_ms);
+bool net_service_due(int job);
+void net_service_wake(void);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
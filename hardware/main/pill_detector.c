@@ -0,0 +1,213 @@
+#include "pill_detector.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define PILL_TASK_STACK 3072
+#define PILL_TASK_PRIORITY 5
+
+static const char *TAG = "pill_detector";
+
+static portMUX_TYPE pd_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t pd_task_handle = NULL;
+static pill_detector_config_t pd_config;
+static bool pd_armed = false;
+
+/* Edge state and results, shared with the ISR under pd_mux */
+static bool pd_blocked = false;
+static int64_t pd_break_us = 0;
+static int64_t pd_last_clear_us = 0;
+static bool pd_merging = false;
+static uint32_t pd_count = 0;
+static uint32_t pd_glitches = 0;
+static uint32_t pd_delivered = 0;
+static pill_drop_t pd_drops[PILL_DETECTOR_MAX_DROPS];
+
+static bool pd_beam_broken(void)
+{
+    return gpio_get_level(pd_config.gpio) == (pd_config.active_low ? 0 : 1);
+}
+
+static void pd_isr(void *arg)
+{
+    (void)arg;
+    int64_t now_us = esp_timer_get_time();
+    bool broken = pd_beam_broken();
+    bool counted = false;
+
+    portENTER_CRITICAL_ISR(&pd_mux);
+    if (broken) {
+        if (!pd_blocked) {
+            pd_blocked = true;
+            /* A break right after a pill is that pill bouncing, not a new one. */
+            pd_merging = pd_count > 0 && now_us - pd_last_clear_us < pd_config.min_gap_us;
+            if (!pd_merging) {
+                pd_break_us = now_us;
+            }
+        }
+    } else if (pd_blocked) {
+        pd_blocked = false;
+        if (pd_merging) {
+            pd_drops[(pd_count - 1) % PILL_DETECTOR_MAX_DROPS].clear_us = now_us;
+            pd_last_clear_us = now_us;
+        } else if (now_us - pd_break_us < pd_config.min_break_us) {
+            pd_glitches++;
+        } else {
+            pill_drop_t *drop = &pd_drops[pd_count % PILL_DETECTOR_MAX_DROPS];
+            drop->break_us = pd_break_us;
+            drop->clear_us = now_us;
+            pd_last_clear_us = now_us;
+            pd_count++;
+            counted = true;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&pd_mux);
+
+    if (counted) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(pd_task_handle, &woken);
+        if (woken == pdTRUE) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+static void pd_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (;;) {
+            pill_drop_t drop;
+            uint32_t count;
+            portENTER_CRITICAL(&pd_mux);
+            if (pd_count - pd_delivered > PILL_DETECTOR_MAX_DROPS) {
+                pd_delivered = pd_count - PILL_DETECTOR_MAX_DROPS;
+            }
+            bool pending = pd_delivered < pd_count;
+            if (pending) {
+                drop = pd_drops[pd_delivered % PILL_DETECTOR_MAX_DROPS];
+                count = ++pd_delivered;
+            }
+            portEXIT_CRITICAL(&pd_mux);
+            if (!pending) {
+                break;
+            }
+            if (pd_config.on_drop) {
+                pd_config.on_drop(&drop, count, pd_config.ctx);
+            }
+        }
+    }
+}
+
+esp_err_t pill_detector_init(const pill_detector_config_t *config)
+{
+    if (!config) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (pd_task_handle) {
+        return ESP_OK;
+    }
+    pd_config = *config;
+
+    gpio_config_t cfg = {
+        .pin_bit_mask = (1ULL << config->gpio),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_ANYEDGE
+    };
+    esp_err_t err = gpio_config(&cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+    gpio_intr_disable(config->gpio);
+
+    if (xTaskCreate(pd_task, "pill_detector", PILL_TASK_STACK, NULL, PILL_TASK_PRIORITY,
+                    &pd_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    /* The BSP may already have installed the shared ISR service. */
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return err;
+    }
+    err = gpio_isr_handler_add(config->gpio, pd_isr, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ESP_LOGI(TAG, "IR detector on GPIO %d (min break %lu us, gap %lu us)", config->gpio,
+             (unsigned long)config->min_break_us, (unsigned long)config->min_gap_us);
+    return ESP_OK;
+}
+
+void pill_detector_arm(void)
+{
+    if (!pd_task_handle) {
+        return;
+    }
+    gpio_intr_disable(pd_config.gpio);
+    bool broken = pd_beam_broken();
+    portENTER_CRITICAL(&pd_mux);
+    pd_blocked = broken;
+    pd_break_us = esp_timer_get_time();
+    pd_merging = false;
+    pd_count = 0;
+    pd_glitches = 0;
+    pd_delivered = 0;
+    pd_armed = true;
+    portEXIT_CRITICAL(&pd_mux);
+    gpio_intr_enable(pd_config.gpio);
+}
+
+void pill_detector_disarm(void)
+{
+    if (!pd_task_handle) {
+        return;
+    }
+    gpio_intr_disable(pd_config.gpio);
+    portENTER_CRITICAL(&pd_mux);
+    pd_armed = false;
+    pd_blocked = false;
+    portEXIT_CRITICAL(&pd_mux);
+}
+
+bool pill_detector_armed(void)
+{
+    return pd_armed;
+}
+
+uint32_t pill_detector_count(void)
+{
+    portENTER_CRITICAL(&pd_mux);
+    uint32_t count = pd_count;
+    portEXIT_CRITICAL(&pd_mux);
+    return count;
+}
+
+uint32_t pill_detector_glitches(void)
+{
+    portENTER_CRITICAL(&pd_mux);
+    uint32_t glitches = pd_glitches;
+    portEXIT_CRITICAL(&pd_mux);
+    return glitches;
+}
+
+size_t pill_detector_drops(pill_drop_t *out, size_t max)
+{
+    if (!out || max == 0) {
+        return 0;
+    }
+    portENTER_CRITICAL(&pd_mux);
+    uint32_t available = pd_count < PILL_DETECTOR_MAX_DROPS ? pd_count : PILL_DETECTOR_MAX_DROPS;
+    size_t n = available < max ? available : max;
+    uint32_t first = pd_count - n;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = pd_drops[(first + i) % PILL_DETECTOR_MAX_DROPS];
+    }
+    portEXIT_CRITICAL(&pd_mux);
+    return n;
+}
@@ -0,0 +1,60 @@
+#ifndef PILL_DETECTOR_H
+#define PILL_DETECTOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/*
+ * Interrupt-driven pill-drop detector on the IR break-beam sensor.
+ *
+ * While armed, every edge on the sensor pin raises a GPIO interrupt that
+ * timestamps it with esp_timer_get_time(). A pill is counted when the beam
+ * clears after being broken for at least min_break_us; shorter breaks are
+ * counted as glitches. A new break less than min_gap_us after a pill is
+ * treated as contact bounce of that same pill. While disarmed the edge
+ * interrupt is off, so the detector costs nothing between dispenses.
+ *
+ * on_drop runs on the detector's own task, once per pill, in order.
+ */
+
+#define PILL_DETECTOR_MAX_DROPS 8
+
+typedef struct {
+    int64_t break_us;               /* esp_timer clock */
+    int64_t clear_us;
+} pill_drop_t;
+
+typedef void (*pill_detector_drop_fn)(const pill_drop_t *drop, uint32_t count, void *ctx);
+
+typedef struct {
+    int gpio;
+    bool active_low;                /* level while the beam is broken */
+    uint32_t min_break_us;
+    uint32_t min_gap_us;
+    pill_detector_drop_fn on_drop;
+    void *ctx;
+} pill_detector_config_t;
+
+esp_err_t pill_detector_init(const pill_detector_config_t *config);
+/* Resets the count and starts listening for edges */
+void pill_detector_arm(void);
+void pill_detector_disarm(void);
+bool pill_detector_armed(void);
+/* Pills and glitches since the last arm */
+uint32_t pill_detector_count(void);
+uint32_t pill_detector_glitches(void);
+/* Copies up to max of the most recent drops since the last arm, oldest first */
+size_t pill_detector_drops(pill_drop_t *out, size_t max);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
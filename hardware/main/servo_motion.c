@@ -0,0 +1,256 @@
+#include "servo_motion.h"
+
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#define SERVO_PERIOD_US 20000
+#define SERVO_RESOLUTION LEDC_TIMER_14_BIT
+#define SERVO_MAX_SEGMENTS (2 * SERVO_MOTION_RAMP_SEGMENTS + 1)
+#define SERVO_FADE_SLACK_MS 50
+#define SERVO_TASK_STACK 3072
+#define SERVO_TASK_PRIORITY 5
+
+static const char *TAG = "servo_motion";
+
+typedef struct {
+    int deg;
+    servo_motion_profile_t profile;
+    servo_motion_done_fn done;
+    void *ctx;
+} servo_move_t;
+
+typedef struct {
+    float deg;                      /* angle at the end of the fade */
+    uint32_t ms;
+} servo_segment_t;
+
+static portMUX_TYPE servo_mux = portMUX_INITIALIZER_UNLOCKED;
+static servo_motion_config_t servo_config;
+static TaskHandle_t servo_task_handle = NULL;
+static QueueHandle_t servo_queue = NULL;
+static uint32_t servo_pending = 0;              /* queued + running, under servo_mux */
+static volatile int servo_deg = 0;
+
+static uint32_t servo_duty(float deg)
+{
+    const uint32_t max_duty = (1u << SERVO_RESOLUTION) - 1u;
+    float pulse_us = (float)servo_config.min_us +
+        (float)(servo_config.max_us - servo_config.min_us) * deg / (float)servo_config.deg_max;
+    return (uint32_t)(pulse_us * (float)max_duty / SERVO_PERIOD_US);
+}
+
+/* LEDC changes the duty once per PWM period, so shorter fades are pointless. */
+static uint32_t servo_segment_ms(float seconds)
+{
+    uint32_t ms = (uint32_t)(seconds * 1000.0f + 0.5f);
+    return ms < SERVO_PERIOD_US / 1000 ? SERVO_PERIOD_US / 1000 : ms;
+}
+
+/* Trapezoidal profile as linear fades: each ramp step runs at its mean speed. */
+static size_t servo_plan(float from, float to, const servo_motion_profile_t *profile,
+                         servo_segment_t *out)
+{
+    float dist = fabsf(to - from);
+    float dir = to >= from ? 1.0f : -1.0f;
+    float v = (float)profile->max_dps;
+    float ramp_s = (float)profile->ramp_ms / 1000.0f;
+    if (dist == 0.0f) {
+        return 0;
+    }
+    if (ramp_s <= 0.0f) {
+        out[0] = (servo_segment_t){.deg = to, .ms = servo_segment_ms(dist / v)};
+        return 1;
+    }
+    if (dist < v * ramp_s) {
+        float accel = v / ramp_s;
+        v = sqrtf(dist * accel);
+        ramp_s = v / accel;
+    }
+    float step_s = ramp_s / SERVO_MOTION_RAMP_SEGMENTS;
+    float cruise_s = (dist - v * ramp_s) / v;
+    float at = from;
+    size_t n = 0;
+    for (int i = 0; i < SERVO_MOTION_RAMP_SEGMENTS; ++i) {
+        at += dir * v * ((float)i + 0.5f) / SERVO_MOTION_RAMP_SEGMENTS * step_s;
+        out[n++] = (servo_segment_t){.deg = at, .ms = servo_segment_ms(step_s)};
+    }
+    if (cruise_s > 0.0f) {
+        at += dir * v * cruise_s;
+        out[n++] = (servo_segment_t){.deg = at, .ms = servo_segment_ms(cruise_s)};
+    }
+    for (int i = SERVO_MOTION_RAMP_SEGMENTS - 1; i >= 0; --i) {
+        at += dir * v * ((float)i + 0.5f) / SERVO_MOTION_RAMP_SEGMENTS * step_s;
+        out[n++] = (servo_segment_t){.deg = at, .ms = servo_segment_ms(step_s)};
+    }
+    out[n - 1].deg = to;
+    return n;
+}
+
+static bool servo_on_fade_end(const ledc_cb_param_t *param, void *user_arg)
+{
+    (void)user_arg;
+    BaseType_t woken = pdFALSE;
+    if (param->event == LEDC_FADE_END_EVT) {
+        vTaskNotifyGiveFromISR(servo_task_handle, &woken);
+    }
+    return woken == pdTRUE;
+}
+
+static void servo_run(const servo_move_t *move)
+{
+    servo_segment_t segments[SERVO_MAX_SEGMENTS];
+    size_t count = servo_plan((float)servo_deg, (float)move->deg, &move->profile, segments);
+    ledc_mode_t mode = servo_config.speed_mode;
+    ledc_channel_t channel = servo_config.channel;
+
+    /* Restarts the output if it was released */
+    uint32_t duty = servo_duty((float)servo_deg);
+    ledc_set_duty(mode, channel, duty);
+    ledc_update_duty(mode, channel);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t next = servo_duty(segments[i].deg);
+        if (next == duty) {
+            continue;
+        }
+        duty = next;
+        ulTaskNotifyTake(pdTRUE, 0);
+        if (ledc_set_fade_with_time(mode, channel, duty, (int)segments[i].ms) != ESP_OK ||
+            ledc_fade_start(mode, channel, LEDC_FADE_NO_WAIT) != ESP_OK) {
+            ledc_set_duty(mode, channel, duty);
+            ledc_update_duty(mode, channel);
+            continue;
+        }
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(segments[i].ms + SERVO_FADE_SLACK_MS)) == 0) {
+            ESP_LOGW(TAG, "Fade to %.1f deg did not end", segments[i].deg);
+        }
+    }
+    servo_deg = move->deg;
+}
+
+static void servo_task(void *arg)
+{
+    (void)arg;
+    servo_move_t move;
+    for (;;) {
+        if (xQueueReceive(servo_queue, &move, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        servo_run(&move);
+        vTaskDelay(pdMS_TO_TICKS(servo_config.settle_ms));
+        if (move.done) {
+            move.done(servo_deg, move.ctx);
+        }
+        portENTER_CRITICAL(&servo_mux);
+        servo_pending--;
+        portEXIT_CRITICAL(&servo_mux);
+        if (uxQueueMessagesWaiting(servo_queue) == 0) {
+            ledc_stop(servo_config.speed_mode, servo_config.channel, 0);
+        }
+    }
+}
+
+esp_err_t servo_motion_init(const servo_motion_config_t *config)
+{
+    if (!config || config->deg_max <= 0 || config->max_us <= config->min_us) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (servo_queue) {
+        return ESP_OK;
+    }
+    servo_config = *config;
+    servo_deg = config->initial_deg;
+
+    ledc_timer_config_t timer_cfg = {
+        .speed_mode = config->speed_mode,
+        .duty_resolution = SERVO_RESOLUTION,
+        .timer_num = config->timer,
+        .freq_hz = 1000000 / SERVO_PERIOD_US,
+        .clk_cfg = LEDC_AUTO_CLK
+    };
+    esp_err_t err = ledc_timer_config(&timer_cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ledc_channel_config_t ch_cfg = {
+        .gpio_num = config->gpio,
+        .speed_mode = config->speed_mode,
+        .channel = config->channel,
+        .timer_sel = config->timer,
+        .duty = 0,
+        .hpoint = 0
+    };
+    err = ledc_channel_config(&ch_cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = ledc_fade_func_install(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return err;
+    }
+    ledc_cbs_t cbs = {
+        .fade_cb = servo_on_fade_end,
+    };
+    err = ledc_cb_register(config->speed_mode, config->channel, &cbs, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    servo_queue = xQueueCreate(SERVO_MOTION_QUEUE_LEN, sizeof(servo_move_t));
+    if (!servo_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(servo_task, "servo_motion", SERVO_TASK_STACK, NULL, SERVO_TASK_PRIORITY,
+                    &servo_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool servo_motion_move_to(int deg, const servo_motion_profile_t *profile,
+                          servo_motion_done_fn done, void *ctx)
+{
+    if (!servo_queue || !profile || profile->max_dps == 0) {
+        return false;
+    }
+    if (deg < 0) {
+        deg = 0;
+    }
+    if (deg > servo_config.deg_max) {
+        deg = servo_config.deg_max;
+    }
+    servo_move_t move = {
+        .deg = deg,
+        .profile = *profile,
+        .done = done,
+        .ctx = ctx,
+    };
+    portENTER_CRITICAL(&servo_mux);
+    servo_pending++;
+    portEXIT_CRITICAL(&servo_mux);
+    if (xQueueSend(servo_queue, &move, 0) != pdTRUE) {
+        portENTER_CRITICAL(&servo_mux);
+        servo_pending--;
+        portEXIT_CRITICAL(&servo_mux);
+        ESP_LOGW(TAG, "Move queue full; dropping move to %d deg", deg);
+        return false;
+    }
+    return true;
+}
+
+bool servo_motion_busy(void)
+{
+    portENTER_CRITICAL(&servo_mux);
+    bool busy = servo_pending > 0;
+    portEXIT_CRITICAL(&servo_mux);
+    return busy;
+}
+
+int servo_motion_position(void)
+{
+    return servo_deg;
+}
@@ -0,0 +1,65 @@
+#ifndef SERVO_MOTION_H
+#define SERVO_MOTION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "driver/ledc.h"
+#include "esp_err.h"
+
+/*
+ * Lid servo moves on the LEDC hardware fade engine.
+ *
+ * A move is cut into a few linear fades that approximate its velocity
+ * profile: a ramp up to max_dps over ramp_ms, a cruise, and a symmetric
+ * ramp down. Short moves never reach max_dps. ramp_ms 0 gives a single
+ * constant-speed fade. LEDC steps the duty every PWM period on its own, and
+ * the fade-end interrupt wakes a small task that starts the next fade. No
+ * CPU time is spent while a fade runs.
+ *
+ * Moves are queued and run in order. Once a move's last fade ends, the task
+ * waits settle_ms for the servo to catch up, then calls the move's done
+ * callback (never from the interrupt). If nothing else is queued it then
+ * stops the PWM output, so the servo does not jitter while holding. The
+ * next move restarts the output at the last commanded angle.
+ */
+
+#define SERVO_MOTION_QUEUE_LEN 4
+#define SERVO_MOTION_RAMP_SEGMENTS 4
+
+typedef struct {
+    int gpio;
+    ledc_mode_t speed_mode;
+    ledc_timer_t timer;
+    ledc_channel_t channel;
+    uint32_t min_us;                /* pulse at 0 deg */
+    uint32_t max_us;                /* pulse at deg_max */
+    int deg_max;
+    int initial_deg;                /* assumed until the first move */
+    uint32_t settle_ms;
+} servo_motion_config_t;
+
+typedef struct {
+    uint32_t max_dps;               /* degrees per second */
+    uint32_t ramp_ms;               /* 0 to max_dps; 0 for constant speed */
+} servo_motion_profile_t;
+
+typedef void (*servo_motion_done_fn)(int deg, void *ctx);
+
+esp_err_t servo_motion_init(const servo_motion_config_t *config);
+bool servo_motion_move_to(int deg, const servo_motion_profile_t *profile,
+                          servo_motion_done_fn done, void *ctx);
+/* True while a move is running or queued */
+bool servo_motion_busy(void);
+/* Last commanded angle */
+int servo_motion_position(void);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
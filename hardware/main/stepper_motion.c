@@ -0,0 +1,335 @@
+#include "stepper_motion.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "esp_log.h"
+
+#define MOTION_TIMER_HZ 1000000
+#define MOTION_TASK_STACK 3072
+#define MOTION_TASK_PRIORITY 6
+#define MOTION_NOTIFY_APPROACH (1u << 0)
+#define MOTION_NOTIFY_DONE (1u << 1)
+
+static const char *TAG = "stepper_motion";
+
+typedef struct {
+    int32_t steps;
+    bool absolute;
+    int32_t revolution;             /* absolute on a wheel: shorter way round */
+    bool track;
+    uint32_t stop_seq;
+    stepper_motion_approach_fn approach;
+    stepper_motion_done_fn done;
+    void *ctx;
+} motion_move_t;
+
+static portMUX_TYPE motion_mux = portMUX_INITIALIZER_UNLOCKED;
+static gptimer_handle_t motion_timer = NULL;
+static TaskHandle_t motion_task_handle = NULL;
+static QueueHandle_t motion_queue = NULL;
+static int motion_gpio[4];
+static uint16_t motion_ramp_us[STEPPER_MOTION_RAMP_MAX];
+static size_t motion_ramp_len = 0;
+static uint32_t motion_approach_steps = 0;
+static uint32_t motion_pending = 0;             /* queued + running, under motion_mux */
+static volatile uint32_t motion_stop_seq = 0;
+static volatile int32_t motion_position = 0;
+
+/* Running move; written by the task before the timer starts, then owned by the ISR */
+static int motion_phase = 0;
+static int motion_dir = 0;
+static uint32_t motion_total = 0;
+static uint32_t motion_approach_left = 0;       /* 0: no approach notification */
+static volatile uint32_t motion_done = 0;
+static bool motion_track = false;
+static uint32_t motion_run_seq = 0;
+
+static void motion_set_phase(int phase)
+{
+    for (int i = 0; i < 4; ++i) {
+        gpio_set_level(motion_gpio[i], i == phase ? 1 : 0);
+    }
+}
+
+/* Interval before step i of an acceleration from start_sps: v_i = sqrt(v0^2 + 2*a*i). */
+static void motion_build_ramp(const stepper_motion_config_t *config)
+{
+    float v0 = (float)config->start_sps;
+    float vmax = (float)config->max_sps;
+    float accel = (float)config->accel_sps2;
+    motion_ramp_len = 0;
+    while (motion_ramp_len < STEPPER_MOTION_RAMP_MAX) {
+        float v = sqrtf(v0 * v0 + 2.0f * accel * (float)motion_ramp_len);
+        if (v >= vmax || accel <= 0.0f) {
+            motion_ramp_us[motion_ramp_len++] = (uint16_t)(MOTION_TIMER_HZ / vmax);
+            break;
+        }
+        motion_ramp_us[motion_ramp_len++] = (uint16_t)(MOTION_TIMER_HZ / v);
+    }
+}
+
+/* Accelerate by steps done, decelerate by steps left, whichever is slower. */
+static uint32_t motion_interval_us(uint32_t done, uint32_t left)
+{
+    uint32_t idx = done < left - 1 ? done : left - 1;
+    if (idx >= motion_ramp_len) {
+        idx = motion_ramp_len - 1;
+    }
+    return motion_ramp_us[idx];
+}
+
+static bool motion_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata,
+                            void *user_ctx)
+{
+    (void)user_ctx;
+    if (motion_stop_seq == motion_run_seq) {
+        motion_phase = (motion_phase + motion_dir) & 0x03;
+        motion_set_phase(motion_phase);
+        if (motion_track) {
+            motion_position += motion_dir;
+        }
+        uint32_t done = ++motion_done;
+        if (done < motion_total) {
+            gptimer_alarm_config_t alarm = {
+                .alarm_count = edata->alarm_value + motion_interval_us(done, motion_total - done),
+            };
+            gptimer_set_alarm_action(timer, &alarm);
+            if (motion_total - done != motion_approach_left) {
+                return false;
+            }
+            BaseType_t woken = pdFALSE;
+            xTaskNotifyFromISR(motion_task_handle, MOTION_NOTIFY_APPROACH, eSetBits, &woken);
+            return woken == pdTRUE;
+        }
+    }
+    gptimer_stop(timer);
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(motion_task_handle, MOTION_NOTIFY_DONE, eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
+/* Shorter of the two ways round for a move of delta steps on a wheel. */
+static int32_t motion_circular_delta(int32_t delta, int32_t revolution)
+{
+    int32_t forward = (delta % revolution + revolution) % revolution;
+    return forward <= revolution - forward ? forward : forward - revolution;
+}
+
+/* Runs one move to completion or cancellation; returns true if every step was taken. */
+static bool motion_run(int32_t steps, const motion_move_t *move)
+{
+    motion_dir = steps > 0 ? 1 : -1;
+    motion_total = (uint32_t)abs(steps);
+    motion_done = 0;
+    motion_track = move->track;
+    motion_run_seq = move->stop_seq;
+    motion_approach_left = 0;
+    if (move->approach) {
+        if (motion_total <= motion_approach_steps) {
+            move->approach((int32_t)motion_total, move->ctx);
+        } else {
+            motion_approach_left = motion_approach_steps;
+        }
+    }
+
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = motion_interval_us(0, motion_total),
+    };
+    gptimer_set_raw_count(motion_timer, 0);
+    gptimer_set_alarm_action(motion_timer, &alarm);
+    gptimer_start(motion_timer);
+    uint32_t bits = 0;
+    while (!(bits & MOTION_NOTIFY_DONE)) {
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        if ((bits & MOTION_NOTIFY_APPROACH) && motion_stop_seq == move->stop_seq) {
+            move->approach((int32_t)motion_approach_left, move->ctx);
+        }
+    }
+    return motion_done == motion_total;
+}
+
+static void motion_task(void *arg)
+{
+    (void)arg;
+    motion_move_t move;
+    for (;;) {
+        if (xQueueReceive(motion_queue, &move, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        bool completed = false;
+        if (move.stop_seq == motion_stop_seq) {
+            int32_t steps = move.absolute ? move.steps - motion_position : move.steps;
+            if (move.absolute && move.revolution > 0) {
+                steps = motion_circular_delta(steps, move.revolution);
+            }
+            completed = steps == 0 || motion_run(steps, &move);
+            if (!completed) {
+                ESP_LOGW(TAG, "Move stopped at %ld", (long)motion_position);
+            }
+        }
+        if (move.done) {
+            move.done(motion_position, completed, move.ctx);
+        }
+        portENTER_CRITICAL(&motion_mux);
+        motion_pending--;
+        portEXIT_CRITICAL(&motion_mux);
+    }
+}
+
+static bool motion_enqueue(int32_t steps, bool absolute, int32_t revolution, bool track,
+                           stepper_motion_approach_fn approach, stepper_motion_done_fn done,
+                           void *ctx)
+{
+    if (!motion_queue) {
+        return false;
+    }
+    motion_move_t move = {
+        .steps = steps,
+        .absolute = absolute,
+        .revolution = revolution,
+        .track = track,
+        .approach = approach,
+        .done = done,
+        .ctx = ctx,
+    };
+    portENTER_CRITICAL(&motion_mux);
+    move.stop_seq = motion_stop_seq;
+    motion_pending++;
+    portEXIT_CRITICAL(&motion_mux);
+    if (xQueueSend(motion_queue, &move, 0) != pdTRUE) {
+        portENTER_CRITICAL(&motion_mux);
+        motion_pending--;
+        portEXIT_CRITICAL(&motion_mux);
+        ESP_LOGW(TAG, "Move queue full; dropping move of %ld", (long)steps);
+        return false;
+    }
+    return true;
+}
+
+esp_err_t stepper_motion_init(const stepper_motion_config_t *config)
+{
+    if (!config || config->start_sps == 0 || config->max_sps < config->start_sps) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (motion_queue) {
+        return ESP_OK;
+    }
+
+    uint64_t pin_mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        motion_gpio[i] = config->gpio[i];
+        pin_mask |= 1ULL << config->gpio[i];
+    }
+    gpio_config_t io_cfg = {
+        .pin_bit_mask = pin_mask,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+    esp_err_t err = gpio_config(&io_cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (int i = 0; i < 4; ++i) {
+        gpio_set_level(motion_gpio[i], 0);
+    }
+    motion_phase = 0;
+    motion_approach_steps = config->approach_steps;
+    motion_build_ramp(config);
+
+    gptimer_config_t timer_cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = MOTION_TIMER_HZ,
+    };
+    err = gptimer_new_timer(&timer_cfg, &motion_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = motion_on_alarm,
+    };
+    err = gptimer_register_event_callbacks(motion_timer, &cbs, NULL);
+    if (err == ESP_OK) {
+        err = gptimer_enable(motion_timer);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    motion_queue = xQueueCreate(STEPPER_MOTION_QUEUE_LEN, sizeof(motion_move_t));
+    if (!motion_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(motion_task, "stepper_motion", MOTION_TASK_STACK, NULL, MOTION_TASK_PRIORITY,
+                    &motion_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Ramp %u steps, %lu..%lu sps", (unsigned)motion_ramp_len,
+             (unsigned long)config->start_sps, (unsigned long)config->max_sps);
+    return ESP_OK;
+}
+
+bool stepper_motion_move(int32_t steps, stepper_motion_done_fn done, void *ctx)
+{
+    return motion_enqueue(steps, false, 0, true, NULL, done, ctx);
+}
+
+bool stepper_motion_move_to(int32_t position, stepper_motion_done_fn done, void *ctx)
+{
+    return motion_enqueue(position, true, 0, true, NULL, done, ctx);
+}
+
+bool stepper_motion_move_to_circular(int32_t position, int32_t revolution,
+                                     stepper_motion_approach_fn approach,
+                                     stepper_motion_done_fn done, void *ctx)
+{
+    if (revolution <= 0) {
+        return false;
+    }
+    return motion_enqueue(position, true, revolution, true, approach, done, ctx);
+}
+
+bool stepper_motion_jog(int32_t steps)
+{
+    return motion_enqueue(steps, false, 0, false, NULL, NULL, NULL);
+}
+
+void stepper_motion_stop(void)
+{
+    portENTER_CRITICAL(&motion_mux);
+    motion_stop_seq++;
+    portEXIT_CRITICAL(&motion_mux);
+}
+
+bool stepper_motion_busy(void)
+{
+    portENTER_CRITICAL(&motion_mux);
+    bool busy = motion_pending > 0;
+    portEXIT_CRITICAL(&motion_mux);
+    return busy;
+}
+
+int32_t stepper_motion_position(void)
+{
+    return motion_position;
+}
+
+bool stepper_motion_set_position(int32_t position)
+{
+    bool idle;
+    portENTER_CRITICAL(&motion_mux);
+    idle = motion_pending == 0;
+    if (idle) {
+        motion_position = position;
+    }
+    portEXIT_CRITICAL(&motion_mux);
+    return idle;
+}
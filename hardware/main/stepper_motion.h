@@ -0,0 +1,72 @@
+#ifndef STEPPER_MOTION_H
+#define STEPPER_MOTION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/*
+ * Background motion engine for the 4-phase carousel stepper.
+ *
+ * Steps are generated from a gptimer alarm interrupt, so nothing blocks
+ * while the motor turns. Each move follows a trapezoidal profile: it starts
+ * at start_sps, accelerates at accel_sps2 up to max_sps and decelerates
+ * symmetrically into the target. Short moves never reach max_sps and become
+ * triangles. The per-step intervals of the ramp are precomputed at init, so
+ * the interrupt only picks a table entry.
+ *
+ * Moves are queued and run in order by a small task, which also calls each
+ * move's done callback (never from the interrupt). The callback may block,
+ * e.g. to write NVS, but must not take long: the next move waits for it.
+ *
+ * stepper_motion_move_to() targets an absolute position, computed when the
+ * move starts, not when it is queued. stepper_motion_move_to_circular()
+ * does the same on a wheel of `revolution` steps, taking the shorter way
+ * round (the tracked position itself is not wrapped). Its optional
+ * approach callback runs on the motion task once approach_steps or fewer
+ * are left (right away for shorter moves), while the motor is still
+ * decelerating, so the caller can start the next actuator early.
+ * stepper_motion_jog() turns the motor without changing the tracked
+ * position, for manual alignment.
+ */
+
+#define STEPPER_MOTION_QUEUE_LEN 8
+#define STEPPER_MOTION_RAMP_MAX 256
+
+typedef struct {
+    int gpio[4];                    /* coils in energizing order */
+    uint32_t start_sps;             /* steps per second */
+    uint32_t max_sps;
+    uint32_t accel_sps2;            /* steps per second squared */
+    uint32_t approach_steps;
+} stepper_motion_config_t;
+
+/* completed is false if the move was cancelled by stepper_motion_stop() */
+typedef void (*stepper_motion_done_fn)(int32_t position, bool completed, void *ctx);
+typedef void (*stepper_motion_approach_fn)(int32_t steps_left, void *ctx);
+
+esp_err_t stepper_motion_init(const stepper_motion_config_t *config);
+bool stepper_motion_move(int32_t steps, stepper_motion_done_fn done, void *ctx);
+bool stepper_motion_move_to(int32_t position, stepper_motion_done_fn done, void *ctx);
+bool stepper_motion_move_to_circular(int32_t position, int32_t revolution,
+                                     stepper_motion_approach_fn approach,
+                                     stepper_motion_done_fn done, void *ctx);
+bool stepper_motion_jog(int32_t steps);
+/* Stops the running move at the next step and cancels the queued ones */
+void stepper_motion_stop(void);
+/* True while a move is running or queued */
+bool stepper_motion_busy(void);
+int32_t stepper_motion_position(void);
+/* Only while idle; returns false otherwise */
+bool stepper_motion_set_position(int32_t position);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
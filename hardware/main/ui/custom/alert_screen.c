@@ -18,7 +18,8 @@ static lv_obj_t *alert_dose_label = NULL;
 static void (*on_pick_cb)(void) = NULL;
 static void (*on_skip_cb)(void) = NULL;
 static esp_codec_dev_handle_t spk_codec_dev = NULL;
-static TaskHandle_t alert_sound_task = NULL;
+static portMUX_TYPE alert_sound_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool alert_sound_alive = false;          /* task exists, under alert_sound_mux */
 static volatile bool alert_sound_running = false;
 
 typedef struct {
@@ -103,7 +104,10 @@ static void alert_sound_task_fn(void *arg)
     (void)arg;
     wav_info_t info = {0};
     if (!parse_wav(alert_audio_wav, alert_audio_wav_len, &info)) {
+        portENTER_CRITICAL(&alert_sound_mux);
         alert_sound_running = false;
+        alert_sound_alive = false;
+        portEXIT_CRITICAL(&alert_sound_mux);
         vTaskDelete(NULL);
         return;
     }
@@ -114,48 +118,61 @@ static void alert_sound_task_fn(void *arg)
         .bits_per_sample = info.bits_per_sample,
     };
 
-    if (spk_codec_dev) {
-        esp_codec_dev_open(spk_codec_dev, &fs);
-    }
+    /* A start that races the stop is picked up here instead of opening the codec twice */
+    bool again = true;
+    while (again) {
+        if (spk_codec_dev) {
+            esp_codec_dev_open(spk_codec_dev, &fs);
+        }
 
-    size_t offset = 0;
-    const size_t chunk = 1024;
-    while (alert_sound_running) {
-        if (spk_codec_dev && info.data && info.data_len > 0) {
-            if (offset >= info.data_len) {
-                offset = 0;
+        size_t offset = 0;
+        const size_t chunk = 1024;
+        while (alert_sound_running) {
+            if (spk_codec_dev && info.data && info.data_len > 0) {
+                if (offset >= info.data_len) {
+                    offset = 0;
+                }
+                size_t remain = info.data_len - offset;
+                size_t send = remain < chunk ? remain : chunk;
+                esp_codec_dev_write(spk_codec_dev, (void *)(info.data + offset), send);
+                offset += send;
             }
-            size_t remain = info.data_len - offset;
-            size_t send = remain < chunk ? remain : chunk;
-            esp_codec_dev_write(spk_codec_dev, (void *)(info.data + offset), send);
-            offset += send;
+            vTaskDelay(pdMS_TO_TICKS(10));
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
 
-    if (spk_codec_dev) {
-        esp_codec_dev_close(spk_codec_dev);
+        if (spk_codec_dev) {
+            esp_codec_dev_close(spk_codec_dev);
+        }
+        portENTER_CRITICAL(&alert_sound_mux);
+        again = alert_sound_running;
+        alert_sound_alive = again;
+        portEXIT_CRITICAL(&alert_sound_mux);
     }
     vTaskDelete(NULL);
 }
 
 static void alert_sound_start(void)
 {
-    if (alert_sound_running) {
-        return;
-    }
     alert_audio_init();
     if (!spk_codec_dev) {
         return;
     }
+    portENTER_CRITICAL(&alert_sound_mux);
+    bool create = !alert_sound_alive;
     alert_sound_running = true;
-    xTaskCreate(alert_sound_task_fn, "alert_sound", 4096, NULL, 5, &alert_sound_task);
+    alert_sound_alive = true;
+    portEXIT_CRITICAL(&alert_sound_mux);
+    if (create && xTaskCreate(alert_sound_task_fn, "alert_sound", 4096, NULL, 5, NULL) != pdPASS) {
+        portENTER_CRITICAL(&alert_sound_mux);
+        alert_sound_running = false;
+        alert_sound_alive = false;
+        portEXIT_CRITICAL(&alert_sound_mux);
+    }
 }
 
 static void alert_sound_stop(void)
 {
     alert_sound_running = false;
-    alert_sound_task = NULL;
 }
 
 static void on_pick_clicked(lv_event_t *e)
@@ -180,6 +197,11 @@ static void on_skip_clicked(lv_event_t *e)
     }
 }
 
+void alert_screen_silence(void)
+{
+    alert_sound_stop();
+}
+
 void alert_screen_set_on_pick(void (*cb)(void))
 {
     on_pick_cb = cb;
@@ -259,7 +281,7 @@ void alert_screen_init(void)
     lv_obj_center(skip_lbl);
 }
 
-void alert_screen_show(const char *name, const char *time_str, const char *dose)
+void alert_screen_update(const char *name, const char *time_str, const char *dose)
 {
     if (!alert_screen) {
         alert_screen_init();
@@ -275,7 +297,11 @@ void alert_screen_show(const char *name, const char *time_str, const char *dose)
     } else {
         lv_label_set_text(alert_dose_label, "Dose: --");
     }
+}
 
+void alert_screen_show(const char *name, const char *time_str, const char *dose)
+{
+    alert_screen_update(name, time_str, dose);
     alert_sound_start();
 
     lv_scr_load_anim(alert_screen, LV_SCR_LOAD_ANIM_FADE_ON, 200, 0, false);
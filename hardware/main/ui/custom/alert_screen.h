@@ -7,6 +7,10 @@ extern "C" {
 
 void alert_screen_init(void);
 void alert_screen_show(const char *name, const char *time_str, const char *dose);
+/* Changes the labels only: no sound, no screen change */
+void alert_screen_update(const char *name, const char *time_str, const char *dose);
+/* Stops the alert sound; the screen stays */
+void alert_screen_silence(void);
 void alert_screen_set_on_pick(void (*cb)(void));
 void alert_screen_set_on_skip(void (*cb)(void));
 
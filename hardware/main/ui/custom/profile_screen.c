@@ -4,19 +4,19 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
 #include "esp_wifi.h"
 #include "esp_err.h"
-#include "nvs.h"
 #include "cJSON.h"
 #include "lvgl.h"
+#include "backend_conn.h"
+#include "nvs_store.h"
 
 static lv_obj_t *profile_screen = NULL;
 static lv_obj_t *profile_title = NULL;
 static lv_obj_t *back_btn = NULL;
 static void (*back_cb)(void) = NULL;
 static char *profile_cache_json = NULL;
+static char profile_cache_etag[64] = {0};
 
 static lv_obj_t *profile_body = NULL;
 static lv_obj_t *status_label = NULL;
@@ -35,43 +35,38 @@ static lv_obj_t *profile_create_section_header(lv_obj_t *parent, const char *tit
 
 static void profile_cache_load_nvs(void)
 {
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READONLY, &handle) != ESP_OK) {   
-        return;
-    }
     size_t len = 0;
-    if (nvs_get_str(handle, "profile_json", NULL, &len) == ESP_OK && len > 1) {
+    if (nvs_store_get_str("profile_json", NULL, &len) && len > 1) {
         char *buf = (char *)malloc(len);
-        if (buf && nvs_get_str(handle, "profile_json", buf, &len) == ESP_OK) {
+        if (buf && nvs_store_get_str("profile_json", buf, &len)) {
             if (profile_cache_json) {
                 free(profile_cache_json);
             }
             profile_cache_json = buf;
+            size_t etag_len = sizeof(profile_cache_etag);
+            if (!nvs_store_get_str("profile_etag", profile_cache_etag, &etag_len)) {
+                profile_cache_etag[0] = '\0';
+            }
         } else if (buf) {
             free(buf);
         }
     }
-    nvs_close(handle);
 }
 
-static void profile_cache_save_nvs(const char *json)
+static void profile_cache_save_nvs(const char *json, const char *etag)
 {
     if (!json) {
         return;
     }
-    nvs_handle_t handle;
-    if (nvs_open("doseright", NVS_READWRITE, &handle) != ESP_OK) {
-        return;
+    if (nvs_store_set_str("profile_json", json, NVS_STORE_DELAY_MS) && etag && etag[0] != '\0') {
+        nvs_store_set_str("profile_etag", etag, NVS_STORE_DELAY_MS);
+    } else {
+        nvs_store_erase("profile_etag", NVS_STORE_DELAY_MS);
     }
-    nvs_set_str(handle, "profile_json", json);
-    nvs_commit(handle);
-    nvs_close(handle);
 }
 
-// NOTE: Fill these locally before building; do not commit real values.
-static const char *PROFILE_BASE_URL = "";
+// NOTE: Fill this locally before building; do not commit real values.
 static const char *PROFILE_DEVICE_ID = "";
-static const char *PROFILE_SECRET = "";
 
 static void profile_render_json(const char *json)
 {
@@ -245,6 +240,54 @@ static void on_back_clicked(lv_event_t *e)
     }
 }
 
+static bool profile_fetch_to_cache(int *out_status, esp_err_t *out_err)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/api/device/%s/profile", PROFILE_DEVICE_ID);
+
+    const backend_conn_request_t req = {
+        .method = HTTP_METHOD_GET,
+        .path = path,
+        .if_none_match = profile_cache_json ? profile_cache_etag : NULL,
+    };
+    backend_conn_response_t resp;
+    esp_err_t err = backend_conn_perform(&req, &resp);
+    *out_err = err;
+    *out_status = resp.status;
+    if (err == ESP_OK && resp.status == 304) {
+        backend_conn_release();
+        return true;
+    }
+    if (err != ESP_OK || resp.status != 200 || resp.body_len == 0) {
+        backend_conn_release();
+        return false;
+    }
+
+    cJSON *root = cJSON_Parse(resp.body);
+    char etag[sizeof(profile_cache_etag)];
+    snprintf(etag, sizeof(etag), "%s", resp.etag);
+    backend_conn_release();
+    if (!root) {
+        *out_err = ESP_ERR_INVALID_RESPONSE;
+        return false;
+    }
+
+    char *printed = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!printed) {
+        *out_err = ESP_ERR_NO_MEM;
+        return false;
+    }
+
+    if (profile_cache_json) {
+        free(profile_cache_json);
+    }
+    profile_cache_json = printed;
+    snprintf(profile_cache_etag, sizeof(profile_cache_etag), "%s", etag);
+    profile_cache_save_nvs(profile_cache_json, profile_cache_etag);
+    return true;
+}
+
 static void profile_fetch_and_render(void)
 {
     if (!profile_body) {
@@ -263,106 +306,28 @@ static void profile_fetch_and_render(void)
         return;
     }
 
-    char url[256];
-    snprintf(url, sizeof(url), "%s/api/device/%s/profile", PROFILE_BASE_URL, PROFILE_DEVICE_ID);
-
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        profile_show_status("Request failed");
-        return;
-    }
-
-    char auth_header[128];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", PROFILE_SECRET);
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_http_client_set_header(client, "Authorization", auth_header);
-
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        esp_http_client_cleanup(client);
-        {
-            char line[96];
-            snprintf(line, sizeof(line), "Server unreachable\n%s", esp_err_to_name(err));
-            profile_show_status(line);
-        }
-        return;
-    }
-
-    int content_length = esp_http_client_fetch_headers(client);
-    int buffer_size = (content_length > 0) ? (content_length + 1) : 4096;
-    char *buffer = (char *)malloc(buffer_size);
-    if (!buffer) {
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
-        profile_show_status("Out of memory");
-        return;
-    }
-
-    int total_read = 0;
-    int read_len = 0;
-    while ((read_len = esp_http_client_read(client, buffer + total_read, buffer_size - 1 - total_read)) > 0) {
-        total_read += read_len;
-        if (total_read >= buffer_size - 1) {
-            buffer_size *= 2;
-            char *new_buf = (char *)realloc(buffer, buffer_size);
-            if (!new_buf) {
-                free(buffer);
-                esp_http_client_close(client);
-                esp_http_client_cleanup(client);
-                profile_show_status("Out of memory");
-                return;
-            }
-            buffer = new_buf;
-        }
-    }
-    buffer[total_read] = '\0';
-
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
-
-    if (status != 200 || total_read == 0) {
-        free(buffer);
-        if (status > 0) {
-            char line[64];
-            snprintf(line, sizeof(line), "HTTP %d", status);
-            {
-                char msg[96];
-                snprintf(msg, sizeof(msg), "Request failed\n%s", line);
-                profile_show_status(msg);
-            }
-        } else {
-            profile_show_status("No data received");
-        }
+    int status = 0;
+    esp_err_t err = ESP_OK;
+    if (profile_fetch_to_cache(&status, &err)) {
+        profile_render_json(profile_cache_json);
         return;
     }
 
-    cJSON *root = cJSON_Parse(buffer);
-    free(buffer);
-    if (!root) {
+    if (err == ESP_ERR_INVALID_RESPONSE) {
         profile_show_status("Invalid response");
-        return;
-    }
-
-    {
-        char *printed = cJSON_PrintUnformatted(root);
-        if (printed) {
-            if (profile_cache_json) {
-                free(profile_cache_json);
-            }
-            profile_cache_json = printed;
-            profile_cache_save_nvs(profile_cache_json);
-        }
+    } else if (err == ESP_ERR_NO_MEM) {
+        profile_show_status("Out of memory");
+    } else if (err != ESP_OK) {
+        char line[96];
+        snprintf(line, sizeof(line), "Server unreachable\n%s", esp_err_to_name(err));
+        profile_show_status(line);
+    } else if (status > 0) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "Request failed\nHTTP %d", status);
+        profile_show_status(msg);
+    } else {
+        profile_show_status("No data received");
     }
-
-    cJSON_Delete(root);
-    profile_render_json(profile_cache_json);
 }
 
 void profile_screen_set_on_back(void (*cb)(void))
@@ -465,83 +430,36 @@ void profile_screen_preload(void)
     if (!profile_wifi_connected()) {
         return;
     }
-
-    char url[256];
-    snprintf(url, sizeof(url), "%s/api/device/%s/profile", PROFILE_BASE_URL, PROFILE_DEVICE_ID);
-
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        return;
-    }
-
-    char auth_header[128];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", PROFILE_SECRET);
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_http_client_set_header(client, "Authorization", auth_header);
-
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        esp_http_client_cleanup(client);
-        return;
-    }
-
-    int content_length = esp_http_client_fetch_headers(client);
-    int buffer_size = (content_length > 0) ? (content_length + 1) : 4096;
-    char *buffer = (char *)malloc(buffer_size);
-    if (!buffer) {
-        esp_http_client_close(client);
-        esp_http_client_cleanup(client);
-        return;
-    }
-
-    int total_read = 0;
-    int read_len = 0;
-    while ((read_len = esp_http_client_read(client, buffer + total_read, buffer_size - 1 - total_read)) > 0) {
-        total_read += read_len;
-        if (total_read >= buffer_size - 1) {
-            buffer_size *= 2;
-            char *new_buf = (char *)realloc(buffer, buffer_size);
-            if (!new_buf) {
-                free(buffer);
-                esp_http_client_close(client);
-                esp_http_client_cleanup(client);
-                return;
-            }
-            buffer = new_buf;
-        }
+    if (!profile_cache_json) {
+        profile_cache_load_nvs();
     }
-    buffer[total_read] = '\0';
 
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+    int status = 0;
+    esp_err_t err = ESP_OK;
+    profile_fetch_to_cache(&status, &err);
+}
 
-    if (status != 200 || total_read == 0) {
-        free(buffer);
-        return;
+const char *profile_screen_cached_etag(void)
+{
+    if (!profile_cache_json) {
+        profile_cache_load_nvs();
     }
+    return profile_cache_json ? profile_cache_etag : NULL;
+}
 
-    cJSON *root = cJSON_Parse(buffer);
-    free(buffer);
-    if (!root) {
+void profile_screen_apply_synced(const char *json, const char *etag)
+{
+    if (!json) {
         return;
     }
-
-    char *printed = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    if (!printed) {
+    char *copy = strdup(json);
+    if (!copy) {
         return;
     }
-
     if (profile_cache_json) {
         free(profile_cache_json);
     }
-    profile_cache_json = printed;
-    profile_cache_save_nvs(profile_cache_json);
+    profile_cache_json = copy;
+    snprintf(profile_cache_etag, sizeof(profile_cache_etag), "%s", etag ? etag : "");
+    profile_cache_save_nvs(profile_cache_json, profile_cache_etag);
 }
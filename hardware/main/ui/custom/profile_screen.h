@@ -9,6 +9,8 @@ void profile_screen_init(void);
 void profile_screen_show(void);
 void profile_screen_set_on_back(void (*cb)(void));
 void profile_screen_preload(void);
+const char *profile_screen_cached_etag(void);
+void profile_screen_apply_synced(const char *json, const char *etag);
 
 #ifdef __cplusplus
 } /*extern "C"*/
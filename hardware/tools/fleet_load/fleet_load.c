@@ -0,0 +1,888 @@
+/*
+ * Fleet load generator: N virtual DoseRight devices against one backend.
+ *
+ * Each virtual device follows the firmware's net_service schedule from
+ * main.c: a fetch cycle every BACKEND_FETCH_INTERVAL_MS (POST /sync, or
+ * upcoming + taken + missed + plans + profile on a backend without /sync), a time
+ * sync every DR_RTC_INTERVAL_MIN_MS doubling up to DR_RTC_INTERVAL_MAX_MS
+ * (a clock that holds, see dr_rtc_sync()), a heartbeat every
+ * HEARTBEAT_INTERVAL_MS (pushed back after each good sync), and an outbox
+ * drain (POST /doses/batch, up to 8 events, or per-dose PATCHes on a
+ * backend without it) whenever it takes or skips a dose. Failed jobs back
+ * off like net_service: 2 s, 4 s, ... capped at 5 min and at the job's
+ * period. ETags are kept per device, and dose ids
+ * come from the lists each device actually received.
+ *
+ * Devices are split over worker threads; each thread runs its devices'
+ * jobs in deadline order with blocking requests through doseright_core's
+ * linux HTTP port. Devices boot evenly over --ramp-s.
+ */
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device_sync.h"
+#include "dr_hal.h"
+#include "dr_hal_linux.h"
+#include "dr_time.h"
+#include "med_json.h"
+
+/* main.c */
+#define BACKEND_FETCH_INTERVAL_MS 60000
+#define HEARTBEAT_INTERVAL_MS 60000
+/* net_service.c */
+#define NET_RETRY_MIN_MS 2000
+#define NET_RETRY_MAX_MS (5 * 60 * 1000)
+/* dose_outbox */
+#define OUTBOX_BATCH 8
+
+#define FLEET_OUTBOX_MAX 16
+#define FLEET_DOSE_IDS 4
+#define FLEET_HIST_BUCKETS 480
+#define FLEET_HIST_BASE 1.04
+#define FLEET_SLEEP_SLICE_MS 100
+#define FLEET_BODY_MAX 2048
+
+typedef enum {
+    ROUTE_SYNC,
+    ROUTE_UPCOMING,
+    ROUTE_TAKEN,
+    ROUTE_MISSED,
+    ROUTE_PLANS,
+    ROUTE_PROFILE,
+    ROUTE_TIME,
+    ROUTE_HEARTBEAT,
+    ROUTE_DOSES_BATCH,
+    ROUTE_DOSE_PATCH,
+    ROUTE_COUNT,
+} fleet_route_t;
+
+static const char *const route_names[ROUTE_COUNT] = {
+    "sync", "upcoming", "taken", "missed", "plans", "profile", "time", "heartbeat", "doses_batch",
+    "dose_patch",
+};
+
+typedef enum {
+    JOB_FETCH,
+    JOB_TIME,
+    JOB_HEARTBEAT,
+    JOB_OUTBOX,
+    JOB_DOSE,               /* the patient taking or skipping a dose, not a request */
+    JOB_COUNT,
+} fleet_job_t;
+
+typedef enum {
+    PROTOCOL_AUTO,
+    PROTOCOL_SYNC,
+    PROTOCOL_LEGACY,
+} fleet_protocol_t;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t transport_errors;      /* no response, timeout, cut-off body */
+    uint64_t server_errors;         /* 5xx */
+    uint64_t client_errors;         /* 4xx */
+    uint64_t not_modified;
+    uint64_t bytes;
+    uint32_t hist[FLEET_HIST_BUCKETS];
+    double max_ms;
+} route_stats_t;
+
+typedef struct {
+    char id[40];
+    int64_t due_ms[JOB_COUNT];      /* INT64_MAX: not scheduled */
+    int64_t backoff_ms[JOB_COUNT];
+    bool sync_supported;
+    bool batch_supported;
+    bool plans_supported;
+    char etags[DEVICE_SYNC_LIST_COUNT][64];
+    char plans_etag[64];
+    char profile_etag[64];
+    char dose_ids[FLEET_DOSE_IDS][40];
+    int dose_count;
+    struct {
+        char id[24];
+        char dose_id[40];
+        bool taken;
+        int64_t at_ms;
+    } outbox[FLEET_OUTBOX_MAX];
+    int outbox_count;
+    uint32_t event_seq;
+    int64_t boot_ms;
+    int64_t time_interval_ms;
+} fleet_device_t;
+
+typedef struct {
+    int index;
+    pthread_t thread;
+    fleet_device_t *devices;
+    int device_count;
+    uint32_t rng;
+    route_stats_t routes[ROUTE_COUNT];
+    /* parsers are per thread: requests on a thread never overlap */
+    device_sync_parser_t sync_parser;
+    device_sync_result_t sync_result;
+    med_json_ingest_t ingest;
+    med_cache_t cache;
+    uint64_t body_bytes;
+} fleet_worker_t;
+
+typedef struct {
+    const char *url;
+    const char *secret;
+    const char *id_format;
+    int devices;
+    int threads;
+    double ramp_s;
+    double duration_s;
+    double time_scale;
+    double jitter;
+    double doses_per_hour;
+    fleet_protocol_t protocol;
+    bool json;
+    double report_s;
+} fleet_opts_t;
+
+static fleet_opts_t opts = {
+    .url = "http://127.0.0.1:3900",
+    .secret = "mock-secret",
+    .id_format = "fleet-%05d",
+    .devices = 100,
+    .threads = 16,
+    .ramp_s = 30,
+    .duration_s = 120,
+    .time_scale = 1,
+    .jitter = 0.1,
+    .doses_per_hour = 2,
+    .protocol = PROTOCOL_AUTO,
+    .report_s = 10,
+};
+
+static atomic_bool fleet_stop;
+static atomic_uint_fast64_t fleet_requests;
+static atomic_uint_fast64_t fleet_failures;
+static atomic_int fleet_booted;
+static int64_t fleet_start_ms;
+
+static int64_t now_ms(void)
+{
+    return dr_hal_now_us() / 1000;
+}
+
+static void sleep_ms(int64_t ms)
+{
+    struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+/* xorshift32 per worker */
+static double rand_unit(fleet_worker_t *w)
+{
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 17;
+    w->rng ^= w->rng << 5;
+    return (double)w->rng / 4294967296.0;
+}
+
+/* A device-side interval, compressed by --time-scale and spread by --jitter */
+static int64_t scaled(fleet_worker_t *w, int64_t ms)
+{
+    double factor = 1.0 + opts.jitter * (2.0 * rand_unit(w) - 1.0);
+    return (int64_t)((double)ms * factor / opts.time_scale);
+}
+
+static void schedule(fleet_worker_t *w, fleet_device_t *d, fleet_job_t job, int64_t period_ms)
+{
+    d->due_ms[job] = now_ms() + scaled(w, period_ms);
+    d->backoff_ms[job] = 0;
+}
+
+static void retry(fleet_worker_t *w, fleet_device_t *d, fleet_job_t job, int64_t period_ms)
+{
+    int64_t backoff = d->backoff_ms[job] ? d->backoff_ms[job] * 2 : NET_RETRY_MIN_MS;
+    if (backoff > NET_RETRY_MAX_MS) {
+        backoff = NET_RETRY_MAX_MS;
+    }
+    if (period_ms > 0 && backoff > period_ms) {
+        backoff = period_ms;
+    }
+    d->due_ms[job] = now_ms() + scaled(w, backoff);
+    d->backoff_ms[job] = backoff;
+}
+
+/* The device's clock holds, so each applied time doubles its resync interval */
+static void time_synced(fleet_worker_t *w, fleet_device_t *d)
+{
+    schedule(w, d, JOB_TIME, d->time_interval_ms);
+    d->time_interval_ms *= 2;
+    if (d->time_interval_ms > DR_RTC_INTERVAL_MAX_MS) {
+        d->time_interval_ms = DR_RTC_INTERVAL_MAX_MS;
+    }
+}
+
+/* Poisson arrivals at --doses-per-hour (device time) */
+static void schedule_dose(fleet_worker_t *w, fleet_device_t *d)
+{
+    if (opts.doses_per_hour <= 0) {
+        d->due_ms[JOB_DOSE] = INT64_MAX;
+        return;
+    }
+    double mean_ms = 3600000.0 / opts.doses_per_hour;
+    double wait_ms = -log(1.0 - rand_unit(w)) * mean_ms;
+    d->due_ms[JOB_DOSE] = now_ms() + (int64_t)(wait_ms / opts.time_scale);
+}
+
+/* ---------- requests ---------- */
+
+static void hist_add(route_stats_t *r, double ms)
+{
+    double us = ms * 1000.0;
+    int i = us < 1.0 ? 0 : (int)(log(us) / log(FLEET_HIST_BASE));
+    if (i >= FLEET_HIST_BUCKETS) {
+        i = FLEET_HIST_BUCKETS - 1;
+    }
+    r->hist[i]++;
+    if (ms > r->max_ms) {
+        r->max_ms = ms;
+    }
+}
+
+static bool count_body(const char *data, size_t len, void *ctx)
+{
+    (void)data;
+    ((fleet_worker_t *)ctx)->body_bytes += len;
+    return true;
+}
+
+static bool ingest_body(const char *data, size_t len, void *ctx)
+{
+    fleet_worker_t *w = ctx;
+    w->body_bytes += len;
+    return med_json_feed(&w->ingest, data, len);
+}
+
+static bool sync_body(const char *data, size_t len, void *ctx)
+{
+    fleet_worker_t *w = ctx;
+    w->body_bytes += len;
+    return device_sync_feed(&w->sync_parser, data, len);
+}
+
+static int perform(fleet_worker_t *w, fleet_route_t route, dr_hal_http_request_t *req,
+                   char *etag, size_t etag_size)
+{
+    route_stats_t *r = &w->routes[route];
+    w->body_bytes = 0;
+    int64_t start = dr_hal_now_us();
+    int status = dr_hal_http_perform(req, etag, etag_size);
+    hist_add(r, (double)(dr_hal_now_us() - start) / 1000.0);
+    r->requests++;
+    r->bytes += w->body_bytes;
+    atomic_fetch_add(&fleet_requests, 1);
+    if (status < 0) {
+        r->transport_errors++;
+    } else if (status >= 500) {
+        r->server_errors++;
+    } else if (status == 304) {
+        r->not_modified++;
+    } else if (status >= 400) {
+        r->client_errors++;
+    }
+    if (status < 0 || status >= 500) {
+        atomic_fetch_add(&fleet_failures, 1);
+    }
+    return status;
+}
+
+static void keep_dose_ids(fleet_device_t *d, const med_cache_t *cache)
+{
+    d->dose_count = 0;
+    for (size_t i = 0; i < cache->count && d->dose_count < FLEET_DOSE_IDS; ++i) {
+        if (cache->items[i].dose_id[0]) {
+            snprintf(d->dose_ids[d->dose_count++], sizeof(d->dose_ids[0]), "%s",
+                     cache->items[i].dose_id);
+        }
+    }
+}
+
+static int heartbeat_fields(const fleet_device_t *d, char *out, size_t size)
+{
+    int64_t uptime_s = (int64_t)((double)(now_ms() - d->boot_ms) * opts.time_scale / 1000.0);
+    return snprintf(out, size,
+                    "\"batteryLevel\":87,\"wifiStrength\":-58,\"status\":\"online\","
+                    "\"firmwareVersion\":\"1.2.3\",\"uptimeSeconds\":%lld,\"storageFreeKb\":812,"
+                    "\"temperatureC\":36.8,\"lastError\":null,\"slotCount\":5,"
+                    "\"pendingDoseEvents\":%d",
+                    (long long)uptime_s, d->outbox_count);
+}
+
+/* JSON-escape an ETag (it carries quotes) */
+static void json_etag(char *dst, size_t size, const char *etag)
+{
+    size_t n = 0;
+    for (; *etag && n + 2 < size; ++etag) {
+        if (*etag == '"' || *etag == '\\') {
+            dst[n++] = '\\';
+        }
+        dst[n++] = *etag;
+    }
+    dst[n] = '\0';
+}
+
+/* Returns 1 on success, 0 if the backend has no /sync, -1 on error */
+static int job_sync(fleet_worker_t *w, fleet_device_t *d)
+{
+    static const char *const names[DEVICE_SYNC_LIST_COUNT] = {"upcoming", "taken", "missed"};
+    char body[FLEET_BODY_MAX];
+    int len = snprintf(body, sizeof(body), "{\"deviceId\":\"%s\",\"heartbeat\":{", d->id);
+    len += heartbeat_fields(d, body + len, sizeof(body) - (size_t)len);
+    len += snprintf(body + len, sizeof(body) - (size_t)len, "},\"etags\":{");
+    const char *sep = "";
+    for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+        if (d->etags[i][0]) {
+            len += snprintf(body + len, sizeof(body) - (size_t)len, "%s\"%s\":\"%s\"", sep,
+                            names[i], d->etags[i]);
+            sep = ",";
+        }
+    }
+    if (d->plans_etag[0]) {
+        len += snprintf(body + len, sizeof(body) - (size_t)len, "%s\"plans\":\"%s\"", sep, d->plans_etag);
+        sep = ",";
+    }
+    if (d->profile_etag[0]) {
+        len += snprintf(body + len, sizeof(body) - (size_t)len, "%s\"profile\":\"%s\"", sep,
+                        d->profile_etag);
+    }
+    snprintf(body + len, sizeof(body) - (size_t)len, "}}");
+
+    device_sync_begin(&w->sync_parser, &w->sync_result);
+    dr_hal_http_request_t req = {
+        .post = true,
+        .path = "/api/hardware/sync",
+        .body = body,
+        .on_body = sync_body,
+        .ctx = w,
+    };
+    int status = perform(w, ROUTE_SYNC, &req, NULL, 0);
+    int result = -1;
+    if (status == 404) {
+        result = 0;
+    } else if (status == 200 && device_sync_end(&w->sync_parser)) {
+        for (int i = 0; i < DEVICE_SYNC_LIST_COUNT; ++i) {
+            device_sync_list_result_t *list = &w->sync_result.lists[i];
+            if (list->state == DEVICE_SYNC_UPDATED) {
+                json_etag(d->etags[i], sizeof(d->etags[i]), list->cache.etag);
+                if (i == DEVICE_SYNC_UPCOMING) {
+                    keep_dose_ids(d, &list->cache);
+                }
+            }
+        }
+        if (w->sync_result.plans_state == DEVICE_SYNC_UPDATED) {
+            json_etag(d->plans_etag, sizeof(d->plans_etag), w->sync_result.plans.etag);
+        }
+        if (w->sync_result.profile_state == DEVICE_SYNC_UPDATED) {
+            json_etag(d->profile_etag, sizeof(d->profile_etag), w->sync_result.profile_etag);
+        }
+        /* The sync carries the time; the standalone time job only runs when it was due */
+        if (w->sync_result.have_time && d->due_ms[JOB_TIME] <= now_ms()) {
+            time_synced(w, d);
+        }
+        result = 1;
+    }
+    device_sync_result_free(&w->sync_result);
+    return result;
+}
+
+/* GET with If-None-Match; the stored tag is JSON-escaped for /sync, so unescape it */
+static int job_get_list(fleet_worker_t *w, fleet_device_t *d, fleet_route_t route, char *stored)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/api/hardware/%s?deviceId=%s", route_names[route], d->id);
+    char if_none_match[64];
+    size_t n = 0;
+    for (const char *p = stored; *p && n + 1 < sizeof(if_none_match); ++p) {
+        if (*p != '\\') {
+            if_none_match[n++] = *p;
+        }
+    }
+    if_none_match[n] = '\0';
+
+    bool ingest = route == ROUTE_UPCOMING;
+    if (ingest) {
+        med_json_begin(&w->ingest, &w->cache);
+    }
+    dr_hal_http_request_t req = {
+        .path = path,
+        .if_none_match = if_none_match[0] ? if_none_match : NULL,
+        .on_body = ingest ? ingest_body : count_body,
+        .ctx = w,
+    };
+    char etag[64];
+    int status = perform(w, route, &req, etag, sizeof(etag));
+    if (status == 200) {
+        json_etag(stored, sizeof(d->etags[0]), etag);
+        if (ingest && med_json_end(&w->ingest)) {
+            keep_dose_ids(d, &w->cache);
+        }
+    }
+    return status;
+}
+
+static bool job_fetch_legacy(fleet_worker_t *w, fleet_device_t *d)
+{
+    int status = job_get_list(w, d, ROUTE_UPCOMING, d->etags[DEVICE_SYNC_UPCOMING]);
+    job_get_list(w, d, ROUTE_TAKEN, d->etags[DEVICE_SYNC_TAKEN]);
+    job_get_list(w, d, ROUTE_MISSED, d->etags[DEVICE_SYNC_MISSED]);
+    /* Like the firmware, a backend without /plans is not asked again */
+    if (d->plans_supported && job_get_list(w, d, ROUTE_PLANS, d->plans_etag) == 404) {
+        d->plans_supported = false;
+    }
+    job_get_list(w, d, ROUTE_PROFILE, d->profile_etag);
+    return status == 200 || status == 304;
+}
+
+static bool job_heartbeat(fleet_worker_t *w, fleet_device_t *d)
+{
+    char body[FLEET_BODY_MAX];
+    int len = snprintf(body, sizeof(body), "{\"deviceId\":\"%s\",", d->id);
+    len += heartbeat_fields(d, body + len, sizeof(body) - (size_t)len);
+    snprintf(body + len, sizeof(body) - (size_t)len, "}");
+    dr_hal_http_request_t req = {
+        .post = true,
+        .path = "/api/hardware/heartbeat",
+        .body = body,
+        .on_body = count_body,
+        .ctx = w,
+    };
+    int status = perform(w, ROUTE_HEARTBEAT, &req, NULL, 0);
+    return status >= 200 && status < 300;
+}
+
+static bool job_time(fleet_worker_t *w)
+{
+    dr_hal_http_request_t req = {
+        .path = "/api/hardware/time",
+        .on_body = count_body,
+        .ctx = w,
+    };
+    return perform(w, ROUTE_TIME, &req, NULL, 0) == 200;
+}
+
+static int send_dose_patch(fleet_worker_t *w, fleet_device_t *d, int i)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/api/hardware/doses/%s/%s", d->outbox[i].dose_id,
+             d->outbox[i].taken ? "mark-taken" : "mark-skipped");
+    char body[64];
+    snprintf(body, sizeof(body), "{\"deviceId\":\"%s\"}", d->id);
+    dr_hal_http_request_t req = {
+        .patch = true,
+        .path = path,
+        .body = body,
+        .on_body = count_body,
+        .ctx = w,
+    };
+    return perform(w, ROUTE_DOSE_PATCH, &req, NULL, 0);
+}
+
+/* dose_outbox_send(): returns how many events were delivered or dropped, -1 to retry */
+static int send_outbox(fleet_worker_t *w, fleet_device_t *d, int count)
+{
+    if (d->batch_supported) {
+        char body[FLEET_BODY_MAX];
+        int len = snprintf(body, sizeof(body), "{\"deviceId\":\"%s\",\"events\":[", d->id);
+        int64_t now = now_ms();
+        for (int i = 0; i < count; ++i) {
+            int64_t age_ms = (int64_t)((double)(now - d->outbox[i].at_ms) * opts.time_scale);
+            len += snprintf(body + len, sizeof(body) - (size_t)len,
+                            "%s{\"id\":\"%s\",\"doseId\":\"%s\",\"action\":\"%s\",\"ageMs\":%lld}",
+                            i ? "," : "", d->outbox[i].id, d->outbox[i].dose_id,
+                            d->outbox[i].taken ? "taken" : "skipped", (long long)age_ms);
+        }
+        snprintf(body + len, sizeof(body) - (size_t)len, "]}");
+        dr_hal_http_request_t req = {
+            .post = true,
+            .path = "/api/hardware/doses/batch",
+            .body = body,
+            .on_body = count_body,
+            .ctx = w,
+        };
+        int status = perform(w, ROUTE_DOSES_BATCH, &req, NULL, 0);
+        /* A 400 batch is dropped: retrying it would block the outbox forever */
+        if ((status >= 200 && status < 300) || status == 400) {
+            return count;
+        }
+        if (status != 404 || opts.protocol == PROTOCOL_SYNC) {
+            return -1;
+        }
+        d->batch_supported = false;
+    }
+    for (int i = 0; i < count; ++i) {
+        int status = send_dose_patch(w, d, i);
+        if (!((status >= 200 && status < 300) || status == 404)) {
+            return i > 0 ? i : -1;
+        }
+    }
+    return count;
+}
+
+/* Returns false to retry later */
+static bool job_outbox(fleet_worker_t *w, fleet_device_t *d)
+{
+    int count = d->outbox_count < OUTBOX_BATCH ? d->outbox_count : OUTBOX_BATCH;
+    int sent = send_outbox(w, d, count);
+    if (sent <= 0) {
+        return false;
+    }
+    memmove(&d->outbox[0], &d->outbox[sent],
+            (size_t)(d->outbox_count - sent) * sizeof(d->outbox[0]));
+    d->outbox_count -= sent;
+    return true;
+}
+
+static void job_dose(fleet_worker_t *w, fleet_device_t *d)
+{
+    schedule_dose(w, d);
+    if (d->dose_count == 0 || d->outbox_count >= FLEET_OUTBOX_MAX) {
+        return;
+    }
+    /* The alert for the first upcoming dose; nine in ten are taken */
+    int n = d->outbox_count++;
+    snprintf(d->outbox[n].id, sizeof(d->outbox[n].id), "%08x-%u", (unsigned)(d->boot_ms & 0xffffffff),
+             ++d->event_seq);
+    snprintf(d->outbox[n].dose_id, sizeof(d->outbox[n].dose_id), "%s", d->dose_ids[0]);
+    d->outbox[n].taken = rand_unit(w) < 0.9;
+    d->outbox[n].at_ms = now_ms();
+    memmove(&d->dose_ids[0], &d->dose_ids[1], (size_t)(d->dose_count - 1) * sizeof(d->dose_ids[0]));
+    d->dose_count--;
+    d->due_ms[JOB_OUTBOX] = now_ms();
+    d->backoff_ms[JOB_OUTBOX] = 0;
+}
+
+static void run_job(fleet_worker_t *w, fleet_device_t *d, fleet_job_t job)
+{
+    switch (job) {
+        case JOB_FETCH: {
+            int synced = d->sync_supported ? job_sync(w, d) : 0;
+            if (synced == 0 && opts.protocol == PROTOCOL_SYNC) {
+                synced = -1;
+            } else if (synced == 0) {
+                d->sync_supported = false;
+                synced = job_fetch_legacy(w, d) ? 1 : -1;
+            } else if (synced > 0) {
+                schedule(w, d, JOB_HEARTBEAT, HEARTBEAT_INTERVAL_MS);
+            }
+            if (synced > 0) {
+                schedule(w, d, JOB_FETCH, BACKEND_FETCH_INTERVAL_MS);
+            } else {
+                retry(w, d, JOB_FETCH, BACKEND_FETCH_INTERVAL_MS);
+            }
+            break;
+        }
+        case JOB_TIME:
+            if (job_time(w)) {
+                time_synced(w, d);
+            } else {
+                retry(w, d, JOB_TIME, DR_RTC_INTERVAL_MAX_MS);
+            }
+            break;
+        case JOB_HEARTBEAT:
+            if (job_heartbeat(w, d)) {
+                schedule(w, d, JOB_HEARTBEAT, HEARTBEAT_INTERVAL_MS);
+            } else {
+                retry(w, d, JOB_HEARTBEAT, HEARTBEAT_INTERVAL_MS);
+            }
+            break;
+        case JOB_OUTBOX:
+            if (!job_outbox(w, d)) {
+                retry(w, d, JOB_OUTBOX, 0);
+            } else if (d->outbox_count > 0) {
+                d->due_ms[JOB_OUTBOX] = now_ms();
+            } else {
+                d->due_ms[JOB_OUTBOX] = INT64_MAX;
+            }
+            break;
+        case JOB_DOSE:
+            job_dose(w, d);
+            break;
+        default:
+            break;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    fleet_worker_t *w = arg;
+    int64_t end_ms = fleet_start_ms + (int64_t)(opts.duration_s * 1000.0);
+    while (!atomic_load(&fleet_stop)) {
+        fleet_device_t *next = NULL;
+        fleet_job_t next_job = JOB_FETCH;
+        int64_t next_due = INT64_MAX;
+        for (int i = 0; i < w->device_count; ++i) {
+            fleet_device_t *d = &w->devices[i];
+            for (int j = 0; j < JOB_COUNT; ++j) {
+                if (d->due_ms[j] < next_due) {
+                    next_due = d->due_ms[j];
+                    next = d;
+                    next_job = (fleet_job_t)j;
+                }
+            }
+        }
+        int64_t now = now_ms();
+        if (now >= end_ms) {
+            break;
+        }
+        if (!next || next_due > now) {
+            int64_t wait = next ? next_due - now : FLEET_SLEEP_SLICE_MS;
+            sleep_ms(wait < FLEET_SLEEP_SLICE_MS ? wait : FLEET_SLEEP_SLICE_MS);
+            continue;
+        }
+        if (next->boot_ms == 0) {
+            /* Boot: every periodic job is due at once, as after WiFi connects */
+            next->boot_ms = now;
+            atomic_fetch_add(&fleet_booted, 1);
+            schedule_dose(w, next);
+        }
+        run_job(w, next, next_job);
+    }
+    return NULL;
+}
+
+/* ---------- reporting ---------- */
+
+static double hist_percentile(const uint32_t *hist, uint64_t total, double p)
+{
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)ceil(p * (double)total);
+    uint64_t seen = 0;
+    for (int i = 0; i < FLEET_HIST_BUCKETS; ++i) {
+        seen += hist[i];
+        if (seen >= rank && hist[i] > 0) {
+            return pow(FLEET_HIST_BASE, i + 1) / 1000.0;     /* bucket upper bound */
+        }
+    }
+    return pow(FLEET_HIST_BASE, FLEET_HIST_BUCKETS) / 1000.0;
+}
+
+static void report(fleet_worker_t *workers, double elapsed_s)
+{
+    if (!opts.json) {
+        printf("\n%-12s %9s %8s %7s %7s %7s %6s %9s %9s %9s %9s\n", "route", "requests", "req/s",
+               "err%", "5xx", "xport", "304", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    }
+    for (int r = 0; r < ROUTE_COUNT; ++r) {
+        route_stats_t sum = {0};
+        for (int t = 0; t < opts.threads; ++t) {
+            const route_stats_t *s = &workers[t].routes[r];
+            sum.requests += s->requests;
+            sum.transport_errors += s->transport_errors;
+            sum.server_errors += s->server_errors;
+            sum.client_errors += s->client_errors;
+            sum.not_modified += s->not_modified;
+            sum.bytes += s->bytes;
+            for (int i = 0; i < FLEET_HIST_BUCKETS; ++i) {
+                sum.hist[i] += s->hist[i];
+            }
+            if (s->max_ms > sum.max_ms) {
+                sum.max_ms = s->max_ms;
+            }
+        }
+        if (sum.requests == 0) {
+            continue;
+        }
+        uint64_t errors = sum.transport_errors + sum.server_errors + sum.client_errors;
+        double err_pct = 100.0 * (double)errors / (double)sum.requests;
+        /* Bucket bounds overshoot by up to 4%; the exact max caps them */
+        double p50 = fmin(hist_percentile(sum.hist, sum.requests, 0.50), sum.max_ms);
+        double p90 = fmin(hist_percentile(sum.hist, sum.requests, 0.90), sum.max_ms);
+        double p99 = fmin(hist_percentile(sum.hist, sum.requests, 0.99), sum.max_ms);
+        if (opts.json) {
+            printf("{\"route\":\"%s\",\"requests\":%llu,\"rps\":%.2f,\"error_rate\":%.4f,"
+                   "\"server_errors\":%llu,\"client_errors\":%llu,\"transport_errors\":%llu,"
+                   "\"not_modified\":%llu,\"bytes\":%llu,\"p50_ms\":%.2f,\"p90_ms\":%.2f,"
+                   "\"p99_ms\":%.2f,\"max_ms\":%.2f}\n",
+                   route_names[r], (unsigned long long)sum.requests, (double)sum.requests / elapsed_s,
+                   err_pct / 100.0, (unsigned long long)sum.server_errors,
+                   (unsigned long long)sum.client_errors, (unsigned long long)sum.transport_errors,
+                   (unsigned long long)sum.not_modified, (unsigned long long)sum.bytes, p50, p90, p99,
+                   sum.max_ms);
+        } else {
+            printf("%-12s %9llu %8.1f %6.2f%% %7llu %7llu %6llu %9.1f %9.1f %9.1f %9.1f\n",
+                   route_names[r], (unsigned long long)sum.requests, (double)sum.requests / elapsed_s,
+                   err_pct, (unsigned long long)sum.server_errors,
+                   (unsigned long long)sum.transport_errors, (unsigned long long)sum.not_modified,
+                   p50, p90, p99, sum.max_ms);
+        }
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --url URL            backend base URL (http://127.0.0.1:3900)\n"
+            "  --secret KEY         device API key (mock-secret)\n"
+            "  --devices N          virtual devices (100)\n"
+            "  --threads N          worker threads (16)\n"
+            "  --ramp-s S           boot all devices over S seconds (30)\n"
+            "  --duration-s S       total run time (120)\n"
+            "  --time-scale X       run device intervals X times faster (1)\n"
+            "  --jitter F           +-F relative jitter on every interval (0.1)\n"
+            "  --doses-per-hour X   dose events per device per hour, device time (2)\n"
+            "  --protocol P         auto | sync | legacy (auto: /sync and /doses/batch,\n"
+            "                       per-endpoint requests after a 404)\n"
+            "  --id-format FMT      printf format for device ids (fleet-%%05d)\n"
+            "  --report-s S         progress line interval on stderr, 0 for none (10)\n"
+            "  --json               one JSON object per route\n",
+            argv0);
+}
+
+static bool parse_args(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--json") == 0) {
+            opts.json = true;
+            continue;
+        }
+        if (!v) {
+            return false;
+        }
+        ++i;
+        if (strcmp(a, "--url") == 0) {
+            opts.url = v;
+        } else if (strcmp(a, "--secret") == 0) {
+            opts.secret = v;
+        } else if (strcmp(a, "--devices") == 0) {
+            opts.devices = atoi(v);
+        } else if (strcmp(a, "--threads") == 0) {
+            opts.threads = atoi(v);
+        } else if (strcmp(a, "--ramp-s") == 0) {
+            opts.ramp_s = atof(v);
+        } else if (strcmp(a, "--duration-s") == 0) {
+            opts.duration_s = atof(v);
+        } else if (strcmp(a, "--time-scale") == 0) {
+            opts.time_scale = atof(v);
+        } else if (strcmp(a, "--jitter") == 0) {
+            opts.jitter = atof(v);
+        } else if (strcmp(a, "--doses-per-hour") == 0) {
+            opts.doses_per_hour = atof(v);
+        } else if (strcmp(a, "--id-format") == 0) {
+            opts.id_format = v;
+        } else if (strcmp(a, "--report-s") == 0) {
+            opts.report_s = atof(v);
+        } else if (strcmp(a, "--protocol") == 0) {
+            if (strcmp(v, "auto") == 0) {
+                opts.protocol = PROTOCOL_AUTO;
+            } else if (strcmp(v, "sync") == 0) {
+                opts.protocol = PROTOCOL_SYNC;
+            } else if (strcmp(v, "legacy") == 0) {
+                opts.protocol = PROTOCOL_LEGACY;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return opts.devices > 0 && opts.threads > 0 && opts.time_scale > 0 && opts.duration_s > 0 &&
+           opts.jitter >= 0 && opts.jitter < 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (!parse_args(argc, argv)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (opts.threads > opts.devices) {
+        opts.threads = opts.devices;
+    }
+    dr_hal_linux_set_backend(opts.url, opts.secret);
+
+    fleet_device_t *devices = calloc((size_t)opts.devices, sizeof(fleet_device_t));
+    fleet_worker_t *workers = calloc((size_t)opts.threads, sizeof(fleet_worker_t));
+    if (!devices || !workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    fleet_start_ms = now_ms();
+    /* Devices are dealt round-robin so every thread ramps at the same pace */
+    int per_thread = (opts.devices + opts.threads - 1) / opts.threads;
+    fleet_device_t *slot = devices;
+    for (int t = 0; t < opts.threads; ++t) {
+        fleet_worker_t *w = &workers[t];
+        w->index = t;
+        w->rng = 0x9e3779b9u * (uint32_t)(t + 1);
+        w->devices = slot;
+        w->device_count = 0;
+        for (int k = t; k < opts.devices && w->device_count < per_thread; k += opts.threads) {
+            fleet_device_t *d = &w->devices[w->device_count++];
+            snprintf(d->id, sizeof(d->id), opts.id_format, k);
+            d->sync_supported = opts.protocol != PROTOCOL_LEGACY;
+            d->batch_supported = opts.protocol != PROTOCOL_LEGACY;
+            d->plans_supported = true;
+            int64_t boot = fleet_start_ms + (int64_t)(opts.ramp_s * 1000.0 * k / opts.devices);
+            for (int j = 0; j < JOB_COUNT; ++j) {
+                d->due_ms[j] = INT64_MAX;
+            }
+            d->due_ms[JOB_FETCH] = boot;
+            d->due_ms[JOB_TIME] = boot;
+            d->time_interval_ms = DR_RTC_INTERVAL_MIN_MS;
+            d->due_ms[JOB_HEARTBEAT] = boot;
+        }
+        slot += w->device_count;
+    }
+
+    for (int t = 0; t < opts.threads; ++t) {
+        if (pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]) != 0) {
+            fprintf(stderr, "pthread_create failed at thread %d\n", t);
+            atomic_store(&fleet_stop, true);
+            opts.threads = t;
+            break;
+        }
+    }
+
+    int64_t end_ms = fleet_start_ms + (int64_t)(opts.duration_s * 1000.0);
+    int64_t last_report = fleet_start_ms;
+    uint64_t last_requests = 0;
+    while (now_ms() < end_ms && !atomic_load(&fleet_stop)) {
+        sleep_ms(FLEET_SLEEP_SLICE_MS);
+        int64_t now = now_ms();
+        if (opts.report_s > 0 && now - last_report >= (int64_t)(opts.report_s * 1000.0)) {
+            uint64_t requests = atomic_load(&fleet_requests);
+            fprintf(stderr, "[%6.1fs] devices %d/%d  %.1f req/s  failures %llu\n",
+                    (double)(now - fleet_start_ms) / 1000.0, atomic_load(&fleet_booted), opts.devices,
+                    (double)(requests - last_requests) * 1000.0 / (double)(now - last_report),
+                    (unsigned long long)atomic_load(&fleet_failures));
+            last_report = now;
+            last_requests = requests;
+        }
+    }
+    atomic_store(&fleet_stop, true);
+    for (int t = 0; t < opts.threads; ++t) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    double elapsed_s = (double)(now_ms() - fleet_start_ms) / 1000.0;
+    if (!opts.json) {
+        printf("%d devices on %d threads for %.1f s (time scale %.1f)\n", opts.devices, opts.threads,
+               elapsed_s, opts.time_scale);
+    }
+    report(workers, elapsed_s);
+    free(workers);
+    free(devices);
+    return 0;
+}
@@ -0,0 +1,755 @@
+#!/usr/bin/env node
+/**
+ * Mock of the /api/hardware/* contract (software/backend/src/routes/hardware.routes.ts)
+ * with scriptable latency, bandwidth and faults. No dependencies: Node >= 20 only.
+ *
+ *   node mock_backend.mjs [--port 3900] [--host 127.0.0.1] [--secret KEY]
+ *                         [--scenario file.json] [--seed N] [--quiet]
+ *
+ * The scenario (see scenarios/) can be replaced or patched while running:
+ *
+ *   GET  /__mock/scenario         current scenario
+ *   PUT  /__mock/scenario         replace it (JSON body)
+ *   PATCH /__mock/scenario        deep-merge the body into it
+ *   GET  /__mock/stats            request, status and fault counters
+ *   POST /__mock/reset            clear counters and device data
+ *
+ * Control routes need no auth. Everything else needs "Authorization: Bearer <secret>".
+ */
+import { createServer } from 'node:http';
+import { createHash } from 'node:crypto';
+import { readFileSync } from 'node:fs';
+
+const DEFAULT_SCENARIO = {
+  // Added to the first request on each connection; stands in for a TLS handshake
+  connectMs: 0,
+  // Applied to every route unless routes.<name> overrides a field
+  defaults: {
+    latencyMs: 0, // before the response headers
+    jitterMs: 0, // uniform 0..jitterMs added to latencyMs
+    bytesPerSec: 0, // body throttle, 0 for unlimited
+    errorRate: 0, // probability of errorStatus instead of the real response
+    errorStatus: 500,
+    stallRate: 0, // probability of an extra stallMs before the headers
+    stallMs: 5000,
+    truncateRate: 0, // probability of closing the socket halfway through the body
+    resetRate: 0, // probability of closing the socket without any response
+  },
+  // Keyed by route name: time, upcoming, taken, missed, plans, profile,
+  // heartbeat, sync, markTaken, markSkipped, dosesBatch
+  routes: {},
+  // Every `every` requests, the next `length` requests fail with `status`
+  errorBurst: { every: 0, length: 0, status: 503 },
+  data: {
+    upcoming: 6,
+    taken: 20,
+    missed: 3,
+    plans: 4, // daily plans, two times each
+    nameLength: 16, // medicine names are lengthened up to this many characters
+    changeEvery: 0, // regenerate the upcoming list every N list requests, 0 never
+    timezone: null, // IANA name for localTime12/24, null for the host zone
+  },
+};
+
+const ROUTES = [
+  ['GET', /^\/api\/hardware\/time$/, 'time'],
+  ['GET', /^\/api\/hardware\/upcoming$/, 'upcoming'],
+  ['GET', /^\/api\/hardware\/taken$/, 'taken'],
+  ['GET', /^\/api\/hardware\/missed$/, 'missed'],
+  ['GET', /^\/api\/hardware\/plans$/, 'plans'],
+  ['GET', /^\/api\/hardware\/profile$/, 'profile'],
+  ['POST', /^\/api\/hardware\/heartbeat$/, 'heartbeat'],
+  ['POST', /^\/api\/hardware\/sync$/, 'sync'],
+  ['POST', /^\/api\/hardware\/doses\/batch$/, 'dosesBatch'],
+  ['PATCH', /^\/api\/hardware\/doses\/([^/]+)\/mark-taken$/, 'markTaken'],
+  ['PATCH', /^\/api\/hardware\/doses\/([^/]+)\/mark-skipped$/, 'markSkipped'],
+];
+
+const MEDICINES = [
+  'Metformin',
+  'Lisinopril',
+  'Atorvastatin',
+  'Levothyroxine',
+  'Amlodipine',
+  'Omeprazole',
+  'Metoprolol',
+  'Gabapentin',
+  'Sertraline',
+  'Vitamin D3',
+];
+
+/* ---------- options ---------- */
+
+const args = process.argv.slice(2);
+const option = (name, fallback) => {
+  const i = args.indexOf(`--${name}`);
+  return i >= 0 && i + 1 < args.length ? args[i + 1] : fallback;
+};
+const port = Number(option('port', 3900));
+const host = option('host', '127.0.0.1');
+const secret = option('secret', process.env.DEVICE_API_KEY || 'mock-secret');
+const quiet = args.includes('--quiet');
+let seed = Number(option('seed', 1));
+
+const isObject = (v) => v !== null && typeof v === 'object' && !Array.isArray(v);
+const merge = (base, patch) => {
+  const out = { ...base };
+  for (const [key, value] of Object.entries(patch ?? {})) {
+    out[key] = isObject(value) && isObject(base[key]) ? merge(base[key], value) : value;
+  }
+  return out;
+};
+
+let scenario = DEFAULT_SCENARIO;
+const scenarioFile = option('scenario', null);
+if (scenarioFile) {
+  scenario = merge(DEFAULT_SCENARIO, JSON.parse(readFileSync(scenarioFile, 'utf8')));
+}
+
+/* ---------- deterministic randomness ---------- */
+
+// mulberry32: the same --seed gives the same fault sequence for the same request order
+const random = () => {
+  seed = (seed + 0x6d2b79f5) | 0;
+  let t = seed;
+  t = Math.imul(t ^ (t >>> 15), t | 1);
+  t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+  return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+};
+const chance = (rate) => rate > 0 && random() < rate;
+const hexId = () =>
+  Array.from({ length: 24 }, () => Math.floor(random() * 16).toString(16)).join('');
+
+/* ---------- device data ---------- */
+
+const devices = new Map();
+let stats;
+
+const resetStats = () => {
+  stats = {
+    startedAt: new Date().toISOString(),
+    connections: 0,
+    requests: 0,
+    byRoute: {},
+    byStatus: {},
+    faults: { error: 0, burst: 0, stall: 0, truncate: 0, reset: 0 },
+    bytesSent: 0,
+  };
+};
+resetStats();
+
+const formatTime = (date, hour12) =>
+  date.toLocaleTimeString('en-US', {
+    hour: '2-digit',
+    minute: '2-digit',
+    hour12,
+    timeZone: scenario.data.timezone ?? undefined,
+  });
+
+const medicineName = (i) => {
+  const base = MEDICINES[i % MEDICINES.length];
+  const length = Math.max(base.length, scenario.data.nameLength);
+  return `${base} Extended Release Oral Tablet`.slice(0, length);
+};
+
+const makeDose = (i, scheduledAt, status) => ({
+  doseId: hexId(),
+  medicineName: medicineName(i),
+  dosage: `1 x ${250 * ((i % 4) + 1)}mg`,
+  scheduledTime: formatTime(scheduledAt, false),
+  status,
+  slot: (i % 5) + 1,
+});
+
+const makeUpcoming = () => {
+  const now = Date.now();
+  return Array.from({ length: scenario.data.upcoming }, (_, i) =>
+    makeDose(i, new Date(now + (i + 1) * 45 * 60 * 1000), 'pending')
+  );
+};
+
+const makeHistory = (count, status) => {
+  const now = Date.now();
+  return Array.from({ length: count }, (_, i) => {
+    const scheduledAt = new Date(now - (i + 1) * 3 * 60 * 60 * 1000);
+    const { doseId: _doseId, ...item } = makeDose(i, scheduledAt, status);
+    return item;
+  });
+};
+
+const makePlans = () => {
+  const startMs = Date.now() - 24 * 60 * 60 * 1000;
+  return Array.from({ length: scenario.data.plans }, (_, i) => ({
+    planId: hexId(),
+    medicineName: medicineName(i),
+    dosage: `1 x ${250 * ((i % 4) + 1)}mg`,
+    slot: (i % 5) + 1,
+    times: [8 * 60 + i * 30, 20 * 60 + i * 30],
+    daysOfWeek: [1, 2, 3, 4, 5, 6, 7],
+    startMs,
+    endMs: null,
+  }));
+};
+
+const deviceState = (deviceId) => {
+  let device = devices.get(deviceId);
+  if (!device) {
+    device = {
+      upcoming: makeUpcoming(),
+      taken: makeHistory(scenario.data.taken, 'taken'),
+      missed: makeHistory(scenario.data.missed, 'missed'),
+      plans: makePlans(),
+      listRequests: 0,
+      heartbeat: null,
+      eventIds: new Set(),
+    };
+    devices.set(deviceId, device);
+  }
+  return device;
+};
+
+const touchLists = (device) => {
+  device.listRequests += 1;
+  const every = scenario.data.changeEvery;
+  if (every > 0 && device.listRequests % every === 0) {
+    device.upcoming = makeUpcoming();
+  }
+};
+
+// Dose ids the device makes up for plan occurrences: "<planId>@<epoch minute>"
+const LOCAL_DOSE_ID = /^([0-9a-f]{24})@(\d{1,10})$/;
+
+const planOccurrence = (device, doseId) => {
+  const match = LOCAL_DOSE_ID.exec(doseId);
+  const plan = match && device.plans.find((p) => p.planId === match[1]);
+  if (!plan) {
+    return null;
+  }
+  return {
+    medicineName: plan.medicineName,
+    dosage: plan.dosage,
+    scheduledTime: formatTime(new Date(Number(match[2]) * 60 * 1000), false),
+    slot: plan.slot,
+  };
+};
+
+const applyAction = (device, doseId, action) => {
+  const status = action === 'taken' ? 'taken' : 'missed';
+  const i = device.upcoming.findIndex((dose) => dose.doseId === doseId);
+  if (i < 0) {
+    const occurrence = planOccurrence(device, doseId);
+    if (occurrence) {
+      device[status].unshift({ ...occurrence, status });
+    }
+    return occurrence !== null;
+  }
+  const [dose] = device.upcoming.splice(i, 1);
+  const { doseId: _doseId, ...item } = dose;
+  device[status].unshift({ ...item, status });
+  return true;
+};
+
+/* ---------- contract ---------- */
+
+const computeEtag = (body, weak = false) => {
+  const hash = createHash('sha1').update(body).digest('base64url');
+  return weak ? `W/"${hash}"` : `"${hash}"`;
+};
+
+const etagMatches = (ifNoneMatch, etag) => {
+  if (!ifNoneMatch) {
+    return false;
+  }
+  const opaque = etag.replace(/^W\//, '');
+  return ifNoneMatch
+    .split(',')
+    .map((tag) => tag.trim())
+    .some((tag) => tag === '*' || tag.replace(/^W\//, '') === opaque);
+};
+
+// POSIX TZ string, as software/backend/src/utils/posixTz.ts derives it
+const posixTzCache = new Map();
+const posixTimeZone = (timeZone, now) => {
+  const zone = timeZone || Intl.DateTimeFormat().resolvedOptions().timeZone || 'UTC';
+  const year = now.getUTCFullYear();
+  const key = `${zone}:${year}`;
+  if (posixTzCache.has(key)) {
+    return posixTzCache.get(key);
+  }
+  const parts = new Intl.DateTimeFormat('en-US', {
+    timeZone: zone,
+    hourCycle: 'h23',
+    year: 'numeric',
+    month: 'numeric',
+    day: 'numeric',
+    hour: 'numeric',
+    minute: 'numeric',
+    second: 'numeric',
+  });
+  const offsetAt = (ms) => {
+    const get = (type) =>
+      Number(parts.formatToParts(new Date(ms)).find((p) => p.type === type)?.value ?? 0);
+    const local = Date.UTC(get('year'), get('month') - 1, get('day'), get('hour'), get('minute'));
+    return Math.round((local - Math.floor(ms / 60000) * 60000) / 60000);
+  };
+  const pad2 = (v) => String(v).padStart(2, '0');
+  const offset = (east) => {
+    const abs = Math.abs(east);
+    const hours = `${east > 0 ? '-' : ''}${Math.floor(abs / 60)}`;
+    return abs % 60 ? `${hours}:${pad2(abs % 60)}` : hours;
+  };
+  const name = (ms, east) => {
+    const short = new Intl.DateTimeFormat('en-US', { timeZone: zone, timeZoneName: 'short' })
+      .formatToParts(new Date(ms))
+      .find((p) => p.type === 'timeZoneName')?.value;
+    if (short && /^[A-Za-z]{3,6}$/.test(short)) {
+      return short;
+    }
+    const abs = Math.abs(east);
+    const sign = east < 0 ? '-' : '+';
+    return `<${sign}${pad2(Math.floor(abs / 60))}${abs % 60 ? pad2(abs % 60) : ''}>`;
+  };
+  const rule = ({ at, from }) => {
+    const local = new Date(at + from * 60000);
+    const day = local.getUTCDate();
+    const monthEnd = Date.UTC(local.getUTCFullYear(), local.getUTCMonth() + 1, 0);
+    const days = new Date(monthEnd).getUTCDate();
+    const week = day + 7 > days ? 5 : Math.ceil(day / 7);
+    const minutes = local.getUTCMinutes();
+    const time = `${local.getUTCHours()}${minutes ? `:${pad2(minutes)}` : ''}`;
+    return `M${local.getUTCMonth() + 1}.${week}.${local.getUTCDay()}/${time}`;
+  };
+
+  const transitions = [];
+  const end = Date.UTC(year + 1, 0, 1);
+  let current = offsetAt(Date.UTC(year, 0, 1));
+  for (let at = Date.UTC(year, 0, 1); at < end; at += 86400000) {
+    const next = Math.min(at + 86400000, end);
+    const nextOffset = offsetAt(next);
+    if (nextOffset !== current) {
+      let [lo, hi] = [at, next];
+      while (hi - lo > 60000) {
+        const mid = lo + Math.floor((hi - lo) / 120000) * 60000;
+        [lo, hi] = offsetAt(mid) === current ? [mid, hi] : [lo, mid];
+      }
+      transitions.push({ at: hi, from: current, to: nextOffset });
+      current = nextOffset;
+    }
+  }
+  let tz;
+  if (transitions.length === 2) {
+    const dst = Math.max(transitions[0].to, transitions[1].to);
+    const std = Math.min(transitions[0].to, transitions[1].to);
+    const start = transitions.find((t) => t.to === dst);
+    const stop = transitions.find((t) => t.to === std);
+    tz =
+      `${name(stop.at, std)}${offset(std)}${name(start.at, dst)}` +
+      `${dst - std === 60 ? '' : offset(dst)},${rule(start)},${rule(stop)}`;
+  } else {
+    const east = offsetAt(now.getTime());
+    tz = `${name(now.getTime(), east)}${offset(east)}`;
+  }
+  posixTzCache.set(key, tz);
+  return tz;
+};
+
+const timePayload = (deviceId) => {
+  const now = new Date();
+  return {
+    deviceId: deviceId || null,
+    iso: now.toISOString(),
+    epochMs: now.getTime(),
+    epochSeconds: Math.floor(now.getTime() / 1000),
+    processingMs: 0, // answered on arrival; injected latency counts as network time
+    tzOffsetMinutes: now.getTimezoneOffset(),
+    timezone: scenario.data.timezone,
+    posixTz: posixTimeZone(scenario.data.timezone, now),
+    localTime24: formatTime(now, false),
+    localTime12: formatTime(now, true),
+    mocked: true,
+  };
+};
+
+const profilePayload = (deviceId, device) => ({
+  success: true,
+  device: {
+    deviceId,
+    name: 'Mock Device',
+    status: 'online',
+    batteryLevel: device.heartbeat?.batteryLevel ?? null,
+    wifiStrength: device.heartbeat?.wifiStrength ?? null,
+    lastHeartbeat: device.heartbeat ? new Date().toISOString() : null,
+  },
+  patient: {
+    displayName: 'Mock Patient',
+    timezone: scenario.data.timezone || 'Asia/Kolkata',
+    medicalProfile: { illnesses: ['Hypertension'], allergies: ['Penicillin'], notes: '' },
+  },
+  support: { caretaker: { name: 'Mock Caretaker', relationship: 'Daughter' } },
+  meta: { syncedAt: new Date().toISOString(), apiVersion: '1.0' },
+});
+
+const profileValidator = (payload) => ({
+  deviceId: payload.device.deviceId,
+  name: payload.device.name,
+  patient: payload.patient,
+  support: payload.support,
+  apiVersion: payload.meta.apiVersion,
+});
+
+const syncSection = (known, etag, key, value) =>
+  typeof known === 'string' && etagMatches(known, etag)
+    ? { etag, notModified: true }
+    : { etag, [key]: value };
+
+const json = (status, payload, headers = {}) => ({
+  status,
+  headers: { 'Content-Type': 'application/json', ...headers },
+  body: payload === undefined ? '' : JSON.stringify(payload),
+});
+
+const withEtag = (req, payload, validator) => {
+  const body = JSON.stringify(payload);
+  const etag =
+    validator === undefined
+      ? computeEtag(body)
+      : computeEtag(JSON.stringify(validator), true);
+  const headers = { ETag: etag, 'Cache-Control': 'no-cache' };
+  if (etagMatches(req.headers['if-none-match'], etag)) {
+    return { status: 304, headers, body: '' };
+  }
+  return {
+    status: 200,
+    headers: { 'Content-Type': 'application/json', ...headers },
+    body,
+  };
+};
+
+// Binary med list, as software/backend/src/utils/medListWire.ts encodes it
+const MED_LIST_WIRE_TYPE = 'application/vnd.doseright.medlist';
+
+const encodeMedList = (items) => {
+  const strings = [];
+  const index = new Map();
+  const intern = (value) => {
+    const text = typeof value === 'string' ? value : '';
+    if (!index.has(text)) {
+      index.set(text, strings.length);
+      let bytes = Buffer.from(text, 'utf8');
+      for (let t = text; bytes.length > 255; ) {
+        t = t.slice(0, -1);
+        bytes = Buffer.from(t, 'utf8');
+      }
+      strings.push(bytes);
+    }
+    return index.get(text);
+  };
+  const records = items.map((item) => {
+    const doseId = typeof item.doseId === 'string' ? item.doseId : '';
+    const objectId = /^[0-9a-f]{24}$/i.test(doseId);
+    const idRef = doseId && !objectId ? intern(doseId) : 0;
+    const refs = [intern(item.medicineName), intern(item.dosage), intern(item.status)];
+    const idBytes = objectId ? 12 : doseId ? 1 : 0;
+    const record = Buffer.alloc(1 + idBytes + 6);
+    record[0] = objectId ? 1 : doseId ? 2 : 0;
+    if (objectId) {
+      Buffer.from(doseId, 'hex').copy(record, 1);
+    } else if (doseId) {
+      record[1] = idRef;
+    }
+    const time = /^(\d{1,2}):(\d{2})$/.exec(item.scheduledTime ?? '');
+    const minute = time ? (Number(time[1]) % 24) * 60 + Number(time[2]) : 0xffff;
+    let off = record.writeUInt16LE(minute, 1 + idBytes);
+    for (const ref of refs) {
+      record[off++] = ref;
+    }
+    record.writeInt8(Math.max(-128, Math.min(127, Math.trunc(item.slot ?? 0) || 0)), off);
+    return record;
+  });
+  if (strings.length > 255 || items.length > 0xffff) {
+    return null;
+  }
+  const header = Buffer.from([0x44, 0x52, 0x4d, 0x01, 0, 0, strings.length]);
+  header.writeUInt16LE(items.length, 4);
+  const table = strings.flatMap((bytes) => [Buffer.from([bytes.length]), bytes]);
+  return Buffer.concat([header, ...table, ...records]);
+};
+
+// Same negotiation as express's req.accepts(['application/json', MED_LIST_WIRE_TYPE])
+const prefersWire = (req) => {
+  let best = { json: -1, wire: -1 };
+  for (const part of (req.headers.accept ?? '').split(',')) {
+    const [type, ...params] = part.trim().split(';');
+    const q = params.map((p) => /^\s*q=([\d.]+)/.exec(p)).find(Boolean);
+    const quality = q ? Number(q[1]) : 1;
+    if (type === MED_LIST_WIRE_TYPE) {
+      best = { ...best, wire: Math.max(best.wire, quality) };
+    } else if (['application/json', 'application/*', '*/*'].includes(type)) {
+      best = { ...best, json: Math.max(best.json, quality) };
+    }
+  }
+  return best.wire > 0 && best.wire > best.json;
+};
+
+const medList = (req, data) => {
+  const body = prefersWire(req) ? encodeMedList(data) : null;
+  if (!body) {
+    return withEtag(req, { data });
+  }
+  // Weak tag of the { data } JSON, so it matches the JSON and /sync tags
+  const etag = computeEtag(JSON.stringify({ data }), true);
+  const headers = { ETag: etag, 'Cache-Control': 'no-cache', Vary: 'Accept' };
+  if (etagMatches(req.headers['if-none-match'], etag)) {
+    return { status: 304, headers, body: '' };
+  }
+  return {
+    status: 200,
+    headers: { 'Content-Type': MED_LIST_WIRE_TYPE, ...headers },
+    body,
+  };
+};
+
+const handle = (name, req, url, body, match) => {
+  const deviceId = url.searchParams.get('deviceId') ?? body?.deviceId;
+  if (name === 'time') {
+    return json(200, timePayload(deviceId));
+  }
+  if (!deviceId || typeof deviceId !== 'string') {
+    return json(400, { message: 'deviceId is required' });
+  }
+  const device = deviceState(deviceId);
+
+  switch (name) {
+    case 'upcoming':
+      touchLists(device);
+      return medList(req, device.upcoming);
+    case 'taken':
+    case 'missed':
+      return medList(req, device[name]);
+    case 'plans':
+      return withEtag(req, { data: device.plans });
+    case 'profile': {
+      const payload = profilePayload(deviceId, device);
+      return withEtag(req, payload, profileValidator(payload));
+    }
+    case 'heartbeat':
+      device.heartbeat = body;
+      return json(200, { ok: true });
+    case 'markTaken':
+    case 'markSkipped':
+      return applyAction(device, match[1], name === 'markTaken' ? 'taken' : 'skipped')
+        ? json(200, { ok: true })
+        : json(404, { message: 'Dose not found' });
+    case 'dosesBatch': {
+      const events = body?.events;
+      if (!Array.isArray(events) || events.length === 0 || events.length > 50) {
+        return json(400, { message: 'events must hold 1 to 50 entries' });
+      }
+      const results = events.map((event) => {
+        const { id, doseId, action } = event ?? {};
+        if (typeof id !== 'string' || typeof doseId !== 'string') {
+          return { id, result: 'invalid' };
+        }
+        if (action !== 'taken' && action !== 'skipped') {
+          return { id, result: 'invalid' };
+        }
+        if (device.eventIds.has(id)) {
+          return { id, result: 'duplicate' };
+        }
+        device.eventIds.add(id);
+        const applied = applyAction(device, doseId, action);
+        return { id, result: applied ? 'applied' : 'not_found' };
+      });
+      return json(200, { results });
+    }
+    case 'sync': {
+      if (isObject(body?.heartbeat)) {
+        device.heartbeat = body.heartbeat;
+      }
+      touchLists(device);
+      const known = isObject(body?.etags) ? body.etags : {};
+      const list = (key) => {
+        const etag = computeEtag(JSON.stringify({ data: device[key] }));
+        return syncSection(known[key], etag, 'data', device[key]);
+      };
+      const profile = profilePayload(deviceId, device);
+      return json(200, {
+        time: timePayload(deviceId),
+        upcoming: list('upcoming'),
+        taken: list('taken'),
+        missed: list('missed'),
+        plans: list('plans'),
+        profile: syncSection(
+          known.profile,
+          computeEtag(JSON.stringify(profileValidator(profile)), true),
+          'body',
+          profile
+        ),
+      });
+    }
+    default:
+      return json(404, { message: 'Route not found' });
+  }
+};
+
+/* ---------- fault injection ---------- */
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+const inBurst = () => {
+  const { every, length } = scenario.errorBurst;
+  return (
+    every > 0 && length > 0 && stats.requests >= every && stats.requests % every < length
+  );
+};
+
+const writeThrottled = async (res, data, bytesPerSec, stopAt) => {
+  const end = stopAt ?? data.length;
+  const chunk = bytesPerSec > 0 ? Math.max(1, Math.ceil(bytesPerSec / 20)) : end;
+  for (let off = 0; off < end && !res.destroyed; off += chunk) {
+    res.write(data.subarray(off, Math.min(off + chunk, end)));
+    stats.bytesSent += Math.min(chunk, end - off);
+    if (bytesPerSec > 0) {
+      await sleep(50);
+    }
+  }
+};
+
+const respond = async (req, res, name, result) => {
+  const profile = merge(scenario.defaults, scenario.routes[name]);
+  const count = (key) => {
+    stats.faults[key] += 1;
+  };
+
+  if (chance(profile.resetRate)) {
+    count('reset');
+    req.socket.destroy();
+    return;
+  }
+  if (chance(profile.stallRate)) {
+    count('stall');
+    await sleep(profile.stallMs);
+  }
+  await sleep(profile.latencyMs + random() * profile.jitterMs);
+
+  if (inBurst()) {
+    count('burst');
+    result = json(scenario.errorBurst.status, { message: 'Injected error burst' });
+  } else if (chance(profile.errorRate)) {
+    count('error');
+    result = json(profile.errorStatus, { message: 'Injected error' });
+  }
+
+  const body = Buffer.from(result.body);
+  stats.byStatus[result.status] = (stats.byStatus[result.status] ?? 0) + 1;
+  res.writeHead(result.status, { ...result.headers, 'Content-Length': body.length });
+  if (body.length > 0 && chance(profile.truncateRate)) {
+    count('truncate');
+    const cut = Math.floor(body.length * random());
+    await writeThrottled(res, body, profile.bytesPerSec, cut);
+    req.socket.destroy();
+    return;
+  }
+  await writeThrottled(res, body, profile.bytesPerSec);
+  res.end();
+};
+
+/* ---------- server ---------- */
+
+const readBody = (req) =>
+  new Promise((resolve, reject) => {
+    const chunks = [];
+    req.on('data', (chunk) => chunks.push(chunk));
+    req.on('end', () => resolve(Buffer.concat(chunks).toString('utf8')));
+    req.on('error', reject);
+  });
+
+const control = async (req, res, path) => {
+  const send = (status, payload) => {
+    res.writeHead(status, { 'Content-Type': 'application/json' });
+    res.end(JSON.stringify(payload, null, 2));
+  };
+  if (path === '/__mock/stats' && req.method === 'GET') {
+    return send(200, { ...stats, devices: devices.size });
+  }
+  if (path === '/__mock/reset' && req.method === 'POST') {
+    resetStats();
+    devices.clear();
+    return send(200, { ok: true });
+  }
+  if (path === '/__mock/scenario') {
+    if (req.method === 'GET') {
+      return send(200, scenario);
+    }
+    if (req.method === 'PUT' || req.method === 'PATCH') {
+      try {
+        const patch = JSON.parse(await readBody(req));
+        scenario = merge(req.method === 'PUT' ? DEFAULT_SCENARIO : scenario, patch);
+        return send(200, scenario);
+      } catch (error) {
+        return send(400, { message: `Invalid scenario: ${error.message}` });
+      }
+    }
+  }
+  return send(404, { message: 'Not found' });
+};
+
+const handshaken = new WeakSet();
+
+const server = createServer(async (req, res) => {
+  const url = new URL(req.url, `http://${req.headers.host ?? 'localhost'}`);
+  if (url.pathname.startsWith('/__mock/')) {
+    return control(req, res, url.pathname);
+  }
+
+  const route = ROUTES.map(([method, pattern, name]) => ({
+    method,
+    name,
+    match: url.pathname.match(pattern),
+  })).find((r) => r.match && r.method === req.method);
+
+  stats.requests += 1;
+  const name = route?.name ?? 'unknown';
+  stats.byRoute[name] = (stats.byRoute[name] ?? 0) + 1;
+  const started = Date.now();
+
+  let result;
+  const raw = await readBody(req);
+  // The http parser reads the socket itself, so charge the handshake to its first request
+  if (!handshaken.has(req.socket)) {
+    handshaken.add(req.socket);
+    await sleep(scenario.connectMs);
+  }
+  if (req.headers.authorization !== `Bearer ${secret}`) {
+    result = json(401, { message: 'Unauthorized device' });
+  } else if (!route) {
+    result = json(404, { message: 'Route not found' });
+  } else {
+    let body = {};
+    try {
+      body = raw ? JSON.parse(raw) : {};
+    } catch {
+      result = json(400, { message: 'Invalid JSON' });
+    }
+    result ??= handle(name, req, url, body, route.match);
+  }
+
+  try {
+    await respond(req, res, name, result);
+  } catch {
+    req.socket.destroy();
+  }
+  if (!quiet) {
+    const ms = Date.now() - started;
+    console.log(`${req.method} ${url.pathname} ${result.status} ${ms}ms`);
+  }
+});
+
+server.keepAliveTimeout = 30000;
+server.on('connection', () => {
+  stats.connections += 1;
+});
+
+server.listen(port, host, () => {
+  console.log(`mock backend on http://${host}:${port}/api/hardware (secret "${secret}")`);
+});
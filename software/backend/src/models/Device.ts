@@ -1,5 +1,13 @@
 import { Schema, model, Document, Types } from 'mongoose';
 
+// Firmware dispense latency histogram; bucket i counts latencies below 128 << i ms
+export interface IDispenseLatencyHist {
+  count: number;
+  sumMs: number;
+  maxMs: number;
+  buckets: number[];
+}
+
 export interface IDevice extends Document {
   deviceId: string;
   patientId: Types.ObjectId;
@@ -16,10 +24,29 @@ export interface IDevice extends Document {
   storageFreeKb?: number;
   temperatureC?: number;
   lastError?: string | null;
+  pendingDoseEvents?: number;
+  dispenseLatency?: {
+    alertToOpen?: IDispenseLatencyHist;
+    openToDrop?: IDispenseLatencyHist;
+    dropToReport?: IDispenseLatencyHist;
+    pickToOpen?: IDispenseLatencyHist;
+  };
+  // Carousel pre-positioning outcomes at dose alerts, since device boot
+  preposition?: { moves: number; valid: number; stale: number; missed: number };
   createdAt: Date;
   updatedAt: Date;
 }
 
+const dispenseLatencyHistSchema = new Schema<IDispenseLatencyHist>(
+  {
+    count: { type: Number, min: 0 },
+    sumMs: { type: Number, min: 0 },
+    maxMs: { type: Number, min: 0 },
+    buckets: [{ type: Number, min: 0 }],
+  },
+  { _id: false }
+);
+
 const deviceSchema = new Schema<IDevice>(
   {
     deviceId: { type: String, required: true, unique: true },
@@ -50,6 +77,19 @@ const deviceSchema = new Schema<IDevice>(
     storageFreeKb: { type: Number, min: 0 },
     temperatureC: { type: Number },
     lastError: { type: String, default: null },
+    pendingDoseEvents: { type: Number, min: 0 },
+    dispenseLatency: {
+      alertToOpen: { type: dispenseLatencyHistSchema },
+      openToDrop: { type: dispenseLatencyHistSchema },
+      dropToReport: { type: dispenseLatencyHistSchema },
+      pickToOpen: { type: dispenseLatencyHistSchema },
+    },
+    preposition: {
+      moves: { type: Number, min: 0 },
+      valid: { type: Number, min: 0 },
+      stale: { type: Number, min: 0 },
+      missed: { type: Number, min: 0 },
+    },
   },
   { timestamps: true }
 );
@@ -21,6 +21,8 @@ export interface IDoseLog extends Document {
   dispensedAt?: Date;
   takenAt?: Date;
   missedReason?: string | null;
+  // Idempotency key of the last device event applied to this dose
+  deviceEventId?: string | null;
 
   createdAt: Date;
   updatedAt: Date;
@@ -57,6 +59,7 @@ const doseLogSchema = new Schema<IDoseLog>(
     dispensedAt: { type: Date },
     takenAt: { type: Date },
     missedReason: { type: String, default: null },
+    deviceEventId: { type: String, default: null },
   },
   { timestamps: true }
 );
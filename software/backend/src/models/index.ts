@@ -33,6 +33,6 @@ export async function dropDatabase(): Promise<void> {
 // Export all models
 export { User, type IUser, type UserRole } from './User';
 export { Patient, type IPatient } from './Patient';
-export { Device, type IDevice } from './Device';
+export { Device, type IDevice, type IDispenseLatencyHist } from './Device';
 export { MedicationPlan, type IMedicationPlan } from './MedicationPlan';
 export { DoseLog, type IDoseLog, type DoseStatus } from './DoseLog';
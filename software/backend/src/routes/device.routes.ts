@@ -1,6 +1,8 @@
 import { Router, Request, Response } from 'express';
-import { Device, Patient } from '../models';
+import { Device } from '../models';
 import { authDevice } from '../middleware/authDevice';
+import { sendJsonWithEtag } from '../utils/etag';
+import { buildDeviceProfile, profileValidator } from '../utils/deviceProfile';
 
 const deviceRouter = Router();
 
@@ -12,7 +14,8 @@ deviceRouter.use(authDevice);
 /**
  * GET /api/device/:deviceId/profile
  * 
- * Read-only device + patient profile for hardware.
+ * Read-only device + patient profile for hardware. Sends a weak ETag and answers
+ * 304 when If-None-Match matches.
  */
 deviceRouter.get('/:deviceId/profile', async (req: Request, res: Response): Promise<void> => {
   try {
@@ -24,7 +27,7 @@ deviceRouter.get('/:deviceId/profile', async (req: Request, res: Response): Prom
     }
 
     if (isHardwareTestMode) {
-      res.status(200).json({
+      const payload = {
         success: true,
         device: {
           deviceId: 'DR-ESP32-001',
@@ -53,7 +56,8 @@ deviceRouter.get('/:deviceId/profile', async (req: Request, res: Response): Prom
           syncedAt: new Date().toISOString(),
           apiVersion: '1.0',
         },
-      });
+      };
+      sendJsonWithEtag(req, res, payload, profileValidator(payload));
       return;
     }
 
@@ -63,56 +67,13 @@ deviceRouter.get('/:deviceId/profile', async (req: Request, res: Response): Prom
       return;
     }
 
-    const patient = await Patient.findOne({ deviceId: device._id })
-      .populate({ path: 'userId', select: 'name' })
-      .populate({ path: 'caretakers.userId', select: 'name role' })
-      .lean()
-      .exec();
-
-    if (!patient) {
+    const payload = await buildDeviceProfile(device);
+    if (!payload) {
       res.status(404).json({ message: 'Patient not found' });
       return;
     }
 
-    const patientUser = patient.userId as unknown as { name?: string } | null;
-    const approvedCaretaker = patient.caretakers?.find((c: { approved?: boolean }) => c.approved);
-    const caretakerUser = approvedCaretaker?.userId as unknown as { name?: string } | null;
-
-    const illnesses = patient.medicalProfile?.illnesses?.map((illness: { name?: string }) => illness.name) || [];
-    const allergies = patient.medicalProfile?.allergies || [];
-
-    res.status(200).json({
-      success: true,
-      device: {
-        deviceId: device.deviceId,
-        name: device.name || 'Device',
-        status: device.lastStatus || 'offline',
-        batteryLevel: device.batteryLevel ?? null,
-        wifiStrength: device.wifiStrength ?? null,
-        lastHeartbeat: device.lastHeartbeatAt ? device.lastHeartbeatAt.toISOString() : null,
-      },
-      patient: {
-        displayName: patientUser?.name || 'Patient',
-        timezone: device.timezone || 'Asia/Kolkata',
-        medicalProfile: {
-          illnesses,
-          allergies,
-          notes: patient.medicalProfile?.otherNotes || '',
-        },
-      },
-      support: {
-        caretaker: approvedCaretaker
-          ? {
-              name: caretakerUser?.name || 'Caretaker',
-              relationship: approvedCaretaker.relationship || 'Caretaker',
-            }
-          : null,
-      },
-      meta: {
-        syncedAt: new Date().toISOString(),
-        apiVersion: '1.0',
-      },
-    });
+    sendJsonWithEtag(req, res, payload, profileValidator(payload));
   } catch (error) {
     console.error('Error in /device/:deviceId/profile endpoint:', error);
     res.status(500).json({ message: 'Internal server error' });
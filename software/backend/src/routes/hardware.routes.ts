@@ -1,9 +1,28 @@
 import { Router, Request, Response } from 'express';
-import { Device, DoseLog, MedicationPlan, Patient } from '../models';
+import { Types } from 'mongoose';
+import {
+  Device,
+  DoseLog,
+  MedicationPlan,
+  Patient,
+  type IDevice,
+  type IDispenseLatencyHist,
+} from '../models';
 import { authDevice } from '../middleware/authDevice';
+import {
+  computeEtag,
+  etagMatches,
+  sendBinaryWithEtag,
+  sendJsonWithEtag,
+} from '../utils/etag';
+import { buildDeviceProfile, profileValidator } from '../utils/deviceProfile';
+import { MED_LIST_WIRE_TYPE, encodeMedList } from '../utils/medListWire';
+import { posixTimeZone } from '../utils/posixTz';
 
 const hardwareRouter = Router();
 
+type DeviceRef = Pick<IDevice, '_id'>;
+
 const isHardwareTestMode = process.env.HARDWARE_TEST_MODE === 'true';
 const DISPENSED_RETRY_MINUTES = 5;
 // Grace period for missed dose marking (doses older than this become "missed")
@@ -11,6 +30,13 @@ const MISSED_GRACE_MINUTES = 5;
 // How far in the past to include pending/dispensed doses for device display
 // This allows the device to still see doses that just passed their time
 const PAST_DOSE_WINDOW_MINUTES = 5;
+const DOSE_BATCH_MAX = 50;
+// Device-reported event times older than this are not trusted
+const DEVICE_EVENT_MAX_AGE_MS = 7 * 24 * 60 * 60 * 1000;
+// Dose ids a device makes up for plan occurrences: "<planId>@<epoch minute>"
+const LOCAL_DOSE_ID = /^([0-9a-f]{24})@(\d{1,10})$/;
+
+type DoseEventResult = 'applied' | 'duplicate' | 'not_found' | 'invalid';
 
 // Apply device authentication to all routes
 hardwareRouter.use(authDevice);
@@ -47,6 +73,515 @@ function formatTime12(date: Date): string {
   });
 }
 
+/**
+ * Shared helper: Server time payload (GET /time and POST /sync).
+ * `receivedAt` is when the request arrived; the device subtracts
+ * processingMs from its round trip to estimate the network delay.
+ * posixTz describes the zone localTime24/12 and dose times are formatted in.
+ */
+function buildTimePayload(
+  now: Date,
+  receivedAt: number,
+  deviceId?: string,
+  timezone?: string
+) {
+  return {
+    deviceId: deviceId || null,
+    iso: now.toISOString(),
+    epochMs: now.getTime(),
+    epochSeconds: Math.floor(now.getTime() / 1000),
+    processingMs: Math.max(0, now.getTime() - receivedAt),
+    tzOffsetMinutes: now.getTimezoneOffset(),
+    timezone: timezone || null,
+    posixTz: posixTimeZone(undefined, now),
+    localTime24: formatTime(now),
+    localTime12: formatTime12(now),
+  };
+}
+
+/**
+ * Shared helper: Upcoming doses for a device (GET /upcoming and POST /sync).
+ * Also rolls stale dispensed doses back to pending, marks overdue ones missed
+ * and creates DoseLogs for plan times that have none yet.
+ * Returns null when the device has no patient.
+ */
+async function buildUpcomingData(device: DeviceRef): Promise<any[] | null> {
+  const now = new Date();
+  const windowEnd = new Date(now);
+  windowEnd.setDate(windowEnd.getDate() + 1);
+
+  const dispensedRetryAt = new Date(now.getTime() - DISPENSED_RETRY_MINUTES * 60 * 1000);
+  // For marking doses as missed - doses older than this window become missed
+  const missedCutoff = new Date(now.getTime() - MISSED_GRACE_MINUTES * 60 * 1000);
+  // For including past doses in response - only include recent past doses
+  const pastDoseWindow = new Date(now.getTime() - PAST_DOSE_WINDOW_MINUTES * 60 * 1000);
+
+  await DoseLog.updateMany(
+    {
+      deviceId: device._id,
+      status: 'dispensed',
+      dispensedAt: { $lte: dispensedRetryAt },
+    },
+    {
+      $set: { status: 'pending', dispensedAt: null },
+    }
+  ).exec();
+
+  // Mark doses as missed if they're older than the grace period and still pending/dispensed
+  await DoseLog.updateMany(
+    {
+      deviceId: device._id,
+      status: { $in: ['pending', 'dispensed'] },
+      scheduledAt: { $lte: missedCutoff },
+    },
+    {
+      $set: { status: 'missed' },
+    }
+  ).exec();
+
+
+  const patient = await Patient.findOne({ deviceId: device._id }).lean().exec();
+  if (!patient) {
+    return null;
+  }
+
+  // Query DoseLogs: from past dose window to future window end
+  // This includes recent past doses (within 5 min) and future doses
+  const doseLogs = await DoseLog.find({
+    deviceId: device._id,
+    scheduledAt: { $gte: pastDoseWindow, $lt: windowEnd },
+  })
+    .populate('medicationPlanId')
+    .lean()
+    .exec();
+
+  const doseLogKeySet = new Set<string>();
+  const upcomingItems: Array<{ scheduledAt: Date; data: any }> = [];
+
+  for (const log of doseLogs as any[]) {
+    const plan = log.medicationPlanId as any;
+    const scheduledAt = new Date(log.scheduledAt);
+    
+    // Skip doses outside our window
+    if (scheduledAt < pastDoseWindow) {
+      continue;
+    }
+    
+    const key = `${plan?._id?.toString() || 'unknown'}_${scheduledAt.getTime()}`;
+    doseLogKeySet.add(key);
+
+    // Only include pending or dispensed doses
+    // For PAST doses: only include if within the past dose window (already filtered above)
+    // For FUTURE doses: include all pending/dispensed
+    if (log.status === 'pending' || log.status === 'dispensed') {
+      upcomingItems.push({
+        scheduledAt,
+        data: {
+          doseId: log._id?.toString?.() || String(log._id),
+          medicineName: plan?.medicationName || 'Unknown',
+          dosage: formatDosage(plan?.dosagePerIntake, plan?.medicationStrength),
+          scheduledTime: formatTime(scheduledAt),
+          status: log.status,
+          slot: log.slotIndex,
+        },
+      });
+    }
+  }
+
+  // Fallback to medication plans when DoseLogs are not yet created
+  const medicationPlans = await MedicationPlan.find({
+    deviceId: device._id,
+    active: true,
+  })
+    .lean()
+    .exec();
+
+  const today = new Date(now);
+  today.setHours(0, 0, 0, 0);
+  const tomorrow = new Date(today);
+  tomorrow.setDate(tomorrow.getDate() + 1);
+
+  const dayOfWeek = today.getDay();
+  const adjustedDay = dayOfWeek === 0 ? 7 : dayOfWeek;
+  const tomorrowDay = tomorrow.getDay();
+  const adjustedTomorrow = tomorrowDay === 0 ? 7 : tomorrowDay;
+
+  for (const plan of medicationPlans as any[]) {
+    const times = Array.isArray(plan.times) ? plan.times : [];
+    const daysOfWeek = Array.isArray(plan.daysOfWeek) ? plan.daysOfWeek : [];
+
+    const scheduleDays = [
+      { date: today, day: adjustedDay },
+      { date: tomorrow, day: adjustedTomorrow },
+    ];
+
+    for (const schedule of scheduleDays) {
+      if (!daysOfWeek.includes(schedule.day)) {
+        continue;
+      }
+
+      for (const time of times) {
+        const [hours, minutes] = time.split(':').map(Number);
+        if (Number.isNaN(hours) || Number.isNaN(minutes)) {
+          continue;
+        }
+
+        const scheduledAt = new Date(schedule.date);
+        scheduledAt.setHours(hours, minutes, 0, 0);
+
+        // Only include if within our valid window:
+        // - Not too far in the future (windowEnd)
+        // - Not too far in the past (pastDoseWindow) - past doses older than 5 min are excluded
+        if (scheduledAt >= windowEnd || scheduledAt < pastDoseWindow) {
+          continue;
+        }
+
+        const key = `${plan._id.toString()}_${scheduledAt.getTime()}`;
+        if (doseLogKeySet.has(key)) {
+          continue;
+        }
+
+        const newDose = await DoseLog.create({
+          patientId: patient._id,
+          deviceId: device._id,
+          medicationPlanId: plan._id,
+          slotIndex: plan.slotIndex ?? 0,
+          scheduledAt,
+          status: 'pending',
+        });
+
+        upcomingItems.push({
+          scheduledAt,
+          data: {
+            doseId: newDose._id?.toString?.() || String(newDose._id),
+            medicineName: plan.medicationName || 'Unknown',
+            dosage: formatDosage(plan.dosagePerIntake, plan.medicationStrength),
+            scheduledTime: formatTime(scheduledAt),
+            status: 'pending',
+            slot: plan.slotIndex ?? 0,
+          },
+        });
+      }
+    }
+  }
+
+  return upcomingItems
+    .sort((a, b) => a.scheduledAt.getTime() - b.scheduledAt.getTime())
+    .map((item) => item.data);
+}
+
+/**
+ * Shared helper: Doses with the given status from the last 7 days.
+ */
+async function buildHistoryData(device: DeviceRef, status: 'taken' | 'missed'): Promise<any[]> {
+  // Calculate date range: last 7 days
+  const sevenDaysAgo = new Date(Date.now() - 7 * 24 * 60 * 60 * 1000);
+
+  const doseLogs = await DoseLog.find({
+    deviceId: device._id,
+    status,
+    scheduledAt: { $gte: sevenDaysAgo },
+  })
+    .populate('medicationPlanId')
+    .lean()
+    .exec();
+
+  // Transform to response format
+  return doseLogs.map((log: any) => {
+    const plan = log.medicationPlanId as any;
+    return {
+      medicineName: plan?.medicationName || 'Unknown',
+      dosage: formatDosage(plan?.dosagePerIntake, plan?.medicationStrength),
+      scheduledTime: formatTime(new Date(log.scheduledAt)),
+      status: log.status,
+      slot: log.slotIndex,
+    };
+  });
+}
+
+/**
+ * Shared helper: Active plan rules for a device (GET /plans and POST /sync),
+ * so the device can expand dose occurrences past the upcoming list itself.
+ * times are minutes of day in the zone of the time payload's posixTz,
+ * daysOfWeek uses 1 = Monday .. 7 = Sunday like the plans.
+ */
+async function buildPlanData(device: DeviceRef): Promise<any[]> {
+  const plans = await MedicationPlan.find({ deviceId: device._id, active: true })
+    .sort({ _id: 1 })
+    .lean()
+    .exec();
+
+  return (plans as any[]).map((plan) => {
+    const times: number[] = [];
+    for (const time of Array.isArray(plan.times) ? plan.times : []) {
+      const [hours, minutes] = String(time).split(':').map(Number);
+      if (hours >= 0 && hours < 24 && minutes >= 0 && minutes < 60) {
+        times.push(hours * 60 + minutes);
+      }
+    }
+    const daysOfWeek = Array.isArray(plan.daysOfWeek) ? [...plan.daysOfWeek] : [];
+    return {
+      planId: plan._id.toString(),
+      medicineName: plan.medicationName || 'Unknown',
+      dosage: formatDosage(plan.dosagePerIntake, plan.medicationStrength),
+      slot: plan.slotIndex ?? 0,
+      times: times.sort((a, b) => a - b),
+      daysOfWeek: daysOfWeek.sort((a, b) => a - b),
+      startMs: plan.startDate ? new Date(plan.startDate).getTime() : null,
+      endMs: plan.endDate ? new Date(plan.endDate).getTime() : null,
+    };
+  });
+}
+
+/**
+ * Shared helper: Store heartbeat telemetry (POST /heartbeat and POST /sync).
+ */
+async function applyHeartbeat(device: DeviceRef, heartbeat: any): Promise<void> {
+  const {
+    batteryLevel,
+    wifiStrength,
+    wifiConnected,
+    firmwareVersion,
+    uptimeSeconds,
+    storageFreeKb,
+    temperatureC,
+    lastError,
+    pendingDoseEvents,
+    dispenseLatency,
+    preposition,
+  } = heartbeat;
+
+  // Update device with new heartbeat info
+  const updateData: any = {
+    lastHeartbeatAt: new Date(),
+    lastStatus: 'online',
+  };
+
+  // Add optional fields if provided
+  if (typeof batteryLevel === 'number') {
+    updateData.batteryLevel = batteryLevel;
+  }
+  if (typeof wifiStrength === 'number') {
+    updateData.wifiStrength = wifiStrength;
+  }
+  if (typeof wifiConnected === 'boolean') {
+    updateData.wifiConnected = wifiConnected;
+  }
+  if (typeof firmwareVersion === 'string' && firmwareVersion.trim()) {
+    updateData.firmwareVersion = firmwareVersion.trim();
+  }
+  if (typeof uptimeSeconds === 'number' && uptimeSeconds >= 0) {
+    updateData.uptimeSeconds = uptimeSeconds;
+  }
+  if (typeof storageFreeKb === 'number' && storageFreeKb >= 0) {
+    updateData.storageFreeKb = storageFreeKb;
+  }
+  if (typeof temperatureC === 'number') {
+    updateData.temperatureC = temperatureC;
+  }
+  if (lastError === null || typeof lastError === 'string') {
+    updateData.lastError = lastError;
+  }
+  if (typeof pendingDoseEvents === 'number' && pendingDoseEvents >= 0) {
+    updateData.pendingDoseEvents = pendingDoseEvents;
+  }
+  if (dispenseLatency && typeof dispenseLatency === 'object') {
+    for (const key of DISPENSE_LATENCY_KEYS) {
+      const hist = dispenseLatencyHist(dispenseLatency[key]);
+      if (hist) {
+        updateData[`dispenseLatency.${key}`] = hist;
+      }
+    }
+  }
+  if (preposition && typeof preposition === 'object') {
+    const { moves, valid, stale, missed } = preposition;
+    if ([moves, valid, stale, missed].every((n) => typeof n === 'number' && n >= 0)) {
+      updateData.preposition = { moves, valid, stale, missed };
+    }
+  }
+
+  await Device.findByIdAndUpdate(device._id, updateData);
+}
+
+const DISPENSE_LATENCY_KEYS = [
+  'alertToOpen',
+  'openToDrop',
+  'dropToReport',
+  'pickToOpen',
+] as const;
+const DISPENSE_HIST_BUCKETS = 16;
+
+/**
+ * Shared helper: Validates one firmware latency histogram
+ * ({ count, sumMs, maxMs, buckets }). Returns null if malformed.
+ */
+function dispenseLatencyHist(value: any): IDispenseLatencyHist | null {
+  if (!value || typeof value !== 'object') {
+    return null;
+  }
+  const { count, sumMs, maxMs, buckets } = value;
+  const isCount = (n: unknown) => typeof n === 'number' && Number.isFinite(n) && n >= 0;
+  if (!isCount(count) || !isCount(sumMs) || !isCount(maxMs)) {
+    return null;
+  }
+  if (
+    !Array.isArray(buckets) ||
+    buckets.length > DISPENSE_HIST_BUCKETS ||
+    !buckets.every(isCount)
+  ) {
+    return null;
+  }
+  return { count, sumMs, maxMs, buckets };
+}
+
+/**
+ * Shared helper: When a device dose event happened. Prefers the monotonic age
+ * (exact within one boot), then the device wall clock, then the receive time.
+ */
+function deviceEventTime(event: any, receivedAt: Date): Date {
+  const now = receivedAt.getTime();
+  let at = now;
+  if (typeof event.ageMs === 'number' && event.ageMs >= 0) {
+    at = now - event.ageMs;
+  } else if (typeof event.at === 'number' && event.at > 0) {
+    at = event.at;
+  }
+  if (at > now || now - at > DEVICE_EVENT_MAX_AGE_MS) {
+    return receivedAt;
+  }
+  return new Date(at);
+}
+
+/**
+ * Shared helper: The DoseLog behind a device-generated dose id
+ * ("<planId>@<epoch minute>"), created if the occurrence has none yet.
+ * Returns null when the plan is not this device's.
+ */
+async function resolveLocalDose(
+  device: DeviceRef,
+  localId: string
+): Promise<string | null> {
+  const match = LOCAL_DOSE_ID.exec(localId);
+  if (!match) {
+    return null;
+  }
+  const plan = await MedicationPlan.findOne({ _id: match[1], deviceId: device._id })
+    .select('patientId slotIndex')
+    .lean()
+    .exec();
+  if (!plan) {
+    return null;
+  }
+
+  // Same key buildUpcomingData uses (plan + scheduledAt), so both find one log
+  const dose = await DoseLog.findOneAndUpdate(
+    {
+      deviceId: device._id,
+      medicationPlanId: plan._id,
+      scheduledAt: new Date(Number(match[2]) * 60 * 1000),
+    },
+    {
+      $setOnInsert: {
+        patientId: plan.patientId,
+        slotIndex: plan.slotIndex ?? 0,
+        status: 'pending',
+      },
+    },
+    { upsert: true, new: true }
+  )
+    .select('_id')
+    .lean()
+    .exec();
+  return dose ? String(dose._id) : null;
+}
+
+/**
+ * Shared helper: Apply one outbox event (POST /doses/batch). The event id is
+ * stored on the dose so a replayed event is not applied twice. doseId may be
+ * a device-generated plan occurrence id, reconciled onto its DoseLog here.
+ */
+async function applyDoseEvent(
+  device: DeviceRef,
+  event: any,
+  receivedAt: Date
+): Promise<DoseEventResult> {
+  const { id, action } = event ?? {};
+  let { doseId } = event ?? {};
+  if (
+    typeof id !== 'string' ||
+    !id ||
+    typeof doseId !== 'string' ||
+    !(Types.ObjectId.isValid(doseId) || LOCAL_DOSE_ID.test(doseId)) ||
+    (action !== 'taken' && action !== 'skipped')
+  ) {
+    return 'invalid';
+  }
+  if (!Types.ObjectId.isValid(doseId)) {
+    doseId = await resolveLocalDose(device, doseId);
+    if (!doseId) {
+      return 'not_found';
+    }
+  }
+
+  const update =
+    action === 'taken'
+      ? { status: 'taken', takenAt: deviceEventTime(event, receivedAt), deviceEventId: id }
+      : { status: 'missed', deviceEventId: id };
+
+  const dose = await DoseLog.findOneAndUpdate(
+    { _id: doseId, deviceId: device._id, deviceEventId: { $ne: id } },
+    { $set: update },
+    { new: true }
+  ).exec();
+  if (dose) {
+    return 'applied';
+  }
+
+  const exists = await DoseLog.exists({ _id: doseId, deviceId: device._id });
+  return exists ? 'duplicate' : 'not_found';
+}
+
+/**
+ * Shared helper: DoseLog id for the :doseId of the per-dose PATCH routes.
+ * Plan occurrence ids are reconciled like in /doses/batch; null for a local
+ * id without a plan, or for anything that is not a dose id at all.
+ */
+async function resolveDoseParam(device: DeviceRef, doseId: string): Promise<string | null> {
+  if (Types.ObjectId.isValid(doseId)) {
+    return doseId;
+  }
+  return LOCAL_DOSE_ID.test(doseId) ? resolveLocalDose(device, doseId) : null;
+}
+
+/**
+ * Shared helper: One /sync section. Carries the same ETag the standalone
+ * endpoint would send, and drops the payload when the device already has it.
+ */
+function syncSection(known: unknown, etag: string, key: string, value: unknown) {
+  if (typeof known === 'string' && etagMatches(known, etag)) {
+    return { etag, notModified: true };
+  }
+  return { etag, [key]: value };
+}
+
+/**
+ * Shared helper: Send a med list (GET /upcoming, /taken, /missed) as
+ * { data } JSON, or in the binary wire format when Accept prefers it.
+ * Both forms carry the tag of the { data } JSON (weak for the binary one),
+ * the same one /sync uses, so a cached tag matches whichever path is used.
+ */
+function sendMedList(req: Request, res: Response, data: any[]): void {
+  res.vary('Accept');
+  if (req.accepts(['application/json', MED_LIST_WIRE_TYPE]) === MED_LIST_WIRE_TYPE) {
+    const body = encodeMedList(data);
+    if (body) {
+      sendBinaryWithEtag(req, res, body, MED_LIST_WIRE_TYPE, { data });
+      return;
+    }
+  }
+  sendJsonWithEtag(req, res, { data });
+}
+
 /**
  * GET /api/hardware/time
  * 
@@ -61,15 +596,17 @@ function formatTime12(date: Date): string {
  *     iso: string,
  *     epochMs: number,
  *     epochSeconds: number,
+ *     processingMs: number,     // request arrival to epochMs
  *     tzOffsetMinutes: number,
  *     timezone: string | null,
+ *     posixTz: string,          // e.g. "EST5EDT,M3.2.0/2,M11.1.0/2", for TZ on the device
  *     localTime24: string,
  *     localTime12: string
  *   }
  */
 hardwareRouter.get('/time', async (req: Request, res: Response): Promise<void> => {
   try {
-    const now = new Date();
+    const receivedAt = Date.now();
     const deviceId = typeof req.query.deviceId === 'string' ? req.query.deviceId : undefined;
     let timezone: string | undefined;
 
@@ -78,16 +615,7 @@ hardwareRouter.get('/time', async (req: Request, res: Response): Promise<void> =
       timezone = device?.timezone;
     }
 
-    const responsePayload = {
-      deviceId: deviceId || null,
-      iso: now.toISOString(),
-      epochMs: now.getTime(),
-      epochSeconds: Math.floor(now.getTime() / 1000),
-      tzOffsetMinutes: now.getTimezoneOffset(),
-      timezone: timezone || null,
-      localTime24: formatTime(now),
-      localTime12: formatTime12(now),
-    };
+    const responsePayload = buildTimePayload(new Date(), receivedAt, deviceId, timezone);
 
     if (isHardwareTestMode) {
       res.status(200).json({
@@ -125,56 +653,13 @@ hardwareRouter.get('/profile', async (req: Request, res: Response): Promise<void
       return;
     }
 
-    const patient = await Patient.findOne({ deviceId: device._id })
-      .populate({ path: 'userId', select: 'name' })
-      .populate({ path: 'caretakers.userId', select: 'name role' })
-      .lean()
-      .exec();
-
-    if (!patient) {
+    const payload = await buildDeviceProfile(device);
+    if (!payload) {
       res.status(404).json({ message: 'Patient not found' });
       return;
     }
 
-    const patientUser = patient.userId as unknown as { name?: string } | null;
-    const approvedCaretaker = patient.caretakers?.find((c: { approved?: boolean }) => c.approved);
-    const caretakerUser = approvedCaretaker?.userId as unknown as { name?: string } | null;
-
-    const illnesses = patient.medicalProfile?.illnesses?.map((illness: { name?: string }) => illness.name) || [];
-    const allergies = patient.medicalProfile?.allergies || [];
-
-    res.status(200).json({
-      success: true,
-      device: {
-        deviceId: device.deviceId,
-        name: device.name || 'Device',
-        status: device.lastStatus || 'offline',
-        batteryLevel: device.batteryLevel ?? null,
-        wifiStrength: device.wifiStrength ?? null,
-        lastHeartbeat: device.lastHeartbeatAt ? device.lastHeartbeatAt.toISOString() : null,
-      },
-      patient: {
-        displayName: patientUser?.name || 'Patient',
-        timezone: device.timezone || 'Asia/Kolkata',
-        medicalProfile: {
-          illnesses,
-          allergies,
-          notes: patient.medicalProfile?.otherNotes || '',
-        },
-      },
-      support: {
-        caretaker: approvedCaretaker
-          ? {
-              name: caretakerUser?.name || 'Caretaker',
-              relationship: approvedCaretaker.relationship || 'Caretaker',
-            }
-          : null,
-      },
-      meta: {
-        syncedAt: new Date().toISOString(),
-        apiVersion: '1.0',
-      },
-    });
+    sendJsonWithEtag(req, res, payload, profileValidator(payload));
   } catch (error) {
     console.error('Error in /profile endpoint:', error);
     res.status(500).json({ message: 'Internal server error' });
@@ -189,7 +674,9 @@ hardwareRouter.get('/profile', async (req: Request, res: Response): Promise<void
  * Query params:
  *   - deviceId (required): The device identifier
  * 
- * Response: { data: [...] }
+ * Response: { data: [...] } with a strong ETag; 304 when If-None-Match matches.
+ * With "Accept: application/vnd.doseright.medlist" the list comes in the
+ * binary format of utils/medListWire.ts instead.
  */
 hardwareRouter.get('/taken', async (req: Request, res: Response): Promise<void> => {
   try {
@@ -208,32 +695,9 @@ hardwareRouter.get('/taken', async (req: Request, res: Response): Promise<void>
       return;
     }
 
-    // Calculate date range: last 7 days
-    const sevenDaysAgo = new Date(Date.now() - 7 * 24 * 60 * 60 * 1000);
+    const data = await buildHistoryData(device, 'taken');
 
-    // Query DoseLog for taken doses
-    const doseLogs = await DoseLog.find({
-      deviceId: device._id,
-      status: 'taken',
-      scheduledAt: { $gte: sevenDaysAgo },
-    })
-      .populate('medicationPlanId')
-      .lean()
-      .exec();
-
-    // Transform to response format
-    const data = doseLogs.map((log: any) => {
-      const plan = log.medicationPlanId as any;
-      return {
-        medicineName: plan?.medicationName || 'Unknown',
-        dosage: formatDosage(plan?.dosagePerIntake, plan?.medicationStrength),
-        scheduledTime: formatTime(new Date(log.scheduledAt)),
-        status: log.status,
-        slot: log.slotIndex,
-      };
-    });
-
-    res.status(200).json({ data });
+    sendMedList(req, res, data);
   } catch (error) {
     console.error('Error in /taken endpoint:', error);
     res.status(500).json({ message: 'Internal server error' });
@@ -251,7 +715,9 @@ hardwareRouter.get('/taken', async (req: Request, res: Response): Promise<void>
  * Query params:
  *   - deviceId (required): The device identifier
  * 
- * Response: { data: [...] }
+ * Response: { data: [...] } with a strong ETag; 304 when If-None-Match matches.
+ * With "Accept: application/vnd.doseright.medlist" the list comes in the
+ * binary format of utils/medListWire.ts instead.
  */
 hardwareRouter.get('/upcoming', async (req: Request, res: Response): Promise<void> => {
   try {
@@ -270,173 +736,51 @@ hardwareRouter.get('/upcoming', async (req: Request, res: Response): Promise<voi
       return;
     }
 
-    const now = new Date();
-    const windowEnd = new Date(now);
-    windowEnd.setDate(windowEnd.getDate() + 1);
-
-    const dispensedRetryAt = new Date(now.getTime() - DISPENSED_RETRY_MINUTES * 60 * 1000);
-    // For marking doses as missed - doses older than this window become missed
-    const missedCutoff = new Date(now.getTime() - MISSED_GRACE_MINUTES * 60 * 1000);
-    // For including past doses in response - only include recent past doses
-    const pastDoseWindow = new Date(now.getTime() - PAST_DOSE_WINDOW_MINUTES * 60 * 1000);
-
-    await DoseLog.updateMany(
-      {
-        deviceId: device._id,
-        status: 'dispensed',
-        dispensedAt: { $lte: dispensedRetryAt },
-      },
-      {
-        $set: { status: 'pending', dispensedAt: null },
-      }
-    ).exec();
-
-    // Mark doses as missed if they're older than the grace period and still pending/dispensed
-    await DoseLog.updateMany(
-      {
-        deviceId: device._id,
-        status: { $in: ['pending', 'dispensed'] },
-        scheduledAt: { $lte: missedCutoff },
-      },
-      {
-        $set: { status: 'missed' },
-      }
-    ).exec();
-
-
-    const patient = await Patient.findOne({ deviceId: device._id }).lean().exec();
-    if (!patient) {
+    const data = await buildUpcomingData(device);
+    if (!data) {
       res.status(404).json({ message: 'Patient not found' });
       return;
     }
 
-    // Query DoseLogs: from past dose window to future window end
-    // This includes recent past doses (within 5 min) and future doses
-    const doseLogs = await DoseLog.find({
-      deviceId: device._id,
-      scheduledAt: { $gte: pastDoseWindow, $lt: windowEnd },
-    })
-      .populate('medicationPlanId')
-      .lean()
-      .exec();
-
-    const doseLogKeySet = new Set<string>();
-    const upcomingItems: Array<{ scheduledAt: Date; data: any }> = [];
-
-    for (const log of doseLogs as any[]) {
-      const plan = log.medicationPlanId as any;
-      const scheduledAt = new Date(log.scheduledAt);
-      
-      // Skip doses outside our window
-      if (scheduledAt < pastDoseWindow) {
-        continue;
-      }
-      
-      const key = `${plan?._id?.toString() || 'unknown'}_${scheduledAt.getTime()}`;
-      doseLogKeySet.add(key);
-
-      // Only include pending or dispensed doses
-      // For PAST doses: only include if within the past dose window (already filtered above)
-      // For FUTURE doses: include all pending/dispensed
-      if (log.status === 'pending' || log.status === 'dispensed') {
-        upcomingItems.push({
-          scheduledAt,
-          data: {
-            doseId: log._id?.toString?.() || String(log._id),
-            medicineName: plan?.medicationName || 'Unknown',
-            dosage: formatDosage(plan?.dosagePerIntake, plan?.medicationStrength),
-            scheduledTime: formatTime(scheduledAt),
-            status: log.status,
-            slot: log.slotIndex,
-          },
-        });
-      }
-    }
+    sendMedList(req, res, data);
+  } catch (error) {
+    console.error('Error in /upcoming endpoint:', error);
+    res.status(500).json({ message: 'Internal server error' });
+  }
+});
 
-    // Fallback to medication plans when DoseLogs are not yet created
-    const medicationPlans = await MedicationPlan.find({
-      deviceId: device._id,
-      active: true,
-    })
-      .lean()
-      .exec();
-
-    const today = new Date(now);
-    today.setHours(0, 0, 0, 0);
-    const tomorrow = new Date(today);
-    tomorrow.setDate(tomorrow.getDate() + 1);
-
-    const dayOfWeek = today.getDay();
-    const adjustedDay = dayOfWeek === 0 ? 7 : dayOfWeek;
-    const tomorrowDay = tomorrow.getDay();
-    const adjustedTomorrow = tomorrowDay === 0 ? 7 : tomorrowDay;
-
-    for (const plan of medicationPlans as any[]) {
-      const times = Array.isArray(plan.times) ? plan.times : [];
-      const daysOfWeek = Array.isArray(plan.daysOfWeek) ? plan.daysOfWeek : [];
-
-      const scheduleDays = [
-        { date: today, day: adjustedDay },
-        { date: tomorrow, day: adjustedTomorrow },
-      ];
-
-      for (const schedule of scheduleDays) {
-        if (!daysOfWeek.includes(schedule.day)) {
-          continue;
-        }
+/**
+ * GET /api/hardware/plans
+ *
+ * Active medication plan rules, for the device to expand doses past the
+ * 24 h upcoming list (e.g. while offline). Doses it generates itself carry
+ * the id "<planId>@<epoch minute>", accepted by POST /doses/batch.
+ *
+ * Query params:
+ *   - deviceId (required): The device identifier
+ *
+ * Response: { data: [{ planId, medicineName, dosage, slot, times: [minute of day],
+ *   daysOfWeek: [1..7], startMs, endMs | null }] } with a strong ETag;
+ * 304 when If-None-Match matches.
+ */
+hardwareRouter.get('/plans', async (req: Request, res: Response): Promise<void> => {
+  try {
+    const { deviceId } = req.query;
 
-        for (const time of times) {
-          const [hours, minutes] = time.split(':').map(Number);
-          if (Number.isNaN(hours) || Number.isNaN(minutes)) {
-            continue;
-          }
-
-          const scheduledAt = new Date(schedule.date);
-          scheduledAt.setHours(hours, minutes, 0, 0);
-
-          // Only include if within our valid window:
-          // - Not too far in the future (windowEnd)
-          // - Not too far in the past (pastDoseWindow) - past doses older than 5 min are excluded
-          if (scheduledAt >= windowEnd || scheduledAt < pastDoseWindow) {
-            continue;
-          }
-
-          const key = `${plan._id.toString()}_${scheduledAt.getTime()}`;
-          if (doseLogKeySet.has(key)) {
-            continue;
-          }
-
-          const newDose = await DoseLog.create({
-            patientId: patient._id,
-            deviceId: device._id,
-            medicationPlanId: plan._id,
-            slotIndex: plan.slotIndex ?? 0,
-            scheduledAt,
-            status: 'pending',
-          });
-
-          upcomingItems.push({
-            scheduledAt,
-            data: {
-              doseId: newDose._id?.toString?.() || String(newDose._id),
-              medicineName: plan.medicationName || 'Unknown',
-              dosage: formatDosage(plan.dosagePerIntake, plan.medicationStrength),
-              scheduledTime: formatTime(scheduledAt),
-              status: 'pending',
-              slot: plan.slotIndex ?? 0,
-            },
-          });
-        }
-      }
+    if (!deviceId || typeof deviceId !== 'string') {
+      res.status(400).json({ message: 'deviceId is required' });
+      return;
     }
 
-    const data = upcomingItems
-      .sort((a, b) => a.scheduledAt.getTime() - b.scheduledAt.getTime())
-      .map((item) => item.data);
+    const device = await Device.findOne({ deviceId }).select('_id').lean().exec();
+    if (!device) {
+      res.status(404).json({ message: 'Device not found' });
+      return;
+    }
 
-    res.status(200).json({ data });
+    sendJsonWithEtag(req, res, { data: await buildPlanData(device) });
   } catch (error) {
-    console.error('Error in /upcoming endpoint:', error);
+    console.error('Error in /plans endpoint:', error);
     res.status(500).json({ message: 'Internal server error' });
   }
 });
@@ -453,7 +797,7 @@ hardwareRouter.get('/upcoming', async (req: Request, res: Response): Promise<voi
  */
 hardwareRouter.patch('/doses/:doseId/mark-taken', async (req: Request, res: Response): Promise<void> => {
   try {
-    const { doseId } = req.params;
+    let { doseId } = req.params;
     const { deviceId } = req.body;
 
     if (!doseId) {
@@ -472,6 +816,14 @@ hardwareRouter.patch('/doses/:doseId/mark-taken', async (req: Request, res: Resp
       return;
     }
 
+    const resolved = await resolveDoseParam(device, doseId);
+    if (!resolved) {
+      const local = LOCAL_DOSE_ID.test(doseId);
+      res.status(local ? 404 : 400).json({ message: local ? 'Dose not found' : 'Invalid doseId' });
+      return;
+    }
+    doseId = resolved;
+
     const dose = await DoseLog.findOneAndUpdate(
       { _id: doseId, deviceId: device._id },
       { $set: { status: 'taken', takenAt: new Date() } },
@@ -502,7 +854,7 @@ hardwareRouter.patch('/doses/:doseId/mark-taken', async (req: Request, res: Resp
  */
 hardwareRouter.patch('/doses/:doseId/mark-skipped', async (req: Request, res: Response): Promise<void> => {
   try {
-    const { doseId } = req.params;
+    let { doseId } = req.params;
     const { deviceId } = req.body;
 
     if (!doseId) {
@@ -521,6 +873,14 @@ hardwareRouter.patch('/doses/:doseId/mark-skipped', async (req: Request, res: Re
       return;
     }
 
+    const resolved = await resolveDoseParam(device, doseId);
+    if (!resolved) {
+      const local = LOCAL_DOSE_ID.test(doseId);
+      res.status(local ? 404 : 400).json({ message: local ? 'Dose not found' : 'Invalid doseId' });
+      return;
+    }
+    doseId = resolved;
+
     const dose = await DoseLog.findOneAndUpdate(
       { _id: doseId, deviceId: device._id },
       { $set: { status: 'missed' } },
@@ -539,6 +899,59 @@ hardwareRouter.patch('/doses/:doseId/mark-skipped', async (req: Request, res: Re
   }
 });
 
+/**
+ * POST /api/hardware/doses/batch
+ *
+ * Apply dose events queued in the device outbox, oldest first.
+ *
+ * Body:
+ *   {
+ *     deviceId: string (required),
+ *     events: [{ id, doseId, action: 'taken' | 'skipped', ageMs?, at? }] (1..50)
+ *   }
+ *
+ * id is the device's idempotency key: an event already applied to its dose is
+ * reported as duplicate and not applied again. doseId is a DoseLog id or a
+ * plan occurrence id from the device ("<planId>@<epoch minute>", see /plans).
+ * ageMs (time since the event on the device's monotonic clock) or at (epoch ms)
+ * sets takenAt.
+ *
+ * Response: { results: [{ id, result: 'applied' | 'duplicate' | 'not_found' | 'invalid' }] }
+ */
+hardwareRouter.post('/doses/batch', async (req: Request, res: Response): Promise<void> => {
+  try {
+    const { deviceId, events } = req.body;
+    const receivedAt = new Date();
+
+    if (!deviceId || typeof deviceId !== 'string') {
+      res.status(400).json({ message: 'deviceId is required' });
+      return;
+    }
+
+    if (!Array.isArray(events) || events.length === 0 || events.length > DOSE_BATCH_MAX) {
+      res.status(400).json({ message: `events must hold 1 to ${DOSE_BATCH_MAX} entries` });
+      return;
+    }
+
+    const device = await Device.findOne({ deviceId }).select('_id').lean().exec();
+    if (!device) {
+      res.status(404).json({ message: 'Device not found' });
+      return;
+    }
+
+    // Sequential on purpose: two events for the same dose must apply in device order
+    const results: { id: unknown; result: DoseEventResult }[] = [];
+    for (const event of events) {
+      results.push({ id: event?.id, result: await applyDoseEvent(device, event, receivedAt) });
+    }
+
+    res.status(200).json({ results });
+  } catch (error) {
+    console.error('Error in /doses/batch endpoint:', error);
+    res.status(500).json({ message: 'Internal server error' });
+  }
+});
+
 /**
  * GET /api/hardware/missed
  * 
@@ -547,7 +960,9 @@ hardwareRouter.patch('/doses/:doseId/mark-skipped', async (req: Request, res: Re
  * Query params:
  *   - deviceId (required): The device identifier
  * 
- * Response: { data: [...] }
+ * Response: { data: [...] } with a strong ETag; 304 when If-None-Match matches.
+ * With "Accept: application/vnd.doseright.medlist" the list comes in the
+ * binary format of utils/medListWire.ts instead.
  */
 hardwareRouter.get('/missed', async (req: Request, res: Response): Promise<void> => {
   try {
@@ -566,32 +981,9 @@ hardwareRouter.get('/missed', async (req: Request, res: Response): Promise<void>
       return;
     }
 
-    // Calculate date range: last 7 days
-    const sevenDaysAgo = new Date(Date.now() - 7 * 24 * 60 * 60 * 1000);
+    const data = await buildHistoryData(device, 'missed');
 
-    // Query DoseLog for missed doses
-    const doseLogs = await DoseLog.find({
-      deviceId: device._id,
-      status: 'missed',
-      scheduledAt: { $gte: sevenDaysAgo },
-    })
-      .populate('medicationPlanId')
-      .lean()
-      .exec();
-
-    // Transform to response format
-    const data = doseLogs.map((log: any) => {
-      const plan = log.medicationPlanId as any;
-      return {
-        medicineName: plan?.medicationName || 'Unknown',
-        dosage: formatDosage(plan?.dosagePerIntake, plan?.medicationStrength),
-        scheduledTime: formatTime(new Date(log.scheduledAt)),
-        status: log.status,
-        slot: log.slotIndex,
-      };
-    });
-
-    res.status(200).json({ data });
+    sendMedList(req, res, data);
   } catch (error) {
     console.error('Error in /missed endpoint:', error);
     res.status(500).json({ message: 'Internal server error' });
@@ -613,24 +1005,26 @@ hardwareRouter.get('/missed', async (req: Request, res: Response): Promise<void>
  *     uptimeSeconds?: number,
  *     storageFreeKb?: number,
  *     temperatureC?: number,
- *     lastError?: string | null
+ *     lastError?: string | null,
+ *     pendingDoseEvents?: number,
+ *     dispenseLatency?: {
+ *       alertToOpen?: { count, sumMs, maxMs, buckets: number[] },
+ *       openToDrop?: ...,
+ *       dropToReport?: ...,
+ *       pickToOpen?: ...
+ *     },
+ *     preposition?: { moves, valid, stale, missed }
  *   }
+ *
+ * dispenseLatency buckets are the firmware's histogram: bucket i counts
+ * latencies below 128 << i ms, the last one is open-ended. Each histogram
+ * replaces the stored one (the device keeps totals since boot).
  * 
  * Response: { ok: true }
  */
 hardwareRouter.post('/heartbeat', async (req: Request, res: Response): Promise<void> => {
   try {
-    const {
-      deviceId,
-      batteryLevel,
-      wifiStrength,
-      wifiConnected,
-      firmwareVersion,
-      uptimeSeconds,
-      storageFreeKb,
-      temperatureC,
-      lastError,
-    } = req.body;
+    const { deviceId } = req.body;
 
     // Validate deviceId
     if (!deviceId || typeof deviceId !== 'string') {
@@ -645,43 +1039,96 @@ hardwareRouter.post('/heartbeat', async (req: Request, res: Response): Promise<v
       return;
     }
 
-    // Update device with new heartbeat info
-    const updateData: any = {
-      lastHeartbeatAt: new Date(),
-      lastStatus: 'online',
-    };
+    await applyHeartbeat(device, req.body);
 
-    // Add optional fields if provided
-    if (typeof batteryLevel === 'number') {
-      updateData.batteryLevel = batteryLevel;
-    }
-    if (typeof wifiStrength === 'number') {
-      updateData.wifiStrength = wifiStrength;
-    }
-    if (typeof wifiConnected === 'boolean') {
-      updateData.wifiConnected = wifiConnected;
-    }
-    if (typeof firmwareVersion === 'string' && firmwareVersion.trim()) {
-      updateData.firmwareVersion = firmwareVersion.trim();
-    }
-    if (typeof uptimeSeconds === 'number' && uptimeSeconds >= 0) {
-      updateData.uptimeSeconds = uptimeSeconds;
-    }
-    if (typeof storageFreeKb === 'number' && storageFreeKb >= 0) {
-      updateData.storageFreeKb = storageFreeKb;
+    res.status(200).json({ ok: true });
+  } catch (error) {
+    console.error('Error in /heartbeat endpoint:', error);
+    res.status(500).json({ message: 'Internal server error' });
+  }
+});
+
+/**
+ * POST /api/hardware/sync
+ *
+ * Everything a device needs per sync cycle in one round-trip: stores the
+ * heartbeat, returns server time, the upcoming/taken/missed lists, the plan
+ * rules and the profile. Sections whose ETag matches the one the device sent
+ * come back as { etag, notModified: true }.
+ *
+ * Body:
+ *   {
+ *     deviceId: string (required),
+ *     heartbeat?: { ...same fields as POST /heartbeat },
+ *     etags?: { upcoming?: string, taken?: string, missed?: string, plans?: string,
+ *               profile?: string }
+ *   }
+ *
+ * Response:
+ *   {
+ *     time: { ...same as GET /time },
+ *     upcoming: { etag, data: [...] } | { etag, notModified: true },
+ *     taken: { etag, data: [...] } | { etag, notModified: true },
+ *     missed: { etag, data: [...] } | { etag, notModified: true },
+ *     plans: { etag, data: [...same as GET /plans] } | { etag, notModified: true },
+ *     profile: { etag, body: {...} } | { etag, notModified: true } | null
+ *   }
+ */
+hardwareRouter.post('/sync', async (req: Request, res: Response): Promise<void> => {
+  try {
+    const receivedAt = Date.now();
+    const { deviceId, heartbeat, etags } = req.body;
+
+    if (!deviceId || typeof deviceId !== 'string') {
+      res.status(400).json({ message: 'deviceId is required' });
+      return;
     }
-    if (typeof temperatureC === 'number') {
-      updateData.temperatureC = temperatureC;
+
+    const device = await Device.findOne({ deviceId }).lean().exec();
+    if (!device) {
+      res.status(404).json({ message: 'Device not found' });
+      return;
     }
-    if (lastError === null || typeof lastError === 'string') {
-      updateData.lastError = lastError;
+
+    if (heartbeat && typeof heartbeat === 'object') {
+      await applyHeartbeat(device, heartbeat);
     }
 
-    await Device.findByIdAndUpdate(device._id, updateData, { new: true });
+    // Upcoming runs first: it marks overdue doses missed, which the missed list must see.
+    const upcoming = await buildUpcomingData(device);
+    if (!upcoming) {
+      res.status(404).json({ message: 'Patient not found' });
+      return;
+    }
+    const [taken, missed, plans, profile] = await Promise.all([
+      buildHistoryData(device, 'taken'),
+      buildHistoryData(device, 'missed'),
+      buildPlanData(device),
+      buildDeviceProfile(device),
+    ]);
+
+    const known = etags && typeof etags === 'object' ? etags : {};
+    type SectionName = 'upcoming' | 'taken' | 'missed' | 'plans';
+    const listSection = (name: SectionName, data: any[]) =>
+      syncSection(known[name], computeEtag(JSON.stringify({ data })), 'data', data);
 
-    res.status(200).json({ ok: true });
+    res.status(200).json({
+      time: buildTimePayload(new Date(), receivedAt, deviceId, device.timezone),
+      upcoming: listSection('upcoming', upcoming),
+      taken: listSection('taken', taken),
+      missed: listSection('missed', missed),
+      plans: listSection('plans', plans),
+      profile: profile
+        ? syncSection(
+            known.profile,
+            computeEtag(JSON.stringify(profileValidator(profile)), true),
+            'body',
+            profile
+          )
+        : null,
+    });
   } catch (error) {
-    console.error('Error in /heartbeat endpoint:', error);
+    console.error('Error in /sync endpoint:', error);
     res.status(500).json({ message: 'Internal server error' });
   }
 });
@@ -354,11 +354,16 @@ const startServer = async () => {
 
     // Start Express server
     const host = '0.0.0.0';
-    app.listen(config.port, host, () => {
+    const server = app.listen(config.port, host, () => {
       console.log(`\n🚀 Server running on http://${host}:${config.port} in ${config.nodeEnv} mode`);
       console.log(`✓ CORS enabled for: ${config.corsOrigin}`);
       console.log(`✓ API Base URL: http://${host === '0.0.0.0' ? 'localhost' : host}:${config.port}/api\n`);
     });
+
+    // Devices sync every 60 s over one keep-alive connection; keep idle
+    // sockets open across a full cycle so they don't re-handshake each time.
+    server.keepAliveTimeout = 75 * 1000;
+    server.headersTimeout = 76 * 1000;
   } catch (error) {
     console.error('❌ Failed to start server:', error);
     process.exit(1);
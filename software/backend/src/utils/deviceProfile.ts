@@ -0,0 +1,101 @@
+import { Patient, type IDevice } from '../models';
+
+type ProfileDevice = Pick<
+  IDevice,
+  | '_id'
+  | 'deviceId'
+  | 'name'
+  | 'timezone'
+  | 'lastStatus'
+  | 'batteryLevel'
+  | 'wifiStrength'
+  | 'lastHeartbeatAt'
+>;
+
+export interface DeviceProfilePayload {
+  success: true;
+  device: {
+    deviceId: string;
+    name: string;
+    status: string;
+    batteryLevel: number | null;
+    wifiStrength: number | null;
+    lastHeartbeat: string | null;
+  };
+  patient: unknown;
+  support: unknown;
+  meta: { syncedAt: string; apiVersion: string };
+}
+
+/**
+ * Device + patient profile as rendered on the hardware profile screen.
+ * Returns null when the device has no patient.
+ */
+export const buildDeviceProfile = async (
+  device: ProfileDevice
+): Promise<DeviceProfilePayload | null> => {
+  const patient = await Patient.findOne({ deviceId: device._id })
+    .populate({ path: 'userId', select: 'name' })
+    .populate({ path: 'caretakers.userId', select: 'name role' })
+    .lean()
+    .exec();
+
+  if (!patient) {
+    return null;
+  }
+
+  const patientUser = patient.userId as unknown as { name?: string } | null;
+  const approvedCaretaker = patient.caretakers?.find((c: { approved?: boolean }) => c.approved);
+  const caretakerUser = approvedCaretaker?.userId as unknown as { name?: string } | null;
+
+  const illnesses = patient.medicalProfile?.illnesses?.map((illness: { name?: string }) => illness.name) || [];
+  const allergies = patient.medicalProfile?.allergies || [];
+
+  return {
+    success: true,
+    device: {
+      deviceId: device.deviceId,
+      name: device.name || 'Device',
+      status: device.lastStatus || 'offline',
+      batteryLevel: device.batteryLevel ?? null,
+      wifiStrength: device.wifiStrength ?? null,
+      lastHeartbeat: device.lastHeartbeatAt ? device.lastHeartbeatAt.toISOString() : null,
+    },
+    patient: {
+      displayName: patientUser?.name || 'Patient',
+      timezone: device.timezone || 'Asia/Kolkata',
+      medicalProfile: {
+        illnesses,
+        allergies,
+        notes: patient.medicalProfile?.otherNotes || '',
+      },
+    },
+    support: {
+      caretaker: approvedCaretaker
+        ? {
+            name: caretakerUser?.name || 'Caretaker',
+            relationship: approvedCaretaker.relationship || 'Caretaker',
+          }
+        : null,
+    },
+    meta: {
+      syncedAt: new Date().toISOString(),
+      apiVersion: '1.0',
+    },
+  };
+};
+
+/**
+ * The profile ETag covers what the device renders. Telemetry echoed back in
+ * `device` (battery, last heartbeat) and `meta.syncedAt` change on every
+ * heartbeat and would defeat If-None-Match.
+ */
+export const profileValidator = (
+  payload: Pick<DeviceProfilePayload, 'device' | 'patient' | 'support' | 'meta'>
+) => ({
+  deviceId: payload.device.deviceId,
+  name: payload.device.name,
+  patient: payload.patient,
+  support: payload.support,
+  apiVersion: payload.meta.apiVersion,
+});
@@ -0,0 +1,79 @@
+import { createHash } from 'crypto';
+import { Request, Response } from 'express';
+
+/**
+ * Build an entity tag from the SHA-1 of `body`.
+ */
+export const computeEtag = (body: string | Buffer, weak = false): string => {
+  const hash = createHash('sha1').update(body).digest('base64url');
+  return weak ? `W/"${hash}"` : `"${hash}"`;
+};
+
+/**
+ * If-None-Match uses the weak comparison (RFC 9110 13.1.2).
+ */
+export const etagMatches = (ifNoneMatch: string | undefined, etag: string): boolean => {
+  if (!ifNoneMatch) {
+    return false;
+  }
+  const opaque = etag.replace(/^W\//, '');
+  return ifNoneMatch
+    .split(',')
+    .map((tag) => tag.trim())
+    .some((tag) => tag === '*' || tag.replace(/^W\//, '') === opaque);
+};
+
+const sendWithEtag = (
+  req: Request,
+  res: Response,
+  body: string | Buffer,
+  type: string,
+  etag: string
+): void => {
+  res.setHeader('ETag', etag);
+  res.setHeader('Cache-Control', 'no-cache');
+  if (etagMatches(req.get('If-None-Match'), etag)) {
+    res.status(304).end();
+    return;
+  }
+  res.status(200).type(type).send(body);
+};
+
+/**
+ * Send `payload` as JSON with an ETag, or an empty 304 if the client already
+ * holds it. By default the tag is strong and covers the exact body. Pass
+ * `validator` when the body carries volatile fields (timestamps) that should
+ * not invalidate the client's copy; the tag is then weak and covers only the
+ * validator.
+ */
+export const sendJsonWithEtag = (
+  req: Request,
+  res: Response,
+  payload: unknown,
+  validator?: unknown
+): void => {
+  const body = JSON.stringify(payload);
+  const etag =
+    validator === undefined ? computeEtag(body) : computeEtag(JSON.stringify(validator), true);
+
+  sendWithEtag(req, res, body, 'application/json', etag);
+};
+
+/**
+ * Send a binary body with a strong ETag over its bytes, or an empty 304.
+ * Pass `validator` when the body is another encoding of data also served as
+ * JSON; the tag is then weak and covers only the validator, so it matches
+ * the tag of the JSON form.
+ */
+export const sendBinaryWithEtag = (
+  req: Request,
+  res: Response,
+  body: Buffer,
+  type: string,
+  validator?: unknown
+): void => {
+  const etag =
+    validator === undefined ? computeEtag(body) : computeEtag(JSON.stringify(validator), true);
+
+  sendWithEtag(req, res, body, type, etag);
+};
@@ -0,0 +1,121 @@
+/**
+ * Compact binary encoding of the hardware med lists (GET /upcoming, /taken,
+ * /missed), sent instead of { data: [...] } when the device asks for it with
+ * Accept. Decoded on the device by hardware/components/doseright_core
+ * (med_wire.c); keep the two in step.
+ *
+ * Version 1, integers little-endian:
+ *
+ *   'D' 'R' 'M' 0x01      magic and version
+ *   u16 itemCount
+ *   u8  stringCount, then per string: u8 byteLength, UTF-8 bytes
+ *   per item:
+ *     u8  flags           bit 0: doseId is a 12-byte ObjectId
+ *                         bit 1: doseId is a string table index
+ *     [12 bytes | u8]     doseId, when a flag says so
+ *     u16 minuteOfDay     scheduledTime as minutes after midnight, 0xffff if unknown
+ *     u8  medicineName    string table index
+ *     u8  dosage          string table index
+ *     u8  status          string table index
+ *     i8  slot
+ *
+ * Strings are interned in first-use order, so the first items of a list only
+ * reference the start of the table.
+ */
+export const MED_LIST_WIRE_TYPE = 'application/vnd.doseright.medlist';
+
+const WIRE_MAGIC = [0x44, 0x52, 0x4d, 0x01];
+const WIRE_MAX_ITEMS = 0xffff;
+const WIRE_MAX_STRINGS = 0xff;
+const WIRE_MAX_STRING_BYTES = 0xff;
+const WIRE_NO_MINUTE = 0xffff;
+const WIRE_FLAG_OBJECT_ID = 0x01;
+const WIRE_FLAG_STRING_ID = 0x02;
+
+export interface MedListWireItem {
+  doseId?: string;
+  medicineName: string;
+  dosage: string;
+  scheduledTime: string;
+  status: string;
+  slot?: number;
+}
+
+const minuteOfDay = (time: string): number => {
+  const match = /^(\d{1,2}):(\d{2})$/.exec(time);
+  if (!match) {
+    return WIRE_NO_MINUTE;
+  }
+  // toLocaleTimeString can render midnight as 24:xx
+  return (Number(match[1]) % 24) * 60 + Number(match[2]);
+};
+
+const clampUtf8 = (value: string): Buffer => {
+  let text = value;
+  let bytes = Buffer.from(text, 'utf8');
+  while (bytes.length > WIRE_MAX_STRING_BYTES) {
+    text = text.slice(0, -1);
+    bytes = Buffer.from(text, 'utf8');
+  }
+  return bytes;
+};
+
+/**
+ * Encode a med list, or null when it does not fit the format (more than 255
+ * distinct strings or 65535 items); the caller then sends JSON.
+ */
+export const encodeMedList = (items: MedListWireItem[]): Buffer | null => {
+  if (items.length > WIRE_MAX_ITEMS) {
+    return null;
+  }
+
+  const strings: Buffer[] = [];
+  const index = new Map<string, number>();
+  const intern = (value: unknown): number => {
+    const text = typeof value === 'string' ? value : '';
+    let i = index.get(text);
+    if (i === undefined) {
+      i = strings.length;
+      index.set(text, i);
+      strings.push(clampUtf8(text));
+    }
+    return i;
+  };
+
+  const records: Buffer[] = [];
+  for (const item of items) {
+    const doseId = typeof item.doseId === 'string' ? item.doseId : '';
+    const objectId = /^[0-9a-f]{24}$/i.test(doseId);
+    const idRef = doseId && !objectId ? intern(doseId) : 0;
+    const name = intern(item.medicineName);
+    const dosage = intern(item.dosage);
+    const status = intern(item.status);
+    if (strings.length > WIRE_MAX_STRINGS) {
+      return null;
+    }
+
+    const idBytes = objectId ? 12 : doseId ? 1 : 0;
+    const record = Buffer.alloc(1 + idBytes + 6);
+    let off = 0;
+    record[off++] = objectId ? WIRE_FLAG_OBJECT_ID : doseId ? WIRE_FLAG_STRING_ID : 0;
+    if (objectId) {
+      Buffer.from(doseId, 'hex').copy(record, off);
+    } else if (doseId) {
+      record[off] = idRef;
+    }
+    off += idBytes;
+    off = record.writeUInt16LE(minuteOfDay(item.scheduledTime ?? ''), off);
+    record[off++] = name;
+    record[off++] = dosage;
+    record[off++] = status;
+    record.writeInt8(Math.max(-128, Math.min(127, Math.trunc(item.slot ?? 0) || 0)), off);
+    records.push(record);
+  }
+
+  const header = Buffer.alloc(WIRE_MAGIC.length + 3);
+  Buffer.from(WIRE_MAGIC).copy(header);
+  header.writeUInt16LE(items.length, WIRE_MAGIC.length);
+  header[WIRE_MAGIC.length + 2] = strings.length;
+  const table = strings.flatMap((bytes) => [Buffer.from([bytes.length]), bytes]);
+  return Buffer.concat([header, ...table, ...records]);
+};
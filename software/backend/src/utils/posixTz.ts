@@ -0,0 +1,161 @@
+/**
+ * POSIX TZ strings (e.g. "EST5EDT,M3.2.0/2,M11.1.0/2") for an IANA zone,
+ * so the device can set TZ and keep local time from its own epoch clock.
+ *
+ * Node ships no tzdata rules, only Intl, so the rules are recovered from the
+ * offsets Intl reports: the year is scanned day by day, each offset change is
+ * narrowed to the minute and written as a Mm.w.d/time rule in the local time
+ * before the change. A zone with no change this year gets a fixed offset; one
+ * with an unusual year (rules changed, more than two transitions) gets the
+ * offset in force now. Results are cached per zone and year.
+ */
+const MINUTE_MS = 60 * 1000;
+const DAY_MS = 24 * 60 * MINUTE_MS;
+
+interface Transition {
+  at: number;
+  from: number;
+  to: number;
+}
+
+const formatters = new Map<string, Intl.DateTimeFormat>();
+const cache = new Map<string, string>();
+
+const partsFormatter = (timeZone: string): Intl.DateTimeFormat => {
+  let formatter = formatters.get(timeZone);
+  if (!formatter) {
+    formatter = new Intl.DateTimeFormat('en-US', {
+      timeZone,
+      hourCycle: 'h23',
+      year: 'numeric',
+      month: 'numeric',
+      day: 'numeric',
+      hour: 'numeric',
+      minute: 'numeric',
+      second: 'numeric',
+    });
+    formatters.set(timeZone, formatter);
+  }
+  return formatter;
+};
+
+/** Minutes east of UTC in `timeZone` at `ms` */
+const offsetMinutes = (timeZone: string, ms: number): number => {
+  const parts = partsFormatter(timeZone).formatToParts(new Date(ms));
+  const get = (type: Intl.DateTimeFormatPartTypes) =>
+    Number(parts.find((part) => part.type === type)?.value ?? 0);
+  const local = Date.UTC(
+    get('year'),
+    get('month') - 1,
+    get('day'),
+    get('hour'),
+    get('minute'),
+    get('second')
+  );
+  return Math.round((local - Math.floor(ms / 1000) * 1000) / MINUTE_MS);
+};
+
+const transitionsIn = (timeZone: string, year: number): Transition[] => {
+  const transitions: Transition[] = [];
+  const end = Date.UTC(year + 1, 0, 1);
+  let at = Date.UTC(year, 0, 1);
+  let offset = offsetMinutes(timeZone, at);
+  while (at < end) {
+    const next = Math.min(at + DAY_MS, end);
+    const nextOffset = offsetMinutes(timeZone, next);
+    if (nextOffset !== offset) {
+      let lo = at;
+      let hi = next;
+      while (hi - lo > MINUTE_MS) {
+        const mid = lo + Math.floor((hi - lo) / 2 / MINUTE_MS) * MINUTE_MS;
+        if (offsetMinutes(timeZone, mid) === offset) {
+          lo = mid;
+        } else {
+          hi = mid;
+        }
+      }
+      transitions.push({ at: hi, from: offset, to: nextOffset });
+      offset = nextOffset;
+    }
+    at = next;
+  }
+  return transitions;
+};
+
+const pad2 = (value: number): string => String(value).padStart(2, '0');
+
+/** POSIX offsets count hours west of UTC: +330 minutes east is "-5:30" */
+const posixOffset = (minutesEast: number): string => {
+  const west = -minutesEast;
+  const abs = Math.abs(west);
+  const minutes = abs % 60;
+  const hours = `${west < 0 ? '-' : ''}${Math.floor(abs / 60)}`;
+  return minutes ? `${hours}:${pad2(minutes)}` : hours;
+};
+
+/** Intl's abbreviation when POSIX can take it as is, else the numeric <+0530> form */
+const zoneName = (timeZone: string, ms: number, minutesEast: number): string => {
+  const name = new Intl.DateTimeFormat('en-US', { timeZone, timeZoneName: 'short' })
+    .formatToParts(new Date(ms))
+    .find((part) => part.type === 'timeZoneName')?.value;
+  if (name && /^[A-Za-z]{3,6}$/.test(name)) {
+    return name;
+  }
+  const abs = Math.abs(minutesEast);
+  const minutes = abs % 60;
+  const sign = minutesEast < 0 ? '-' : '+';
+  return `<${sign}${pad2(Math.floor(abs / 60))}${minutes ? pad2(minutes) : ''}>`;
+};
+
+/** Mm.w.d/time for a transition, in the local time in force before it */
+const posixRule = ({ at, from }: Transition): string => {
+  const local = new Date(at + from * MINUTE_MS);
+  const day = local.getUTCDate();
+  const daysInMonth = new Date(
+    Date.UTC(local.getUTCFullYear(), local.getUTCMonth() + 1, 0)
+  ).getUTCDate();
+  const week = day + 7 > daysInMonth ? 5 : Math.ceil(day / 7);
+  const minutes = local.getUTCMinutes();
+  const seconds = local.getUTCSeconds();
+  let time = String(local.getUTCHours());
+  if (minutes || seconds) {
+    time += `:${pad2(minutes)}`;
+  }
+  if (seconds) {
+    time += `:${pad2(seconds)}`;
+  }
+  return `M${local.getUTCMonth() + 1}.${week}.${local.getUTCDay()}/${time}`;
+};
+
+/**
+ * POSIX TZ string for `timeZone` (default: this process's zone, the one
+ * formatTime() uses) as of `now`.
+ */
+export const posixTimeZone = (timeZone?: string, now = new Date()): string => {
+  const zone = timeZone || Intl.DateTimeFormat().resolvedOptions().timeZone || 'UTC';
+  const year = now.getUTCFullYear();
+  const key = `${zone}:${year}`;
+  const cached = cache.get(key);
+  if (cached) {
+    return cached;
+  }
+
+  const transitions = transitionsIn(zone, year);
+  let tz: string;
+  if (transitions.length === 2) {
+    const dst = Math.max(transitions[0].to, transitions[1].to);
+    const std = Math.min(transitions[0].to, transitions[1].to);
+    const start = transitions.find((t) => t.to === dst) as Transition;
+    const end = transitions.find((t) => t.to === std) as Transition;
+    tz =
+      `${zoneName(zone, end.at, std)}${posixOffset(std)}` +
+      `${zoneName(zone, start.at, dst)}${dst - std === 60 ? '' : posixOffset(dst)}` +
+      `,${posixRule(start)},${posixRule(end)}`;
+  } else {
+    const ms = now.getTime();
+    const offset = offsetMinutes(zone, ms);
+    tz = `${zoneName(zone, ms, offset)}${posixOffset(offset)}`;
+  }
+  cache.set(key, tz);
+  return tz;
+};